@@ -163,10 +163,18 @@ SOURCE=.\ldecod\src\mbuffer.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\ldecod\src\mc_prediction.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\ldecod\src\memalloc.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\ldecod\src\metrics.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\ldecod\src\nal.c
 # End Source File
 # Begin Source File
@@ -203,6 +211,14 @@ SOURCE=.\ldecod\src\sei.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\ldecod\src\simd.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\ldecod\src\threadpool.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\ldecod\src\vlc.c
 # End Source File
 # End Group
@@ -299,10 +315,18 @@ SOURCE=.\ldecod\inc\mbuffer.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\ldecod\inc\mc_prediction.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\ldecod\inc\memalloc.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\ldecod\inc\metrics.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\ldecod\inc\nalu.h
 # End Source File
 # Begin Source File
@@ -331,6 +355,14 @@ SOURCE=.\ldecod\inc\sei.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\ldecod\inc\simd.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\ldecod\inc\threadpool.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\ldecod\inc\vlc.h
 # End Source File
 # End Group
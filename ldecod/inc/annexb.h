@@ -39,6 +39,8 @@ extern int NALUCount;
 int  GetAnnexbNALU (NALU_t *nalu);
 void OpenBitstreamFile (char *fn);
 void CloseBitstreamFile();
+long TellBitstreamFile ();
+void SeekBitstreamFile (long pos);
 void CheckZeroByteNonVCL(NALU_t *nalu, int * ret);
 void CheckZeroByteVCL(NALU_t *nalu, int * ret);
 
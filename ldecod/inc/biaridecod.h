@@ -47,6 +47,7 @@
 void arideco_start_decoding(DecodingEnvironmentPtr eep, unsigned char *code_buffer, int firstbyte, int *code_len, int slice_type);
 int  arideco_bits_read(DecodingEnvironmentPtr dep);
 void arideco_done_decoding(DecodingEnvironmentPtr dep);
+void arideco_stop_decoding(DecodingEnvironmentPtr dep);
 void biari_init_context (struct img_par *img, BiContextTypePtr ctx, const int* ini);
 void rescale_cum_freq(BiContextTypePtr bi_ct);
 unsigned int biari_decode_symbol(DecodingEnvironmentPtr dep, BiContextTypePtr bi_ct );
@@ -139,6 +139,9 @@
 
 #define MAX_REFERENCE_PICTURES 32               //!< H264 allows 32 fields
 
+#define MAX_DEBLOCK_THREADS    64               //!< Maximum number of deblocking threads
+#define MAX_SLICE_THREADS      64               //!< Maximum number of slice decoding threads
+
 #define INVALIDINDEX  (-135792468)
 
 #ifndef WIN32
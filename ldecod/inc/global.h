@@ -48,6 +48,7 @@
 #include <time.h>
 #include <sys/timeb.h>
 #include "defines.h"
+#include "threadpool.h"
 #include "parsetcommon.h"
 
 #ifdef WIN32
@@ -205,10 +206,9 @@ typedef enum {
 //! struct to characterize the state of the arithmetic coding engine
 typedef struct
 {
-  unsigned int    Dlow, Drange;
-  unsigned int    Dvalue;
-  unsigned int    Dbuffer;
-  int             Dbits_to_go;
+  unsigned int    Drange;
+  unsigned int    Dvalue;             //!< B_BITS-1 bits of the decoder followed by DbitsLeft bits read ahead
+  int             DbitsLeft;
   byte            *Dcodestrm;
   int             *Dcodestrm_len;
 } DecodingEnvironment;
@@ -475,9 +475,6 @@ typedef struct img_par
   // For MB level frame/field coding
   int MbaffFrameFlag;
 
-  // for signalling to the neighbour logic that this is a deblocker call
-  int DeblockCall;
-
   int **field_anchor;
 
   DecRefPicMarking_t *dec_ref_pic_marking_buffer;                    //!< stores the memory management control operations
@@ -536,6 +533,8 @@ typedef struct img_par
   int wp_round_chroma;
   unsigned int apply_weights;
 
+  int chroma_vector_adjustment[6][MAX_REFERENCE_PICTURES+1]; //!< chroma vector offset of listX[list][index] in the current slice
+
   int idr_flag;
   int nal_reference_idc;                       //!< nal_reference_idc from NAL unit
 
@@ -576,7 +575,7 @@ typedef struct img_par
 
 } ImageParameters;
 
-extern ImageParameters *img;
+extern THREAD_LOCAL ImageParameters *img;   //!< per thread, see exit_picture()
 extern struct snr_par  *snr;
 // signal to noice ratio parameters
 struct snr_par
@@ -590,6 +589,12 @@ struct snr_par
   float snr_ya;                                //!< Average SNR Y(dB) remaining frames
   float snr_ua;                                //!< Average SNR U(dB) remaining frames
   float snr_va;                                //!< Average SNR V(dB) remaining frames
+  float ssim_y;                                //!< current Y SSIM (Report SSIM)
+  float ssim_u;                                //!< current U SSIM
+  float ssim_v;                                //!< current V SSIM
+  float ssim_ya;                               //!< Average SSIM Y all frames
+  float ssim_ua;                               //!< Average SSIM U all frames
+  float ssim_va;                               //!< Average SSIM V all frames
 };
 
 int tot_time;
@@ -604,6 +609,14 @@ struct inp_par
   int dpb_size;                          //!< Frame buffer size
   int ref_offset;
   int poc_scale;
+  int write_flush;                        //!< fflush the output file after every picture
+  int write_thread;                       //!< write the output file on a separate thread
+  int simd_kernels;                       //!< SIMD level of the prediction kernels (0=auto)
+  int deblock_threads;                    //!< deblocking threads, 0: deblock on the decoding thread
+  int deblock_overlap;                    //!< deblock MB rows while later rows are decoded
+  int frame_pipeline;                     //!< deblock and store non-reference B frames while the next picture is decoded
+  int slice_threads;                      //!< slice decoding threads, 0: slices are decoded as they are read
+  int ssim;                               //!< report the SSIM of the decoded pictures
 
 #ifdef _LEAKYBUCKET_
   unsigned long R_decoder;                //!< Decoder Rate in HRD Model
@@ -663,9 +676,14 @@ void free_slice(struct inp_par *inp, struct img_par *img);
 int  decode_one_frame(struct img_par *img,struct inp_par *inp, struct snr_par *snr);
 void init_picture(struct img_par *img, struct inp_par *inp);
 void exit_picture();
+void finish_pending_picture();
+void free_frame_pipeline();
+void init_slice_threads(int num_threads);
+void free_slice_threads();
+void decode_pending_slices();
 
 int  read_new_slice();
-void decode_one_slice(struct img_par *img,struct inp_par *inp);
+int  decode_one_slice(struct img_par *img,struct inp_par *inp);
 
 void start_macroblock(struct img_par *img,struct inp_par *inp, int CurrentMBInScanOrder);
 int  read_one_macroblock(struct img_par *img,struct inp_par *inp);
@@ -704,6 +722,7 @@ void reset_ec_flags();
 void error(char *text, int code);
 int  is_new_picture();
 void init_old_slice();
+void exit_slice();
 
 // dynamic mem allocation
 int  init_global_buffers();
@@ -712,7 +731,7 @@ void free_global_buffers();
 void frame_postprocessing(struct img_par *img, struct inp_par *inp);
 void field_postprocessing(struct img_par *img, struct inp_par *inp);
 int  bottom_field_picture(struct img_par *img,struct inp_par *inp);
-void decode_slice(struct img_par *img,struct inp_par *inp, int current_header);
+int  decode_slice(struct img_par *img,struct inp_par *inp, int current_header);
 
 #define PAYLOAD_TYPE_IDERP 8
 int RBSPtoSODB(byte *streamBuffer, int last_byte_pos);
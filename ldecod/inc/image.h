@@ -32,10 +32,12 @@
 // this one is empty. keep it, maybe we will move some image.c function 
 // declarations here
 
-extern StorablePicture *dec_picture;
+extern THREAD_LOCAL StorablePicture *dec_picture;
 
 void find_snr(struct snr_par *snr, StorablePicture *p, FILE *p_ref);
 void get_block(int ref_frame, StorablePicture **list, int x_pos, int y_pos, struct img_par *img, int block[BLOCK_SIZE][BLOCK_SIZE]);
+void get_block_partition(int ref_frame, StorablePicture **list, int x_pos, int y_pos, int width, int height,
+                         struct img_par *img, byte *pred, int pred_stride);
 int  picture_order(struct img_par *img);
 
 #endif
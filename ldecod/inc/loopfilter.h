@@ -32,5 +32,11 @@
 #include "mbuffer.h"
 
 void DeblockPicture(struct img_par *img, StorablePicture *p) ;
+void DeblockPictureSerial(struct img_par *img, StorablePicture *p);
+
+void init_deblock       (int num_threads, int overlap);
+void free_deblock       ();
+void start_deblock      (StorablePicture *p);
+void deblock_mb_decoded (int mb_nr);
 
 #endif //_LOOPFILTER_H_
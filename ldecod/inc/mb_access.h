@@ -33,7 +33,11 @@
 #ifndef _MB_ACCESS_H_
 #define _MB_ACCESS_H_
 
-void CheckAvailabilityOfNeighbors();
+#include "threadpool.h"
+
+extern THREAD_LOCAL int DeblockCall;
+
+void CheckAvailabilityOfNeighbors(int mb_nr);
 
 void getNeighbour(int curr_mb_nr, int xN, int yN, int luma, PixelPos *pix);
 void getLuma4x4Neighbour (int curr_mb_nr, int block_x, int block_y, int rel_x, int rel_y, PixelPos *pix);
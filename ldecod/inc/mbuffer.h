@@ -36,6 +36,7 @@
 #include "global.h"
 
 #define MAX_LIST_SIZE 33
+#define PIC_POOL_SIZE 64   //!< maximum number of released pictures kept for reuse
 
 //! definition a picture (field or frame)
 typedef struct storable_picture
@@ -64,7 +65,6 @@ typedef struct storable_picture
   int         max_slice_id;
 
   int         size_x, size_y, size_x_cr, size_y_cr;
-  int         chroma_vector_adjustment;
   int         coded_frame;
   int         MbaffFrameFlag;
   unsigned    PicWidthInMbs;
@@ -73,6 +73,11 @@ typedef struct storable_picture
   byte **     imgY;          //!< Y picture component
   byte ***    imgUV;         //!< U and V picture components
 
+  byte **     imgY_pad;      //!< Y component with a border of MC_PAD_LUMA samples (reference pictures)
+  byte **     imgUV_pad[2];  //!< U and V components with a border of MC_PAD_CHROMA samples
+  int         padded;        //!< imgY_pad / imgUV_pad hold the current samples
+  int         chroma_qp_offset; //!< chroma_qp_index_offset for the deblocking filter
+
   byte *      mb_field;      //!< field macroblock indicator
 
   int  **     slice_id;      //!< reference picture   [mb_x][mb_y]
@@ -93,6 +98,7 @@ typedef struct storable_picture
   struct storable_picture *top_field;     // for mb aff, if frame for referencing the top field
   struct storable_picture *bottom_field;  // for mb aff, if frame for referencing the bottom field
   struct storable_picture *frame;         // for mb aff, if field for referencing the combined frame
+  struct storable_picture *pool_next;     // next released picture in the picture pool
 
   int         slice_type;
   int         idr_flag;
@@ -192,8 +198,10 @@ typedef struct decoded_picture_buffer
 
 
 extern DecodedPictureBuffer dpb;
-extern StorablePicture **listX[6];
-extern int listXsize[6];
+extern THREAD_LOCAL StorablePicture **listX[6];
+extern THREAD_LOCAL int listXsize[6];
+extern int pic_pool_hits;
+extern int pic_pool_misses;
 
 void             init_dpb();
 void             free_dpb();
@@ -201,6 +209,7 @@ FrameStore*      alloc_frame_store();
 void             free_frame_store(FrameStore* f);
 StorablePicture* alloc_storable_picture(PictureStructure type, int size_x, int size_y, int size_x_cr, int size_y_cr);
 void             free_storable_picture(StorablePicture* p);
+void             flush_picture_pool();
 void             store_picture_in_dpb(StorablePicture* p);
 void             flush_dpb();
 
@@ -213,6 +222,7 @@ void             reorder_ref_pic_list(StorablePicture **list, int *list_size,
                                       int *abs_diff_pic_num_minus1, int *long_term_pic_idx);
 
 void             init_mbaff_lists();
+void             set_chroma_vector_adjustment();
 void             alloc_ref_pic_list_reordering_buffer(Slice *currSlice);
 void             free_ref_pic_list_reordering_buffer(Slice *currSlice);
 
@@ -0,0 +1,43 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file mc_prediction.h
+ *
+ * \brief
+ *    Motion compensated prediction from padded reference planes
+ ************************************************************************
+ */
+#ifndef _MC_PREDICTION_H_
+#define _MC_PREDICTION_H_
+
+#include "mbuffer.h"
+
+#define MC_PAD_LUMA    32     //!< border of the padded luma planes (samples)
+#define MC_PAD_CHROMA  16     //!< border of the padded chroma planes (samples)
+
+void init_mc_kernels       (int level);
+void pad_reference_picture (StorablePicture *p);
+void free_padded_planes    (StorablePicture *p);
+
+int  mc_luma_block   (StorablePicture *ref, int x_pos, int y_pos, int width, int height, byte *pred, int pred_stride);
+int  mc_chroma_block (StorablePicture *ref, int uv, int x_pos, int y_pos, int width, int height, byte *pred, int pred_stride);
+
+#endif
@@ -33,6 +33,8 @@ void write_stored_frame(FrameStore *fs, FILE *p_out);
 void direct_output(StorablePicture *p, FILE *p_out);
 void init_out_buffer();
 void uninit_out_buffer();
+void init_out_writer(FILE *p_out);
+void uninit_out_writer();
 
 #ifdef PAIR_FIELDS_IN_OUTPUT
 void flush_pending_output(FILE *p_out);
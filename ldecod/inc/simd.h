@@ -0,0 +1,53 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file simd.h
+ *
+ * \brief
+ *    Run-time detection of the SIMD instruction sets used by the
+ *    optimized kernels
+ ************************************************************************
+ */
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+//! SIMD kernel levels, as selected by the SIMDKernels parameter
+#define SIMD_AUTO   0     //!< use the best level supported by the CPU
+#define SIMD_C      1     //!< plain C reference code
+#define SIMD_SSE2   2
+#define SIMD_SSSE3  3
+#define SIMD_AVX2   4
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define HAVE_X86_SIMD 1
+  #define SIMD_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #define HAVE_X86_SIMD 1
+  #define SIMD_TARGET(isa)
+#endif
+
+extern int simd_level;    //!< SIMD level used by the kernels
+
+int         simd_detect  ();
+void        init_simd    (int requested_level);
+const char *simd_name    (int level);
+
+#endif
@@ -0,0 +1,64 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file threadpool.h
+ *
+ * \brief
+ *    Minimal portable threading layer (POSIX threads / Win32)
+ ************************************************************************
+ */
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+//! storage class for per-thread copies of coding state
+#if defined(_MSC_VER)
+  #define THREAD_LOCAL __declspec(thread)
+#else
+  #define THREAD_LOCAL __thread
+#endif
+
+typedef struct jm_mutex       JMMutex;
+typedef struct jm_cond        JMCond;
+typedef struct jm_thread      JMThread;
+typedef struct jm_thread_pool ThreadPool;
+
+typedef void (*ThreadFunc) (void *arg);
+typedef void (*ThreadHook) (int thread_id);
+
+JMMutex    *create_mutex      ();
+void        lock_mutex        (JMMutex *mutex);
+void        unlock_mutex      (JMMutex *mutex);
+void        free_mutex        (JMMutex *mutex);
+
+JMCond     *create_cond       ();
+void        wait_cond         (JMCond *cond, JMMutex *mutex);
+void        signal_cond       (JMCond *cond);
+void        broadcast_cond    (JMCond *cond);
+void        free_cond         (JMCond *cond);
+
+JMThread   *create_thread     (ThreadFunc func, void *arg);
+void        join_thread       (JMThread *thread);
+
+ThreadPool *create_thread_pool (int num_threads, ThreadHook thread_init, ThreadHook thread_exit);
+void        run_thread_pool    (ThreadPool *pool, ThreadFunc job, void *jobs, int job_size, int num_jobs);
+void        free_thread_pool   (ThreadPool *pool);
+
+#endif
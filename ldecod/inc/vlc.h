@@ -55,6 +55,7 @@ int  GetVLCSymbol (byte buffer[],int totbitoffset,int *info, int bytecount);
 int  GetVLCSymbol_IntraMode (byte buffer[],int totbitoffset,int *info, int bytecount);
 
 int readSyntaxElement_FLC(SyntaxElement *sym, Bitstream *currStream);
+void init_vlc_tables ();
 int readSyntaxElement_NumCoeffTrailingOnes(SyntaxElement *sym,  DataPartition *dP,
                                            char *type);
 int readSyntaxElement_NumCoeffTrailingOnesChromaDC(SyntaxElement *sym,  DataPartition *dP);
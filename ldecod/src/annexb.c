@@ -38,14 +38,91 @@
 #include "memalloc.h"
 
 
+#define ANNEXB_BUFFER_SIZE  (1<<21)   //!< initial size of the byte stream buffer, doubled for larger NAL units
+
 FILE *bits = NULL;                //!< the bit stream file
-static int FindStartCode (unsigned char *Buf, int zeros_in_startcode);
+
+static byte *StreamBuf     = NULL; //!< window into the byte stream, NAL units are returned as views into it
+static int   StreamBufSize = 0;    //!< allocated size of StreamBuf
+static int   StreamPos     = 0;    //!< first byte of StreamBuf not consumed yet
+static int   StreamEnd     = 0;    //!< number of valid bytes in StreamBuf
+static long  StreamBase    = 0;    //!< file position of StreamBuf[0]
+static int   StreamEOF     = 0;    //!< StreamBuf holds the end of the file
 
 int IsFirstByteStreamNALU=1;
 int LastAccessUnitExists=0;
 int NALUCount=0;
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Discards the consumed bytes of the stream buffer and appends the
+ *    next block of the file.  If nothing was consumed and the buffer is
+ *    full (a NAL unit larger than the buffer), the buffer is doubled.
+ *
+ * \return
+ *    the number of bytes the buffer contents moved towards its start,
+ *    positions into StreamBuf held by the caller have to be corrected
+ *    by this amount
+ ************************************************************************
+ */
+static int FillStreamBuffer ()
+{
+  int shift = StreamPos;
+  int n;
+
+  if (shift > 0)
+  {
+    memmove (StreamBuf, StreamBuf + shift, StreamEnd - shift);
+    StreamEnd  -= shift;
+    StreamPos   = 0;
+    StreamBase += shift;
+  }
+  else if (StreamEnd == StreamBufSize)
+  {
+    StreamBufSize <<= 1;
+    if ((StreamBuf = (byte*) realloc (StreamBuf, StreamBufSize)) == NULL) no_mem_exit ("FillStreamBuffer: StreamBuf");
+  }
+
+  n = fread (StreamBuf + StreamEnd, 1, StreamBufSize - StreamEnd, bits);
+  if (n < StreamBufSize - StreamEnd)
+    StreamEOF = 1;
+  StreamEnd += n;
+
+  return shift;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    returns the position of the first start code prefix (0x000001)
+ *    that begins at or after pos in the stream buffer, -1 if there is
+ *    none in the valid part of the buffer.
+ *
+ * \note
+ *    The scan looks for the 0x01 byte with memchr(), which the C library
+ *    implements with wide (SIMD) compares, and only then checks the two
+ *    zero bytes in front of it.
+ ************************************************************************
+ */
+static int FindStartCode (int pos)
+{
+  byte *p   = StreamBuf + pos + 2;
+  byte *end = StreamBuf + StreamEnd;
+
+  while (p < end && (p = (byte*) memchr (p, 1, end - p)) != NULL)
+  {
+    if (p[-1] == 0 && p[-2] == 0)
+      return (int) (p - StreamBuf) - 2;
+    // *p is not zero, so the next start code cannot end before p+3
+    p += 3;
+  }
+  return -1;
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -53,6 +130,10 @@ int NALUCount=0;
  *    Annex B.  nalu->buf and nalu->len are filled.  Other field in
  *    nalu-> remain uninitialized (will be taken care of by NALUtoRBSP.
  *
+ *    nalu->buf is set to point into the byte stream buffer, no data is
+ *    copied.  It stays valid (and may be modified, e.g. by NALUtoRBSP)
+ *    until the next call of GetAnnexbNALU.
+ *
  * \return
  *     0 if there is nothing any more to read (EOF)
  *    -1 in case of any error
@@ -67,48 +148,44 @@ int NALUCount=0;
 
 int GetAnnexbNALU (NALU_t *nalu)
 {
-  int info2, info3, pos = 0;
-  int StartCodeFound, rewind;
-  char *Buf;
-  int LeadingZero8BitsCount=0, TrailingZero8Bits=0;
-    
-  if ((Buf = (char*)calloc (nalu->max_size , sizeof(char))) == NULL) no_mem_exit("GetAnnexbNALU: Buf");
-
-  while(!feof(bits) && (Buf[pos++]=fgetc(bits))==0);
-  
-  if(feof(bits))
+  int pos, start, next, end, consumed;
+  int LeadingZero8BitsCount=0;
+
+  // leading_zero_8bits and the zero bytes of the start code
+  pos = StreamPos;
+  for (;;)
   {
-    if(pos==0)
-    return 0;
-    else
-    {
-      printf( "GetAnnexbNALU can't read start code\n");
-      free(Buf);
-      return -1;
-    }
+    while (pos < StreamEnd && StreamBuf[pos] == 0)
+      pos++;
+    if (pos < StreamEnd || StreamEOF)
+      break;
+    pos -= FillStreamBuffer ();
   }
 
-  if(Buf[pos-1]!=1)
+  if (pos == StreamEnd)
   {
-    printf ("GetAnnexbNALU: no Start Code at the begin of the NALU, return -1\n");
-    free(Buf);
+    if (pos == StreamPos)
+      return 0;
+    printf( "GetAnnexbNALU can't read start code\n");
+    StreamPos = pos;
     return -1;
   }
 
-  if(pos<3)
+  if (StreamBuf[pos] != 1 || pos - StreamPos < 2)
   {
     printf ("GetAnnexbNALU: no Start Code at the begin of the NALU, return -1\n");
-    free(Buf);
+    StreamPos = pos + 1;
     return -1;
   }
-  else if(pos==3)
+
+  if (pos - StreamPos == 2)
   {
     nalu->startcodeprefix_len = 3;
     LeadingZero8BitsCount = 0;
   }
   else
   {
-    LeadingZero8BitsCount = pos-4;
+    LeadingZero8BitsCount = pos - StreamPos - 3;
     nalu->startcodeprefix_len = 4;
   }
 
@@ -118,95 +195,95 @@ int GetAnnexbNALU (NALU_t *nalu)
   if(!IsFirstByteStreamNALU && LeadingZero8BitsCount>0)
   {
     printf ("GetAnnexbNALU: The leading_zero_8bits syntax can only be present in the first byte stream NAL unit, return -1\n");
-    free(Buf);
+    StreamPos = pos + 1;
     return -1;
   }
   IsFirstByteStreamNALU=0;
 
-  StartCodeFound = 0;
-  info2 = 0;
-  info3 = 0;
-
-  while (!StartCodeFound)
+  // search the next start code, refilling the buffer as long as the NALU continues
+  start = pos = pos + 1;
+  while ((next = FindStartCode (pos)) < 0 && !StreamEOF)
   {
-    if (feof (bits))
-    {
-      //Count the trailing_zero_8bits
-      while(Buf[pos-2-TrailingZero8Bits]==0)
-        TrailingZero8Bits++;
-      nalu->len = (pos-1)-nalu->startcodeprefix_len-LeadingZero8BitsCount-TrailingZero8Bits;
-      memcpy (nalu->buf, &Buf[LeadingZero8BitsCount+nalu->startcodeprefix_len], nalu->len);     
-      nalu->forbidden_bit = (nalu->buf[0]>>7) & 1;
-      nalu->nal_reference_idc = (nalu->buf[0]>>5) & 3;
-      nalu->nal_unit_type = (nalu->buf[0]) & 0x1f;
-
-// printf ("GetAnnexbNALU, eof case: pos %d nalu->len %d, nalu->reference_idc %d, nal_unit_type %d \n", pos, nalu->len, nalu->nal_reference_idc, nalu->nal_unit_type);
+    int shift;
 
-#if TRACE
-  fprintf (p_trace, "\n\nLast NALU in File\n\n");
-  fprintf (p_trace, "Annex B NALU w/ %s startcode, len %d, forbidden_bit %d, nal_reference_idc %d, nal_unit_type %d\n\n",
-    nalu->startcodeprefix_len == 4?"long":"short", nalu->len, nalu->forbidden_bit, nalu->nal_reference_idc, nalu->nal_unit_type);
-  fflush (p_trace);
-#endif
-      free(Buf);
-      return pos-1;
-    }
-    Buf[pos++] = fgetc (bits);
-    info3 = FindStartCode(&Buf[pos-4], 3);
-    if(info3 != 1)
-      info2 = FindStartCode(&Buf[pos-3], 2);
-    StartCodeFound = (info2 == 1 || info3 == 1);
+    pos   = max (start, StreamEnd - 2);
+    shift = FillStreamBuffer ();
+    start -= shift;
+    pos   -= shift;
   }
 
-  //Count the trailing_zero_8bits
-  if(info3==1)	//if the detected start code is 00 00 01, trailing_zero_8bits is sure not to be present
+  if (next < 0)
   {
-    while(Buf[pos-5-TrailingZero8Bits]==0)
-      TrailingZero8Bits++;
+    // last NALU in the file, count the trailing_zero_8bits
+    end = next = StreamEnd;
+    while (end > start && StreamBuf[end-1] == 0)
+      end--;
+  }
+  else if (next > start && StreamBuf[next-1] == 0)
+  {
+    // the next NALU has a 4 byte start code, the zeros in front of it are trailing_zero_8bits
+    end = --next;
+    while (end > start && StreamBuf[end-1] == 0)
+      end--;
   }
-  // Here, we have found another start code (and read length of startcode bytes more than we should
-  // have.  Hence, go back in the file
-  rewind = 0;
-  if(info3 == 1)
-    rewind = -4;
-  else if (info2 == 1)
-    rewind = -3;
   else
-    printf(" Panic: Error in next start code search \n");
-
-  if (0 != fseek (bits, rewind, SEEK_CUR))
   {
-    snprintf (errortext, ET_SIZE, "GetAnnexbNALU: Cannot fseek %d in the bit stream file", rewind);
-    free(Buf);
-    error(errortext, 600);
+    // a 3 byte start code, trailing_zero_8bits are sure not to be present
+    end = next;
   }
 
-  // Here the leading zeros(if any), Start code, the complete NALU, trailing zeros(if any)
-  // and the next start code is in the Buf.
-  // The size of Buf is pos, pos+rewind are the number of bytes excluding the next
-  // start code, and (pos+rewind)-startcodeprefix_len-LeadingZero8BitsCount-TrailingZero8Bits
-  // is the size of the NALU.
-
-  nalu->len = (pos+rewind)-nalu->startcodeprefix_len-LeadingZero8BitsCount-TrailingZero8Bits;
-  memcpy (nalu->buf, &Buf[LeadingZero8BitsCount+nalu->startcodeprefix_len], nalu->len);
+  nalu->buf = StreamBuf + start;
+  nalu->len = end - start;
   nalu->forbidden_bit = (nalu->buf[0]>>7) & 1;
   nalu->nal_reference_idc = (nalu->buf[0]>>5) & 3;
   nalu->nal_unit_type = (nalu->buf[0]) & 0x1f;
 
+  consumed  = next - StreamPos;
+  StreamPos = next;
 
-//printf ("GetAnnexbNALU, regular case: pos %d nalu->len %d, nalu->reference_idc %d, nal_unit_type %d \n", pos, nalu->len, nalu->nal_reference_idc, nalu->nal_unit_type);
 #if TRACE
+  if (StreamEOF && StreamPos == StreamEnd)
+    fprintf (p_trace, "\n\nLast NALU in File\n\n");
   fprintf (p_trace, "\n\nAnnex B NALU w/ %s startcode, len %d, forbidden_bit %d, nal_reference_idc %d, nal_unit_type %d\n\n",
     nalu->startcodeprefix_len == 4?"long":"short", nalu->len, nalu->forbidden_bit, nalu->nal_reference_idc, nalu->nal_unit_type);
   fflush (p_trace);
 #endif
-  
-  free(Buf);
- 
-  return (pos+rewind);
+
+  return consumed;
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Returns the file position of the next NALU to be read
+ ************************************************************************
+ */
+long TellBitstreamFile ()
+{
+  return StreamBase + StreamPos;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Continues reading the byte stream at file position pos.  The
+ *    buffer is refilled from the file, since NALUs already handed out
+ *    may have been modified in place.
+ ************************************************************************
+ */
+void SeekBitstreamFile (long pos)
+{
+  if (0 != fseek (bits, pos, SEEK_SET))
+  {
+    snprintf (errortext, ET_SIZE, "SeekBitstreamFile: Cannot fseek to %ld in the bit stream file", pos);
+    error(errortext, 600);
+  }
+  StreamBase = pos;
+  StreamPos  = StreamEnd = 0;
+  StreamEOF  = 0;
+}
 
 
 /*!
@@ -224,6 +301,12 @@ void OpenBitstreamFile (char *fn)
     snprintf (errortext, ET_SIZE, "Cannot open Annex B ByteStream file '%s'", input->infile);
     error(errortext,500);
   }
+
+  StreamBufSize = ANNEXB_BUFFER_SIZE;
+  if ((StreamBuf = (byte*) malloc (StreamBufSize)) == NULL) no_mem_exit ("OpenBitstreamFile: StreamBuf");
+  StreamBase = 0;
+  StreamPos  = StreamEnd = 0;
+  StreamEOF  = 0;
 }
 
 
@@ -236,40 +319,11 @@ void OpenBitstreamFile (char *fn)
 void CloseBitstreamFile()
 {
   fclose (bits);
+  free (StreamBuf);
+  StreamBuf = NULL;
 }
 
 
-/*!
- ************************************************************************
- * \brief
- *    returns if new start code is found at byte aligned position buf.
- *    new-startcode is of form N 0x00 bytes, followed by a 0x01 byte.
- *
- *  \return
- *     1 if start-code is found or                      \n
- *     0, indicating that there is no start code
- *
- *  \param Buf
- *     pointer to byte-stream
- *  \param zeros_in_startcode
- *     indicates number of 0x00 bytes in start-code.
- ************************************************************************
- */
-static int FindStartCode (unsigned char *Buf, int zeros_in_startcode)
-{
-  int info;
-  int i;
-
-  info = 1;
-  for (i = 0; i < zeros_in_startcode; i++)
-    if(Buf[i] != 0)
-      info = 0;
-
-  if(Buf[i] != 1)
-    info = 0;
-  return info;
-}
-
 void CheckZeroByteNonVCL(NALU_t *nalu, int * ret)
 {
   int CheckZeroByte=0;
@@ -33,6 +33,9 @@
  */
 
 #include <stdlib.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #include "global.h"
 #include "memalloc.h"
@@ -41,8 +44,7 @@ extern int symbolCount;
 
 int binCount = 0;
 
-#define Dbuffer         (dep->Dbuffer)
-#define Dbits_to_go     (dep->Dbits_to_go)
+#define DbitsLeft       (dep->DbitsLeft)
 #define Dcodestrm       (dep->Dcodestrm)
 #define Dcodestrm_len   (dep->Dcodestrm_len)
 
@@ -144,16 +146,47 @@ const unsigned short AC_next_state_LPS_64[64] =
   37,38,38,63
 };
 
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+//! renormalization shifts of an LPS range, indexed by range>>3
+static const byte renorm_table_32[32] =
+{
+  6, 5, 4, 4, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+#endif
+
 /************************************************************************
  * M a c r o s
  ************************************************************************
  */
 
-#define get_byte(){                                         \
-                    Dbuffer = Dcodestrm[(*Dcodestrm_len)++];\
-                    Dbits_to_go = 7;                        \
+//! appends the next two bytes of the stream to the value window
+#define get_word(value){                                                                    \
+                    value = (value << 16) | (Dcodestrm[*Dcodestrm_len] << 8) | Dcodestrm[*Dcodestrm_len + 1];\
+                    *Dcodestrm_len += 2;                                                    \
+                    DbitsLeft += 16;                                                        \
                   }
 
+/*!
+ ************************************************************************
+ * \brief
+ *    number of shifts that bring the range of an LPS (2..255) back
+ *    to QUARTER or above, from the leading zeros of the range
+ ************************************************************************
+ */
+static __inline int renorm_bits(unsigned int range)
+{
+#if defined(__GNUC__)
+  return __builtin_clz(range) - 23;
+#elif defined(_MSC_VER)
+  unsigned long msb;
+  _BitScanReverse(&msb, range);
+  return 8 - (int) msb;
+#else
+  return renorm_table_32[range >> 3];
+#endif
+}
+
 
 /************************************************************************
  ************************************************************************
@@ -201,31 +234,22 @@ void arideco_delete_decoding_environment(DecodingEnvironmentPtr dep)
 /*!
  ************************************************************************
  * \brief
- *    Initializes the DecodingEnvironment for the arithmetic coder
+ *    Initializes the DecodingEnvironment for the arithmetic coder.
+ *    Dvalue holds the B_BITS-1 bits of the arithmetic decoder followed
+ *    by DbitsLeft bits read ahead, which are refilled 16 at a time.
  ************************************************************************
  */
 void arideco_start_decoding(DecodingEnvironmentPtr dep, unsigned char *cpixcode,
                             int firstbyte, int *cpixcode_len, int slice_type )
 {
- 
-  int value = 0;
-
   Dcodestrm = cpixcode;
   Dcodestrm_len = cpixcode_len;
   *Dcodestrm_len = firstbyte;
- 
-  {
-    int i;
-    Dbits_to_go = 0;
-    for (i = 0; i < B_BITS -1 ; i++) // insertion of redundant bit
-    {
-      if (--Dbits_to_go < 0)
-        get_byte();
-      value = (value<<1)  | ((Dbuffer >> Dbits_to_go) & 0x01);
-    }
-  }
+
+  dep->Dvalue = (Dcodestrm[firstbyte] << 16) | (Dcodestrm[firstbyte + 1] << 8) | Dcodestrm[firstbyte + 2];
+  *Dcodestrm_len += 3;
+  DbitsLeft = 24 - (B_BITS-1);
   dep->Drange = HALF-2;
-  dep->Dvalue = value;
 }
 
 
@@ -237,7 +261,22 @@ void arideco_start_decoding(DecodingEnvironmentPtr dep, unsigned char *cpixcode,
  */
 int arideco_bits_read(DecodingEnvironmentPtr dep)
 {
-  return 8 * ((*Dcodestrm_len)-1) + (8 - Dbits_to_go) - 16;
+  return 8 * (*Dcodestrm_len) - DbitsLeft - 16;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    gives the bytes read ahead back to the stream: *Dcodestrm_len is
+ *    set to the first byte after the bits used by the decoded symbols,
+ *    where the samples of an I_PCM macroblock start
+ ************************************************************************
+ */
+void arideco_stop_decoding(DecodingEnvironmentPtr dep)
+{
+  *Dcodestrm_len = (8 * (*Dcodestrm_len) - DbitsLeft + 7) >> 3;
+  DbitsLeft = 0;
 }
 
 
@@ -258,16 +297,20 @@ void arideco_done_decoding(DecodingEnvironmentPtr dep)
  ************************************************************************
  * \brief
  *    biari_decode_symbol():
+ *    The symbol is decoded on the top bits of the value window, the
+ *    renormalization shifts only the range and DbitsLeft.
  * \return
  *    the decoded symbol
  ************************************************************************
  */
 unsigned int biari_decode_symbol(DecodingEnvironmentPtr dep, BiContextTypePtr bi_ct )
 {
-  register unsigned int bit = bi_ct->MPS;
+  register unsigned int state = bi_ct->state;
+  register unsigned int bit   = bi_ct->MPS;
   register unsigned int value = dep->Dvalue;
   register unsigned int range = dep->Drange;
-  register unsigned int rLPS = rLPS_table_64x4[bi_ct->state][(range>>6) & 0x03];
+  register unsigned int rLPS  = rLPS_table_64x4[state][(range>>6) & 0x03];
+  int renorm;
 
 #if TRACE
 //  fprintf(p_trace, "%d  0x%04x  %d  %d\n", binCount++, dep->Drange, bi_ct->state, bi_ct->MPS );
@@ -275,29 +318,32 @@ unsigned int biari_decode_symbol(DecodingEnvironmentPtr dep, BiContextTypePtr bi
 
   range -= rLPS;
 
-  if (value < range) /* MPS */ 
-    bi_ct->state = AC_next_state_MPS_64[bi_ct->state]; // next state
+  if (value < (range << DbitsLeft)) /* MPS */ 
+  {
+    bi_ct->state = AC_next_state_MPS_64[state]; // next state
+    if (range >= QUARTER)
+    {
+      dep->Drange = range;
+      return(bit);
+    }
+    range <<= 1;
+    renorm = 1;
+  }
   else              /* LPS */
   {
-    value -= range;
-    range = rLPS;
-    bit = !bit;
-    if (!bi_ct->state)       // switch meaning of MPS if necessary  
+    value -= range << DbitsLeft;
+    renorm = renorm_bits(rLPS);
+    range  = rLPS << renorm;
+    bit ^= 0x01;
+    if (!state)       // switch meaning of MPS if necessary  
       bi_ct->MPS ^= 0x01;              
-    bi_ct->state = AC_next_state_LPS_64[bi_ct->state]; // next state 
+    bi_ct->state = AC_next_state_LPS_64[state]; // next state 
   }
-  
-  while (range < QUARTER)
-  {
-    /* Double range */
-    range <<= 1;
-    if (--Dbits_to_go < 0) 
-      get_byte();   
-    /* Shift in next bit and add to value */
-    value = (value << 1) | ((Dbuffer >> Dbits_to_go) & 0x01);
 
-  }
-  
+  DbitsLeft -= renorm;
+  if (DbitsLeft <= 0)
+    get_word(value);
+
   dep->Drange = range;
   dep->Dvalue = value;
 
@@ -316,21 +362,22 @@ unsigned int biari_decode_symbol(DecodingEnvironmentPtr dep, BiContextTypePtr bi
 unsigned int biari_decode_symbol_eq_prob(DecodingEnvironmentPtr dep)
 {
   register unsigned int bit = 0;
-  register unsigned int value  = (dep->Dvalue<<1);
+  register unsigned int value = dep->Dvalue;
+  register unsigned int range;
 
 #if TRACE
 //  fprintf(p_trace, "%d  0x%04x\n", binCount++, dep->Drange );
 #endif
 
-  if (--Dbits_to_go < 0) 
-    get_byte(); 
-  /* Shift in next bit and add to value */  
-  value |= (Dbuffer >> Dbits_to_go) &  0x01;  
-  if (value >= dep->Drange) 
+  // one more bit of the window belongs to the arithmetic decoder
+  range = dep->Drange << (--DbitsLeft);
+  if (value >= range) 
   {
     bit = 1;
-    value -= dep->Drange;
+    value -= range;
   }
+  if (DbitsLeft == 0)
+    get_word(value);
 
   dep->Dvalue = value;
 
@@ -354,21 +401,19 @@ unsigned int biari_decode_final(DecodingEnvironmentPtr dep)
 //  fprintf(p_trace, "%d  0x%04x\n", binCount++, dep->Drange );
 #endif
     
-  if (value >= range) 
+  if (value >= (range << DbitsLeft)) 
   {
     return 1;
   }
   else
   {
-    while (range < QUARTER)
+    // range-2 is at least QUARTER-2, one shift at most
+    if (range < QUARTER)
     {
-    /* Double range */
       range <<= 1;
-      if (--Dbits_to_go < 0) 
-        get_byte();   
-      /* Shift in next bit and add to value */
-      value = (value << 1) | ((Dbuffer >> Dbits_to_go) & 0x01);
-    } 
+      if (--DbitsLeft == 0)
+        get_word(value);
+    }
     dep->Dvalue = value;
     dep->Drange = range;
     return 0;
@@ -42,7 +42,7 @@
 #include "mb_access.h"
 
 int symbolCount = 0;
-int last_dquant = 0;
+THREAD_LOCAL int last_dquant = 0;
 
 
 /***********************************************************************
@@ -222,7 +222,7 @@ int check_next_mb_and_get_field_mode_CABAC( SyntaxElement *se,
   currMB->slice_nr = img->current_slice_nr;
   currMB->mb_field = img->mb_data[img->current_mb_nr-1].mb_field;
 
-  CheckAvailabilityOfNeighbors();
+  CheckAvailabilityOfNeighbors(img->current_mb_nr);
   CheckAvailabilityOfNeighborsCABAC();
     
   //create
@@ -1352,6 +1352,9 @@ int read_significance_map (Macroblock              *currMB,
   BiContextTypePtr  last_ctx  = ( fld ? img->currentSlice->tex_ctx->fld_last_contexts[type2ctx_last[type]]
                                       : img->currentSlice->tex_ctx->    last_contexts[type2ctx_last[type]] );
 
+  const int        *pos2ctx   = ( img->structure!=FRAME ? pos2ctx_map_int[type] : pos2ctx_map[type] );
+  const int        *pos2last  = pos2ctx_last[type];
+
   if (!c1isdc[type])
   {
     i0++; i1++; coeff--;
@@ -1360,33 +1363,23 @@ int read_significance_map (Macroblock              *currMB,
   for (i=i0; i<i1; i++) // if last coeff is reached, it has to be significant
   {
     //--- read significance symbol ---
-    if (img->structure!=FRAME)
-      sig = biari_decode_symbol   (dep_dp, map_ctx + pos2ctx_map_int [type][i]);
-    else
-      sig = biari_decode_symbol   (dep_dp, map_ctx + pos2ctx_map     [type][i]);
+    sig = biari_decode_symbol (dep_dp, map_ctx + pos2ctx[i]);
+    coeff[i] = sig;
     if (sig)
     {
-      coeff[i] = 1;
       coeff_ctr++;
       //--- read last coefficient symbol ---
-      if (biari_decode_symbol (dep_dp, last_ctx + pos2ctx_last[type][i]))
+      if (biari_decode_symbol (dep_dp, last_ctx + pos2last[i]))
       {
-        for (i++; i<i1+1; i++) coeff[i] = 0;
+        memset (&coeff[i+1], 0, (i1-i) * sizeof(int));
+        return coeff_ctr;
       }
     }
-    else
-    {
-      coeff[i] = 0;
-    }
   }
   //--- last coefficient must be significant if no last symbol was received ---
-  if (i<i1+1)
-  {
-    coeff[i] = 1;
-    coeff_ctr++;
-  }
+  coeff[i1] = 1;
 
-  return coeff_ctr;
+  return coeff_ctr + 1;
 }
 
 
@@ -1406,17 +1399,19 @@ void read_significant_coefficients (Macroblock              *currMB,
   int   i, ctx;
   int   c1 = 1;
   int   c2 = 0;
+  BiContextTypePtr  one_ctx   = img->currentSlice->tex_ctx->one_contexts[type2ctx_one[type]];
+  BiContextTypePtr  abs_ctx   = img->currentSlice->tex_ctx->abs_contexts[type2ctx_abs[type]];
 
   for (i=maxpos[type]-1; i>=0; i--)
   {
     if (coeff[i]!=0)
     {
       ctx = min (c1,4);
-      coeff[i] += biari_decode_symbol (dep_dp, img->currentSlice->tex_ctx->one_contexts[type2ctx_one[type]] + ctx);
+      coeff[i] += biari_decode_symbol (dep_dp, one_ctx + ctx);
       if (coeff[i]==2)
       {
         ctx = min (c2,4);
-        coeff[i] += unary_exp_golomb_level_decode (dep_dp, img->currentSlice->tex_ctx->abs_contexts[type2ctx_abs[type]]+ctx);
+        coeff[i] += unary_exp_golomb_level_decode (dep_dp, abs_ctx + ctx);
         c1=0;
         c2++;
       }
@@ -1444,9 +1439,9 @@ void readRunLevel_CABAC (SyntaxElement  *se,
                          struct img_par *img,    
                          DecodingEnvironmentPtr dep_dp)
 {
-  static int  coeff[64]; // one more for EOB
-  static int  coeff_ctr = -1;
-  static int  pos       =  0;
+  static THREAD_LOCAL int  coeff[64]; // one more for EOB
+  static THREAD_LOCAL int  coeff_ctr = -1;
+  static THREAD_LOCAL int  pos       =  0;
 
   Macroblock *currMB = &img->mb_data[img->current_mb_nr];
 
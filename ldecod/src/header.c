@@ -42,7 +42,7 @@
 
 #include "ctx_tables.h"
 
-extern StorablePicture *dec_picture;
+extern THREAD_LOCAL StorablePicture *dec_picture;
 
 #if TRACE
 #define SYMTRACESTRING(s) strncpy(sym.tracestring,s,TRACESTRING_SIZE)
@@ -50,7 +50,7 @@ extern StorablePicture *dec_picture;
 #define SYMTRACESTRING(s) // to nothing
 #endif
 
-extern int UsedBits;
+extern THREAD_LOCAL int UsedBits;
 
 static void ref_pic_list_reordering();
 static void pred_weight_table();
@@ -52,6 +52,7 @@
 #include "errorconcealment.h"
 #include "image.h"
 #include "mbuffer.h"
+#include "memalloc.h"
 #include "fmo.h"
 #include "nalu.h"
 #include "parsetcommon.h"
@@ -62,6 +63,8 @@
 #include "output.h"
 #include "biaridecod.h"
 #include "mb_access.h"
+#include "mc_prediction.h"
+#include "metrics.h"
 #include "annexb.h"
 
 #include "context_ini.h"
@@ -79,13 +82,51 @@ extern struct img_par *erc_img;
 
 //extern FILE *p_out2;
 
-extern StorablePicture **listX[6];
-extern ColocatedParams *Co_located;
+extern THREAD_LOCAL ColocatedParams *Co_located;
 
-StorablePicture *dec_picture;
+THREAD_LOCAL StorablePicture *dec_picture;
 
 OldSliceParams old_slice;
 
+/*****
+ *****  Frame pipelining: a non-reference B frame is deblocked on pipe_thread
+ *****  and stored into the DPB while the next frame is decoded
+ *****/
+static int              pipe_candidate = 0;      //!< the picture being decoded may go to the pipeline
+static StorablePicture *pipe_pic       = NULL;   //!< pending picture, deblocked on pipe_thread
+static JMThread        *pipe_thread    = NULL;
+static ImageParameters  pipe_img;               //!< img of pipe_thread, mb_data holds the macroblocks of pipe_pic
+static Macroblock      *pipe_mb_data   = NULL;
+static unsigned         pipe_mb_size   = 0;      //!< allocated size of pipe_mb_data
+static int              pipe_qp;                 //!< img->qp at the end of pipe_pic, for the picture report
+static int              pipe_time;               //!< decoding time of pipe_pic
+
+/*****
+ *****  Slice threads: the slices of a picture are queued while they are read
+ *****  and decoded on slice_pool before the picture is finished
+ *****/
+typedef struct
+{
+  ImageParameters    img;                //!< img of the slice, currentSlice points to slice
+  Slice              slice;              //!< slice header, partitions with a copy of the NAL units, CABAC contexts
+  StorablePicture  **list[6];            //!< copy of listX
+  int                list_size[6];       //!< copy of listXsize
+  int             ***wp_weight;          //!< weighted prediction tables of img
+  int             ***wp_offset;
+  int            ****wbp_weight;
+  StorablePicture   *pic;                //!< dec_picture of the slice
+  int                header;             //!< SOP or SOS
+  int                mvperMB;            //!< motion vector sum for the error concealment
+} SliceJob;
+
+static ThreadPool  *slice_pool     = NULL;
+static SliceJob   **slice_jobs     = NULL;   //!< jobs of slice_pool, allocated once and reused
+static int          slice_max_jobs = 0;      //!< allocated size of slice_jobs
+static int          slice_pending  = 0;      //!< slices of dec_picture queued in slice_jobs
+
+static void queue_slice(int current_header);
+static void end_pending_slices();
+
 void MbAffPostProc()
 {
   byte temp[16][32];
@@ -159,7 +200,12 @@ int decode_one_frame(struct img_par *img,struct inp_par *inp, struct snr_par *sn
       return EOS;
     }
 
-    decode_slice(img, inp, current_header);
+    if (slice_pool != NULL)
+      queue_slice(current_header);
+    else
+      erc_mvperMB += decode_slice(img, inp, current_header);
+    if ((current_header == SOP || current_header == SOS) && currSlice->ei_flag == 0)
+      exit_slice();
 
     img->newframe = 0;
     img->current_slice_nr++;
@@ -184,7 +230,7 @@ void find_snr(
   FILE *p_ref)            //!< open reference YUV file
 {
   int i,j;
-  int diff_y,diff_u,diff_v;
+  int64 diff_y,diff_u,diff_v;
   int uv;
   int  status;
 
@@ -218,36 +264,27 @@ void find_snr(
     }
   }
 
+  // samples behind the end of the file read as 255, like fgetc() returning EOF
   for (j=0; j < p->size_y; j++)
-    for (i=0; i < p->size_x; i++)
-      imgY_ref[j][i]=fgetc(p_ref);
+    for (i=fread(imgY_ref[j], 1, p->size_x, p_ref); i < p->size_x; i++)
+      imgY_ref[j][i]=(byte) EOF;
 
   for (uv=0; uv < 2; uv++)
     for (j=0; j < p->size_y_cr ; j++)
-      for (i=0; i < p->size_x_cr; i++)
-        imgUV_ref[uv][j][i]=fgetc(p_ref);
+      for (i=fread(imgUV_ref[uv][j], 1, p->size_x_cr, p_ref); i < p->size_x_cr; i++)
+        imgUV_ref[uv][j][i]=(byte) EOF;
 
-  img->quad[0]=0;
-  diff_y=0;
-  for (j=0; j < p->size_y; ++j)
-  {
-    for (i=0; i < p->size_x; ++i)
-    {
-      diff_y += img->quad[abs(p->imgY[j][i]-imgY_ref[j][i])];
-    }
-  }
+  diff_y = plane_sse (imgY_ref, p->imgY, p->size_x, p->size_y);
 
   // Chroma
-  diff_u=0;
-  diff_v=0;
+  diff_u = plane_sse (imgUV_ref[0], p->imgUV[0], p->size_x_cr, p->size_y_cr);
+  diff_v = plane_sse (imgUV_ref[1], p->imgUV[1], p->size_x_cr, p->size_y_cr);
 
-  for (j=0; j < p->size_y_cr; ++j)
+  if (input->ssim)
   {
-    for (i=0; i < p->size_x_cr; ++i)
-    {
-      diff_u += img->quad[abs(imgUV_ref[0][j][i]-p->imgUV[0][j][i])];
-      diff_v += img->quad[abs(imgUV_ref[1][j][i]-p->imgUV[1][j][i])];
-    }
+    snr->ssim_y = (float) plane_ssim (imgY_ref, p->imgY, p->size_x, p->size_y);
+    snr->ssim_u = (float) plane_ssim (imgUV_ref[0], p->imgUV[0], p->size_x_cr, p->size_y_cr);
+    snr->ssim_v = (float) plane_ssim (imgUV_ref[1], p->imgUV[1], p->size_x_cr, p->size_y_cr);
   }
 
 /*  if (diff_y == 0)
@@ -276,6 +313,9 @@ void find_snr(
     snr->snr_ya=snr->snr_y1=snr->snr_y;                                                        // keep luma snr for first frame
     snr->snr_ua=snr->snr_u1=snr->snr_u;                                                        // keep chroma snr for first frame
     snr->snr_va=snr->snr_v1=snr->snr_v;                                                        // keep chroma snr for first frame
+    snr->ssim_ya=snr->ssim_y;
+    snr->ssim_ua=snr->ssim_u;
+    snr->ssim_va=snr->ssim_v;
   
   }
   else
@@ -283,10 +323,31 @@ void find_snr(
     snr->snr_ya=(float)(snr->snr_ya*(img->number+Bframe_ctr)+snr->snr_y)/(img->number+Bframe_ctr+1); // average snr chroma for all frames
     snr->snr_ua=(float)(snr->snr_ua*(img->number+Bframe_ctr)+snr->snr_u)/(img->number+Bframe_ctr+1); // average snr luma for all frames
     snr->snr_va=(float)(snr->snr_va*(img->number+Bframe_ctr)+snr->snr_v)/(img->number+Bframe_ctr+1); // average snr luma for all frames
+    snr->ssim_ya=(float)(snr->ssim_ya*(img->number+Bframe_ctr)+snr->ssim_y)/(img->number+Bframe_ctr+1);
+    snr->ssim_ua=(float)(snr->ssim_ua*(img->number+Bframe_ctr)+snr->ssim_u)/(img->number+Bframe_ctr+1);
+    snr->ssim_va=(float)(snr->ssim_va*(img->number+Bframe_ctr)+snr->ssim_v)/(img->number+Bframe_ctr+1);
   } 
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Returns 1 if the sample positions of the current macroblock are
+ *    clipped to the size of the reference picture, i.e. its padded
+ *    planes give the same prediction as the clipping code
+ ************************************************************************
+ */
+static int padded_planes_usable(StorablePicture *ref, struct img_par *img)
+{
+  int size_y = dec_picture->size_y;
+
+  if (dec_picture->mb_field[img->current_mb_nr])
+    size_y /= 2;
+
+  return (ref->size_x == dec_picture->size_x && ref->size_y == size_y);
+}
+
 /*!
  ************************************************************************
  * \brief
@@ -304,8 +365,19 @@ void get_block(int ref_frame, StorablePicture **list, int x_pos, int y_pos, stru
   int pres_x;
   int pres_y; 
   int tmp_res[4][9];
+  byte pred[BLOCK_SIZE][BLOCK_SIZE];
   static const int COEF[6] = {    1, -5, 20, 20, -5, 1  };
 
+  // inside of the padded planes the sample positions need no clipping
+  if (padded_planes_usable(list[ref_frame], img) &&
+      mc_luma_block(list[ref_frame], x_pos, y_pos, BLOCK_SIZE, BLOCK_SIZE, &pred[0][0], BLOCK_SIZE))
+  {
+    for (j = 0; j < BLOCK_SIZE; j++)
+      for (i = 0; i < BLOCK_SIZE; i++)
+        block[i][j] = pred[j][i];
+    return;
+  }
+
   dx = x_pos&3;
   dy = y_pos&3;
   x_pos = (x_pos-dx)/4;
@@ -428,6 +500,38 @@ void get_block(int ref_frame, StorablePicture **list, int x_pos, int y_pos, stru
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Interpolation of 1/4 subpixel for a partition of width x height
+ *    luma samples with one motion vector (multiples of 4, up to 16x16)
+ *
+ * \param pred
+ *    prediction samples, row by row with a stride of pred_stride
+ ************************************************************************
+ */
+void get_block_partition(int ref_frame, StorablePicture **list, int x_pos, int y_pos, int width, int height,
+                         struct img_par *img, byte *pred, int pred_stride)
+{
+  int block[BLOCK_SIZE][BLOCK_SIZE];
+  int bx, by, i, j;
+
+  if (padded_planes_usable(list[ref_frame], img) &&
+      mc_luma_block(list[ref_frame], x_pos, y_pos, width, height, pred, pred_stride))
+    return;
+
+  // (partly) outside of the padded planes: 4x4 blocks with clipped positions
+  for (by = 0; by < height; by += BLOCK_SIZE)
+    for (bx = 0; bx < width; bx += BLOCK_SIZE)
+    {
+      get_block(ref_frame, list, x_pos + 4*bx, y_pos + 4*by, img, block);
+      for (j = 0; j < BLOCK_SIZE; j++)
+        for (i = 0; i < BLOCK_SIZE; i++)
+          pred[(by+j)*pred_stride + bx+i] = (byte) block[i][j];
+    }
+}
+
+
 void reorder_lists(int currSliceType, Slice * currSlice)
 {
 
@@ -521,7 +625,8 @@ void set_ref_pic_num()
  */
 int read_new_slice()
 {
-  NALU_t *nalu = AllocNALU(MAX_CODED_FRAME_SIZE);
+  // Annex B NALUs are views into the byte stream buffer, RTP packets are copied
+  NALU_t *nalu = AllocNALU(input->FileFormat == PAR_OF_ANNEXB ? 0 : MAX_CODED_FRAME_SIZE);
   int current_header;
   int ret;
   int BitsUsedByHeader;
@@ -537,7 +642,10 @@ int read_new_slice()
 
   while (1)
   {
-    ftell_position = ftell(bits);
+    if (input->FileFormat == PAR_OF_ANNEXB)
+      ftell_position = TellBitstreamFile();
+    else
+      ftell_position = ftell(bits);
 
     if (input->FileFormat == PAR_OF_ANNEXB)
       ret=GetAnnexbNALU (nalu);
@@ -559,7 +667,10 @@ int read_new_slice()
       if(expected_slice_type != NALU_TYPE_DPA)
       {
         /* oops... we found the next slice, go back! */
-        fseek(bits, ftell_position, SEEK_SET);
+        if (input->FileFormat == PAR_OF_ANNEXB)
+          SeekBitstreamFile(ftell_position);
+        else
+          fseek(bits, ftell_position, SEEK_SET);
         FreeNALU(nalu);
         return current_header;
       }
@@ -597,6 +708,7 @@ int read_new_slice()
         UseParameterSet (currSlice->pic_parameter_set_id);
         BitsUsedByHeader+= RestOfSliceHeader ();
 
+        end_pending_slices();
         FmoInit (active_pps, active_sps);
 
         if(is_new_picture())
@@ -617,6 +729,7 @@ int read_new_slice()
         {
           init_mbaff_lists();
         }
+        set_chroma_vector_adjustment();
 
 /*        if (img->frame_num==1) // write a reference list
         {
@@ -669,7 +782,10 @@ int read_new_slice()
         if(expected_slice_type != NALU_TYPE_DPA)
         {
           /* oops... we found the next slice, go back! */
-          fseek(bits, ftell_position, SEEK_SET);
+          if (input->FileFormat == PAR_OF_ANNEXB)
+            SeekBitstreamFile(ftell_position);
+          else
+            fseek(bits, ftell_position, SEEK_SET);
           FreeNALU(nalu);
           return current_header;
         }
@@ -690,6 +806,7 @@ int read_new_slice()
         UseParameterSet (currSlice->pic_parameter_set_id);
         BitsUsedByHeader    += RestOfSliceHeader ();
         
+        end_pending_slices();
         FmoInit (active_pps, active_sps);
 
         if(is_new_picture())
@@ -709,6 +826,7 @@ int read_new_slice()
         {
           init_mbaff_lists();
         }
+        set_chroma_vector_adjustment();
 
         // From here on, active_sps, active_pps and the slice header are valid
         if (img->MbaffFrameFlag)
@@ -848,6 +966,9 @@ void init_picture(struct img_par *img, struct inp_par *inp)
     // this may only happen on slice loss
     exit_picture();
   }
+  // the field counting in img->number must not see a pending picture
+  if (img->structure != FRAME)
+    finish_pending_picture();
 
   if (img->frame_num != img->pre_frame_num && img->frame_num != (img->pre_frame_num + 1) % img->MaxFrameNum) 
   {
@@ -970,6 +1091,128 @@ void init_picture(struct img_par *img, struct inp_par *inp)
     dec_picture->frame_cropping_rect_bottom_offset = active_sps->frame_cropping_rect_bottom_offset;
   }
 
+  pipe_candidate = inp->frame_pipeline && !dec_picture->used_for_reference && img->structure==FRAME &&
+                   !img->MbaffFrameFlag && img->type==B_SLICE;
+  // the pipeline thread deblocks a whole picture, the rows are not released while decoding;
+  // neither are they when the slice threads decode the macroblocks out of order
+  if (!pipe_candidate && slice_pool == NULL)
+    start_deblock(dec_picture);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    prints the statistics line of a decoded frame or field pair
+ ************************************************************************
+ */
+static void report_picture(int slice_type, int frame_poc, int refpic, int qp, int tmp_time)
+{
+  if(slice_type == I_SLICE) // I picture
+    fprintf(stdout,"%3d(I)  %3d %5d %7.4f %7.4f %7.4f %5d\n",
+    frame_no, frame_poc, qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
+  else if(slice_type == P_SLICE) // P pictures
+    fprintf(stdout,"%3d(P)  %3d %5d %7.4f %7.4f %7.4f %5d\n",
+    frame_no, frame_poc, qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
+  else if(slice_type == SP_SLICE) // SP pictures
+    fprintf(stdout,"%3d(SP) %3d %5d %7.4f %7.4f %7.4f %5d\n",
+    frame_no, frame_poc, qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
+  else if (slice_type == SI_SLICE)
+    fprintf(stdout,"%3d(SI) %3d %5d %7.4f %7.4f %7.4f %5d\n",
+    frame_no, frame_poc, qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
+  else if(refpic) // stored B pictures
+    fprintf(stdout,"%3d(BS) %3d %5d %7.4f %7.4f %7.4f %5d\n",
+    frame_no, frame_poc, qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
+  else // B pictures
+    fprintf(stdout,"%3d(B)  %3d %5d %7.4f %7.4f %7.4f %5d\n",
+    frame_no, frame_poc, qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
+
+  fflush(stdout);
+
+  if(slice_type == I_SLICE || slice_type == SI_SLICE || slice_type == P_SLICE || refpic)   // I or P pictures
+    img->number++;
+  else
+    Bframe_ctr++;    // B pictures
+
+  g_nFrame++;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    deblocks the pending picture (pipe_thread)
+ ************************************************************************
+ */
+static void deblock_pending_picture(void *arg)
+{
+  img         = &pipe_img;
+  dec_picture = pipe_pic;
+  DeblockPictureSerial (img, pipe_pic);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    starts deblocking dec_picture on pipe_thread. The macroblocks are
+ *    copied, so the next picture is decoded from the same img->mb_data
+ *    as without the pipeline.
+ ************************************************************************
+ */
+static void start_pending_picture()
+{
+  if (pipe_mb_size < dec_picture->PicSizeInMbs)
+  {
+    free (pipe_mb_data);
+    if ((pipe_mb_data = (Macroblock *) malloc (dec_picture->PicSizeInMbs * sizeof(Macroblock))) == NULL)
+      no_mem_exit ("start_pending_picture: pipe_mb_data");
+    pipe_mb_size = dec_picture->PicSizeInMbs;
+  }
+  memcpy (pipe_mb_data, img->mb_data, dec_picture->PicSizeInMbs * sizeof(Macroblock));
+
+  pipe_img         = *img;
+  pipe_img.mb_data = pipe_mb_data;
+  pipe_pic         = dec_picture;
+  pipe_pic->chroma_qp_offset = active_pps->chroma_qp_index_offset;
+
+  pipe_thread = create_thread (deblock_pending_picture, NULL);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    waits for the deblocking of the pending picture and stores it into
+ *    the DPB. Has to be called before anything else is stored, output or
+ *    flushed.
+ ************************************************************************
+ */
+void finish_pending_picture()
+{
+  StorablePicture *p = pipe_pic;
+  int frame_poc;
+
+  if (p == NULL)
+    return;
+
+  join_thread (pipe_thread);
+  pipe_thread = NULL;
+  pipe_pic    = NULL;
+
+  frame_poc = p->frame_poc;
+  store_picture_in_dpb (p);
+  report_picture (B_SLICE, frame_poc, 0, pipe_qp, pipe_time);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    frees the buffers of the frame pipeline
+ ************************************************************************
+ */
+void free_frame_pipeline()
+{
+  finish_pending_picture();
+  free (pipe_mb_data);
+  pipe_mb_data = NULL;
+  pipe_mb_size = 0;
 }
 
 /*!
@@ -986,6 +1229,7 @@ void exit_picture()
   frame recfr;
   unsigned int i;
   int structure, frame_poc, slice_type, refpic;
+  int pipelined;
 
   int tmp_time;                   // time used by decoding the last frame
 
@@ -995,11 +1239,26 @@ void exit_picture()
     return;
   }
 
-  //deblocking for frame or field
-  DeblockPicture( img, dec_picture );
+  decode_pending_slices();
+
+  // lost macroblocks are concealed after deblocking, such pictures are finished here
+  pipelined = pipe_candidate && dec_picture->slice_type == B_SLICE;
+  for (i=0; pipelined && i<dec_picture->PicSizeInMbs; i++)
+    pipelined = !img->mb_data[i].ei_flag;
+
+  if (pipelined)
+  {
+    // the previous picture is stored first and frees the pipeline
+    finish_pending_picture();
+  }
+  else
+  {
+    //deblocking for frame or field
+    DeblockPicture( img, dec_picture );
 
-  if (dec_picture->MbaffFrameFlag)
-    MbAffPostProc();
+    if (dec_picture->MbaffFrameFlag)
+      MbAffPostProc();
+  }
 
   recfr.yptr = &dec_picture->imgY[0][0];
   recfr.uptr = &dec_picture->imgUV[0][0][0];
@@ -1058,7 +1317,15 @@ void exit_picture()
   frame_poc  = dec_picture->frame_poc;
   refpic     = dec_picture->used_for_reference;
 
-  store_picture_in_dpb(dec_picture);
+  if (pipelined)
+  {
+    // what store_picture_in_dpb() sets for the POC decoding of the next picture
+    img->last_has_mmco_5 = 0;
+    img->last_pic_bottom_field = 0;
+    start_pending_picture();
+  }
+  else
+    store_picture_in_dpb(dec_picture);
   dec_picture=NULL;
 
   if (img->last_has_mmco_5)
@@ -1079,34 +1346,15 @@ void exit_picture()
 
     tmp_time=(img->ltime_end*1000+img->tstruct_end.millitm) - (img->ltime_start*1000+img->tstruct_start.millitm);
     tot_time=tot_time + tmp_time;
-    
-    if(slice_type == I_SLICE) // I picture
-      fprintf(stdout,"%3d(I)  %3d %5d %7.4f %7.4f %7.4f %5d\n",
-      frame_no, frame_poc, img->qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
-    else if(slice_type == P_SLICE) // P pictures
-      fprintf(stdout,"%3d(P)  %3d %5d %7.4f %7.4f %7.4f %5d\n",
-      frame_no, frame_poc, img->qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
-    else if(slice_type == SP_SLICE) // SP pictures
-      fprintf(stdout,"%3d(SP) %3d %5d %7.4f %7.4f %7.4f %5d\n",
-      frame_no, frame_poc, img->qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
-    else if (slice_type == SI_SLICE)
-      fprintf(stdout,"%3d(SI) %3d %5d %7.4f %7.4f %7.4f %5d\n",
-      frame_no, frame_poc, img->qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
-    else if(refpic) // stored B pictures
-      fprintf(stdout,"%3d(BS) %3d %5d %7.4f %7.4f %7.4f %5d\n",
-      frame_no, frame_poc, img->qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
-    else // B pictures
-      fprintf(stdout,"%3d(B)  %3d %5d %7.4f %7.4f %7.4f %5d\n",
-      frame_no, frame_poc, img->qp,snr->snr_y,snr->snr_u,snr->snr_v,tmp_time);
-    
-    fflush(stdout);
-    
-    if(slice_type == I_SLICE || slice_type == SI_SLICE || slice_type == P_SLICE || refpic)   // I or P pictures
-      img->number++;
+
+    if (pipelined)
+    {
+      // reported when the picture is stored
+      pipe_qp   = img->qp;
+      pipe_time = tmp_time;
+    }
     else
-      Bframe_ctr++;    // B pictures
- 
-    g_nFrame++;
+      report_picture(slice_type, frame_poc, refpic, img->qp, tmp_time);
   }
 
   img->current_mb_nr = -4712;   // impossible value for debugging, StW
@@ -1119,13 +1367,17 @@ void exit_picture()
  * \brief
  *    write the encoding mode and motion vectors of current 
  *    MB to the buffer of the error concealment module.
+ *
+ * \return
+ *    sum of the absolute motion vector components written, for erc_mvperMB
  ************************************************************************
  */
 
-void ercWriteMBMODEandMV(struct img_par *img,struct inp_par *inp)
+int ercWriteMBMODEandMV(struct img_par *img,struct inp_par *inp)
 {
   extern objectBuffer_t *erc_object_list;
   int i, ii, jj, currMBNum = img->current_mb_nr;
+  int mvperMB = 0;
   int mbx = xPosMB(currMBNum,dec_picture->size_x), mby = yPosMB(currMBNum,dec_picture->size_x);
   objectBuffer_t *currRegion, *pRegion;
   Macroblock *currMB = &img->mb_data[currMBNum];
@@ -1164,7 +1416,7 @@ void ercWriteMBMODEandMV(struct img_par *img,struct inp_par *inp)
 //          pRegion->mv[0]  = dec_picture->mv[LIST_0][4*mbx+(i%2)*2+BLOCK_SIZE][4*mby+(i/2)*2][0];
 //          pRegion->mv[1]  = dec_picture->mv[LIST_0][4*mbx+(i%2)*2+BLOCK_SIZE][4*mby+(i/2)*2][1];
         }
-        erc_mvperMB      += mabs(pRegion->mv[0]) + mabs(pRegion->mv[1]);
+        mvperMB          += mabs(pRegion->mv[0]) + mabs(pRegion->mv[1]);
         pRegion->mv[2]    = dec_picture->ref_idx[LIST_0][ii][jj];
       }
     }
@@ -1192,7 +1444,7 @@ void ercWriteMBMODEandMV(struct img_par *img,struct inp_par *inp)
         mv                = dec_picture->mv[idx];
         pRegion->mv[0]    = (mv[ii][jj][0] + mv[ii+1][jj][0] + mv[ii][jj+1][0] + mv[ii+1][jj+1][0] + 2)/4;
         pRegion->mv[1]    = (mv[ii][jj][1] + mv[ii+1][jj][1] + mv[ii][jj+1][1] + mv[ii+1][jj+1][1] + 2)/4;
-        erc_mvperMB      += mabs(pRegion->mv[0]) + mabs(pRegion->mv[1]);
+        mvperMB          += mabs(pRegion->mv[0]) + mabs(pRegion->mv[1]);
 
         pRegion->mv[2]  = (dec_picture->ref_idx[idx][ii][jj]);
 /*        
@@ -1210,6 +1462,7 @@ void ercWriteMBMODEandMV(struct img_par *img,struct inp_par *inp)
       }
     }
   }
+  return mvperMB;
 }
 
 /*!
@@ -1331,13 +1584,17 @@ int is_new_picture()
  ************************************************************************
  * \brief
  *    decodes one slice
+ *
+ * \return
+ *    motion vector sum of the slice for erc_mvperMB
  ************************************************************************
  */
-void decode_one_slice(struct img_par *img,struct inp_par *inp)
+int decode_one_slice(struct img_par *img,struct inp_par *inp)
 {
 
   Boolean end_of_slice = FALSE;
   int read_flag;
+  int mvperMB = 0;
   img->cod_counter=-1;
 
   set_ref_pic_num();
@@ -1366,20 +1623,32 @@ void decode_one_slice(struct img_par *img,struct inp_par *inp)
       img->num_ref_idx_l1_active >>= 1;
     }
 
-    ercWriteMBMODEandMV(img,inp);
+    mvperMB += ercWriteMBMODEandMV(img,inp);
+    deblock_mb_decoded(img->current_mb_nr);
 
     end_of_slice=exit_macroblock(img,inp,(!img->MbaffFrameFlag||img->current_mb_nr%2));
   }
 
-  exit_slice();
   //reset_ec_flags();
 
+  return mvperMB;
 }
 
 
-void decode_slice(struct img_par *img,struct inp_par *inp, int current_header)
+/*!
+ ************************************************************************
+ * \brief
+ *    decodes the slice read by read_new_slice(), exit_slice() is left
+ *    to the caller
+ *
+ * \return
+ *    motion vector sum of the slice for erc_mvperMB
+ ************************************************************************
+ */
+int decode_slice(struct img_par *img,struct inp_par *inp, int current_header)
 {
   Slice *currSlice = img->currentSlice;
+  int mvperMB = 0;
 
   if (active_pps->entropy_coding_mode_flag)
   {
@@ -1395,12 +1664,255 @@ void decode_slice(struct img_par *img,struct inp_par *inp, int current_header)
 
   // decode main slice information
   if ((current_header == SOP || current_header == SOS) && currSlice->ei_flag == 0)
-    decode_one_slice(img,inp);
+    mvperMB = decode_one_slice(img,inp);
     
   // setMB-Nr in case this slice was lost
 //  if(currSlice->ei_flag)  
 //    img->current_mb_nr = currSlice->last_mb_nr + 1;
 
+  return mvperMB;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    frees the co-located buffer of a slice thread, allocated by
+ *    decode_slice_job()
+ ************************************************************************
+ */
+static void free_slice_thread(int thread_id)
+{
+  free_collocated(Co_located);
+  Co_located = NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    starts num_threads slice decoding threads, none for 0
+ ************************************************************************
+ */
+void init_slice_threads(int num_threads)
+{
+  if (num_threads < 1 || slice_pool != NULL)
+    return;
+
+  slice_pool = create_thread_pool(num_threads, NULL, free_slice_thread);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    stops the slice decoding threads and frees the slice jobs
+ ************************************************************************
+ */
+void free_slice_threads()
+{
+  SliceJob *job;
+  int i, j;
+
+  if (slice_pool == NULL)
+    return;
+
+  free_thread_pool(slice_pool);
+  slice_pool = NULL;
+
+  for (i=0; i<slice_max_jobs; i++)
+  {
+    job = slice_jobs[i];
+    FreePartition(job->slice.partArr, 3);
+    delete_contexts_MotionInfo(job->slice.mot_ctx);
+    delete_contexts_TextureInfo(job->slice.tex_ctx);
+    for (j=0; j<6; j++)
+      free(job->list[j]);
+    free_mem3Dint(job->wp_weight, 2);
+    free_mem3Dint(job->wp_offset, 6);
+    free_mem4Dint(job->wbp_weight, 6, MAX_REFERENCE_PICTURES);
+    free(job);
+  }
+  free(slice_jobs);
+  slice_jobs = NULL;
+  slice_max_jobs = slice_pending = 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    allocates a slice job with the buffers of malloc_slice() and
+ *    init_global_buffers() that differ between the slices of a picture
+ ************************************************************************
+ */
+static SliceJob *alloc_slice_job()
+{
+  SliceJob *job;
+  int i;
+
+  if ((job = (SliceJob *) calloc(1, sizeof(SliceJob))) == NULL)
+    no_mem_exit("alloc_slice_job: job");
+
+  job->slice.partArr = AllocPartition(3);
+  job->slice.mot_ctx = create_contexts_MotionInfo();
+  job->slice.tex_ctx = create_contexts_TextureInfo();
+  for (i=0; i<6; i++)
+  {
+    if ((job->list[i] = (StorablePicture **) calloc(MAX_LIST_SIZE, sizeof(StorablePicture *))) == NULL)
+      no_mem_exit("alloc_slice_job: job->list");
+  }
+  get_mem3Dint(&job->wp_weight, 2, MAX_REFERENCE_PICTURES, 3);
+  get_mem3Dint(&job->wp_offset, 6, MAX_REFERENCE_PICTURES, 3);
+  get_mem4Dint(&job->wbp_weight, 6, MAX_REFERENCE_PICTURES, MAX_REFERENCE_PICTURES, 3);
+
+  return job;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    queues the slice just read by read_new_slice() for
+ *    decode_pending_slices(). The next slice header overwrites img, the
+ *    slice and the reference lists, so the job gets copies of them and
+ *    of the NAL units of the slice.
+ ************************************************************************
+ */
+static void queue_slice(int current_header)
+{
+  Slice *currSlice = img->currentSlice;
+  DataPartition *partArr;
+  MotionInfoContexts *mot_ctx;
+  TextureInfoContexts *tex_ctx;
+  Bitstream *src, *dst;
+  byte *buf;
+  SliceJob *job;
+  int i;
+
+  if (slice_pending == slice_max_jobs)
+  {
+    if ((slice_jobs = (SliceJob **) realloc(slice_jobs, (slice_max_jobs+1) * sizeof(SliceJob *))) == NULL)
+      no_mem_exit("queue_slice: slice_jobs");
+    slice_jobs[slice_max_jobs++] = alloc_slice_job();
+  }
+  job = slice_jobs[slice_pending++];
+
+  partArr = job->slice.partArr;
+  mot_ctx = job->slice.mot_ctx;
+  tex_ctx = job->slice.tex_ctx;
+  job->slice         = *currSlice;
+  job->slice.partArr = partArr;
+  job->slice.mot_ctx = mot_ctx;
+  job->slice.tex_ctx = tex_ctx;
+
+  for (i=0; i<currSlice->max_part_nr; i++)
+  {
+    src  = currSlice->partArr[i].bitstream;
+    dst  = partArr[i].bitstream;
+    buf  = dst->streamBuffer;
+    *dst = *src;
+    dst->streamBuffer = buf;
+    memcpy(buf, src->streamBuffer, src->bitstream_length);
+
+    // the arithmetic decoder was started on the stream of currSlice
+    partArr[i].de_cabac               = currSlice->partArr[i].de_cabac;
+    partArr[i].de_cabac.Dcodestrm     = buf;
+    partArr[i].de_cabac.Dcodestrm_len = &dst->read_len;
+    partArr[i].readSyntaxElement      = currSlice->partArr[i].readSyntaxElement;
+  }
+
+  job->img              = *img;
+  job->img.currentSlice = &job->slice;
+  job->img.num_dec_mb   = 0;
+  job->img.wp_weight    = job->wp_weight;
+  job->img.wp_offset    = job->wp_offset;
+  job->img.wbp_weight   = job->wbp_weight;
+  memcpy(&job->wp_weight[0][0][0], &img->wp_weight[0][0][0], 2 * MAX_REFERENCE_PICTURES * 3 * sizeof(int));
+  memcpy(&job->wp_offset[0][0][0], &img->wp_offset[0][0][0], 6 * MAX_REFERENCE_PICTURES * 3 * sizeof(int));
+
+  for (i=0; i<6; i++)
+  {
+    memcpy(job->list[i], listX[i], MAX_LIST_SIZE * sizeof(StorablePicture *));
+    job->list_size[i] = listXsize[i];
+  }
+  job->pic    = dec_picture;
+  job->header = current_header;
+
+  // start_macroblock() on the slice threads only reads it then
+  if (img->current_slice_nr > dec_picture->max_slice_id)
+    dec_picture->max_slice_id = img->current_slice_nr;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    decodes a queued slice (slice thread)
+ ************************************************************************
+ */
+static void decode_slice_job(void *arg)
+{
+  SliceJob *job = *(SliceJob **) arg;
+  int i;
+
+  img         = &job->img;
+  dec_picture = job->pic;
+  for (i=0; i<6; i++)
+  {
+    listX[i]     = job->list[i];
+    listXsize[i] = job->list_size[i];
+  }
+
+  // decode_one_macroblock() reads it for all slice types
+  if (Co_located == NULL || Co_located->size_x != img->width || Co_located->size_y != img->height ||
+      Co_located->mb_adaptive_frame_field_flag != active_sps->mb_adaptive_frame_field_flag)
+  {
+    free_collocated(Co_located);
+    Co_located = alloc_colocated(img->width, img->height, active_sps->mb_adaptive_frame_field_flag);
+  }
+
+  job->mvperMB = decode_slice(img, input, job->header);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    decodes the queued slices of dec_picture on the slice threads and
+ *    leaves img as if they had been decoded in order. Called before the
+ *    picture is finished.
+ ************************************************************************
+ */
+void decode_pending_slices()
+{
+  int i;
+
+  if (slice_pending == 0)
+    return;
+
+  run_thread_pool(slice_pool, decode_slice_job, slice_jobs, sizeof(SliceJob *), slice_pending);
+
+  for (i=0; i<slice_pending; i++)
+  {
+    erc_mvperMB     += slice_jobs[i]->mvperMB;
+    img->num_dec_mb += slice_jobs[i]->img.num_dec_mb;
+  }
+  img->qp = slice_jobs[slice_pending-1]->img.qp;
+  slice_pending = 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    decodes the pending slices when the slice header just read starts
+ *    a new picture, before FmoInit() replaces the slice group map they
+ *    use. img keeps the QP of the new slice.
+ ************************************************************************
+ */
+static void end_pending_slices()
+{
+  int qp = img->qp;
+
+  if (slice_pending > 0 && is_new_picture())
+  {
+    decode_pending_slices();
+    img->qp = qp;
+  }
 }
 
 
@@ -76,6 +76,11 @@
 #include "annexb.h"
 #include "output.h"
 #include "cabac.h"
+#include "vlc.h"
+#include "simd.h"
+#include "mc_prediction.h"
+#include "metrics.h"
+#include "loopfilter.h"
 
 #include "erc_api.h"
 
@@ -88,7 +93,7 @@
 
 extern objectBuffer_t *erc_object_list;
 extern ercVariables_t *erc_errorVar;
-extern ColocatedParams *Co_located;
+extern THREAD_LOCAL ColocatedParams *Co_located;
 
 // I have started to move the inp and img structures into global variables.
 // They are declared in the following lines.  Since inp is defined in conio.h
@@ -98,11 +103,11 @@ extern ColocatedParams *Co_located;
 // the local override through the formal parameter mechanism
 
 extern FILE* bits;
-extern StorablePicture* dec_picture;
+extern THREAD_LOCAL StorablePicture* dec_picture;
 
 struct inp_par    *input;       //!< input parameters from input configuration file
 struct snr_par    *snr;         //!< statistics
-struct img_par    *img;         //!< image parameters
+THREAD_LOCAL struct img_par *img;  //!< image parameters
 
 int global_init_done = 0;
 
@@ -146,6 +151,7 @@ int main(int argc, char **argv)
   malloc_slice(input,img);
 
   init(img);
+  init_vlc_tables();
 
   dec_picture = NULL;
 
@@ -154,6 +160,9 @@ int main(int argc, char **argv)
 
 //  init_dpb(input);
   init_out_buffer();
+  init_out_writer(p_out);
+  init_deblock(input->deblock_threads, input->deblock_overlap);
+  init_slice_threads(input->slice_threads);
 
   img->idr_psnr_number=input->ref_offset;
   img->psnr_number=0;
@@ -169,8 +178,11 @@ int main(int argc, char **argv)
   tot_time = 0;
   while (decode_one_frame(img, input, snr) != EOS)
     ;
+  free_frame_pipeline();
 
   report(input, img, snr);
+  free_deblock();
+  free_slice_threads();
   free_slice(input,img);
   FmoFinit();
   free_global_buffers();
@@ -183,6 +195,7 @@ int main(int argc, char **argv)
 
   CloseBitstreamFile();
 
+  uninit_out_writer();
   fclose(p_out);
 //  fclose(p_out2);
   if (p_ref)
@@ -195,6 +208,7 @@ int main(int argc, char **argv)
 
   free_dpb();
   uninit_out_buffer();
+  flush_picture_pool();
 
   free_collocated(Co_located);
   free (input);
@@ -226,6 +240,25 @@ void init(struct img_par *img)  //!< image parameters
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads an optional integer line of the configuration file.  The
+ *    value is left unchanged if the file ends before the line.
+ *
+ * \return
+ *    1 if the parameter was read
+ ************************************************************************
+ */
+static int read_optional_param(FILE *fd, int *value)
+{
+  if (fscanf(fd,"%d,",value) != 1)
+    return 0;
+  fscanf(fd,"%*[^\n]");
+  return 1;
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -243,6 +276,7 @@ void init_conf(struct inp_par *inp,
 {
   FILE *fd;
   int NAL_mode;
+  int i;
 
   // read the decoder configuration file
   if((fd=fopen(config_filename,"r")) == NULL)
@@ -308,10 +342,83 @@ void init_conf(struct inp_par *inp,
   fscanf(fd, "%*[^\n]"); 
   fscanf(fd,"%s",inp->LeakyBucketParamFile);    // file where Leaky Bucket params (computed by encoder) are stored
   fscanf(fd,"%*[^\n]");
+#else
+  for (i=0; i<4; i++)                          // the leaky bucket lines are in the file nevertheless
+  {
+    fscanf(fd,"%*s");
+    fscanf(fd,"%*[^\n]");
+  }
 #endif
 
+  // optional parameters, older configuration files end before them
+  inp->write_flush = 1;
+  read_optional_param(fd, &inp->write_flush);  // fflush the output after each picture
+  inp->write_thread = 0;
+  read_optional_param(fd, &inp->write_thread); // asynchronous output writer thread
+  inp->simd_kernels = SIMD_AUTO;
+  read_optional_param(fd, &inp->simd_kernels); // SIMD level of the prediction kernels
+  inp->deblock_threads = 0;
+  read_optional_param(fd, &inp->deblock_threads); // deblocking threads
+  inp->deblock_overlap = 0;
+  read_optional_param(fd, &inp->deblock_overlap); // deblocking overlaps decoding
+  inp->frame_pipeline = 0;
+  read_optional_param(fd, &inp->frame_pipeline);  // non-reference B frames overlap the next picture
+  inp->slice_threads = 0;
+  read_optional_param(fd, &inp->slice_threads);   // slices of a picture are decoded in parallel
+  inp->ssim = 0;
+  read_optional_param(fd, &inp->ssim);            // SSIM of the decoded pictures
+
+  if (inp->write_flush < 0 || inp->write_flush > 1)
+  {
+    snprintf(errortext, ET_SIZE, "Output flush is %d. It has to be 0 or 1",inp->write_flush);
+    error(errortext,1);
+  }
+  if (inp->write_thread < 0 || inp->write_thread > 1)
+  {
+    snprintf(errortext, ET_SIZE, "Output writer thread is %d. It has to be 0 or 1",inp->write_thread);
+    error(errortext,1);
+  }
+  if (inp->simd_kernels < SIMD_AUTO || inp->simd_kernels > SIMD_AVX2)
+  {
+    snprintf(errortext, ET_SIZE, "SIMD kernels is %d. It has to be in the range 0..4",inp->simd_kernels);
+    error(errortext,1);
+  }
+  if (inp->deblock_threads < 0 || inp->deblock_threads > MAX_DEBLOCK_THREADS)
+  {
+    snprintf(errortext, ET_SIZE, "Deblocking threads is %d. It has to be in the range 0..%d",inp->deblock_threads, MAX_DEBLOCK_THREADS);
+    error(errortext,1);
+  }
+  if (inp->deblock_overlap < 0 || inp->deblock_overlap > 1)
+  {
+    snprintf(errortext, ET_SIZE, "Deblocking overlap is %d. It has to be 0 or 1",inp->deblock_overlap);
+    error(errortext,1);
+  }
+  if (inp->deblock_overlap && inp->deblock_threads == 0)
+  {
+    snprintf(errortext, ET_SIZE, "Deblocking overlap requires at least one deblocking thread");
+    error(errortext,1);
+  }
+  if (inp->frame_pipeline < 0 || inp->frame_pipeline > 1)
+  {
+    snprintf(errortext, ET_SIZE, "Frame pipelining is %d. It has to be 0 or 1",inp->frame_pipeline);
+    error(errortext,1);
+  }
+  if (inp->ssim < 0 || inp->ssim > 1)
+  {
+    snprintf(errortext, ET_SIZE, "Report SSIM is %d. It has to be 0 or 1",inp->ssim);
+    error(errortext,1);
+  }
+  if (inp->slice_threads < 0 || inp->slice_threads > MAX_SLICE_THREADS)
+  {
+    snprintf(errortext, ET_SIZE, "Slice decoding threads is %d. It has to be in the range 0..%d",inp->slice_threads, MAX_SLICE_THREADS);
+    error(errortext,1);
+  }
+
   fclose (fd);
 
+  init_mc_kernels (inp->simd_kernels);
+  init_metrics ();
+
 
 #if TRACE
   if ((p_trace=fopen(TRACEFILE,"w"))==0)             // append new statistic at the end
@@ -339,6 +446,7 @@ void init_conf(struct inp_par *inp,
   fprintf(stdout," Input H.264 bitstream                  : %s \n",inp->infile);
   fprintf(stdout," Output decoded YUV 4:2:0               : %s \n",inp->outfile);
   fprintf(stdout," Output status file                     : %s \n",LOGFILE);
+  fprintf(stdout," Motion compensation kernels            : %s \n",simd_name(simd_level));
   if ((p_ref=fopen(inp->reffile,"rb"))==0)
   {
     fprintf(stdout," Input reference file                   : %s does not exist \n",inp->reffile);
@@ -391,7 +499,14 @@ void report(struct inp_par *inp, struct img_par *img, struct snr_par *snr)
   fprintf(stdout," SNR Y(dB)           : %5.2f\n",snr->snr_ya);
   fprintf(stdout," SNR U(dB)           : %5.2f\n",snr->snr_ua);
   fprintf(stdout," SNR V(dB)           : %5.2f\n",snr->snr_va);
+  if (input->ssim)
+  {
+    fprintf(stdout," SSIM Y              : %6.4f\n",snr->ssim_ya);
+    fprintf(stdout," SSIM U              : %6.4f\n",snr->ssim_ua);
+    fprintf(stdout," SSIM V              : %6.4f\n",snr->ssim_va);
+  }
   fprintf(stdout," Total decoding time : %.3f sec \n",tot_time*0.001);
+  fprintf(stdout," Picture pool        : %d reused, %d allocated\n",pic_pool_hits,pic_pool_misses);
   fprintf(stdout,"--------------------------------------------------------------------------\n");
   fprintf(stdout," Exit JM %s decoder, ver %s ",JM,VERSION);
   fprintf(stdout,"\n");
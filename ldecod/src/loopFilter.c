@@ -39,13 +39,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include "global.h"
+#include "memalloc.h"
 #include "image.h"
 #include "mb_access.h"
 #include "loopfilter.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#if defined(HAVE_X86_SIMD)
+  #include <emmintrin.h>
+#endif
 
 extern const byte QP_SCALE_CR[52] ;
 
-byte mixedModeEdgeFlag, fieldModeFilteringFlag;
+static THREAD_LOCAL byte mixedModeEdgeFlag, fieldModeFilteringFlag;
+static THREAD_LOCAL int  dbk_chroma_qp_offset;   //!< of the picture being deblocked by this thread
+
+/*****
+ *****  MB row parallel deblocking
+ *****
+ */
+static ThreadPool      *dbk_pool      = NULL;
+static JMThread        *dbk_driver    = NULL;   //!< runs the row jobs while the picture is decoded (overlap)
+static JMMutex         *dbk_lock      = NULL;
+static JMCond          *dbk_cond      = NULL;   //!< signalled on progress of decoding or deblocking
+static StorablePicture *dbk_pic       = NULL;   //!< picture being deblocked on the pool
+static ImageParameters *dbk_img       = NULL;   //!< img of the decoding thread, for the pool threads
+static int              dbk_overlap   = 0;
+static int              dbk_rows      = 0;      //!< MB rows (MB pair rows for MB AFF) of dbk_pic
+static int              dbk_row_size  = 0;      //!< macroblock addresses per row
+static int              dbk_max_rows  = 0;      //!< allocated size of dbk_row_jobs and dbk_row_done
+static int             *dbk_row_jobs  = NULL;   //!< row numbers, the jobs of the pool
+static int             *dbk_row_done  = NULL;   //!< number of deblocked MBs (MB pairs) of each row
+static int              dbk_decoded   = 0;      //!< MBs decoded in address order from the first MB
 
 /*********************************************************************************************************/
 
@@ -71,6 +97,12 @@ void GetStrength(byte Strength[16],struct img_par *img,int MbQAddr,int dir,int e
 void EdgeLoop(byte** Img, byte Strength[16],struct img_par *img, int MbQAddr, int AlphaC0Offset, int BetaOffset, int dir, int edge, int width, int yuv);
 void DeblockMb(ImageParameters *img, StorablePicture *p, int MbQAddr) ;
 
+static void DeblockMbEdges (ImageParameters *img, StorablePicture *p, int MbQAddr, int mb_x, int mb_y,
+                            int filterLeftMbEdgeFlag, int filterTopMbEdgeFlag, int mvlimit);
+
+static void DeblockRowJob (void *arg);
+static void init_deblock_rows (StorablePicture *p);
+
 /*!
  *****************************************************************************************
  * \brief
@@ -78,6 +110,42 @@ void DeblockMb(ImageParameters *img, StorablePicture *p, int MbQAddr) ;
  *****************************************************************************************
  */
 void DeblockPicture(ImageParameters *img, StorablePicture *p)
+{
+  if (dbk_pool == NULL)
+  {
+    p->chroma_qp_offset = active_pps->chroma_qp_index_offset;
+    DeblockPictureSerial (img, p);
+    return;
+  }
+
+  if (dbk_pic == p)
+  {
+    // deblocking runs since the start of the picture, release the last rows
+    lock_mutex (dbk_lock);
+    dbk_decoded = p->PicSizeInMbs;
+    broadcast_cond (dbk_cond);
+    unlock_mutex (dbk_lock);
+    join_thread (dbk_driver);
+    dbk_driver = NULL;
+  }
+  else
+  {
+    init_deblock_rows (p);
+    dbk_decoded = p->PicSizeInMbs;
+    run_thread_pool (dbk_pool, DeblockRowJob, dbk_row_jobs, sizeof(int), dbk_rows);
+  }
+  dbk_pic = NULL;
+} 
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filter all macroblocks of p on the calling thread. img and dec_picture of the
+ *    thread have to describe p, p->chroma_qp_offset has to be set.
+ *****************************************************************************************
+ */
+void DeblockPictureSerial(ImageParameters *img, StorablePicture *p)
 {
   unsigned i;
 
@@ -85,7 +153,192 @@ void DeblockPicture(ImageParameters *img, StorablePicture *p)
   {
     DeblockMb( img, p, i ) ;
   }
-} 
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Returns 1 if MB row mb_y can be deblocked: the row below it has been decoded,
+ *    so the unfiltered samples are not needed for intra prediction anymore.
+ *****************************************************************************************
+ */
+static int row_decoded (int mb_y)
+{
+  return dbk_decoded >= (int) min ((mb_y+2) * dbk_row_size, dbk_pic->PicSizeInMbs);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Row job: deblocks one MB row (MB pair row for MB AFF). Each MB waits until the row
+ *    above is finished up to its above-right neighbour, this gives the order of
+ *    DeblockPicture() for all samples an edge filter reads or writes.
+ *****************************************************************************************
+ */
+static void DeblockRowJob (void *arg)
+{
+  int mb_y  = *(int *) arg;
+  int width = dbk_pic->PicWidthInMbs;
+  int mb_x, mb_nr;
+
+  img         = dbk_img;
+  dec_picture = dbk_pic;
+
+  lock_mutex (dbk_lock);
+  while (!row_decoded (mb_y))
+    wait_cond (dbk_cond, dbk_lock);
+  unlock_mutex (dbk_lock);
+
+  for (mb_x=0; mb_x<width; mb_x++)
+  {
+    if (mb_y > 0)
+    {
+      lock_mutex (dbk_lock);
+      while (dbk_row_done[mb_y-1] < min (mb_x+2, width))
+        wait_cond (dbk_cond, dbk_lock);
+      unlock_mutex (dbk_lock);
+    }
+
+    if (dbk_pic->MbaffFrameFlag)
+    {
+      mb_nr = 2 * (mb_y * width + mb_x);
+      DeblockMb (img, dbk_pic, mb_nr);
+      DeblockMb (img, dbk_pic, mb_nr + 1);
+    }
+    else
+      DeblockMb (img, dbk_pic, mb_y * width + mb_x);
+
+    lock_mutex (dbk_lock);
+    dbk_row_done[mb_y] = mb_x + 1;
+    broadcast_cond (dbk_cond);
+    unlock_mutex (dbk_lock);
+  }
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Sets up the row bookkeeping for deblocking picture p on the pool
+ *****************************************************************************************
+ */
+static void init_deblock_rows (StorablePicture *p)
+{
+  int n;
+
+  dbk_pic      = p;
+  dbk_row_size = p->MbaffFrameFlag ? 2 * p->PicWidthInMbs : p->PicWidthInMbs;
+  dbk_rows     = p->PicSizeInMbs / dbk_row_size;
+
+  if (dbk_rows > dbk_max_rows)
+  {
+    free (dbk_row_jobs);
+    free (dbk_row_done);
+    if ((dbk_row_jobs = (int*) calloc (dbk_rows, sizeof(int))) == NULL)
+      no_mem_exit ("init_deblock_rows: dbk_row_jobs");
+    if ((dbk_row_done = (int*) calloc (dbk_rows, sizeof(int))) == NULL)
+      no_mem_exit ("init_deblock_rows: dbk_row_done");
+    for (n=0; n<dbk_rows; n++)
+      dbk_row_jobs[n] = n;
+    dbk_max_rows = dbk_rows;
+  }
+  dbk_img      = img;
+  dbk_decoded  = 0;
+  p->chroma_qp_offset = active_pps->chroma_qp_index_offset;
+  memset (dbk_row_done, 0, dbk_rows * sizeof(int));
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Runs the row jobs of the picture that is being decoded (overlap)
+ *****************************************************************************************
+ */
+static void deblock_driver (void *arg)
+{
+  run_thread_pool (dbk_pool, DeblockRowJob, dbk_row_jobs, sizeof(int), dbk_rows);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Starts the deblocking threads (num_threads > 0). With overlap the rows of a
+ *    picture are deblocked while the following rows are decoded.
+ *****************************************************************************************
+ */
+void init_deblock (int num_threads, int overlap)
+{
+  if (num_threads < 1 || dbk_pool != NULL)
+    return;
+
+  dbk_overlap = overlap;
+  dbk_lock    = create_mutex ();
+  dbk_cond    = create_cond ();
+  dbk_pool    = create_thread_pool (num_threads, NULL, NULL);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Stops the deblocking threads
+ *****************************************************************************************
+ */
+void free_deblock ()
+{
+  if (dbk_pool == NULL)
+    return;
+
+  free_thread_pool (dbk_pool);
+  dbk_pool = NULL;
+  free_cond (dbk_cond);
+  free_mutex (dbk_lock);
+  free (dbk_row_jobs);
+  free (dbk_row_done);
+  dbk_row_jobs = dbk_row_done = NULL;
+  dbk_max_rows = 0;
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Starts deblocking picture p while it is decoded (overlap)
+ *****************************************************************************************
+ */
+void start_deblock (StorablePicture *p)
+{
+  if (dbk_pool == NULL || !dbk_overlap)
+    return;
+
+  init_deblock_rows (p);
+  dbk_driver = create_thread (deblock_driver, NULL);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Reports the decoded macroblock mb_nr of the picture in start_deblock(). Rows are
+ *    only released while the macroblocks arrive in address order, all others are
+ *    deblocked by DeblockPicture() when the picture is finished.
+ *****************************************************************************************
+ */
+void deblock_mb_decoded (int mb_nr)
+{
+  if (dbk_pic == NULL || mb_nr != dbk_decoded)
+    return;
+
+  lock_mutex (dbk_lock);
+  dbk_decoded++;
+  if (dbk_decoded % dbk_row_size == 0)
+    broadcast_cond (dbk_cond);
+  unlock_mutex (dbk_lock);
+}
 
 
 /*!
@@ -111,7 +364,8 @@ void DeblockMb(ImageParameters *img, StorablePicture *p, int MbQAddr)
   byte **imgY   = p->imgY;
   byte ***imgUV = p->imgUV;
   
-  img->DeblockCall = 1;
+  DeblockCall = 1;
+  dbk_chroma_qp_offset = p->chroma_qp_offset;
   get_mb_pos (MbQAddr, &mb_x, &mb_y);
   filterLeftMbEdgeFlag  = (mb_x != 0);
   filterTopMbEdgeFlag   = (mb_y != 0);
@@ -127,7 +381,7 @@ void DeblockMb(ImageParameters *img, StorablePicture *p, int MbQAddr)
 
   // return, if filter is disabled
   if (MbQ->LFDisableIdc==1) {
-    img->DeblockCall = 0;
+    DeblockCall = 0;
     return;
   }
 
@@ -138,8 +392,17 @@ void DeblockMb(ImageParameters *img, StorablePicture *p, int MbQAddr)
     filterTopMbEdgeFlag  = MbQ->mbAvailB;;
   }
 
-  img->current_mb_nr = MbQAddr;
-  CheckAvailabilityOfNeighbors();
+  CheckAvailabilityOfNeighbors(MbQAddr);
+
+  if (!p->MbaffFrameFlag
+    && (!filterLeftMbEdgeFlag || img->mb_data[MbQ->mbAddrA].mb_field == MbQ->mb_field)
+    && (!filterTopMbEdgeFlag  || img->mb_data[MbQ->mbAddrB].mb_field == MbQ->mb_field))
+  {
+    // no mixed edges: all strengths of the MB at once, the edges are filtered line parallel
+    DeblockMbEdges (img, p, MbQAddr, mb_x, mb_y, filterLeftMbEdgeFlag, filterTopMbEdgeFlag, mvlimit);
+    DeblockCall = 0;
+    return;
+  }
 
   for( dir=0 ; dir<2 ; dir++ )                                             // vertical edges, than horicontal edges
   {
@@ -164,7 +427,7 @@ void DeblockMb(ImageParameters *img, StorablePicture *p, int MbQAddr)
 
         if (dir && !edge && !MbQ->mb_field && mixedModeEdgeFlag) {
           // this is the extra horizontal edge between a frame macroblock pair and a field above it
-          img->DeblockCall = 2;
+          DeblockCall = 2;
           GetStrength(Strength,img,MbQAddr,dir,4, mvlimit, p); // Strength for 4 blks in 1 stripe
           if( *((int*)Strength) )                      // only if one of the 4 Strength bytes is != 0
           {
@@ -175,13 +438,13 @@ void DeblockMb(ImageParameters *img, StorablePicture *p, int MbQAddr)
               EdgeLoop( imgUV[1], Strength, img, MbQAddr, MbQ->LFAlphaC0Offset, MbQ->LFBetaOffset, dir, 4, p->size_x_cr, 1 ) ; 
             }
           }
-          img->DeblockCall = 1;
+          DeblockCall = 1;
         }
 
       }
     }//end edge
   }//end loop dir
-  img->DeblockCall = 0;
+  DeblockCall = 0;
 
 }
 
@@ -326,7 +589,89 @@ void GetStrength(byte Strength[16],struct img_par *img,int MbQAddr,int dir,int e
   }
 }
 
-#define CQPOF(qp) (Clip3(0, 51, qp + active_pps->chroma_qp_index_offset))
+#define CQPOF(qp) (Clip3(0, 51, qp + dbk_chroma_qp_offset))
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters one line across an edge, SrcPtrP and SrcPtrQ point to the samples next to it
+ *****************************************************************************************
+ */
+static void FilterLine (byte *SrcPtrP, byte *SrcPtrQ, int incP, int incQ, int Strng,
+                        int Alpha, int Beta, const byte *ClipTab, int yuv)
+{
+  int      ap = 0, aq = 0;
+  int      C0, c0, Delta, dif, AbsDelta ;
+  int      L2, L1, L0, R0, R1, R2, RL0, L3, R3 ;
+  int      small_gap;
+
+  L0  = SrcPtrP[0] ;
+  R0  = SrcPtrQ[0] ;
+  L1  = SrcPtrP[-incP] ;
+  R1  = SrcPtrQ[ incQ] ;
+
+  AbsDelta  = abs( Delta = R0 - L0 )  ;
+
+  if( AbsDelta < Alpha )
+  {
+    C0  = ClipTab[ Strng ] ;
+    if( ((abs( R0 - R1) - Beta )  & (abs(L0 - L1) - Beta )) < 0  ) 
+    {
+      L2  = yuv ? 0 : SrcPtrP[-incP*2] ;
+      R2  = yuv ? 0 : SrcPtrQ[ incQ*2] ;
+      if( !yuv)
+      {
+        aq  = (abs( R0 - R2) - Beta ) < 0  ;
+        ap  = (abs( L0 - L2) - Beta ) < 0  ;
+      }
+    
+      RL0             = L0 + R0 ;
+    
+      if(Strng == 4 )    // INTRA strong filtering
+      {
+        if( yuv)  // Chroma
+        {
+          SrcPtrQ[0] = ((R1 << 1) + R0 + L1 + 2) >> 2; 
+          SrcPtrP[0] = ((L1 << 1) + L0 + R1 + 2) >> 2;                                           
+        }
+        else  // Luma
+        {
+          L3  = SrcPtrP[-incP*3] ;
+          R3  = SrcPtrQ[ incQ*3] ;
+          small_gap = (AbsDelta < ((Alpha >> 2) + 2));
+        
+          aq &= small_gap;
+          ap &= small_gap;
+        
+          SrcPtrQ[0]   = aq ? ( L1 + ((R1 + RL0) << 1) +  R2 + 4) >> 3 : ((R1 << 1) + R0 + L1 + 2) >> 2 ;
+          SrcPtrP[0]   = ap ? ( R1 + ((L1 + RL0) << 1) +  L2 + 4) >> 3 : ((L1 << 1) + L0 + R1 + 2) >> 2 ;
+        
+          SrcPtrQ[ incQ] =   aq  ? ( R2 + R0 + R1 + L0 + 2) >> 2 : R1;
+          SrcPtrP[-incP] =   ap  ? ( L2 + L1 + L0 + R0 + 2) >> 2 : L1;
+        
+          SrcPtrQ[ incQ*2] = aq ? (((R3 + R2) <<1) + R2 + R1 + RL0 + 4) >> 3 : R2;
+          SrcPtrP[-incP*2] = ap ? (((L3 + L2) <<1) + L2 + L1 + RL0 + 4) >> 3 : L2;
+        }
+      }
+      else                                                                                   // normal filtering
+      {
+        c0               = yuv? (C0+1):(C0 + ap + aq) ;
+        dif              = IClip( -c0, c0, ( (Delta << 2) + (L1 - R1) + 4) >> 3 ) ;
+        SrcPtrP[0]  = IClip(0, 255, L0 + dif) ;
+        SrcPtrQ[0]  = IClip(0, 255, R0 - dif) ;
+      
+        if( !yuv )
+        {
+          if( ap )
+            SrcPtrP[-incP] += IClip( -C0,  C0, ( L2 + ((RL0 + 1) >> 1) - (L1<<1)) >> 1 ) ;
+          if( aq  )
+            SrcPtrQ[ incQ] += IClip( -C0,  C0, ( R2 + ((RL0 + 1) >> 1) - (R1<<1)) >> 1 ) ;
+        } ;
+      } ;
+    } ; 
+  } ;
+}
+
 
 /*!
  *****************************************************************************************
@@ -337,19 +682,16 @@ void GetStrength(byte Strength[16],struct img_par *img,int MbQAddr,int dir,int e
 void EdgeLoop(byte** Img, byte Strength[16],struct img_par *img, int MbQAddr, int AlphaC0Offset, int BetaOffset,
               int dir, int edge, int width, int yuv)
 {
-  int      pel, ap = 0, aq = 0, Strng ;
+  int      pel, Strng ;
   int      incP, incQ;
-  int      C0, c0, Delta, dif, AbsDelta ;
-  int      L2 = 0, L1, L0, R0, R1, R2 = 0, RL0, L3, R3 ;
   int      Alpha = 0, Beta = 0 ;
   byte*    ClipTab = NULL;   
-  int      small_gap;
   int      indexA, indexB;
   int      PelNum;
   int      StrengthIdx;
   byte     *SrcPtrP, *SrcPtrQ;
   int      QP;
-  int      xP, xQ, yP, yQ;
+  int      xQ, yQ;
   Macroblock *MbQ, *MbP;
   PixelPos pixP, pixQ;
   
@@ -361,8 +703,6 @@ void EdgeLoop(byte** Img, byte Strength[16],struct img_par *img, int MbQAddr, in
     yQ = dir ? (edge < 4 ? edge << 2 : 1) : pel;
     getNeighbour(MbQAddr, xQ, yQ, 1-yuv, &pixQ);
     getNeighbour(MbQAddr, xQ - (1 - dir), yQ - dir, 1-yuv, &pixP);
-    xP = pixP.x;
-    yP = pixP.y;
     MbQ = &(img->mb_data[MbQAddr]);
     MbP = &(img->mb_data[pixP.mb_addr]);
     fieldModeFilteringFlag = MbQ->mb_field || MbP->mb_field;
@@ -384,74 +724,416 @@ void EdgeLoop(byte** Img, byte Strength[16],struct img_par *img, int MbQAddr, in
       Beta=BETA_TABLE[indexB];  
       ClipTab=CLIP_TAB[indexA];
 
-      L0  = SrcPtrP[0] ;
-      R0  = SrcPtrQ[0] ;
-      L1  = SrcPtrP[-incP] ;
-      R1  = SrcPtrQ[ incQ] ;
-      L2  = SrcPtrP[-incP*2] ;
-      R2  = SrcPtrQ[ incQ*2] ;
-      L3  = SrcPtrP[-incP*3] ;
-      R3  = SrcPtrQ[ incQ*3] ;
       if( (Strng = Strength[StrengthIdx]) )
+        FilterLine (SrcPtrP, SrcPtrQ, incP, incQ, Strng, Alpha, Beta, ClipTab, yuv);
+    } ;
+  }
+}
+
+
+
+/*
+ *****************************************************************************************
+ *  MB edges without mixed frame/field macroblocks (frame and field pictures)
+ *****************************************************************************************
+ */
+#define MB_IS_INTRA(MB) ((MB)->mb_type==I4MB || (MB)->mb_type==I16MB || (MB)->mb_type==IPCM)
+#define MV_DIFFERS(a,b) ((abs ((a)[0] - (b)[0]) >= 4) | (abs ((a)[1] - (b)[1]) >= mvlimit))
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Strength 0 or 1 of an edge between the inter 4x4 blocks q and p from their
+ *    references and motion vectors, same rules as GetStrength()
+ *****************************************************************************************
+ */
+static byte MvStrength (int64 ref[2][5][5], int mv[2][5][5][2], int xq, int yq, int xp, int yp, int mvlimit)
+{
+  int64 ref_q0 = ref[LIST_0][yq][xq], ref_q1 = ref[LIST_1][yq][xq];
+  int64 ref_p0 = ref[LIST_0][yp][xp], ref_p1 = ref[LIST_1][yp][xp];
+  int   *mv_q0 = mv[LIST_0][yq][xq],  *mv_q1 = mv[LIST_1][yq][xq];
+  int   *mv_p0 = mv[LIST_0][yp][xp],  *mv_p1 = mv[LIST_1][yp][xp];
+
+  if (!((ref_q0==ref_p0 && ref_q1==ref_p1) || (ref_q0==ref_p1 && ref_q1==ref_p0)))
+    return 1;
+
+  if (ref_q0 != ref_q1)
+  {
+    // compare MV for the same reference picture
+    if (ref_q0 == ref_p0)
+      return MV_DIFFERS (mv_q0, mv_p0) | MV_DIFFERS (mv_q1, mv_p1);
+    else
+      return MV_DIFFERS (mv_q0, mv_p1) | MV_DIFFERS (mv_q1, mv_p0);
+  }
+  // L0 and L1 reference pictures of q are the same; p as well
+  return (MV_DIFFERS (mv_q0, mv_p0) | MV_DIFFERS (mv_q1, mv_p1)) &&
+         (MV_DIFFERS (mv_q0, mv_p1) | MV_DIFFERS (mv_q1, mv_p0));
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Strength values of all edges of a macroblock without mixed edges [dir][edge][pel].
+ *    The references and vectors of the MB and of the 4x4 blocks left of and above it
+ *    are gathered once, one value is derived per 4x4 block edge.
+ *****************************************************************************************
+ */
+static void GetStrengthMb (byte Strength[2][4][16], ImageParameters *img, int MbQAddr,
+                           int filterLeftMbEdgeFlag, int filterTopMbEdgeFlag, int mvlimit, StorablePicture *p)
+{
+  int64  ref[2][5][5];        // [list][y+1][x+1] of the 4x4 blocks, row and column 0 are the neighbours
+  int    mv[2][5][5][2];
+  int    list, x, y, xp, yp, k, dir, edge, blk_x, blk_y;
+  int    StrValue, Strng;
+  int    sp_slice = (p->slice_type==SP_SLICE) || (p->slice_type==SI_SLICE);
+  Macroblock *MbQ = &(img->mb_data[MbQAddr]);
+  Macroblock *MbP;
+
+  get_mb_block_pos (MbQAddr, &blk_x, &blk_y);
+  blk_x <<= 2;
+  blk_y <<= 2;
+
+  if (!sp_slice && !MB_IS_INTRA(MbQ))
+  {
+    for (list=0; list<2; list++)
+      for (y = filterTopMbEdgeFlag ? -1 : 0; y<4; y++)
+        for (x = filterLeftMbEdgeFlag ? -1 : 0; x<4; x++)
+        {
+          if (x < 0 && y < 0)
+            continue;
+          ref[list][y+1][x+1]   = p->ref_idx[list][blk_x+x][blk_y+y] < 0 ? -1 : p->ref_pic_id[list][blk_x+x][blk_y+y];
+          mv[list][y+1][x+1][0] = p->mv[list][blk_x+x][blk_y+y][0];
+          mv[list][y+1][x+1][1] = p->mv[list][blk_x+x][blk_y+y][1];
+        }
+  }
+
+  for (dir=0; dir<2; dir++)
+  {
+    for (edge=0; edge<4; edge++)
+    {
+      if (!edge && !(dir ? filterTopMbEdgeFlag : filterLeftMbEdgeFlag))
+        continue;
+
+      MbP = edge ? MbQ : &(img->mb_data[dir ? MbQ->mbAddrB : MbQ->mbAddrA]);
+      // Strength=4 for Mb-edge (vertical ones only in field pictures), 3 otherwise
+      StrValue = (edge == 0 && (p->structure==FRAME || !dir)) ? 4 : 3;
+
+      for (k=0; k<4; k++)
       {
-        AbsDelta  = abs( Delta = R0 - L0 )  ;
-      
-        if( AbsDelta < Alpha )
+        x  = dir ? k : edge;
+        y  = dir ? edge : k;
+        xp = x - (1 - dir);
+        yp = y - dir;
+
+        Strng = StrValue;
+        if (!sp_slice && !MB_IS_INTRA(MbP) && !MB_IS_INTRA(MbQ))
         {
-          C0  = ClipTab[ Strng ] ;
-          if( ((abs( R0 - R1) - Beta )  & (abs(L0 - L1) - Beta )) < 0  ) 
-          {
-            if( !yuv)
-            {
-              aq  = (abs( R0 - R2) - Beta ) < 0  ;
-              ap  = (abs( L0 - L2) - Beta ) < 0  ;
-            }
-          
-            RL0             = L0 + R0 ;
-          
-            if(Strng == 4 )    // INTRA strong filtering
-            {
-              if( yuv)  // Chroma
-              {
-                SrcPtrQ[0] = ((R1 << 1) + R0 + L1 + 2) >> 2; 
-                SrcPtrP[0] = ((L1 << 1) + L0 + R1 + 2) >> 2;                                           
-              }
-              else  // Luma
-              {
-                small_gap = (AbsDelta < ((Alpha >> 2) + 2));
-              
-                aq &= small_gap;
-                ap &= small_gap;
-              
-                SrcPtrQ[0]   = aq ? ( L1 + ((R1 + RL0) << 1) +  R2 + 4) >> 3 : ((R1 << 1) + R0 + L1 + 2) >> 2 ;
-                SrcPtrP[0]   = ap ? ( R1 + ((L1 + RL0) << 1) +  L2 + 4) >> 3 : ((L1 << 1) + L0 + R1 + 2) >> 2 ;
-              
-                SrcPtrQ[ incQ] =   aq  ? ( R2 + R0 + R1 + L0 + 2) >> 2 : R1;
-                SrcPtrP[-incP] =   ap  ? ( L2 + L1 + L0 + R0 + 2) >> 2 : L1;
-              
-                SrcPtrQ[ incQ*2] = aq ? (((R3 + R2) <<1) + R2 + R1 + RL0 + 4) >> 3 : R2;
-                SrcPtrP[-incP*2] = ap ? (((L3 + L2) <<1) + L2 + L1 + RL0 + 4) >> 3 : L2;
-              }
-            }
-            else                                                                                   // normal filtering
-            {
-              c0               = yuv? (C0+1):(C0 + ap + aq) ;
-              dif              = IClip( -c0, c0, ( (Delta << 2) + (L1 - R1) + 4) >> 3 ) ;
-              SrcPtrP[0]  = IClip(0, 255, L0 + dif) ;
-              SrcPtrQ[0]  = IClip(0, 255, R0 - dif) ;
-            
-              if( !yuv )
-              {
-                if( ap )
-                  SrcPtrP[-incP] += IClip( -C0,  C0, ( L2 + ((RL0 + 1) >> 1) - (L1<<1)) >> 1 ) ;
-                if( aq  )
-                  SrcPtrQ[ incQ] += IClip( -C0,  C0, ( R2 + ((RL0 + 1) >> 1) - (R1<<1)) >> 1 ) ;
-              } ;
-            } ;
-          } ; 
-        } ;
-      } ;
-    } ;
+          if ((MbQ->cbp_blk & (1 << ((y<<2) + x))) || (MbP->cbp_blk & (1 << (((yp&3)<<2) + (xp&3)))))
+            Strng = 2;
+          else
+            Strng = MvStrength (ref, mv, x+1, y+1, xp+1, yp+1, mvlimit);
+        }
+        memset (&Strength[dir][edge][k<<2], Strng, 4);
+      }
+    }
+  }
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters the lines of an edge in C, (x,y) is the first q0 sample
+ *****************************************************************************************
+ */
+static void EdgeLinesC (byte **Img, int x, int y, int dir, int lines, int width, const byte *Strength,
+                        int Alpha, int Beta, const byte *ClipTab, int yuv)
+{
+  int pel;
+
+  if (dir)
+  {
+    for (pel=0; pel<lines; pel++)
+      if (Strength[pel])
+        FilterLine (&Img[y-1][x+pel], &Img[y][x+pel], width, width, Strength[pel], Alpha, Beta, ClipTab, yuv);
+  }
+  else
+  {
+    for (pel=0; pel<lines; pel++)
+      if (Strength[pel])
+        FilterLine (&Img[y+pel][x-1], &Img[y+pel][x], 1, 1, Strength[pel], Alpha, Beta, ClipTab, yuv);
+  }
+}
+
+
+#if defined(HAVE_X86_SIMD)
+
+#define ABS_DIFF(a,b)  _mm_sub_epi16 (_mm_max_epi16 (a, b), _mm_min_epi16 (a, b))
+#define SELECT(m,a,b)  _mm_or_si128 (_mm_and_si128 (m, a), _mm_andnot_si128 (m, b))
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters 8 lines, v[] holds p3 p2 p1 p0 q0 q1 q2 q3 of the lines as words and
+ *    returns 0 if no sample changes. Values of the normal filter are clipped to
+ *    0..255 by the packing of the caller.
+ *****************************************************************************************
+ */
+static int SIMD_TARGET("sse2") filter8_sse2 (__m128i v[8], __m128i bs, __m128i tc0, int Alpha, int Beta, int yuv)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i two  = _mm_set1_epi16 (2);
+  const __m128i four = _mm_set1_epi16 (4);
+  const __m128i beta = _mm_set1_epi16 ((short) Beta);
+  __m128i L3 = v[0], L2 = v[1], L1 = v[2], L0 = v[3], R0 = v[4], R1 = v[5], R2 = v[6], R3 = v[7];
+  __m128i AbsDelta = ABS_DIFF (R0, L0);
+  __m128i filt, strong, normal, ap, aq, aps, aqs, RL0, c0, dif, t, P0, Q0;
+
+  filt = _mm_andnot_si128 (_mm_cmpeq_epi16 (bs, zero), _mm_cmplt_epi16 (AbsDelta, _mm_set1_epi16 ((short) Alpha)));
+  filt = _mm_and_si128 (filt, _mm_cmplt_epi16 (ABS_DIFF (R0, R1), beta));
+  filt = _mm_and_si128 (filt, _mm_cmplt_epi16 (ABS_DIFF (L0, L1), beta));
+  if (!_mm_movemask_epi8 (filt))
+    return 0;
+
+  strong = _mm_and_si128 (filt, _mm_cmpeq_epi16 (bs, four));
+  normal = _mm_andnot_si128 (strong, filt);
+  RL0    = _mm_add_epi16 (L0, R0);
+
+  // normal filtering of p0 and q0, the masks ap and aq are -1 where set
+  if (yuv)
+  {
+    ap = aq = zero;
+    c0 = _mm_add_epi16 (tc0, _mm_set1_epi16 (1));
+  }
+  else
+  {
+    ap = _mm_cmplt_epi16 (ABS_DIFF (L0, L2), beta);
+    aq = _mm_cmplt_epi16 (ABS_DIFF (R0, R2), beta);
+    c0 = _mm_sub_epi16 (_mm_sub_epi16 (tc0, ap), aq);
+  }
+  t   = _mm_add_epi16 (_mm_slli_epi16 (_mm_sub_epi16 (R0, L0), 2), _mm_sub_epi16 (L1, R1));
+  dif = _mm_srai_epi16 (_mm_add_epi16 (t, four), 3);
+  dif = _mm_max_epi16 (_mm_sub_epi16 (zero, c0), _mm_min_epi16 (c0, dif));
+  P0  = _mm_add_epi16 (L0, dif);
+  Q0  = _mm_sub_epi16 (R0, dif);
+
+  if (yuv)
+  {
+    // strong filtering: P0 = (2*L1 + L0 + R1 + 2) >> 2
+    t    = _mm_add_epi16 (_mm_add_epi16 (L1, R1), two);
+    v[3] = SELECT (strong, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, L1), L0), 2), SELECT (normal, P0, L0));
+    v[4] = SELECT (strong, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, R1), R0), 2), SELECT (normal, Q0, R0));
+    return 1;
+  }
+
+  // normal filtering of p1 and q1
+  t    = _mm_sub_epi16 (_mm_srai_epi16 (_mm_add_epi16 (RL0, _mm_set1_epi16 (1)), 1), _mm_slli_epi16 (L1, 1));
+  t    = _mm_srai_epi16 (_mm_add_epi16 (L2, t), 1);
+  t    = _mm_max_epi16 (_mm_sub_epi16 (zero, tc0), _mm_min_epi16 (tc0, t));
+  v[2] = _mm_add_epi16 (L1, _mm_and_si128 (_mm_and_si128 (normal, ap), t));
+  t    = _mm_sub_epi16 (_mm_srai_epi16 (_mm_add_epi16 (RL0, _mm_set1_epi16 (1)), 1), _mm_slli_epi16 (R1, 1));
+  t    = _mm_srai_epi16 (_mm_add_epi16 (R2, t), 1);
+  t    = _mm_max_epi16 (_mm_sub_epi16 (zero, tc0), _mm_min_epi16 (tc0, t));
+  v[5] = _mm_add_epi16 (R1, _mm_and_si128 (_mm_and_si128 (normal, aq), t));
+  v[3] = SELECT (normal, P0, L0);
+  v[4] = SELECT (normal, Q0, R0);
+
+  if (_mm_movemask_epi8 (strong))
+  {
+    t   = _mm_cmplt_epi16 (AbsDelta, _mm_set1_epi16 ((short) ((Alpha >> 2) + 2)));   // small gap
+    aps = _mm_and_si128 (ap, t);
+    aqs = _mm_and_si128 (aq, t);
+
+    // P0 = ap ? (R1 + 2*(L1 + RL0) + L2 + 4) >> 3 : (2*L1 + L0 + R1 + 2) >> 2
+    t  = _mm_add_epi16 (_mm_add_epi16 (R1, L2), _mm_slli_epi16 (_mm_add_epi16 (L1, RL0), 1));
+    P0 = SELECT (aps, _mm_srai_epi16 (_mm_add_epi16 (t, four), 3),
+                 _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (_mm_slli_epi16 (L1, 1), L0), _mm_add_epi16 (R1, two)), 2));
+    t  = _mm_add_epi16 (_mm_add_epi16 (L1, R2), _mm_slli_epi16 (_mm_add_epi16 (R1, RL0), 1));
+    Q0 = SELECT (aqs, _mm_srai_epi16 (_mm_add_epi16 (t, four), 3),
+                 _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (_mm_slli_epi16 (R1, 1), R0), _mm_add_epi16 (L1, two)), 2));
+    v[3] = SELECT (strong, P0, v[3]);
+    v[4] = SELECT (strong, Q0, v[4]);
+
+    // P1 = (L2 + L1 + L0 + R0 + 2) >> 2, P2 = (2*(L3 + L2) + L2 + L1 + RL0 + 4) >> 3
+    aps  = _mm_and_si128 (strong, aps);
+    aqs  = _mm_and_si128 (strong, aqs);
+    t    = _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (L2, L1), _mm_add_epi16 (RL0, two)), 2);
+    v[2] = SELECT (aps, t, v[2]);
+    t    = _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (R2, R1), _mm_add_epi16 (RL0, two)), 2);
+    v[5] = SELECT (aqs, t, v[5]);
+    t    = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (L3, L2), 1), _mm_add_epi16 (L2, L1));
+    v[1] = SELECT (aps, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, RL0), four), 3), L2);
+    t    = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (R3, R2), 1), _mm_add_epi16 (R2, R1));
+    v[6] = SELECT (aqs, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, RL0), four), 3), R2);
+  }
+  return 1;
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Transposes 8x8 samples: the low 8 bytes of r[i] are row i, out[k] returns the
+ *    columns 2k and 2k+1 in its low and high 8 bytes
+ *****************************************************************************************
+ */
+static void SIMD_TARGET("sse2") transpose8x8_sse2 (__m128i r[8], __m128i out[4])
+{
+  __m128i t0 = _mm_unpacklo_epi8 (r[0], r[1]);
+  __m128i t1 = _mm_unpacklo_epi8 (r[2], r[3]);
+  __m128i t2 = _mm_unpacklo_epi8 (r[4], r[5]);
+  __m128i t3 = _mm_unpacklo_epi8 (r[6], r[7]);
+  __m128i u0 = _mm_unpacklo_epi16 (t0, t1);
+  __m128i u1 = _mm_unpackhi_epi16 (t0, t1);
+  __m128i u2 = _mm_unpacklo_epi16 (t2, t3);
+  __m128i u3 = _mm_unpackhi_epi16 (t2, t3);
+
+  out[0] = _mm_unpacklo_epi32 (u0, u2);
+  out[1] = _mm_unpackhi_epi32 (u0, u2);
+  out[2] = _mm_unpacklo_epi32 (u1, u3);
+  out[3] = _mm_unpackhi_epi32 (u1, u3);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters the lines of an edge 8 at a time, (x,y) is the first q0 sample
+ *****************************************************************************************
+ */
+static void SIMD_TARGET("sse2") EdgeLinesSSE2 (byte **Img, int x, int y, int dir, int lines, const byte *Strength,
+                                                int Alpha, int Beta, const byte *ClipTab, int yuv)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i v[8], r[8], c[4], bs, tc0;
+  const byte *s;
+  int line, i;
+
+  for (line=0; line<lines; line+=8)
+  {
+    s = Strength + line;
+    if (!(s[0] | s[1] | s[2] | s[3] | s[4] | s[5] | s[6] | s[7]))
+      continue;
+    bs  = _mm_setr_epi16 (s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+    tc0 = _mm_setr_epi16 (ClipTab[s[0]], ClipTab[s[1]], ClipTab[s[2]], ClipTab[s[3]],
+                          ClipTab[s[4]], ClipTab[s[5]], ClipTab[s[6]], ClipTab[s[7]]);
+    if (dir)
+    {
+      // horizontal edge: the lines are columns, each row holds one sample position
+      for (i=0; i<8; i++)
+        v[i] = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) &Img[y-4+i][x+line]), zero);
+      if (filter8_sse2 (v, bs, tc0, Alpha, Beta, yuv))
+        for (i=1; i<7; i++)
+          _mm_storel_epi64 ((__m128i*) &Img[y-4+i][x+line], _mm_packus_epi16 (v[i], v[i]));
+    }
+    else
+    {
+      // vertical edge: the lines are rows, transposed to sample positions and back
+      for (i=0; i<8; i++)
+        r[i] = _mm_loadl_epi64 ((__m128i*) &Img[y+line+i][x-4]);
+      transpose8x8_sse2 (r, c);
+      for (i=0; i<4; i++)
+      {
+        v[2*i]   = _mm_unpacklo_epi8 (c[i], zero);
+        v[2*i+1] = _mm_unpackhi_epi8 (c[i], zero);
+      }
+      if (filter8_sse2 (v, bs, tc0, Alpha, Beta, yuv))
+      {
+        for (i=0; i<8; i++)
+          r[i] = _mm_packus_epi16 (v[i], v[i]);
+        transpose8x8_sse2 (r, c);
+        for (i=0; i<4; i++)
+        {
+          _mm_storel_epi64 ((__m128i*) &Img[y+line+2*i  ][x-4], c[i]);
+          _mm_storel_epi64 ((__m128i*) &Img[y+line+2*i+1][x-4], _mm_srli_si128 (c[i], 8));
+        }
+      }
+    }
   }
 }
+#endif // HAVE_X86_SIMD
 
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters one edge of 16 (luma) or 8 (chroma) pel of a macroblock without mixed
+ *    edges. QP, Alpha, Beta and the clipping table are the same for all lines.
+ *****************************************************************************************
+ */
+static void EdgeLoopMb (byte **Img, byte Strength[16], Macroblock *MbQ, Macroblock *MbP,
+                        int dir, int edge, int mb_x, int mb_y, int width, int yuv)
+{
+  int   QP, indexA, indexB, Alpha, Beta, pel, x, y;
+  byte  StrengthCr[8];
+  byte *ClipTab;
+
+  QP     = yuv ? (QP_SCALE_CR[CQPOF(MbP->qp)] + QP_SCALE_CR[CQPOF(MbQ->qp)] + 1) >> 1 : (MbP->qp + MbQ->qp + 1) >> 1;
+  indexA = IClip(0, MAX_QP, QP + MbQ->LFAlphaC0Offset);
+  indexB = IClip(0, MAX_QP, QP + MbQ->LFBetaOffset);
+  Alpha  = ALPHA_TABLE[indexA];
+  Beta   = BETA_TABLE[indexB];
+  ClipTab= CLIP_TAB[indexA];
+  if (!Alpha || !Beta)
+    return;
+
+  if (yuv)
+  {
+    for (pel=0; pel<8; pel++)
+      StrengthCr[pel] = Strength[((pel>>1)<<2)+(pel%2)];
+    Strength = StrengthCr;
+    mb_x >>= 1;
+    mb_y >>= 1;
+  }
+  x = mb_x + (dir ? 0 : edge << 2);
+  y = mb_y + (dir ? edge << 2 : 0);
+
+#if defined(HAVE_X86_SIMD)
+  if (simd_level >= SIMD_SSE2)
+  {
+    EdgeLinesSSE2 (Img, x, y, dir, yuv ? 8 : 16, Strength, Alpha, Beta, ClipTab, yuv);
+    return;
+  }
+#endif
+  EdgeLinesC (Img, x, y, dir, yuv ? 8 : 16, width, Strength, Alpha, Beta, ClipTab, yuv);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Deblocks a macroblock without mixed edges (mb_x, mb_y in samples)
+ *****************************************************************************************
+ */
+static void DeblockMbEdges (ImageParameters *img, StorablePicture *p, int MbQAddr, int mb_x, int mb_y,
+                            int filterLeftMbEdgeFlag, int filterTopMbEdgeFlag, int mvlimit)
+{
+  byte        Strength[2][4][16];
+  int         dir, edge, i, StrengthSum;
+  Macroblock *MbQ = &(img->mb_data[MbQAddr]);
+  Macroblock *MbP;
+
+  GetStrengthMb (Strength, img, MbQAddr, filterLeftMbEdgeFlag, filterTopMbEdgeFlag, mvlimit, p);
+
+  for (dir=0; dir<2; dir++)
+  {
+    for (edge=0; edge<4; edge++)
+    {
+      if (!edge && !(dir ? filterTopMbEdgeFlag : filterLeftMbEdgeFlag))
+        continue;
+      for (StrengthSum=0, i=0; i<16; i+=4)
+        StrengthSum += Strength[dir][edge][i];
+      if (!StrengthSum)
+        continue;
+
+      MbP = edge ? MbQ : &(img->mb_data[dir ? MbQ->mbAddrB : MbQ->mbAddrA]);
+      EdgeLoopMb (p->imgY, Strength[dir][edge], MbQ, MbP, dir, edge, mb_x, mb_y, p->size_x, 0);
+      if ((p->imgUV != NULL) && !(edge & 1))
+      {
+        EdgeLoopMb (p->imgUV[0], Strength[dir][edge], MbQ, MbP, dir, edge/2, mb_x, mb_y, p->size_x_cr, 1);
+        EdgeLoopMb (p->imgUV[1], Strength[dir][edge], MbQ, MbP, dir, edge/2, mb_x, mb_y, p->size_x_cr, 1);
+      }
+    }
+  }
+}
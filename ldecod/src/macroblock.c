@@ -55,6 +55,7 @@
 #include "image.h"
 #include "mb_access.h"
 #include "biaridecod.h"
+#include "mc_prediction.h"
 
 #if TRACE
 #define TRACE_STRING(s) strncpy(currSE.tracestring, s, TRACESTRING_SIZE)
@@ -62,8 +63,8 @@
 #define TRACE_STRING(s) // do nothing
 #endif
 
-extern int last_dquant;
-extern ColocatedParams *Co_located;
+extern THREAD_LOCAL int last_dquant;
+extern THREAD_LOCAL ColocatedParams *Co_located;
 
 
 static void SetMotionVectorPredictor (struct img_par  *img,
@@ -138,7 +139,7 @@ void start_macroblock(struct img_par *img,struct inp_par *inp, int CurrentMBInSc
     dec_picture->max_slice_id=img->current_slice_nr;
   }
   
-  CheckAvailabilityOfNeighbors(img);
+  CheckAvailabilityOfNeighbors(img->current_mb_nr);
 
   // Reset syntax element entries in MB struct
   currMB->qp          = img->qp ;
@@ -1003,6 +1004,9 @@ void readIPCMcoeffsFromNAL(struct img_par *img, struct inp_par *inp, struct data
   //  because we have variable for integer bytes position
   if(active_pps->entropy_coding_mode_flag  == CABAC)
   {
+    // the samples start after the bytes used by the arithmetic decoder
+    arideco_stop_decoding(&dP->de_cabac);
+
     //read luma and chroma IPCM coefficients
     currSE.len=8;
 
@@ -3084,6 +3088,159 @@ void decode_ipcm_mb(struct img_par *img)
   last_dquant=0;
 }
 
+static THREAD_LOCAL byte mc_luma_pred  [2][MB_BLOCK_SIZE][MB_BLOCK_SIZE];          //!< partition predictions [list][y][x]
+static THREAD_LOCAL byte mc_chroma_pred[2][2][MB_BLOCK_SIZE/2][MB_BLOCK_SIZE/2];  //!< partition predictions [list][uv][y][x]
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Size of the inter partition that starts with the 8x8 block b8 and
+ *    has one reference index and motion vector per list. Returns 0 if b8
+ *    starts no such partition (sub-8x8, direct and intra blocks).
+ ************************************************************************
+ */
+static int mc_partition_size(struct img_par *img, Macroblock *currMB, int b8, int *width, int *height)
+{
+  int mv_mode  = currMB->b8mode[b8];
+  int pred_dir = currMB->b8pdir[b8];
+  int i4 = img->block_x + 2*(b8&1);
+  int j4 = img->block_y + 2*(b8>>1);
+  int l, x, y;
+
+  if (pred_dir < 0)
+    return 0;
+
+  switch (mv_mode)
+  {
+  case 0:   // P_Skip, direct blocks are predicted 4x4 block-wise
+    if (pred_dir == 2 || b8 != 0)
+      return 0;
+    *width = *height = MB_BLOCK_SIZE;
+    break;
+  case 1:
+    if (b8 != 0)
+      return 0;
+    *width = *height = MB_BLOCK_SIZE;
+    break;
+  case 2:
+    if (b8 & 1)
+      return 0;
+    *width = MB_BLOCK_SIZE; *height = 2*BLOCK_SIZE;
+    break;
+  case 3:
+    if (b8 & 2)
+      return 0;
+    *width = 2*BLOCK_SIZE; *height = MB_BLOCK_SIZE;
+    break;
+  case 4:
+    *width = *height = 2*BLOCK_SIZE;
+    break;
+  default:
+    return 0;
+  }
+
+  for (l = LIST_0; l <= LIST_1; l++)
+  {
+    if (pred_dir != 2 && pred_dir != l)
+      continue;
+    if (dec_picture->ref_idx[l][i4][j4] < 0)
+      return 0;
+    for (y = 0; y < *height/BLOCK_SIZE; y++)
+      for (x = 0; x < *width/BLOCK_SIZE; x++)
+      {
+        if (dec_picture->ref_idx[l][i4+x][j4+y] != dec_picture->ref_idx[l][i4][j4] ||
+            dec_picture->mv[l][i4+x][j4+y][0]   != dec_picture->mv[l][i4][j4][0]   ||
+            dec_picture->mv[l][i4+x][j4+y][1]   != dec_picture->mv[l][i4][j4][1])
+          return 0;
+      }
+  }
+  return 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Predicts the partition of width x height luma samples that starts
+ *    with the 8x8 block b8 for all its lists into mc_luma_pred and
+ *    mc_chroma_pred, and marks the covered 8x8 blocks in luma_ok and
+ *    chroma_ok. Chroma is left to the sample-wise code if a reference
+ *    does not cover the clipped positions.
+ ************************************************************************
+ */
+static void mc_partition_prediction(struct img_par *img, Macroblock *currMB, int b8, int width, int height,
+                                    int list_offset, int curr_mb_field, int max_y_cr, int luma_ok[4], int chroma_ok[4])
+{
+  int pred_dir = currMB->b8pdir[b8];
+  int ioff = 8*(b8&1);
+  int joff = 8*(b8>>1);
+  int i4 = img->block_x + ioff/BLOCK_SIZE;
+  int j4 = img->block_y + joff/BLOCK_SIZE;
+  int c_ok = 1;
+  int l, uv, ref_idx, vec_x, vec_y, c_x, c_y, b;
+  StorablePicture **list;
+
+  for (l = LIST_0; l <= LIST_1; l++)
+  {
+    if (pred_dir != 2 && pred_dir != l)
+      continue;
+
+    ref_idx = dec_picture->ref_idx[l][i4][j4];
+    list    = listX[l+list_offset];
+
+    vec_x = i4*BLOCK_SIZE*4 + dec_picture->mv[l][i4][j4][0];
+    c_x   = (img->pix_c_x + ioff/2)*8 + dec_picture->mv[l][i4][j4][0];
+    if (!curr_mb_field)
+    {
+      vec_y = j4*BLOCK_SIZE*4 + dec_picture->mv[l][i4][j4][1];
+      c_y   = (img->pix_c_y + joff/2)*8 + dec_picture->mv[l][i4][j4][1];
+    }
+    else if (img->current_mb_nr%2 == 0)
+    {
+      vec_y = (img->block_y*2 + joff)*4 + dec_picture->mv[l][i4][j4][1];
+      c_y   = (img->pix_c_y)/2*8 + (joff/2)*8 + dec_picture->mv[l][i4][j4][1];
+    }
+    else
+    {
+      vec_y = ((img->block_y-4)*2 + joff)*4 + dec_picture->mv[l][i4][j4][1];
+      c_y   = (img->pix_c_y-8)/2*8 + (joff/2)*8 + dec_picture->mv[l][i4][j4][1];
+    }
+    c_y += img->chroma_vector_adjustment[l+list_offset][ref_idx];
+
+    get_block_partition (ref_idx, list, vec_x, vec_y, width, height, img,
+                         &mc_luma_pred[l][joff][ioff], MB_BLOCK_SIZE);
+
+    if (list[ref_idx]->size_x_cr != img->width_cr || list[ref_idx]->size_y_cr != max_y_cr+1)
+      c_ok = 0;
+    for (uv = 0; uv < 2 && c_ok; uv++)
+      c_ok = mc_chroma_block (list[ref_idx], uv, c_x, c_y, width/2, height/2,
+                              &mc_chroma_pred[l][uv][joff/2][ioff/2], MB_BLOCK_SIZE/2);
+  }
+
+  for (b = 0; b < 4; b++)
+  {
+    if (8*(b&1) >= ioff && 8*(b&1) < ioff+width && 8*(b>>1) >= joff && 8*(b>>1) < joff+height)
+    {
+      luma_ok[b]   = 1;
+      chroma_ok[b] = c_ok;
+    }
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Copies the 4x4 block at (ioff,joff) of a partition prediction
+ ************************************************************************
+ */
+static void mc_copy_block(byte pred[MB_BLOCK_SIZE][MB_BLOCK_SIZE], int ioff, int joff, int block[BLOCK_SIZE][BLOCK_SIZE])
+{
+  int ii, jj;
+
+  for (jj = 0; jj < BLOCK_SIZE; jj++)
+    for (ii = 0; ii < BLOCK_SIZE; ii++)
+      block[ii][jj] = pred[joff+jj][ioff+ii];
+}
+
 /*!
  ************************************************************************
  * \brief
@@ -3095,7 +3252,7 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
 {
   int tmp_block[BLOCK_SIZE][BLOCK_SIZE];
   int tmp_blockbw[BLOCK_SIZE][BLOCK_SIZE];
-  int i=0,j=0,k,l,ii=0,jj=0,i1=0,j1=0,j4=0,i4=0;
+  int i=0,j=0,k,ii=0,jj=0,i1=0,j1=0,j4=0,i4=0;
   int uv, hv;
   int vec1_x=0,vec1_y=0,vec2_x=0,vec2_y=0;
   int ioff,joff;
@@ -3130,6 +3287,9 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
   int direct_pdir=-1;
 
   int curr_mb_field = ((img->MbaffFrameFlag)&&(currMB->mb_field));
+  int part_w, part_h;
+  int mc_luma_ok[4]   = {0, 0, 0, 0};
+  int mc_chroma_ok[4] = {0, 0, 0, 0};
   
   byte **     moving_block;
   int ****     co_located_mv;
@@ -3178,48 +3338,6 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
 
 
 
-  if (!img->MbaffFrameFlag)
-  {
-    for (l=0+list_offset;l<(2+list_offset);l++)
-    {
-      for(k = 0; k < listXsize[l]; k++)
-      {
-        listX[l][k]->chroma_vector_adjustment= 0;
-        if(img->structure == TOP_FIELD && img->structure != listX[l][k]->structure)
-          listX[l][k]->chroma_vector_adjustment = -2;
-        if(img->structure == BOTTOM_FIELD && img->structure != listX[l][k]->structure)
-          listX[l][k]->chroma_vector_adjustment = 2;
-      }
-    }
-  }
-  else
-  {
-    if (curr_mb_field)
-    {
-      for (l=0+list_offset;l<(2+list_offset);l++)
-      {
-        for(k = 0; k < listXsize[l]; k++)
-        {
-          listX[l][k]->chroma_vector_adjustment= 0;
-          if(img->current_mb_nr % 2 == 0 && listX[l][k]->structure == BOTTOM_FIELD)
-            listX[l][k]->chroma_vector_adjustment = -2;
-          if(img->current_mb_nr % 2 == 1 && listX[l][k]->structure == TOP_FIELD)
-            listX[l][k]->chroma_vector_adjustment = 2;
-        }
-      }
-    }
-    else
-    {
-      for (l=0+list_offset;l<(2+list_offset);l++)
-      {
-        for(k = 0; k < listXsize[l]; k++)
-        {
-          listX[l][k]->chroma_vector_adjustment= 0;
-        }
-      }
-    }
-  }
-
   mv_mul=4;
   f1=8;
   f2=7;
@@ -3365,6 +3483,10 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
 
   for (block8x8=0; block8x8<4; block8x8++)
   {
+    // partitions of 8x8 and more samples are predicted at once
+    if (!IS_INTRA (currMB) && mc_partition_size (img, currMB, block8x8, &part_w, &part_h))
+      mc_partition_prediction (img, currMB, block8x8, part_w, part_h, list_offset, curr_mb_field, max_y_cr, mc_luma_ok, mc_chroma_ok);
+
     for (k = block8x8*4; k < block8x8*4+4; k ++)
     {
       i = (decode_block_scan[k] & 3);
@@ -3410,7 +3532,10 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
               vec1_y = ((img->block_y-4) * 2 + joff)* mv_mul + mv_array[i4][j4][1];
           }
 
-          get_block (ref_idx, list, vec1_x, vec1_y, img, tmp_block);
+          if (mc_luma_ok[block8x8])
+            mc_copy_block (mc_luma_pred[pred_dir], ioff, joff, tmp_block);
+          else
+            get_block (ref_idx, list, vec1_x, vec1_y, img, tmp_block);
 
           if (img->apply_weights)
           {
@@ -3673,8 +3798,16 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
               }
             }
             
-            get_block(fw_refframe, listX[0+list_offset], vec1_x, vec1_y, img, tmp_block);
-            get_block(bw_refframe, listX[1+list_offset], vec2_x, vec2_y, img, tmp_blockbw);
+            if (mc_luma_ok[block8x8])
+            {
+              mc_copy_block (mc_luma_pred[LIST_0], ioff, joff, tmp_block);
+              mc_copy_block (mc_luma_pred[LIST_1], ioff, joff, tmp_blockbw);
+            }
+            else
+            {
+              get_block(fw_refframe, listX[0+list_offset], vec1_x, vec1_y, img, tmp_block);
+              get_block(bw_refframe, listX[1+list_offset], vec2_x, vec2_y, img, tmp_blockbw);
+            }
           }
           
           if (mv_mode==0 && img->direct_type && direct_pdir==0)
@@ -3812,36 +3945,44 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
                 
                 fw_refframe = ref_idx   = dec_picture->ref_idx[LIST_0+pred_dir][if1][jf];
                 
-                i1=(img->pix_c_x+ii+ioff)*f1+mv_array[if1][jf][0];
-
-                if (!curr_mb_field)
-                  j1=(img->pix_c_y+jj+joff)*f1+mv_array[if1][jf][1];
-                else
+                if (mc_chroma_ok[2*(j-4)+i])
                 {
-                  if (mb_nr%2 == 0) 
-                    j1=(img->pix_c_y)/2*f1 + (jj+joff)*f1+mv_array[if1][jf][1];
-                  else
-                    j1=(img->pix_c_y-8)/2*f1 + (jj+joff)*f1 +mv_array[if1][jf][1];
+                  pred = mc_chroma_pred[pred_dir][uv][jj+joff][ii+ioff];
                 }
-                
-                j1 += list[ref_idx]->chroma_vector_adjustment;
-                
-                ii0=max (0, min (i1>>3, img->width_cr-1));
-                jj0=max (0, min (j1>>3, max_y_cr));
-                ii1=max (0, min ((i1>>3)+1, img->width_cr-1));
-                jj1=max (0, min ((j1>>3)+1, max_y_cr));
-                
-                if1=(i1 & f2);
-                jf1=(j1 & f2);
-                if0=f1-if1;
-                jf0=f1-jf1;
-                
-                if (img->apply_weights)
+                else
                 {
+                  i1=(img->pix_c_x+ii+ioff)*f1+mv_array[if1][jf][0];
+
+                  if (!curr_mb_field)
+                    j1=(img->pix_c_y+jj+joff)*f1+mv_array[if1][jf][1];
+                  else
+                  {
+                    if (mb_nr%2 == 0) 
+                      j1=(img->pix_c_y)/2*f1 + (jj+joff)*f1+mv_array[if1][jf][1];
+                    else
+                      j1=(img->pix_c_y-8)/2*f1 + (jj+joff)*f1 +mv_array[if1][jf][1];
+                  }
+                  
+                  j1 += img->chroma_vector_adjustment[list_offset+pred_dir][ref_idx];
+                  
+                  ii0=max (0, min (i1>>3, img->width_cr-1));
+                  jj0=max (0, min (j1>>3, max_y_cr));
+                  ii1=max (0, min ((i1>>3)+1, img->width_cr-1));
+                  jj1=max (0, min ((j1>>3)+1, max_y_cr));
+                  
+                  if1=(i1 & f2);
+                  jf1=(j1 & f2);
+                  if0=f1-if1;
+                  jf0=f1-jf1;
+                  
                   pred = (if0*jf0*list[ref_idx]->imgUV[uv][jj0][ii0]+
                           if1*jf0*list[ref_idx]->imgUV[uv][jj0][ii1]+
                           if0*jf1*list[ref_idx]->imgUV[uv][jj1][ii0]+
                           if1*jf1*list[ref_idx]->imgUV[uv][jj1][ii1]+f4)>>6;
+                }
+                
+                if (img->apply_weights)
+                {
                   if (((active_pps->weighted_pred_flag&&(img->type==P_SLICE|| img->type == SP_SLICE))||
                     (active_pps->weighted_bipred_idc==1 && (img->type==B_SLICE))) && curr_mb_field)
                   {
@@ -3852,10 +3993,7 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
                 }
                 else
                 {
-                  img->mpr[ii+ioff][jj+joff]=(if0*jf0*list[ref_idx]->imgUV[uv][jj0][ii0]+
-                                              if1*jf0*list[ref_idx]->imgUV[uv][jj0][ii1]+
-                                              if0*jf1*list[ref_idx]->imgUV[uv][jj1][ii0]+
-                                              if1*jf1*list[ref_idx]->imgUV[uv][jj1][ii1]+f4)>>6;
+                  img->mpr[ii+ioff][jj+joff]=pred;
                 }
               }
             }
@@ -3941,7 +4079,7 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
                         j1=(img->pix_c_y-8)/2*f1 + (jj+joff)*f1 +fw_mv_array[ifx][jf][1];
                     }
                 
-                    j1 += listX[0+list_offset][fw_refframe]->chroma_vector_adjustment;
+                    j1 += img->chroma_vector_adjustment[0+list_offset][fw_refframe];
                     
                     ii0=max (0, min (i1>>3, img->width_cr-1));
                     jj0=max (0, min (j1>>3, max_y_cr));
@@ -3973,7 +4111,7 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
                       else
                         j1=(img->pix_c_y-8)/2*f1 + (jj+joff)*f1 +bw_mv_array[ifx][jf][1];
                     }
-                    j1 += listX[1+list_offset][bw_refframe]->chroma_vector_adjustment;
+                    j1 += img->chroma_vector_adjustment[1+list_offset][bw_refframe];
                     
                     ii0=max (0, min (i1>>3, img->width_cr-1));
                     jj0=max (0, min (j1>>3, max_y_cr));
@@ -3992,6 +4130,11 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
                   }
 
                 }
+                else if (mc_chroma_ok[2*(j-4)+i])
+                {
+                  fw_pred = mc_chroma_pred[LIST_0][uv][jj+joff][ii+ioff];
+                  bw_pred = mc_chroma_pred[LIST_1][uv][jj+joff][ii+ioff];
+                }
                 else
                 {
                   i1=(img->pix_c_x+ii+ioff)*f1+fw_mv_array[ifx][jf][0];
@@ -4008,7 +4151,7 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
                       j1=(img->pix_c_y-8)/2*f1 + (jj+joff)*f1 +fw_mv_array[ifx][jf][1];
                   }
 
-                  j1 += listX[0+list_offset][fw_refframe]->chroma_vector_adjustment;
+                  j1 += img->chroma_vector_adjustment[0+list_offset][fw_refframe];
                   
                   ii0=max (0, min (i1>>3, img->width_cr-1));
                   jj0=max (0, min (j1>>3, max_y_cr));
@@ -4039,7 +4182,7 @@ int decode_one_macroblock(struct img_par *img,struct inp_par *inp)
                       j1=(img->pix_c_y-8)/2*f1 + (jj+joff)*f1 +bw_mv_array[ifx][jf][1];
                   }
 
-                  j1 += listX[1+list_offset][bw_refframe]->chroma_vector_adjustment;
+                  j1 += img->chroma_vector_adjustment[1+list_offset][bw_refframe];
 
                   ii0=max (0, min (i1>>3, img->width_cr-1));
                   jj0=max (0, min (j1>>3, max_y_cr));
@@ -32,8 +32,12 @@
 
 #include "global.h"
 #include "mbuffer.h"
+#include "mb_access.h"
 
-extern StorablePicture *dec_picture;
+extern THREAD_LOCAL StorablePicture *dec_picture;
+
+//! signals to the neighbour logic that this is a deblocker call (set per thread)
+THREAD_LOCAL int DeblockCall = 0;
 
 /*!
  ************************************************************************
@@ -47,7 +51,7 @@ int mb_is_available(int mbAddr, int currMbAddr)
     return 0;
 
   // the following line checks both: slice number and if the mb has been decoded
-  if (!img->DeblockCall)
+  if (!DeblockCall)
   {
     if (img->mb_data[mbAddr].slice_nr != img->mb_data[currMbAddr].slice_nr)
       return 0;
@@ -61,12 +65,11 @@ int mb_is_available(int mbAddr, int currMbAddr)
  ************************************************************************
  * \brief
  *    Checks the availability of neighboring macroblocks of
- *    the current macroblock for prediction and context determination;
+ *    the macroblock mb_nr for prediction and context determination;
  ************************************************************************
  */
-void CheckAvailabilityOfNeighbors()
+void CheckAvailabilityOfNeighbors(int mb_nr)
 {
-  const int mb_nr = img->current_mb_nr;
   Macroblock *currMB = &img->mb_data[mb_nr];
 
   // mark all neighbors as unavailable
@@ -196,7 +199,7 @@ void getNonAffNeighbour(unsigned int curr_mb_nr, int xN, int yN, int luma, Pixel
   {
     pix->available = 0;
   }
-  if (pix->available || img->DeblockCall)
+  if (pix->available || DeblockCall)
   {
     pix->x = (xN + maxWH) % maxWH;
     pix->y = (yN + maxWH) % maxWH;
@@ -451,7 +454,7 @@ void getAffNeighbour(unsigned int curr_mb_nr, int xN, int yN, int luma, PixelPos
             // then the neighbor is the top MB of the pair
             if (currMb->mbAvailB)
             {
-              if (!(img->DeblockCall == 1 && (img->mb_data[currMb->mbAddrB]).mb_field))
+              if (!(DeblockCall == 1 && (img->mb_data[currMb->mbAddrB]).mb_field))
                 pix->mb_addr  += 1;
             }
 
@@ -500,7 +503,7 @@ void getAffNeighbour(unsigned int curr_mb_nr, int xN, int yN, int luma, PixelPos
       {
         // yN >=0
         // for the deblocker if this is the extra edge then do this special stuff
-        if (yN == 0 && img->DeblockCall == 2)
+        if (yN == 0 && DeblockCall == 2)
         {
           pix->mb_addr  = currMb->mbAddrB + 1;
           pix->available = 1;
@@ -568,7 +571,7 @@ void getAffNeighbour(unsigned int curr_mb_nr, int xN, int yN, int luma, PixelPos
       }
     }
   }
-  if (pix->available || img->DeblockCall)
+  if (pix->available || DeblockCall)
   {
     pix->x = (xN + maxWH) % maxWH;
     pix->y = (yM + maxWH) % maxWH;
@@ -43,8 +43,11 @@
 #include "output.h"
 #include "image.h"
 #include "header.h"
+#include "mc_prediction.h"
 
 static void insert_picture_in_dpb(FrameStore* fs, StorablePicture* p);
+static void clear_storable_picture(StorablePicture* s);
+static void free_picture_memory(StorablePicture* p);
 static void output_one_frame_from_dpb();
 static int  is_used_for_reference(FrameStore* fs);
 static void get_smallest_poc(int *poc,int * pos);
@@ -55,16 +58,33 @@ void gen_field_ref_ids(StorablePicture *p);
 
 DecodedPictureBuffer dpb;
 
-StorablePicture **listX[6];
+THREAD_LOCAL StorablePicture **listX[6];          //!< per thread, the slice decoding threads use copies
 
-ColocatedParams *Co_located = NULL;
+THREAD_LOCAL ColocatedParams *Co_located = NULL;
 
-extern StorablePicture *dec_picture;
+extern THREAD_LOCAL StorablePicture *dec_picture;
 
-int listXsize[6];
+THREAD_LOCAL int listXsize[6];
 
 #define MAX_LIST_SIZE 33
 
+//! initial reference lists of the current picture for the I, P and B slices (init_lists),
+//! valid for the picture they were built for until the dpb changes
+static struct
+{
+  int              valid;                              //!< bit n: set n holds the lists
+  PictureStructure structure;
+  unsigned         frame_num;
+  int              poc, framepoc;
+  int              size[3][2];
+  StorablePicture *list[3][2][MAX_LIST_SIZE];
+} list_cache;
+
+static StorablePicture *pic_pool      = NULL;  //!< released pictures kept for reuse, linked by pool_next
+static int              pic_pool_size = 0;
+int pic_pool_hits   = 0;                       //!< pictures taken from the pool
+int pic_pool_misses = 0;                       //!< pictures that had to be allocated
+
 /*!
  ************************************************************************
  * \brief
@@ -179,11 +199,15 @@ int getDpbSize()
 void init_dpb()
 {
   unsigned i,j;
+  list_cache.valid = 0;
 
+  finish_pending_picture();
   if (dpb.init_done)
   {
     free_dpb();
   }
+  // the picture size may change with the new sequence parameter set
+  flush_picture_pool();
 
   dpb.size      = getDpbSize();
   dpb.num_ref_frames = active_sps->num_ref_frames;
@@ -269,6 +293,7 @@ void free_dpb()
     free (dpb.fs_ltref);
   }
   dpb.last_output_poc = INT_MIN;
+  list_cache.valid = 0;
 
   for (i=0; i<6; i++)
     if (listX[i])
@@ -330,40 +355,63 @@ FrameStore* alloc_frame_store()
  *
  * \return
  *    the allocated StorablePicture structure
+ *
+ * \note
+ *    A released picture of the same size is taken from the picture pool
+ *    if there is one. It is cleared, so it looks like a newly allocated one.
  ************************************************************************
  */
 StorablePicture* alloc_storable_picture(PictureStructure structure, int size_x, int size_y, int size_x_cr, int size_y_cr)
 {
-  StorablePicture *s;
+  StorablePicture *s, **pp;
 
   //printf ("Allocating (%s) picture (x=%d, y=%d, x_cr=%d, y_cr=%d)\n", (type == FRAME)?"FRAME":(type == TOP_FIELD)?"TOP_FIELD":"BOTTOM_FIELD", size_x, size_y, size_x_cr, size_y_cr);
 
-  s = calloc (1, sizeof(StorablePicture));
-  if (NULL==s) 
-    no_mem_exit("alloc_storable_picture: s");
-
   if (structure!=FRAME)
   {
     size_y    /= 2;
     size_y_cr /= 2; 
   }
 
-  s->PicSizeInMbs                  = (size_x*size_y)/256;
+  for (pp = &pic_pool; *pp; pp = &(*pp)->pool_next)
+  {
+    s = *pp;
+    if (s->size_x == size_x && s->size_y == size_y && s->size_x_cr == size_x_cr && s->size_y_cr == size_y_cr)
+      break;
+  }
+
+  if (*pp)
+  {
+    *pp = s->pool_next;
+    pic_pool_size--;
+    pic_pool_hits++;
+    clear_storable_picture (s);
+  }
+  else
+  {
+    pic_pool_misses++;
 
-  get_mem2D (&(s->imgY), size_y, size_x);
-  get_mem3D (&(s->imgUV), 2, size_y_cr, size_x_cr );
+    s = calloc (1, sizeof(StorablePicture));
+    if (NULL==s) 
+      no_mem_exit("alloc_storable_picture: s");
 
-  s->mb_field = calloc (s->PicSizeInMbs, sizeof(int));
+    get_mem2D (&(s->imgY), size_y, size_x);
+    get_mem3D (&(s->imgUV), 2, size_y_cr, size_x_cr );
 
-  get_mem2Dint (&(s->slice_id), size_x / MB_BLOCK_SIZE, size_y / MB_BLOCK_SIZE);
+    s->mb_field = calloc ((size_x*size_y)/256, sizeof(int));
 
-  get_mem3Dint (&(s->ref_idx), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem3Dint64 (&(s->ref_pic_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem3Dint64 (&(s->ref_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem4Dint (&(s->mv), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE,2 );
+    get_mem2Dint (&(s->slice_id), size_x / MB_BLOCK_SIZE, size_y / MB_BLOCK_SIZE);
 
-  get_mem2D (&(s->moving_block), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem2D (&(s->field_frame), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem3Dint (&(s->ref_idx), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem3Dint64 (&(s->ref_pic_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem3Dint64 (&(s->ref_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem4Dint (&(s->mv), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE,2 );
+
+    get_mem2D (&(s->moving_block), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem2D (&(s->field_frame), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+  }
+
+  s->PicSizeInMbs                  = (size_x*size_y)/256;
 
   s->pic_num=0;
   s->frame_num=0;
@@ -435,46 +483,132 @@ void free_frame_store(FrameStore* f)
  * \param p
  *    Picture to be freed
  *
+ * \note
+ *    The picture is kept in the picture pool for reuse by
+ *    alloc_storable_picture() unless the pool is full.
  ************************************************************************
  */
 void free_storable_picture(StorablePicture* p)
 {
   if (p)
   {
-    free_mem2Dint   (p->slice_id);
-    free_mem3Dint   (p->ref_idx, 2);
-    free_mem3Dint64 (p->ref_pic_id, 6);
-    free_mem3Dint64 (p->ref_id, 6);
-    free_mem4Dint   (p->mv, 2, p->size_x / BLOCK_SIZE);
-
-    if (p->moving_block)
+    if (pic_pool_size < PIC_POOL_SIZE)
     {
-      free_mem2D (p->moving_block);
-      p->moving_block=NULL;
+      p->pool_next = pic_pool;
+      pic_pool     = p;
+      pic_pool_size++;
     }
+    else
+      free_picture_memory (p);
+  }
+}
 
-    if (p->field_frame)
-    {
-      free_mem2D (p->field_frame);
-      p->field_frame=NULL;
-    }
+/*!
+ ************************************************************************
+ * \brief
+ *    Free all pictures of the picture pool.
+ ************************************************************************
+ */
+void flush_picture_pool()
+{
+  StorablePicture *p;
 
-    
-    if (p->imgY)
-    {
-      free_mem2D (p->imgY);
-      p->imgY=NULL;
-    }
-    if (p->imgUV)
-    {
-      free_mem3D (p->imgUV, 2);
-      p->imgUV=NULL;
-    }
-    
-    free(p->mb_field);
+  while (pic_pool)
+  {
+    p        = pic_pool;
+    pic_pool = p->pool_next;
+    free_picture_memory (p);
+  }
+  pic_pool_size = 0;
+}
 
-    free(p);
+/*!
+ ************************************************************************
+ * \brief
+ *    Clear a picture taken from the picture pool: all fields and
+ *    sample / motion arrays are set to zero as after calloc(), the
+ *    arrays and the padded planes stay allocated.
+ ************************************************************************
+ */
+static void clear_storable_picture(StorablePicture* s)
+{
+  StorablePicture keep = *s;
+  int bx = s->size_x / BLOCK_SIZE;
+  int by = s->size_y / BLOCK_SIZE;
+
+  memset (s->imgY[0],         0, s->size_y * s->size_x);
+  memset (s->imgUV[0][0],     0, 2 * s->size_y_cr * s->size_x_cr);
+  memset (s->mb_field,        0, s->PicSizeInMbs * sizeof(int));
+  memset (s->slice_id[0],     0, (s->size_x / MB_BLOCK_SIZE) * (s->size_y / MB_BLOCK_SIZE) * sizeof(int));
+  memset (s->ref_idx[0][0],   0, 2 * bx * by * sizeof(int));
+  memset (s->ref_pic_id[0][0],0, 6 * bx * by * sizeof(int64));
+  memset (s->ref_id[0][0],    0, 6 * bx * by * sizeof(int64));
+  memset (s->mv[0][0][0],     0, 2 * bx * by * 2 * sizeof(int));
+  memset (s->moving_block[0], 0, bx * by);
+  memset (s->field_frame[0],  0, bx * by);
+
+  memset (s, 0, sizeof(StorablePicture));
+  s->size_x       = keep.size_x;
+  s->size_y       = keep.size_y;
+  s->size_x_cr    = keep.size_x_cr;
+  s->size_y_cr    = keep.size_y_cr;
+  s->imgY         = keep.imgY;
+  s->imgUV        = keep.imgUV;
+  s->imgY_pad     = keep.imgY_pad;
+  s->imgUV_pad[0] = keep.imgUV_pad[0];
+  s->imgUV_pad[1] = keep.imgUV_pad[1];
+  s->mb_field     = keep.mb_field;
+  s->slice_id     = keep.slice_id;
+  s->ref_idx      = keep.ref_idx;
+  s->ref_pic_id   = keep.ref_pic_id;
+  s->ref_id       = keep.ref_id;
+  s->mv           = keep.mv;
+  s->moving_block = keep.moving_block;
+  s->field_frame  = keep.field_frame;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Free the memory of a picture.
+ ************************************************************************
+ */
+static void free_picture_memory(StorablePicture* p)
+{
+  free_mem2Dint   (p->slice_id);
+  free_mem3Dint   (p->ref_idx, 2);
+  free_mem3Dint64 (p->ref_pic_id, 6);
+  free_mem3Dint64 (p->ref_id, 6);
+  free_mem4Dint   (p->mv, 2, p->size_x / BLOCK_SIZE);
+
+  if (p->moving_block)
+  {
+    free_mem2D (p->moving_block);
+    p->moving_block=NULL;
+  }
+
+  if (p->field_frame)
+  {
+    free_mem2D (p->field_frame);
+    p->field_frame=NULL;
+  }
+
+  
+  if (p->imgY)
+  {
+    free_mem2D (p->imgY);
+    p->imgY=NULL;
+  }
+  if (p->imgUV)
+  {
+    free_mem3D (p->imgUV, 2);
+    p->imgUV=NULL;
   }
+  free_padded_planes (p);
+  
+  free(p->mb_field);
+
+  free(p);
 }
 
 /*!
@@ -802,11 +936,12 @@ static void gen_pic_list_from_frame_list(PictureStructure currStrcture, FrameSto
 /*!
  ************************************************************************
  * \brief
- *    Initialize listX[0] and list 1 depending on current picture type
+ *    Generates the initial reference picture lists of the current slice
+ *    type in listX[0] and listX[1], not limited to the active sizes
  *
  ************************************************************************
  */
-void init_lists(int currSliceType, PictureStructure currPicStructure)
+static void build_lists(int currSliceType, PictureStructure currPicStructure)
 {
   int add_top = 0, add_bottom = 0;
   unsigned i;
@@ -1145,6 +1280,49 @@ void init_lists(int currSliceType, PictureStructure currPicStructure)
       listX[1][1]=tmp_s;
     }
   }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Initialize listX[0] and list 1 depending on current picture type
+ *
+ ************************************************************************
+ */
+void init_lists(int currSliceType, PictureStructure currPicStructure)
+{
+  int i;
+  int set = ((currSliceType == I_SLICE)||(currSliceType == SI_SLICE)) ? 0 : (currSliceType == B_SLICE) ? 2 : 1;
+
+  // the lists only change with the picture and the contents of the dpb
+  if (!list_cache.valid || list_cache.structure != currPicStructure || list_cache.frame_num != img->frame_num
+    || list_cache.poc != img->ThisPOC || list_cache.framepoc != img->framepoc)
+  {
+    list_cache.valid     = 0;
+    list_cache.structure = currPicStructure;
+    list_cache.frame_num = img->frame_num;
+    list_cache.poc       = img->ThisPOC;
+    list_cache.framepoc  = img->framepoc;
+  }
+
+  if (list_cache.valid & (1 << set))
+  {
+    listXsize[0] = list_cache.size[set][0];
+    listXsize[1] = list_cache.size[set][1];
+    memcpy (listX[0], list_cache.list[set][0], listXsize[0] * sizeof (StorablePicture*));
+    memcpy (listX[1], list_cache.list[set][1], listXsize[1] * sizeof (StorablePicture*));
+  }
+  else
+  {
+    build_lists(currSliceType, currPicStructure);
+    list_cache.size[set][0] = listXsize[0];
+    list_cache.size[set][1] = listXsize[1];
+    memcpy (list_cache.list[set][0], listX[0], listXsize[0] * sizeof (StorablePicture*));
+    memcpy (list_cache.list[set][1], listX[1], listXsize[1] * sizeof (StorablePicture*));
+    list_cache.valid |= 1 << set;
+  }
+
   // set max size
   listXsize[0] = min (listXsize[0], img->num_ref_idx_l0_active);
   listXsize[1] = min (listXsize[1], img->num_ref_idx_l1_active);
@@ -1203,6 +1381,48 @@ void init_mbaff_lists()
   }
   listXsize[3]=listXsize[5]=listXsize[1] * 2;
 }
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets the chroma vector offsets of the references of the other
+ *    field parity for the final lists of the current slice. Called on
+ *    the main thread, the slice threads only read them.
+ *
+ ************************************************************************
+ */
+void set_chroma_vector_adjustment()
+{
+  int l, k;
+
+  for (l=0; l<2; l++)
+  {
+    for (k=0; k<listXsize[l]; k++)
+    {
+      img->chroma_vector_adjustment[l][k] = 0;
+      if(img->structure == TOP_FIELD && img->structure != listX[l][k]->structure)
+        img->chroma_vector_adjustment[l][k] = -2;
+      if(img->structure == BOTTOM_FIELD && img->structure != listX[l][k]->structure)
+        img->chroma_vector_adjustment[l][k] = 2;
+    }
+  }
+
+  if (!img->MbaffFrameFlag)
+    return;
+
+  // field MBs of an MB AFF frame: top MBs use lists 2 and 3, bottom MBs lists 4 and 5
+  for (l=2; l<6; l++)
+  {
+    for (k=0; k<listXsize[l]; k++)
+    {
+      img->chroma_vector_adjustment[l][k] = 0;
+      if(l < 4 && listX[l][k]->structure == BOTTOM_FIELD)
+        img->chroma_vector_adjustment[l][k] = -2;
+      if(l >= 4 && listX[l][k]->structure == TOP_FIELD)
+        img->chroma_vector_adjustment[l][k] = 2;
+    }
+  }
+}
  
  /*!
  ************************************************************************
@@ -2118,6 +2338,10 @@ void store_picture_in_dpb(StorablePicture* p)
   //printf ("Storing (%s) non-ref pic with frame_num #%d\n", (p->type == FRAME)?"FRAME":(p->type == TOP_FIELD)?"TOP_FIELD":"BOTTOM_FIELD", p->pic_num);
   // if frame, check for new store, 
   assert (p!=NULL);
+  list_cache.valid = 0;
+
+  // a picture pending on the frame pipeline was decoded before p
+  finish_pending_picture();
 
   img->last_has_mmco_5=0;
   img->last_pic_bottom_field = (p->structure==BOTTOM_FIELD);
@@ -2303,6 +2527,17 @@ static void insert_picture_in_dpb(FrameStore* fs, StorablePicture* p)
   fs->frame_num = p->pic_num;
   fs->is_output = p->is_output;
 
+  // reference pictures are padded once for the motion compensation
+  if (fs->frame && fs->frame->used_for_reference && !fs->frame->padded)
+    pad_reference_picture (fs->frame);
+  if (!active_sps->frame_mbs_only_flag)
+  {
+    if (fs->top_field && fs->top_field->used_for_reference && !fs->top_field->padded)
+      pad_reference_picture (fs->top_field);
+    if (fs->bottom_field && fs->bottom_field->used_for_reference && !fs->bottom_field->padded)
+      pad_reference_picture (fs->bottom_field);
+  }
+
   if (fs->is_used==3)
   {
     if (p_ref)
@@ -2574,6 +2809,9 @@ static void output_one_frame_from_dpb()
 void flush_dpb()
 {
   unsigned i;
+  list_cache.valid = 0;
+
+  finish_pending_picture();
 
   //diagnostics
 //  printf("Flush remaining frames from dpb. dpb.size=%d, dpb.used_size=%d\n",dpb.size,dpb.used_size);
@@ -0,0 +1,484 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ *************************************************************************************
+ * \file mc_prediction.c
+ *
+ * \brief
+ *    Motion compensated prediction from padded reference planes.
+ *
+ *    Every reference picture gets a copy of its planes with a border of
+ *    MC_PAD_LUMA / MC_PAD_CHROMA replicated edge samples when it is
+ *    stored in the DPB. Blocks whose interpolation window lies inside
+ *    the padded planes are predicted without clipping the sample
+ *    positions, by kernels that work on whole partitions (up to 16x16
+ *    luma / 8x8 chroma samples). Blocks further outside the picture
+ *    return 0 and are predicted by the clipping code as before.
+ *
+ *    The kernels exist as C reference code and as SSE2 version; both
+ *    give the same samples as get_block() and the chroma loop of
+ *    decode_one_macroblock().
+ *
+ *************************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "memalloc.h"
+#include "simd.h"
+#include "mc_prediction.h"
+
+#if defined(HAVE_X86_SIMD)
+  #include <emmintrin.h>
+#endif
+
+typedef void (*MCKernel) (byte *src, int stride, int dx, int dy, int width, int height, byte *pred, int pred_stride);
+
+static MCKernel luma_kernel;
+static MCKernel chroma_kernel;
+
+//! 6 tap filter of the luma half sample positions
+#define TAP6(p, s)  ((p)[-2*(s)] - 5*(p)[-(s)] + 20*(p)[0] + 20*(p)[(s)] - 5*(p)[2*(s)] + (p)[3*(s)])
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    copies a picture plane into a padded plane and replicates the
+ *    edge samples into the border
+ ************************************************************************
+ */
+static void fill_padded_plane (byte **dst, byte **src, int size_y, int size_x, int pad)
+{
+  int width = size_x + 2*pad;
+  int y;
+
+  for (y=0; y<size_y; y++)
+  {
+    memcpy (dst[y], src[y], size_x);
+    memset (dst[y] - pad,    src[y][0],        pad);
+    memset (dst[y] + size_x, src[y][size_x-1], pad);
+  }
+  for (y=1; y<=pad; y++)
+  {
+    memcpy (dst[-y] - pad,           dst[0] - pad,        width);
+    memcpy (dst[size_y-1+y] - pad,   dst[size_y-1] - pad, width);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    fills the padded planes of a reference picture; called once when
+ *    the picture (or a field/frame generated from it) enters the DPB
+ ************************************************************************
+ */
+void pad_reference_picture (StorablePicture *p)
+{
+  int uv;
+
+  if (p->imgY_pad == NULL)
+  {
+    get_plane (&p->imgY_pad, p->size_y, p->size_x, MC_PAD_LUMA);
+    for (uv=0; uv<2; uv++)
+      get_plane (&p->imgUV_pad[uv], p->size_y_cr, p->size_x_cr, MC_PAD_CHROMA);
+  }
+
+  fill_padded_plane (p->imgY_pad, p->imgY, p->size_y, p->size_x, MC_PAD_LUMA);
+  for (uv=0; uv<2; uv++)
+    fill_padded_plane (p->imgUV_pad[uv], p->imgUV[uv], p->size_y_cr, p->size_x_cr, MC_PAD_CHROMA);
+  p->padded = 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    frees the padded planes of a picture
+ ************************************************************************
+ */
+void free_padded_planes (StorablePicture *p)
+{
+  int uv;
+
+  if (p->imgY_pad)
+  {
+    free_plane (p->imgY_pad, MC_PAD_LUMA);
+    p->imgY_pad = NULL;
+  }
+  for (uv=0; uv<2; uv++)
+  {
+    if (p->imgUV_pad[uv])
+    {
+      free_plane (p->imgUV_pad[uv], MC_PAD_CHROMA);
+      p->imgUV_pad[uv] = NULL;
+    }
+  }
+  p->padded = 0;
+}
+
+
+/*
+ *************************************************************************************
+ *  C reference kernels
+ *************************************************************************************
+ */
+
+/*!
+ ************************************************************************
+ * \brief
+ *    luma sample at the quarter sample offset (dx,dy) from p, exactly
+ *    as get_block() computes it
+ ************************************************************************
+ */
+static int luma_sample_c (byte *p, int stride, int dx, int dy)
+{
+  static const int COEF[6] = { 1, -5, 20, 20, -5, 1 };
+  int b, h, j, y;
+
+  if (dy == 0)        // no vertical interpolation
+  {
+    b = TAP6 (p, 1);
+    b = Clip1 ((b + 16) >> 5);
+    return (dx & 1) ? (b + p[dx>>1] + 1) >> 1 : b;
+  }
+  if (dx == 0)        // no horizontal interpolation
+  {
+    h = TAP6 (p, stride);
+    h = Clip1 ((h + 16) >> 5);
+    return (dy & 1) ? (h + p[(dy>>1)*stride] + 1) >> 1 : h;
+  }
+  if (dx == 2 || dy == 2)
+  {
+    for (j = 0, y = -2; y < 4; y++)
+      j += TAP6 (p + y*stride, 1) * COEF[y+2];
+    j = Clip1 ((j + 512) >> 10);
+
+    if (dx == 2 && (dy & 1))
+    {
+      b = TAP6 (p + (dy>>1)*stride, 1);
+      j = (j + Clip1 ((b + 16) >> 5) + 1) >> 1;
+    }
+    else if (dy == 2 && (dx & 1))
+    {
+      h = TAP6 (p + (dx>>1), stride);
+      j = (j + Clip1 ((h + 16) >> 5) + 1) >> 1;
+    }
+    return j;
+  }
+  // diagonal: mean of the horizontal and the vertical half sample next to it
+  b = TAP6 (p + (dy>>1)*stride, 1);
+  h = TAP6 (p + (dx>>1), stride);
+  return (Clip1 ((b + 16) >> 5) + Clip1 ((h + 16) >> 5) + 1) >> 1;
+}
+
+static void luma_c (byte *src, int stride, int dx, int dy, int width, int height, byte *pred, int pred_stride)
+{
+  int x, y;
+
+  if (dx == 0 && dy == 0)
+  {
+    for (y=0; y<height; y++, src+=stride, pred+=pred_stride)
+      memcpy (pred, src, width);
+    return;
+  }
+  for (y=0; y<height; y++, src+=stride, pred+=pred_stride)
+    for (x=0; x<width; x++)
+      pred[x] = (byte) luma_sample_c (src+x, stride, dx, dy);
+}
+
+static void chroma_c (byte *src, int stride, int dx, int dy, int width, int height, byte *pred, int pred_stride)
+{
+  int w00 = (8-dx)*(8-dy);
+  int w01 =    dx *(8-dy);
+  int w10 = (8-dx)*   dy;
+  int w11 =    dx *   dy;
+  int x, y;
+
+  for (y=0; y<height; y++, src+=stride, pred+=pred_stride)
+    for (x=0; x<width; x++)
+      pred[x] = (byte) ((w00*src[x] + w01*src[x+1] + w10*src[stride+x] + w11*src[stride+x+1] + 32) >> 6);
+}
+
+
+#if defined(HAVE_X86_SIMD)
+/*
+ *************************************************************************************
+ *  SSE2 kernels, 8 samples per step (4 sample wide blocks compute 8 and store 4)
+ *************************************************************************************
+ */
+
+//! 6 tap sums of six rows/columns of 8 samples (16 bit, unrounded)
+static __m128i tap6_sse2 (__m128i a0, __m128i a1, __m128i a2, __m128i a3, __m128i a4, __m128i a5)
+{
+  __m128i s05 = _mm_add_epi16 (a0, a5);
+  __m128i s14 = _mm_add_epi16 (a1, a4);
+  __m128i s23 = _mm_add_epi16 (a2, a3);
+
+  return _mm_add_epi16 (_mm_sub_epi16 (s05, _mm_mullo_epi16 (s14, _mm_set1_epi16 (5))),
+                        _mm_mullo_epi16 (s23, _mm_set1_epi16 (20)));
+}
+
+//! horizontal 6 tap sums of the samples p[0..7]
+static __m128i h6_sse2 (byte *p)
+{
+  __m128i zero = _mm_setzero_si128 ();
+  __m128i r    = _mm_loadu_si128 ((__m128i*) (p-2));
+
+  return tap6_sse2 (_mm_unpacklo_epi8 (r, zero),
+                    _mm_unpacklo_epi8 (_mm_srli_si128 (r, 1), zero),
+                    _mm_unpacklo_epi8 (_mm_srli_si128 (r, 2), zero),
+                    _mm_unpacklo_epi8 (_mm_srli_si128 (r, 3), zero),
+                    _mm_unpacklo_epi8 (_mm_srli_si128 (r, 4), zero),
+                    _mm_unpacklo_epi8 (_mm_srli_si128 (r, 5), zero));
+}
+
+//! vertical 6 tap sums of the samples p[0..7]
+static __m128i v6_sse2 (byte *p, int stride)
+{
+  __m128i zero = _mm_setzero_si128 ();
+
+  return tap6_sse2 (_mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p-2*stride)), zero),
+                    _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p-  stride)), zero),
+                    _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p         )), zero),
+                    _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p+  stride)), zero),
+                    _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p+2*stride)), zero),
+                    _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p+3*stride)), zero));
+}
+
+//! Clip1((sum+16)>>5) of 8 half sample sums, in the low 8 bytes
+static __m128i round5_sse2 (__m128i sum)
+{
+  sum = _mm_srai_epi16 (_mm_add_epi16 (sum, _mm_set1_epi16 (16)), 5);
+  return _mm_packus_epi16 (sum, sum);
+}
+
+//! Clip1((sum+512)>>10) of the vertical 6 tap sums over six rows of horizontal sums
+static __m128i center_sse2 (__m128i *hs)
+{
+  __m128i s05 = _mm_add_epi16 (hs[0], hs[5]);
+  __m128i s14 = _mm_add_epi16 (hs[1], hs[4]);
+  __m128i s23 = _mm_add_epi16 (hs[2], hs[3]);
+  __m128i c1m5 = _mm_set_epi16 (-5, 1, -5, 1, -5, 1, -5, 1);
+  __m128i c20  = _mm_set1_epi32 (20);
+  __m128i rnd  = _mm_set1_epi32 (512);
+  __m128i lo, hi;
+
+  lo = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (s05, s14), c1m5),
+                      _mm_madd_epi16 (_mm_unpacklo_epi16 (s23, _mm_setzero_si128 ()), c20));
+  hi = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (s05, s14), c1m5),
+                      _mm_madd_epi16 (_mm_unpackhi_epi16 (s23, _mm_setzero_si128 ()), c20));
+  lo = _mm_srai_epi32 (_mm_add_epi32 (lo, rnd), 10);
+  hi = _mm_srai_epi32 (_mm_add_epi32 (hi, rnd), 10);
+  lo = _mm_packs_epi32 (lo, hi);
+  return _mm_packus_epi16 (lo, lo);
+}
+
+//! stores 8 (or 4) samples from the low bytes of v
+static void store_sse2 (byte *pred, __m128i v, int n)
+{
+  if (n >= 8)
+    _mm_storel_epi64 ((__m128i*) pred, v);
+  else
+  {
+    int w = _mm_cvtsi128_si32 (v);
+    memcpy (pred, &w, 4);
+  }
+}
+
+static void luma_sse2 (byte *src, int stride, int dx, int dy, int width, int height, byte *pred, int pred_stride)
+{
+  __m128i hs[MB_BLOCK_SIZE+5];
+  __m128i v;
+  int x, y;
+
+  for (x=0; x<width; x+=8, src+=8, pred+=8)
+  {
+    byte *p = src;
+    byte *q = pred;
+    int   n = width - x;
+
+    if (dx == 0 && dy == 0)
+    {
+      for (y=0; y<height; y++, p+=stride, q+=pred_stride)
+        store_sse2 (q, _mm_loadl_epi64 ((__m128i*) p), n);
+    }
+    else if (dy == 0)
+    {
+      for (y=0; y<height; y++, p+=stride, q+=pred_stride)
+      {
+        v = round5_sse2 (h6_sse2 (p));
+        if (dx & 1)
+          v = _mm_avg_epu8 (v, _mm_loadl_epi64 ((__m128i*) (p + (dx>>1))));
+        store_sse2 (q, v, n);
+      }
+    }
+    else if (dx == 0)
+    {
+      for (y=0; y<height; y++, p+=stride, q+=pred_stride)
+      {
+        v = round5_sse2 (v6_sse2 (p, stride));
+        if (dy & 1)
+          v = _mm_avg_epu8 (v, _mm_loadl_epi64 ((__m128i*) (p + (dy>>1)*stride)));
+        store_sse2 (q, v, n);
+      }
+    }
+    else if (dx == 2 || dy == 2)
+    {
+      for (y=0; y<height+5; y++)
+        hs[y] = h6_sse2 (p + (y-2)*stride);
+
+      for (y=0; y<height; y++, p+=stride, q+=pred_stride)
+      {
+        v = center_sse2 (hs + y);
+        if (dx == 2 && (dy & 1))
+          v = _mm_avg_epu8 (v, round5_sse2 (hs[y + 2 + (dy>>1)]));
+        else if (dy == 2 && (dx & 1))
+          v = _mm_avg_epu8 (v, round5_sse2 (v6_sse2 (p + (dx>>1), stride)));
+        store_sse2 (q, v, n);
+      }
+    }
+    else  // diagonal
+    {
+      for (y=0; y<height; y++, p+=stride, q+=pred_stride)
+      {
+        v = _mm_avg_epu8 (round5_sse2 (h6_sse2 (p + (dy>>1)*stride)),
+                          round5_sse2 (v6_sse2 (p + (dx>>1), stride)));
+        store_sse2 (q, v, n);
+      }
+    }
+  }
+}
+
+static void chroma_sse2 (byte *src, int stride, int dx, int dy, int width, int height, byte *pred, int pred_stride)
+{
+  __m128i zero = _mm_setzero_si128 ();
+  __m128i w00  = _mm_set1_epi16 ((short) ((8-dx)*(8-dy)));
+  __m128i w01  = _mm_set1_epi16 ((short) (   dx *(8-dy)));
+  __m128i w10  = _mm_set1_epi16 ((short) ((8-dx)*   dy ));
+  __m128i w11  = _mm_set1_epi16 ((short) (   dx *   dy ));
+  __m128i rnd  = _mm_set1_epi16 (32);
+  __m128i a, b, s;
+  int x, y;
+
+  for (x=0; x<width; x+=8, src+=8, pred+=8)
+  {
+    byte *p = src;
+    byte *q = pred;
+
+    // the upper row of the next line is the lower row of this one
+    a = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*)  p),      zero);
+    b = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p + 1)), zero);
+    for (y=0; y<height; y++, q+=pred_stride)
+    {
+      s = _mm_add_epi16 (_mm_mullo_epi16 (a, w00), _mm_mullo_epi16 (b, w01));
+      p += stride;
+      a = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*)  p),      zero);
+      b = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) (p + 1)), zero);
+      s = _mm_add_epi16 (s, _mm_add_epi16 (_mm_mullo_epi16 (a, w10), _mm_mullo_epi16 (b, w11)));
+      s = _mm_srli_epi16 (_mm_add_epi16 (s, rnd), 6);
+      store_sse2 (q, _mm_packus_epi16 (s, s), width - x);
+    }
+  }
+}
+#endif
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    selects the prediction kernels
+ * \param level
+ *    requested SIMD level (SIMD_AUTO, SIMD_C ... SIMD_AVX2)
+ ************************************************************************
+ */
+void init_mc_kernels (int level)
+{
+  init_simd (level);
+
+  luma_kernel   = luma_c;
+  chroma_kernel = chroma_c;
+
+#if defined(HAVE_X86_SIMD)
+  if (simd_level >= SIMD_SSE2)
+  {
+    luma_kernel   = luma_sse2;
+    chroma_kernel = chroma_sse2;
+  }
+#endif
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    luma prediction of a width x height block (4, 8 or 16 samples)
+ *    from the padded plane of a reference picture
+ * \param x_pos, y_pos
+ *    position of the block in quarter samples
+ * \return
+ *    0 if the picture has no padded planes or the block needs samples
+ *    outside of them; the caller has to use the clipping code then
+ ************************************************************************
+ */
+int mc_luma_block (StorablePicture *ref, int x_pos, int y_pos, int width, int height, byte *pred, int pred_stride)
+{
+  int x = x_pos >> 2;
+  int y = y_pos >> 2;
+  PlaneView plane;
+
+  if (!ref->padded ||
+      x - 2 < -MC_PAD_LUMA || x + max (width, 8) + 6 > ref->size_x + MC_PAD_LUMA ||
+      y - 2 < -MC_PAD_LUMA || y + height + 3     > ref->size_y + MC_PAD_LUMA)
+    return 0;
+
+  plane = plane_view (ref->imgY_pad, ref->size_y, ref->size_x);
+  luma_kernel (plane.data + y*plane.stride + x, plane.stride, x_pos & 3, y_pos & 3, width, height, pred, pred_stride);
+  return 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    chroma prediction of a width x height block (4 or 8 samples)
+ *    from the padded plane of a reference picture
+ * \param x_pos, y_pos
+ *    position of the block in 1/8 samples, including the chroma
+ *    vector adjustment
+ * \return
+ *    0 if the picture has no padded planes or the block needs samples
+ *    outside of them; the caller has to use the clipping code then
+ ************************************************************************
+ */
+int mc_chroma_block (StorablePicture *ref, int uv, int x_pos, int y_pos, int width, int height, byte *pred, int pred_stride)
+{
+  int x = x_pos >> 3;
+  int y = y_pos >> 3;
+  PlaneView plane;
+
+  if (!ref->padded ||
+      x < -MC_PAD_CHROMA || x + max (width, 8) + 1 > ref->size_x_cr + MC_PAD_CHROMA ||
+      y < -MC_PAD_CHROMA || y + height + 1         > ref->size_y_cr + MC_PAD_CHROMA)
+    return 0;
+
+  plane = plane_view (ref->imgUV_pad[uv], ref->size_y_cr, ref->size_x_cr);
+  chroma_kernel (plane.data + y*plane.stride + x, plane.stride, x_pos & 7, y_pos & 7, width, height, pred, pred_stride);
+  return 1;
+}
@@ -0,0 +1,276 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file metrics.c
+ *
+ * \brief
+ *    Distortion metrics of reconstructed pictures: SSE, MB distortion
+ *    maps and SSIM
+ *
+ * \note
+ *    The planes are walked row by row. The squared differences of a row
+ *    are summed by compute_sse_row(), which init_metrics() sets to the
+ *    SSE2 kernel if simd_level allows it. Rows are accumulated in 64 bit,
+ *    so the SSE of a plane does not overflow at any picture size.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+
+#include "global.h"
+#include "memalloc.h"
+#include "metrics.h"
+#include "simd.h"
+
+#if defined(HAVE_X86_SIMD)
+  #include <emmintrin.h>
+#endif
+
+int (*compute_sse_row) (byte *org, byte *rec, int n);
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    SSE of n samples, C version
+ ************************************************************************
+ */
+static int sse_row_c (byte *org, byte *rec, int n)
+{
+  int i, d, sse = 0;
+
+  for (i=0; i<n; i++)
+  {
+    d    = org[i] - rec[i];
+    sse += d * d;
+  }
+  return sse;
+}
+
+
+#if defined(HAVE_X86_SIMD)
+/*!
+ ************************************************************************
+ * \brief
+ *    SSE of n samples, SSE2 version
+ ************************************************************************
+ */
+static int SIMD_TARGET("sse2") sse_row_sse2 (byte *org, byte *rec, int n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i sum = _mm_setzero_si128 ();
+  __m128i o, r, d;
+  int i = 0, e, sse;
+
+  for ( ; i+16<=n; i+=16)
+  {
+    o   = _mm_loadu_si128 ((__m128i *) &org[i]);
+    r   = _mm_loadu_si128 ((__m128i *) &rec[i]);
+    d   = _mm_sub_epi16 (_mm_unpacklo_epi8 (o, zero), _mm_unpacklo_epi8 (r, zero));
+    sum = _mm_add_epi32 (sum, _mm_madd_epi16 (d, d));
+    d   = _mm_sub_epi16 (_mm_unpackhi_epi8 (o, zero), _mm_unpackhi_epi8 (r, zero));
+    sum = _mm_add_epi32 (sum, _mm_madd_epi16 (d, d));
+  }
+  if (i+8<=n)
+  {
+    d   = _mm_sub_epi16 (_mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i *) &org[i]), zero),
+                         _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i *) &rec[i]), zero));
+    sum = _mm_add_epi32 (sum, _mm_madd_epi16 (d, d));
+    i  += 8;
+  }
+  sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, 0x4e));
+  sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, 0xb1));
+  sse = _mm_cvtsi128_si32 (sum);
+
+  for ( ; i<n; i++)
+  {
+    e    = org[i] - rec[i];
+    sse += e * e;
+  }
+  return sse;
+}
+#endif
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    selects the kernels for the SIMD level set by init_simd()
+ ************************************************************************
+ */
+void init_metrics ()
+{
+  compute_sse_row = sse_row_c;
+#if defined(HAVE_X86_SIMD)
+  if (simd_level >= SIMD_SSE2)
+    compute_sse_row = sse_row_sse2;
+#endif
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    SSE of two planes of width x height samples
+ ************************************************************************
+ */
+int64 plane_sse (byte **org, byte **rec, int width, int height)
+{
+  int64 sse = 0;
+  int   j;
+
+  for (j=0; j<height; j++)
+    sse += compute_sse_row (org[j], rec[j], width);
+  return sse;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    SSE of a width x height block in column x, starting in row org_y
+ *    of org and in row rec_y of rec
+ ************************************************************************
+ */
+int block_sse (byte **org, int org_y, byte **rec, int rec_y, int x, int width, int height)
+{
+  int j, sse = 0;
+
+  for (j=0; j<height; j++)
+    sse += compute_sse_row (&org[org_y+j][x], &rec[rec_y+j][x], width);
+  return sse;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    SSE of every mb_size x mb_size block of two planes, map[] is filled
+ *    in raster scan order
+ ************************************************************************
+ */
+void mb_sse_map (byte **org, byte **rec, int width, int height, int mb_size, int *map)
+{
+  int mb_x, mb_y;
+  int mb_width = width / mb_size;
+
+  for (mb_y=0; mb_y<height/mb_size; mb_y++)
+    for (mb_x=0; mb_x<mb_width; mb_x++)
+      map[mb_y*mb_width+mb_x] = block_sse (org, mb_y*mb_size, rec, mb_y*mb_size, mb_x*mb_size, mb_size, mb_size);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    SSIM of one 8x8 window from the sums of its samples s1, s2, squares
+ *    ss and products s12
+ ************************************************************************
+ */
+static double ssim_window (int s1, int s2, int ss, int s12)
+{
+  static const double c1 = .01*.01*255*255*64;
+  static const double c2 = .03*.03*255*255*64*63;
+  double vars  = (double) ss*64 - (double) s1*s1 - (double) s2*s2;
+  double covar = (double) s12*64 - (double) s1*s2;
+
+  return (2 * (double) s1*s2 + c1) * (2 * covar + c2) / (((double) s1*s1 + (double) s2*s2 + c1) * (vars + c2));
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sums of a row of 4x4 blocks: sums[bx] holds the sums of the samples
+ *    of org and rec, of their squares and of their products
+ ************************************************************************
+ */
+static void ssim_row_sums (byte **org, byte **rec, int y, int blocks, int (*sums)[4])
+{
+  int bx, i, j, a, b;
+
+  for (bx=0; bx<blocks; bx++)
+  {
+    int s1 = 0, s2 = 0, ss = 0, s12 = 0;
+    for (j=y; j<y+4; j++)
+    {
+      byte *o = &org[j][bx*4];
+      byte *r = &rec[j][bx*4];
+      for (i=0; i<4; i++)
+      {
+        a    = o[i];
+        b    = r[i];
+        s1  += a;
+        s2  += b;
+        ss  += a*a + b*b;
+        s12 += a*b;
+      }
+    }
+    sums[bx][0] = s1;
+    sums[bx][1] = s2;
+    sums[bx][2] = ss;
+    sums[bx][3] = s12;
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Mean SSIM of two planes over 8x8 windows on a grid of 4 samples
+ ************************************************************************
+ */
+double plane_ssim (byte **org, byte **rec, int width, int height)
+{
+  int    blocks = width / 4;
+  int    rows   = height / 4;
+  int    (*buf)[4], (*sums[2])[4], (*t)[4];
+  int    by, bx, k, s[4];
+  double ssim = 0;
+  int    windows = 0;
+
+  if (blocks < 2 || rows < 2)
+    return 1.0;
+
+  if ((buf = (int (*)[4]) malloc (2 * blocks * sizeof (*buf))) == NULL)
+    no_mem_exit ("plane_ssim: buf");
+  sums[0] = buf;
+  sums[1] = buf + blocks;
+
+  ssim_row_sums (org, rec, 0, blocks, sums[0]);
+  for (by=1; by<rows; by++)
+  {
+    ssim_row_sums (org, rec, by*4, blocks, sums[1]);
+    for (bx=0; bx<blocks-1; bx++)
+    {
+      for (k=0; k<4; k++)
+        s[k] = sums[0][bx][k] + sums[0][bx+1][k] + sums[1][bx][k] + sums[1][bx+1][k];
+      ssim += ssim_window (s[0], s[1], s[2], s[3]);
+      windows++;
+    }
+    t       = sums[0];
+    sums[0] = sums[1];
+    sums[1] = t;
+  }
+
+  free (buf);
+  return ssim / windows;
+}
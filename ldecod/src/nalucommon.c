@@ -45,7 +45,8 @@
  *    Allocates memory for a NALU
  *
  * \param buffersize
- *     size of NALU buffer 
+ *     size of NALU buffer, 0 if buf is set to memory owned by the reader
+ *     (Annex B byte stream buffer)
  *
  * \return
  *    pointer to a NALU
@@ -61,7 +62,8 @@ NALU_t *AllocNALU(int buffersize)
 
   n->max_size=buffersize;
 
-  if ((n->buf = (byte*)calloc (buffersize, sizeof (byte))) == NULL) no_mem_exit ("AllocNALU: n->buf");
+  if (buffersize > 0)
+    if ((n->buf = (byte*)calloc (buffersize, sizeof (byte))) == NULL) no_mem_exit ("AllocNALU: n->buf");
   
   return n;
 }
@@ -82,7 +84,7 @@ void FreeNALU(NALU_t *n)
 {
   if (n)
   {
-    if (n->buf)
+    if (n->buf && n->max_size > 0)
     {
       free(n->buf);
       n->buf=NULL;
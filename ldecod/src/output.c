@@ -40,9 +40,29 @@
 #include "mbuffer.h"
 #include "image.h"
 #include "memalloc.h"
+#include "threadpool.h"
+
+#define OUT_QUEUE_SIZE  4               //!< pictures queued for the output writer thread
+
+//! a cropped picture in file order (Y, U, V), written with a single fwrite
+typedef struct
+{
+  byte *buf;
+  int   size;                           //!< bytes to write
+  int   alloc;                          //!< bytes allocated for buf
+} OutPicture;
 
 FrameStore* out_buffer;
 
+static OutPicture out_queue[OUT_QUEUE_SIZE];  //!< ring of pictures for the writer thread, [0] is used without it
+static int        out_head   = 0;             //!< next picture the writer thread writes
+static int        out_count  = 0;             //!< pictures queued
+static int        out_stop   = 0;             //!< writer thread ends when the queue is empty
+static FILE      *out_file   = NULL;          //!< file written by the writer thread
+static JMMutex   *out_lock   = NULL;
+static JMCond    *out_cond   = NULL;          //!< broadcast on every change of the queue
+static JMThread  *out_thread = NULL;
+
 StorablePicture *pending_output = NULL;
 int              pending_output_state = FRAME;
 
@@ -221,7 +241,109 @@ void write_picture(StorablePicture *p, FILE *p_out, int real_structure)
 /*!
  ************************************************************************
  * \brief
- *    Writes out a storable picture
+ *    Writes an assembled picture to the output file
+ ************************************************************************
+ */
+static void write_out_buffer(OutPicture *pic, FILE *p_out)
+{
+  if (fwrite (pic->buf, 1, pic->size, p_out) != (size_t) pic->size)
+  {
+    snprintf(errortext, ET_SIZE, "Error writing the output file %s", input->outfile);
+    error(errortext,500);
+  }
+  if (input->write_flush)
+    fflush(p_out);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Output writer thread: writes the queued pictures in order until
+ *    uninit_out_writer() stops it
+ ************************************************************************
+ */
+static void output_writer(void *arg)
+{
+  OutPicture *pic;
+
+  lock_mutex (out_lock);
+  for (;;)
+  {
+    while (out_count == 0 && !out_stop)
+      wait_cond (out_cond, out_lock);
+    if (out_count == 0)
+      break;
+    pic = &out_queue[out_head];
+    unlock_mutex (out_lock);
+
+    write_out_buffer (pic, out_file);
+
+    lock_mutex (out_lock);
+    out_head = (out_head + 1) % OUT_QUEUE_SIZE;
+    out_count--;
+    broadcast_cond (out_cond);
+  }
+  unlock_mutex (out_lock);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Returns a buffer for the next picture with room for size bytes.
+ *    With the writer thread this waits until a queue entry is free.
+ ************************************************************************
+ */
+static OutPicture *get_out_picture(int size)
+{
+  OutPicture *pic;
+
+  if (out_thread)
+  {
+    lock_mutex (out_lock);
+    while (out_count == OUT_QUEUE_SIZE)
+      wait_cond (out_cond, out_lock);
+    pic = &out_queue[(out_head + out_count) % OUT_QUEUE_SIZE];
+    unlock_mutex (out_lock);
+  }
+  else
+    pic = &out_queue[0];
+
+  if (pic->alloc < size)
+  {
+    free (pic->buf);
+    if ((pic->buf = (byte *) malloc (size)) == NULL) no_mem_exit ("get_out_picture: buf");
+    pic->alloc = size;
+  }
+  pic->size = size;
+  return pic;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes the picture from get_out_picture() or hands it to the
+ *    writer thread
+ ************************************************************************
+ */
+static void put_out_picture(OutPicture *pic, FILE *p_out)
+{
+  if (out_thread)
+  {
+    lock_mutex (out_lock);
+    out_count++;
+    broadcast_cond (out_cond);
+    unlock_mutex (out_lock);
+  }
+  else
+    write_out_buffer (pic, p_out);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Writes out a storable picture.  The cropped planes are copied row
+ *    by row into one buffer, which is written with a single fwrite
+ *    (on the writer thread if it is enabled).
  * \param p
  *    Picture to be written
  * \param p_out
@@ -230,7 +352,10 @@ void write_picture(StorablePicture *p, FILE *p_out, int real_structure)
  */
 void write_out_picture(StorablePicture *p, FILE *p_out)
 {
-  int i,j;
+  int i;
+  int size_x, size_y, size_x_cr, size_y_cr;
+  OutPicture *pic;
+  byte *buf;
 
   int crop_left, crop_right, crop_top, crop_bottom;
   int crop_vert_mult;
@@ -267,30 +392,29 @@ void write_out_picture(StorablePicture *p, FILE *p_out)
   }
 
   //printf ("write frame size: %dx%d\n", p->size_x-crop_left-crop_right,p->size_y-crop_top-crop_bottom );
-  
-  for(i=crop_top;i<p->size_y-crop_bottom;i++)
-    for(j=crop_left;j<p->size_x-crop_right;j++)
-    {
-      fputc(p->imgY[i][j],p_out);
-    }
+
+  size_x    = p->size_x - crop_left - crop_right;
+  size_y    = p->size_y - crop_top - crop_bottom;
+  size_x_cr = p->size_x_cr - (crop_left + crop_right) / 2;
+  size_y_cr = p->size_y_cr - (crop_top + crop_bottom) / 2;
+
+  pic = get_out_picture (size_x * size_y + 2 * size_x_cr * size_y_cr);
+  buf = pic->buf;
+
+  for(i=crop_top;i<p->size_y-crop_bottom;i++, buf+=size_x)
+    memcpy (buf, &p->imgY[i][crop_left], size_x);
 
   crop_left   /= 2;
   crop_right  /= 2;
   crop_top    /= 2;
   crop_bottom /= 2;
 
-  for(i=crop_top;i<p->size_y_cr-crop_bottom;i++)
-    for(j=crop_left;j<p->size_x_cr-crop_right;j++)
-    {
-      fputc(p->imgUV[0][i][j],p_out);
-    }
-  for(i=crop_top;i<p->size_y_cr-crop_bottom;i++)
-    for(j=crop_left;j<p->size_x_cr-crop_right;j++)
-    {
-      fputc(p->imgUV[1][i][j],p_out);
-    }
-    
-  fflush(p_out);
+  for(i=crop_top;i<p->size_y_cr-crop_bottom;i++, buf+=size_x_cr)
+    memcpy (buf, &p->imgUV[0][i][crop_left], size_x_cr);
+  for(i=crop_top;i<p->size_y_cr-crop_bottom;i++, buf+=size_x_cr)
+    memcpy (buf, &p->imgUV[1][i][crop_left], size_x_cr);
+
+  put_out_picture (pic, p_out);
 }
 
 /*!
@@ -324,6 +448,59 @@ void uninit_out_buffer()
   free (pending_output);
 }
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts the output writer thread if input->write_thread is set
+ * \param p_out
+ *    Output file, it has to stay open until uninit_out_writer()
+ ************************************************************************
+ */
+void init_out_writer(FILE *p_out)
+{
+  out_head  = out_count = 0;
+  out_stop  = 0;
+  if (input->write_thread)
+  {
+    out_file   = p_out;
+    out_lock   = create_mutex ();
+    out_cond   = create_cond ();
+    out_thread = create_thread (output_writer, NULL);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Waits until all pictures are written, stops the writer thread and
+ *    frees the picture buffers
+ ************************************************************************
+ */
+void uninit_out_writer()
+{
+  int i;
+
+  if (out_thread)
+  {
+    lock_mutex (out_lock);
+    out_stop = 1;
+    broadcast_cond (out_cond);
+    unlock_mutex (out_lock);
+    join_thread (out_thread);
+    free_cond (out_cond);
+    free_mutex (out_lock);
+    out_thread = NULL;
+    out_cond   = NULL;
+    out_lock   = NULL;
+  }
+  for (i=0; i<OUT_QUEUE_SIZE; i++)
+  {
+    free (out_queue[i].buf);
+    out_queue[i].buf   = NULL;
+    out_queue[i].alloc = 0;
+  }
+}
+
 /*!
  ************************************************************************
  * \brief
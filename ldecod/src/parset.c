@@ -51,13 +51,13 @@
 #define SYMTRACESTRING(s) // do nothing
 #endif
 
-extern int UsedBits;      // for internal statistics, is adjusted by se_v, ue_v, u_1
-extern ColocatedParams *Co_located;
+extern THREAD_LOCAL int UsedBits;      // for internal statistics, is adjusted by se_v, ue_v, u_1
+extern THREAD_LOCAL ColocatedParams *Co_located;
 
 seq_parameter_set_rbsp_t SeqParSet[MAXSPS];
 pic_parameter_set_rbsp_t PicParSet[MAXPPS];
 
-extern StorablePicture* dec_picture;
+extern THREAD_LOCAL StorablePicture* dec_picture;
 
 // fill sps with content of p
 
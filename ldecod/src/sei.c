@@ -44,7 +44,7 @@
 #include "mbuffer.h"
 #include "parset.h"
 
-extern int UsedBits;
+extern THREAD_LOCAL int UsedBits;
 
 extern seq_parameter_set_rbsp_t SeqParSet[MAXSPS];
 
@@ -0,0 +1,373 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file threadpool.c
+ *
+ * \brief
+ *    Minimal portable threading layer (POSIX threads / Win32)
+ *
+ * \note
+ *    A thread pool runs a fixed set of worker threads. run_thread_pool()
+ *    hands an array of jobs to the workers, which pull them in order from
+ *    a shared counter, and returns when all jobs are finished. The calling
+ *    thread does not execute jobs itself, so the job function always runs
+ *    on a worker with its own thread local state.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+  #include <windows.h>
+  #include <process.h>
+#else
+  #include <pthread.h>
+#endif
+
+#include "global.h"
+#include "memalloc.h"
+#include "threadpool.h"
+
+#if defined(_WIN32)
+struct jm_mutex  { CRITICAL_SECTION cs; };
+struct jm_cond   { CONDITION_VARIABLE cv; };
+struct jm_thread { HANDLE handle; ThreadFunc func; void *arg; };
+#else
+struct jm_mutex  { pthread_mutex_t mutex; };
+struct jm_cond   { pthread_cond_t cond; };
+struct jm_thread { pthread_t thread; ThreadFunc func; void *arg; };
+#endif
+
+struct jm_thread_pool
+{
+  int         num_threads;
+  JMThread  **threads;
+  JMMutex    *lock;
+  JMCond     *work_cond;         //!< signalled when new jobs are available or on shutdown
+  JMCond     *done_cond;         //!< signalled when the last job is finished / all workers are ready
+  ThreadHook  thread_init;
+  ThreadHook  thread_exit;
+  int         next_id;           //!< thread ids handed out to the workers
+  int         ready;             //!< workers that finished thread_init
+  int         shutdown;
+  int         generation;        //!< incremented by every run_thread_pool() call
+
+  ThreadFunc  job;
+  char       *jobs;
+  int         job_size;
+  int         num_jobs;
+  int         next_job;
+  int         jobs_done;
+};
+
+
+JMMutex *create_mutex ()
+{
+  JMMutex *mutex = (JMMutex *) calloc (1, sizeof (JMMutex));
+  if (mutex == NULL)
+    no_mem_exit ("create_mutex: mutex");
+#if defined(_WIN32)
+  InitializeCriticalSection (&mutex->cs);
+#else
+  pthread_mutex_init (&mutex->mutex, NULL);
+#endif
+  return mutex;
+}
+
+void lock_mutex (JMMutex *mutex)
+{
+#if defined(_WIN32)
+  EnterCriticalSection (&mutex->cs);
+#else
+  pthread_mutex_lock (&mutex->mutex);
+#endif
+}
+
+void unlock_mutex (JMMutex *mutex)
+{
+#if defined(_WIN32)
+  LeaveCriticalSection (&mutex->cs);
+#else
+  pthread_mutex_unlock (&mutex->mutex);
+#endif
+}
+
+void free_mutex (JMMutex *mutex)
+{
+#if defined(_WIN32)
+  DeleteCriticalSection (&mutex->cs);
+#else
+  pthread_mutex_destroy (&mutex->mutex);
+#endif
+  free (mutex);
+}
+
+JMCond *create_cond ()
+{
+  JMCond *cond = (JMCond *) calloc (1, sizeof (JMCond));
+  if (cond == NULL)
+    no_mem_exit ("create_cond: cond");
+#if defined(_WIN32)
+  InitializeConditionVariable (&cond->cv);
+#else
+  pthread_cond_init (&cond->cond, NULL);
+#endif
+  return cond;
+}
+
+void wait_cond (JMCond *cond, JMMutex *mutex)
+{
+#if defined(_WIN32)
+  SleepConditionVariableCS (&cond->cv, &mutex->cs, INFINITE);
+#else
+  pthread_cond_wait (&cond->cond, &mutex->mutex);
+#endif
+}
+
+void signal_cond (JMCond *cond)
+{
+#if defined(_WIN32)
+  WakeConditionVariable (&cond->cv);
+#else
+  pthread_cond_signal (&cond->cond);
+#endif
+}
+
+void broadcast_cond (JMCond *cond)
+{
+#if defined(_WIN32)
+  WakeAllConditionVariable (&cond->cv);
+#else
+  pthread_cond_broadcast (&cond->cond);
+#endif
+}
+
+void free_cond (JMCond *cond)
+{
+#if defined(_WIN32)
+  // condition variables need no cleanup on Win32
+#else
+  pthread_cond_destroy (&cond->cond);
+#endif
+  free (cond);
+}
+
+
+#if defined(_WIN32)
+static unsigned __stdcall thread_entry (void *arg)
+{
+  JMThread *thread = (JMThread *) arg;
+  thread->func (thread->arg);
+  return 0;
+}
+#else
+static void *thread_entry (void *arg)
+{
+  JMThread *thread = (JMThread *) arg;
+  thread->func (thread->arg);
+  return NULL;
+}
+#endif
+
+/*!
+ ************************************************************************
+ * \brief
+ *    starts a thread running func(arg)
+ ************************************************************************
+ */
+JMThread *create_thread (ThreadFunc func, void *arg)
+{
+  JMThread *thread = (JMThread *) calloc (1, sizeof (JMThread));
+  int failed;
+
+  if (thread == NULL)
+    no_mem_exit ("create_thread: thread");
+  thread->func = func;
+  thread->arg  = arg;
+#if defined(_WIN32)
+  thread->handle = (HANDLE) _beginthreadex (NULL, 0, thread_entry, thread, 0, NULL);
+  failed = (thread->handle == 0);
+#else
+  failed = pthread_create (&thread->thread, NULL, thread_entry, thread);
+#endif
+  if (failed)
+    error ("create_thread: cannot start thread", 500);
+  return thread;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    waits for a thread to finish and frees it
+ ************************************************************************
+ */
+void join_thread (JMThread *thread)
+{
+#if defined(_WIN32)
+  WaitForSingleObject (thread->handle, INFINITE);
+  CloseHandle (thread->handle);
+#else
+  pthread_join (thread->thread, NULL);
+#endif
+  free (thread);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    main loop of a pool worker
+ ************************************************************************
+ */
+static void pool_worker (void *arg)
+{
+  ThreadPool *pool = (ThreadPool *) arg;
+  int id, seen;
+
+  lock_mutex (pool->lock);
+  id = pool->next_id++;
+  unlock_mutex (pool->lock);
+
+  if (pool->thread_init)
+    pool->thread_init (id);
+
+  lock_mutex (pool->lock);
+  if (++pool->ready == pool->num_threads)
+    broadcast_cond (pool->done_cond);
+  seen = pool->generation;
+
+  for (;;)
+  {
+    while (!pool->shutdown && pool->generation == seen)
+      wait_cond (pool->work_cond, pool->lock);
+    if (pool->shutdown)
+      break;
+    seen = pool->generation;
+
+    while (pool->next_job < pool->num_jobs)
+    {
+      void *job = pool->jobs + pool->next_job * pool->job_size;
+
+      pool->next_job++;
+      unlock_mutex (pool->lock);
+      pool->job (job);
+      lock_mutex (pool->lock);
+      if (++pool->jobs_done == pool->num_jobs)
+        broadcast_cond (pool->done_cond);
+    }
+  }
+  unlock_mutex (pool->lock);
+
+  if (pool->thread_exit)
+    pool->thread_exit (id);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    creates a pool of num_threads workers. thread_init / thread_exit
+ *    (may be NULL) are called on each worker when it starts / stops;
+ *    the function returns after all workers finished thread_init.
+ ************************************************************************
+ */
+ThreadPool *create_thread_pool (int num_threads, ThreadHook thread_init, ThreadHook thread_exit)
+{
+  ThreadPool *pool = (ThreadPool *) calloc (1, sizeof (ThreadPool));
+  int i;
+
+  if (pool == NULL)
+    no_mem_exit ("create_thread_pool: pool");
+  if ((pool->threads = (JMThread **) calloc (num_threads, sizeof (JMThread *))) == NULL)
+    no_mem_exit ("create_thread_pool: pool->threads");
+
+  pool->num_threads = num_threads;
+  pool->lock        = create_mutex ();
+  pool->work_cond   = create_cond ();
+  pool->done_cond   = create_cond ();
+  pool->thread_init = thread_init;
+  pool->thread_exit = thread_exit;
+
+  for (i = 0; i < num_threads; i++)
+    pool->threads[i] = create_thread (pool_worker, pool);
+
+  lock_mutex (pool->lock);
+  while (pool->ready < num_threads)
+    wait_cond (pool->done_cond, pool->lock);
+  unlock_mutex (pool->lock);
+
+  return pool;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    runs job() on each of the num_jobs elements (job_size bytes each)
+ *    of the jobs array and waits until all of them are finished.
+ *    Jobs are started in array order.
+ ************************************************************************
+ */
+void run_thread_pool (ThreadPool *pool, ThreadFunc job, void *jobs, int job_size, int num_jobs)
+{
+  if (num_jobs <= 0)
+    return;
+
+  lock_mutex (pool->lock);
+  pool->job       = job;
+  pool->jobs      = (char *) jobs;
+  pool->job_size  = job_size;
+  pool->num_jobs  = num_jobs;
+  pool->next_job  = 0;
+  pool->jobs_done = 0;
+  pool->generation++;
+  broadcast_cond (pool->work_cond);
+
+  while (pool->jobs_done < num_jobs)
+    wait_cond (pool->done_cond, pool->lock);
+  unlock_mutex (pool->lock);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    stops all workers (running thread_exit on each) and frees the pool
+ ************************************************************************
+ */
+void free_thread_pool (ThreadPool *pool)
+{
+  int i;
+
+  if (pool == NULL)
+    return;
+
+  lock_mutex (pool->lock);
+  pool->shutdown = 1;
+  broadcast_cond (pool->work_cond);
+  unlock_mutex (pool->lock);
+
+  for (i = 0; i < pool->num_threads; i++)
+    join_thread (pool->threads[i]);
+
+  free_cond (pool->done_cond);
+  free_cond (pool->work_cond);
+  free_mutex (pool->lock);
+  free (pool->threads);
+  free (pool);
+}
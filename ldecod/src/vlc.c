@@ -53,7 +53,7 @@
 extern void tracebits(const char *trace_str,  int len,  int info,int value1);
 
 
-int UsedBits;      // for internal statistics, is adjusted by se_v, ue_v, u_1
+THREAD_LOCAL int UsedBits;      // for internal statistics, is adjusted by se_v, ue_v, u_1
 
 // Note that all NA values are filled with 0
 
@@ -662,6 +662,355 @@ found_code:
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    CAVLC lookup tables
+ *
+ *    The coeff_token, total_zeros and run_before codes are decoded with
+ *    tables indexed by the next VLC_LOOKUP_BITS bits of the stream. Codes
+ *    longer than that continue in a second level table, indexed by the
+ *    following bits. The tables are built once by init_vlc_tables() from
+ *    the same length / code tables that code_from_bitstream_2d() scans.
+ ************************************************************************
+ */
+
+#define VLC_LOOKUP_BITS   8       //!< index bits of the first level tables
+#define VLC_LOOKUP_POOL   8192    //!< entries of all lookup tables
+
+typedef struct
+{
+  byte  len;        //!< code length, 0: no code (or second level table)
+  byte  value1;     //!< column of the code in its 2d table
+  byte  value2;     //!< row of the code in its 2d table
+  byte  next_bits;  //!< index bits of the second level table at next (0: none)
+  int   next;       //!< offset of the second level table from the first level table
+} VLCLookup;
+
+typedef struct
+{
+  int        bits;  //!< index bits of the first level table
+  VLCLookup *entry;
+} VLCTable;
+
+//! coeff_token, 0 <= nC < 2, 2 <= nC < 4, 4 <= nC < 8 (8 <= nC is a 6 bit FLC)
+static const int lentab_coeff_token[3][4][17] = 
+{
+  {   // 0702
+    { 1, 6, 8, 9,10,11,13,13,13,14,14,15,15,16,16,16,16},
+    { 0, 2, 6, 8, 9,10,11,13,13,14,14,15,15,15,16,16,16},
+    { 0, 0, 3, 7, 8, 9,10,11,13,13,14,14,15,15,16,16,16},
+    { 0, 0, 0, 5, 6, 7, 8, 9,10,11,13,14,14,15,15,16,16},
+  },                                                 
+  {                                                  
+    { 2, 6, 6, 7, 8, 8, 9,11,11,12,12,12,13,13,13,14,14},
+    { 0, 2, 5, 6, 6, 7, 8, 9,11,11,12,12,13,13,14,14,14},
+    { 0, 0, 3, 6, 6, 7, 8, 9,11,11,12,12,13,13,13,14,14},
+    { 0, 0, 0, 4, 4, 5, 6, 6, 7, 9,11,11,12,13,13,13,14},
+  },                                                 
+  {                                                  
+    { 4, 6, 6, 6, 7, 7, 7, 7, 8, 8, 9, 9, 9,10,10,10,10},
+    { 0, 4, 5, 5, 5, 5, 6, 6, 7, 8, 8, 9, 9, 9,10,10,10},
+    { 0, 0, 4, 5, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9,10,10,10},
+    { 0, 0, 0, 4, 4, 4, 4, 4, 5, 6, 7, 8, 8, 9,10,10,10},
+  },
+};
+
+static const int codtab_coeff_token[3][4][17] = 
+{
+  {
+    { 1, 5, 7, 7, 7, 7,15,11, 8,15,11,15,11,15,11, 7,4}, 
+    { 0, 1, 4, 6, 6, 6, 6,14,10,14,10,14,10, 1,14,10,6}, 
+    { 0, 0, 1, 5, 5, 5, 5, 5,13, 9,13, 9,13, 9,13, 9,5}, 
+    { 0, 0, 0, 3, 3, 4, 4, 4, 4, 4,12,12, 8,12, 8,12,8},
+  },
+  {
+    { 3,11, 7, 7, 7, 4, 7,15,11,15,11, 8,15,11, 7, 9,7}, 
+    { 0, 2, 7,10, 6, 6, 6, 6,14,10,14,10,14,10,11, 8,6}, 
+    { 0, 0, 3, 9, 5, 5, 5, 5,13, 9,13, 9,13, 9, 6,10,5}, 
+    { 0, 0, 0, 5, 4, 6, 8, 4, 4, 4,12, 8,12,12, 8, 1,4},
+  },
+  {
+    {15,15,11, 8,15,11, 9, 8,15,11,15,11, 8,13, 9, 5,1}, 
+    { 0,14,15,12,10, 8,14,10,14,14,10,14,10, 7,12, 8,4},
+    { 0, 0,13,14,11, 9,13, 9,13,10,13, 9,13, 9,11, 7,3},
+    { 0, 0, 0,12,11,10, 9, 8,13,12,12,12, 8,12,10, 6,2},
+  },
+};
+
+//! coeff_token of chroma DC
+static const int lentab_coeff_token_cdc[4][5] = 
+{
+  { 2, 6, 6, 6, 6,},          
+  { 0, 1, 6, 7, 8,}, 
+  { 0, 0, 3, 7, 8,}, 
+  { 0, 0, 0, 6, 7,},
+};
+
+static const int codtab_coeff_token_cdc[4][5] = 
+{
+  {1,7,4,3,2},
+  {0,1,6,3,3},
+  {0,0,1,2,2},
+  {0,0,0,5,0},
+};
+
+//! total_zeros, indexed by TotalCoeff-1
+static const int lentab_total_zeros[TOTRUN_NUM][16] = 
+{
+  { 1,3,3,4,4,5,5,6,6,7,7,8,8,9,9,9},  
+  { 3,3,3,3,3,4,4,4,4,5,5,6,6,6,6},  
+  { 4,3,3,3,4,4,3,3,4,5,5,6,5,6},  
+  { 5,3,4,4,3,3,3,4,3,4,5,5,5},  
+  { 4,4,4,3,3,3,3,3,4,5,4,5},  
+  { 6,5,3,3,3,3,3,3,4,3,6},  
+  { 6,5,3,3,3,2,3,4,3,6},  
+  { 6,4,5,3,2,2,3,3,6},  
+  { 6,6,4,2,2,3,2,5},  
+  { 5,5,3,2,2,2,4},  
+  { 4,4,3,3,1,3},  
+  { 4,4,2,1,3},  
+  { 3,3,1,2},  
+  { 2,2,1},  
+  { 1,1},  
+};
+
+static const int codtab_total_zeros[TOTRUN_NUM][16] = 
+{
+  {1,3,2,3,2,3,2,3,2,3,2,3,2,3,2,1},
+  {7,6,5,4,3,5,4,3,2,3,2,3,2,1,0},
+  {5,7,6,5,4,3,4,3,2,3,2,1,1,0},
+  {3,7,5,4,6,5,4,3,3,2,2,1,0},
+  {5,4,3,7,6,5,4,3,2,1,1,0},
+  {1,1,7,6,5,4,3,2,1,1,0},
+  {1,1,5,4,3,3,2,1,1,0},
+  {1,1,1,3,3,2,2,1,0},
+  {1,0,1,3,2,1,1,1,},
+  {1,0,1,3,2,1,1,},
+  {0,1,1,2,1,3},
+  {0,1,1,1,1},
+  {0,1,1,1},
+  {0,1,1},
+  {0,1},  
+};
+
+//! total_zeros of chroma DC, indexed by TotalCoeff-1
+static const int lentab_total_zeros_cdc[3][4] = 
+{
+  { 1, 2, 3, 3,},
+  { 1, 2, 2, 0,},
+  { 1, 1, 0, 0,}, 
+};
+
+static const int codtab_total_zeros_cdc[3][4] = 
+{
+  { 1, 1, 1, 0,},
+  { 1, 1, 0, 0,},
+  { 1, 0, 0, 0,},
+};
+
+//! run_before, indexed by min(zerosLeft,7)-1
+static const int lentab_run[RUNBEFORE_NUM][16] = 
+{
+  {1,1},
+  {1,2,2},
+  {2,2,2,2},
+  {2,2,2,3,3},
+  {2,2,3,3,3,3},
+  {2,3,3,3,3,3,3},
+  {3,3,3,3,3,3,3,4,5,6,7,8,9,10,11},
+};
+
+static const int codtab_run[RUNBEFORE_NUM][16] = 
+{
+  {1,0},
+  {1,1,0},
+  {3,2,1,0},
+  {3,2,1,1,0},
+  {3,2,3,2,1,0},
+  {3,0,1,3,2,5,4},
+  {7,6,5,4,3,2,1,1,1,1,1,1,1,1,1},
+};
+
+static VLCLookup vlc_lookup_pool[VLC_LOOKUP_POOL];
+static int       vlc_lookup_used = 0;
+
+static VLCTable  coeff_token_lookup[3];
+static VLCTable  coeff_token_cdc_lookup;
+static VLCTable  total_zeros_lookup[TOTRUN_NUM];
+static VLCTable  total_zeros_cdc_lookup[3];
+static VLCTable  run_lookup[RUNBEFORE_NUM];
+
+
+static VLCLookup *alloc_vlc_lookup (int entries)
+{
+  VLCLookup *entry = vlc_lookup_pool + vlc_lookup_used;
+
+  if (vlc_lookup_used + entries > VLC_LOOKUP_POOL)
+    error ("alloc_vlc_lookup: VLC_LOOKUP_POOL is too small", 500);
+  vlc_lookup_used += entries;
+  return entry;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    stores the code (length len, 2d table position value1 / value2) in
+ *    all entries of table (index bits 'bits') whose index starts with the
+ *    idx_len bits idx_code. Entries already used by a code found earlier
+ *    in the 2d table are kept, as code_from_bitstream_2d() returns the
+ *    first match.
+ ************************************************************************
+ */
+static void fill_vlc_lookup (VLCLookup *table, int bits, int idx_len, int idx_code, int len, int value1, int value2)
+{
+  VLCLookup *e = table + (idx_code << (bits - idx_len));
+  int k;
+
+  for (k = 0; k < (1 << (bits - idx_len)); k++, e++)
+  {
+    if (e->len == 0 && e->next_bits == 0)
+    {
+      e->len    = (byte) len;
+      e->value1 = (byte) value1;
+      e->value2 = (byte) value2;
+    }
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    builds the lookup table t for the 2d VLC table lentab / codtab
+ *    (tabheight rows of tabwidth codes, see code_from_bitstream_2d())
+ ************************************************************************
+ */
+static void build_vlc_lookup (VLCTable *t, const int *lentab, const int *codtab, int tabwidth, int tabheight)
+{
+  VLCLookup *e;
+  int i, j, len, cod, rest, maxlen = 0;
+
+  for (i = 0; i < tabwidth * tabheight; i++)
+    maxlen = max (maxlen, lentab[i]);
+
+  t->bits  = min (maxlen, VLC_LOOKUP_BITS);
+  t->entry = alloc_vlc_lookup (1 << t->bits);
+
+  // second level tables, sized for the longest code behind each prefix
+  for (i = 0; i < tabwidth * tabheight; i++)
+  {
+    if (lentab[i] > t->bits)
+    {
+      e = &t->entry[codtab[i] >> (lentab[i] - t->bits)];
+      e->next_bits = (byte) max (e->next_bits, lentab[i] - t->bits);
+    }
+  }
+  for (i = 0; i < (1 << t->bits); i++)
+    if (t->entry[i].next_bits)
+      t->entry[i].next = (int) (alloc_vlc_lookup (1 << t->entry[i].next_bits) - t->entry);
+
+  for (j = 0; j < tabheight; j++)
+  {
+    for (i = 0; i < tabwidth; i++)
+    {
+      len = lentab[j * tabwidth + i];
+      cod = codtab[j * tabwidth + i];
+      if (!len)
+        continue;
+      if (len <= t->bits)
+        fill_vlc_lookup (t->entry, t->bits, len, cod, len, i, j);
+      else
+      {
+        rest = len - t->bits;
+        e    = &t->entry[cod >> rest];
+        fill_vlc_lookup (t->entry + e->next, e->next_bits, rest, cod & ((1 << rest) - 1), len, i, j);
+      }
+    }
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    builds the CAVLC lookup tables, called once at decoder start
+ ************************************************************************
+ */
+void init_vlc_tables ()
+{
+  int i;
+
+  if (vlc_lookup_used)
+    return;
+
+  for (i = 0; i < 3; i++)
+    build_vlc_lookup (&coeff_token_lookup[i], &lentab_coeff_token[i][0][0], &codtab_coeff_token[i][0][0], 17, 4);
+  build_vlc_lookup (&coeff_token_cdc_lookup, &lentab_coeff_token_cdc[0][0], &codtab_coeff_token_cdc[0][0], 5, 4);
+  for (i = 0; i < TOTRUN_NUM; i++)
+    build_vlc_lookup (&total_zeros_lookup[i], lentab_total_zeros[i], codtab_total_zeros[i], 16, 1);
+  for (i = 0; i < 3; i++)
+    build_vlc_lookup (&total_zeros_cdc_lookup[i], lentab_total_zeros_cdc[i], codtab_total_zeros_cdc[i], 4, 1);
+  for (i = 0; i < RUNBEFORE_NUM; i++)
+    build_vlc_lookup (&run_lookup[i], lentab_run[i], codtab_run[i], 16, 1);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    returns the next 32 bits of the stream (MSB first) without moving
+ *    the bitstream pointer. Bits behind the end of the stream read as 0.
+ ************************************************************************
+ */
+static __inline unsigned int show_bits_32 (Bitstream *currStream)
+{
+  int   byteoffset = currStream->frame_bitoffset >> 3;
+  int   bitoffset  = currStream->frame_bitoffset & 7;
+  int   left       = currStream->bitstream_length - byteoffset;
+  byte *buf        = currStream->streamBuffer + byteoffset;
+  byte  tail[5];
+  unsigned int word;
+
+  if (left < 5)
+  {
+    memset (tail, 0, 5);
+    if (left > 0)
+      memcpy (tail, buf, left);
+    buf = tail;
+  }
+
+  word = ((unsigned int) buf[0] << 24) | ((unsigned int) buf[1] << 16) | ((unsigned int) buf[2] << 8) | buf[3];
+  if (bitoffset)
+    word = (word << bitoffset) | (buf[4] >> (8 - bitoffset));
+  return word;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    reads a code of the lookup table t: sets sym->value1 / value2 to the
+ *    position of the code in its 2d table and sym->len to its length,
+ *    returns -1 if there is no matching code
+ ************************************************************************
+ */
+static int read_vlc_lookup (SyntaxElement *sym, Bitstream *currStream, VLCTable *t, int *code)
+{
+  unsigned int word = show_bits_32 (currStream);
+  VLCLookup   *e    = &t->entry[word >> (32 - t->bits)];
+
+  if (e->next_bits)
+    e = &t->entry[e->next + ((word << t->bits) >> (32 - e->next_bits))];
+
+  if (!e->len || currStream->frame_bitoffset + e->len > (currStream->bitstream_length + 1) * 8)
+    return -1;  // failed to find code
+
+  sym->value1 = e->value1;
+  sym->value2 = e->value2;
+  sym->len    = e->len;
+  *code       = (int) (word >> (32 - e->len));
+  currStream->frame_bitoffset += e->len;   // move bitstream pointer
+  return 0;
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -700,57 +1049,9 @@ int readSyntaxElement_NumCoeffTrailingOnes(SyntaxElement *sym,  DataPartition *d
                                            char *type)
 {
   Bitstream   *currStream = dP->bitstream;
-  int frame_bitoffset = currStream->frame_bitoffset;
-  byte *buf = currStream->streamBuffer;
-  int BitstreamLengthInBytes = currStream->bitstream_length;
 
   int vlcnum, retval;
-  int code, *ct, *lt;
-
-  int lentab[3][4][17] = 
-  {
-    {   // 0702
-      { 1, 6, 8, 9,10,11,13,13,13,14,14,15,15,16,16,16,16},
-      { 0, 2, 6, 8, 9,10,11,13,13,14,14,15,15,15,16,16,16},
-      { 0, 0, 3, 7, 8, 9,10,11,13,13,14,14,15,15,16,16,16},
-      { 0, 0, 0, 5, 6, 7, 8, 9,10,11,13,14,14,15,15,16,16},
-    },                                                 
-    {                                                  
-      { 2, 6, 6, 7, 8, 8, 9,11,11,12,12,12,13,13,13,14,14},
-      { 0, 2, 5, 6, 6, 7, 8, 9,11,11,12,12,13,13,14,14,14},
-      { 0, 0, 3, 6, 6, 7, 8, 9,11,11,12,12,13,13,13,14,14},
-      { 0, 0, 0, 4, 4, 5, 6, 6, 7, 9,11,11,12,13,13,13,14},
-    },                                                 
-    {                                                  
-      { 4, 6, 6, 6, 7, 7, 7, 7, 8, 8, 9, 9, 9,10,10,10,10},
-      { 0, 4, 5, 5, 5, 5, 6, 6, 7, 8, 8, 9, 9, 9,10,10,10},
-      { 0, 0, 4, 5, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9,10,10,10},
-      { 0, 0, 0, 4, 4, 4, 4, 4, 5, 6, 7, 8, 8, 9,10,10,10},
-    },
-
-  };
-
-  int codtab[3][4][17] = 
-  {
-    {
-      { 1, 5, 7, 7, 7, 7,15,11, 8,15,11,15,11,15,11, 7,4}, 
-      { 0, 1, 4, 6, 6, 6, 6,14,10,14,10,14,10, 1,14,10,6}, 
-      { 0, 0, 1, 5, 5, 5, 5, 5,13, 9,13, 9,13, 9,13, 9,5}, 
-      { 0, 0, 0, 3, 3, 4, 4, 4, 4, 4,12,12, 8,12, 8,12,8},
-    },
-    {
-      { 3,11, 7, 7, 7, 4, 7,15,11,15,11, 8,15,11, 7, 9,7}, 
-      { 0, 2, 7,10, 6, 6, 6, 6,14,10,14,10,14,10,11, 8,6}, 
-      { 0, 0, 3, 9, 5, 5, 5, 5,13, 9,13, 9,13, 9, 6,10,5}, 
-      { 0, 0, 0, 5, 4, 6, 8, 4, 4, 4,12, 8,12,12, 8, 1,4},
-    },
-    {
-      {15,15,11, 8,15,11, 9, 8,15,11,15,11, 8,13, 9, 5,1}, 
-      { 0,14,15,12,10, 8,14,10,14,14,10,14,10, 7,12, 8,4},
-      { 0, 0,13,14,11, 9,13, 9,13,10,13, 9,13, 9,11, 7,3},
-      { 0, 0, 0,12,11,10, 9, 8,13,12,12,12, 8,12,10, 6,2},
-    },
-  };
+  int code;
 
   vlcnum = sym->value1;
   // vlcnum is the index of Table used to code coeff_token
@@ -759,7 +1060,7 @@ int readSyntaxElement_NumCoeffTrailingOnes(SyntaxElement *sym,  DataPartition *d
   if (vlcnum == 3)
   {
     // read 6 bit FLC
-    code = ShowBits(buf, frame_bitoffset, BitstreamLengthInBytes, 6);
+    code = show_bits_32(currStream) >> 26;
     currStream->frame_bitoffset += 6;
     sym->value2 = code & 3;
     sym->value1 = (code >> 2);
@@ -779,9 +1080,7 @@ int readSyntaxElement_NumCoeffTrailingOnes(SyntaxElement *sym,  DataPartition *d
   else
 
   {
-    lt = &lentab[vlcnum][0][0];
-    ct = &codtab[vlcnum][0][0];
-    retval = code_from_bitstream_2d(sym, dP, lt, ct, 17, 4, &code);
+    retval = read_vlc_lookup(sym, currStream, &coeff_token_lookup[vlcnum], &code);
   }
 
   if (retval)
@@ -811,30 +1110,9 @@ int readSyntaxElement_NumCoeffTrailingOnes(SyntaxElement *sym,  DataPartition *d
 int readSyntaxElement_NumCoeffTrailingOnesChromaDC(SyntaxElement *sym,  DataPartition *dP)
 {
   int retval;
-  int code, *ct, *lt;
+  int code;
 
-  int lentab[4][5] = 
-  {
-    { 2, 6, 6, 6, 6,},          
-    { 0, 1, 6, 7, 8,}, 
-    { 0, 0, 3, 7, 8,}, 
-    { 0, 0, 0, 6, 7,},
-  };
-
-  int codtab[4][5] = 
-  {
-    {1,7,4,3,2},
-    {0,1,6,3,3},
-    {0,0,1,2,2},
-    {0,0,0,5,0},
-  };
-
-
-
-  lt = &lentab[0][0];
-  ct = &codtab[0][0];
-
-  retval = code_from_bitstream_2d(sym, dP, lt, ct, 5, 4, &code);
+  retval = read_vlc_lookup(sym, dP->bitstream, &coeff_token_cdc_lookup, &code);
 
   if (retval)
   {
@@ -1008,52 +1286,11 @@ int readSyntaxElement_Level_VLCN(SyntaxElement *sym, int vlc, struct datapartiti
 int readSyntaxElement_TotalZeros(SyntaxElement *sym,  DataPartition *dP)
 {
   int vlcnum, retval;
-  int code, *ct, *lt;
+  int code;
 
-  int lentab[TOTRUN_NUM][16] = 
-  {
-    
-    { 1,3,3,4,4,5,5,6,6,7,7,8,8,9,9,9},  
-    { 3,3,3,3,3,4,4,4,4,5,5,6,6,6,6},  
-    { 4,3,3,3,4,4,3,3,4,5,5,6,5,6},  
-    { 5,3,4,4,3,3,3,4,3,4,5,5,5},  
-    { 4,4,4,3,3,3,3,3,4,5,4,5},  
-    { 6,5,3,3,3,3,3,3,4,3,6},  
-    { 6,5,3,3,3,2,3,4,3,6},  
-    { 6,4,5,3,2,2,3,3,6},  
-    { 6,6,4,2,2,3,2,5},  
-    { 5,5,3,2,2,2,4},  
-    { 4,4,3,3,1,3},  
-    { 4,4,2,1,3},  
-    { 3,3,1,2},  
-    { 2,2,1},  
-    { 1,1},  
-  };
-
-  int codtab[TOTRUN_NUM][16] = 
-  {
-    {1,3,2,3,2,3,2,3,2,3,2,3,2,3,2,1},
-    {7,6,5,4,3,5,4,3,2,3,2,3,2,1,0},
-    {5,7,6,5,4,3,4,3,2,3,2,1,1,0},
-    {3,7,5,4,6,5,4,3,3,2,2,1,0},
-    {5,4,3,7,6,5,4,3,2,1,1,0},
-    {1,1,7,6,5,4,3,2,1,1,0},
-    {1,1,5,4,3,3,2,1,1,0},
-    {1,1,1,3,3,2,2,1,0},
-    {1,0,1,3,2,1,1,1,},
-    {1,0,1,3,2,1,1,},
-    {0,1,1,2,1,3},
-    {0,1,1,1,1},
-    {0,1,1,1},
-    {0,1,1},
-    {0,1},  
-  };
   vlcnum = sym->value1;
 
-  lt = &lentab[vlcnum][0];
-  ct = &codtab[vlcnum][0];
-
-  retval = code_from_bitstream_2d(sym, dP, lt, ct, 16, 1, &code);
+  retval = read_vlc_lookup(sym, dP->bitstream, &total_zeros_lookup[vlcnum], &code);
 
   if (retval)
   {
@@ -1079,28 +1316,11 @@ int readSyntaxElement_TotalZeros(SyntaxElement *sym,  DataPartition *dP)
 int readSyntaxElement_TotalZerosChromaDC(SyntaxElement *sym,  DataPartition *dP)
 {
   int vlcnum, retval;
-  int code, *ct, *lt;
-
-  int lentab[3][4] = 
-  {
-    { 1, 2, 3, 3,},
-    { 1, 2, 2, 0,},
-    { 1, 1, 0, 0,}, 
-  };
-
-  int codtab[3][4] = 
-  {
-    { 1, 1, 1, 0,},
-    { 1, 1, 0, 0,},
-    { 1, 0, 0, 0,},
-  };
+  int code;
 
   vlcnum = sym->value1;
 
-  lt = &lentab[vlcnum][0];
-  ct = &codtab[vlcnum][0];
-
-  retval = code_from_bitstream_2d(sym, dP, lt, ct, 4, 1, &code);
+  retval = read_vlc_lookup(sym, dP->bitstream, &total_zeros_cdc_lookup[vlcnum], &code);
 
   if (retval)
   {
@@ -1127,36 +1347,11 @@ int readSyntaxElement_TotalZerosChromaDC(SyntaxElement *sym,  DataPartition *dP)
 int readSyntaxElement_Run(SyntaxElement *sym,  DataPartition *dP)
 {
   int vlcnum, retval;
-  int code, *ct, *lt;
-
-  int lentab[TOTRUN_NUM][16] = 
-  {
-    {1,1},
-    {1,2,2},
-    {2,2,2,2},
-    {2,2,2,3,3},
-    {2,2,3,3,3,3},
-    {2,3,3,3,3,3,3},
-    {3,3,3,3,3,3,3,4,5,6,7,8,9,10,11},
-  };
-
-  int codtab[TOTRUN_NUM][16] = 
-  {
-    {1,0},
-    {1,1,0},
-    {3,2,1,0},
-    {3,2,1,1,0},
-    {3,2,3,2,1,0},
-    {3,0,1,3,2,5,4},
-    {7,6,5,4,3,2,1,1,1,1,1,1,1,1,1},
-  };
+  int code;
 
   vlcnum = sym->value1;
 
-  lt = &lentab[vlcnum][0];
-  ct = &codtab[vlcnum][0];
-
-  retval = code_from_bitstream_2d(sym, dP, lt, ct, 16, 1, &code);
+  retval = read_vlc_lookup(sym, dP->bitstream, &run_lookup[vlcnum], &code);
 
   if (retval)
   {
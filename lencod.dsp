@@ -163,10 +163,18 @@ SOURCE=.\lencod\src\mbuffer.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lencod\src\me_distortion.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\lencod\src\memalloc.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lencod\src\metrics.c
+# End Source File
+# Begin Source File
+
 SOURCE=".\lencod\src\mv-search.c"
 # End Source File
 # Begin Source File
@@ -219,10 +227,26 @@ SOURCE=.\lencod\src\sei.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lencod\src\simd.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\lencod\src\slice.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lencod\src\source_reader.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\lencod\src\threadpool.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\lencod\src\upsample.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\lencod\src\vlc.c
 # End Source File
 # Begin Source File
@@ -319,10 +343,18 @@ SOURCE=.\lencod\inc\mbuffer.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\lencod\inc\me_distortion.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\lencod\inc\memalloc.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\lencod\inc\metrics.h
+# End Source File
+# Begin Source File
+
 SOURCE=".\lencod\inc\mv-search.h"
 # End Source File
 # Begin Source File
@@ -367,6 +399,22 @@ SOURCE=.\lencod\inc\sei.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\lencod\inc\simd.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\lencod\inc\source_reader.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\lencod\inc\threadpool.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\lencod\inc\upsample.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\lencod\inc\vlc.h
 # End Source File
 # End Group
@@ -50,9 +50,10 @@
 
 #define Elow            (eep->Elow)
 #define Erange          (eep->Erange)
-#define Ebits_to_follow (eep->Ebits_to_follow)
+#define Eoutstanding    (eep->Eoutstanding)
 #define Ebuffer         (eep->Ebuffer)
-#define Ebits_to_go     (eep->Ebits_to_go)
+#define Epending        (eep->Epending)
+#define Equeue          (eep->Equeue)
 #define Ecodestrm       (eep->Ecodestrm)
 #define Ecodestrm_len   (eep->Ecodestrm_len)
 #define Ecodestrm_laststartcode   (eep->Ecodestrm_laststartcode)
@@ -154,5 +155,29 @@ const unsigned short AC_next_state_LPS_64[64] =
 };
 
 
+/*! Bits of the MPS [0] and the LPS [1] for each state, in units of 1/32768 bit
+    (-log2 of the probability; used for the rate estimation) */
+#define EST_BITS_SHIFT  15
+const int entropy_bits_64x2[64][2]=
+{
+        { 32768,  32768}, { 30426,  35232}, { 28306,  37696}, { 26377,  40159},
+        { 24617,  42623}, { 23005,  45087}, { 21523,  47551}, { 20159,  50015},
+        { 18899,  52479}, { 17734,  54942}, { 16653,  57406}, { 15650,  59870},
+        { 14717,  62334}, { 13849,  64798}, { 13038,  67262}, { 12282,  69725},
+        { 11575,  72189}, { 10914,  74653}, { 10294,  77117}, {  9714,  79581},
+        {  9169,  82044}, {  8658,  84508}, {  8178,  86972}, {  7727,  89436},
+        {  7303,  91900}, {  6903,  94364}, {  6527,  96827}, {  6173,  99291},
+        {  5840, 101755}, {  5525, 104219}, {  5228, 106683}, {  4948, 109147},
+        {  4684, 111610}, {  4435, 114074}, {  4199, 116538}, {  3977, 119002},
+        {  3767, 121466}, {  3568, 123929}, {  3380, 126393}, {  3202, 128857},
+        {  3034, 131321}, {  2876, 133785}, {  2725, 136249}, {  2583, 138712},
+        {  2448, 141176}, {  2321, 143640}, {  2200, 146104}, {  2086, 148568},
+        {  1978, 151032}, {  1875, 153495}, {  1778, 155959}, {  1686, 158423},
+        {  1599, 160887}, {  1517, 163351}, {  1439, 165814}, {  1364, 168278},
+        {  1294, 170742}, {  1228, 173206}, {  1164, 175670}, {  1105, 178134},
+        {  1048, 180597}, {   994, 183061}, {   943, 185525}, {   895, 187989}
+};
+
+
 #endif  // BIARIENCOD_H
 
@@ -45,6 +45,8 @@
 void arienco_start_encoding(EncodingEnvironmentPtr eep, unsigned char *code_buffer, int *code_len, /* int *last_startcode, */int slice_type);
 int  arienco_bits_written(EncodingEnvironmentPtr eep);
 void arienco_done_encoding(EncodingEnvironmentPtr eep);
+void arienco_start_estimation(EncodingEnvironmentPtr eep);
+void arienco_done_estimation(EncodingEnvironmentPtr eep);
 void biari_init_context (BiContextTypePtr ctx, const int* ini);
 void rescale_cum_freq(BiContextTypePtr bi_ct);
 void biari_encode_symbol(EncodingEnvironmentPtr eep, signed short symbol, BiContextTypePtr bi_ct );
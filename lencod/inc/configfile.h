@@ -71,11 +71,15 @@ Mapping Map[] = {
     {"MbLineIntraUpdate",        &configinput.intra_upd,               0},
     {"SliceMode",                &configinput.slice_mode,              0},
     {"SliceArgument",            &configinput.slice_argument,          0},
+    {"SliceThreads",             &configinput.SliceThreads,            0},
     {"UseConstrainedIntraPred",  &configinput.UseConstrainedIntraPred, 0},
     {"InputFile",                &configinput.infile,                  1},
     {"InputHeaderLength",        &configinput.infile_header,           0},
+    {"InputReadAhead",           &configinput.InputReadAhead,          0},
+    {"InputMemoryMap",           &configinput.InputMemoryMap,          0},
     {"OutputFile",               &configinput.outfile,                 1},
     {"ReconFile",                &configinput.ReconFile,               1},
+    {"ReportSSIM",               &configinput.ReportSSIM,              0},
     {"TraceFile",                &configinput.TraceFile,               1},
     {"NumberBFrames",            &configinput.successive_Bframe,       0},
     {"QPBPicture",               &configinput.qpB,                     0},
@@ -108,10 +112,13 @@ Mapping Map[] = {
     {"ChangeQPStart",            &configinput.qp2start,                0},
 #endif
     {"RDOptimization",           &configinput.rdopt,                   0},
+    {"FastModeDecision",         &configinput.FastModeDecision,        0},
+    {"CABACRateEstimation",      &configinput.CABACRateEstimation,     0},
     {"LossRateA",                &configinput.LossRateA,               0},
     {"LossRateB",                &configinput.LossRateB,               0},
     {"LossRateC",                &configinput.LossRateC,               0},
     {"NumberOfDecoders",         &configinput.NoOfDecoders,            0},
+    {"LossDecoderThreads",       &configinput.LossDecoderThreads,      0},
     {"RestrictRefFrames",        &configinput.RestrictRef ,            0},
 #ifdef _LEAKYBUCKET_
     {"NumberofLeakyBuckets",     &configinput.NumberLeakyBuckets,      0},
@@ -120,6 +127,8 @@ Mapping Map[] = {
 #endif
     {"PicInterlace",             &configinput.PicInterlace,            0},
     {"MbInterlace",              &configinput.MbInterlace,             0},
+    {"ConcurrentPAFF",           &configinput.ConcurrentPAFF,          0},
+    {"PAFFPreDecision",          &configinput.PAFFPreDecision,         0},
 
     {"IntraBottom",              &configinput.IntraBottom,             0},
 
@@ -161,6 +170,16 @@ Mapping Map[] = {
 
     // Fast ME enable
     {"UseFME",                   &configinput.FMEnable,                0},
+
+    // SIMD kernels
+    {"SIMDKernels",              &configinput.SIMDKernels,             0},
+    {"SIMDSelfCheck",            &configinput.SIMDSelfCheck,           0},
+    {"WavefrontME",              &configinput.WavefrontME,             0},
+    {"WavefrontMERange",         &configinput.WavefrontMERange,        0},
+    {"FastFullSearchThreads",    &configinput.FastFullSearchThreads,   0},
+    {"HierarchicalME",           &configinput.HierarchicalME,          0},
+    {"HierarchicalMERange",      &configinput.HierarchicalMERange,     0},
+    {"QPelCacheSize",            &configinput.QPelCacheSize,           0},
     
     {"ChromaQPOffset",           &configinput.chroma_qp_index_offset,  0},    
     {NULL,                       NULL,                                -1}
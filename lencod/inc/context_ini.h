@@ -44,6 +44,7 @@ void  store_contexts ();
 void  update_field_frame_contexts (int);
 
 void  SetCtxModelNumber ();
+int   CtxModelsKnownBeforeCoding (int num_slices);
 
 #endif
 
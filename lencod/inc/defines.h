@@ -177,6 +177,12 @@ typedef unsigned char byte;    //!< byte type definition
                                   // CAVLC needs more symbols per MB
 
 
+#define MAX_SLICE_THREADS   64    //!< Maximum number of slice threads (SliceThreads)
+#define MAX_WAVEFRONT_THREADS 64  //!< Maximum number of motion search pre-pass threads (WavefrontME)
+#define MAX_LOSS_DECODER_THREADS 64 //!< Maximum number of threads of the simulated decoders (LossDecoderThreads)
+#define MAX_FAST_FULL_SEARCH_THREADS 64 //!< Maximum number of threads of the fast full search setup (FastFullSearchThreads)
+
+
 #define MAX_PART_NR     3 /*!< Maximum number of different data partitions.
                                Some reasonable number which should reflect
                                what is currently defined in the SE2Partition map (elements.h) */
@@ -121,7 +121,7 @@ typedef enum {
 //} SE_type;
 
 
-extern int * assignSE2partition[2];
+extern THREAD_LOCAL int * assignSE2partition[2];
 extern int assignSE2partition_NoDP[SE_MAX_ELEMENTS];
 extern int assignSE2partition_DP[SE_MAX_ELEMENTS];
 
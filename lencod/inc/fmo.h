@@ -52,6 +52,6 @@ void FmoSetLastMacroblockInSlice (int mb);
 
 int FmoGetPreviousMBNr (int CurrentMbNr);
 
-extern int *MBAmap; 
+extern THREAD_LOCAL int *MBAmap; 
 
 #endif
@@ -48,6 +48,7 @@
 #include "defines.h"
 #include "nalucommon.h"
 #include "parsetcommon.h"
+#include "threadpool.h"
 
 #ifndef WIN32
   #include "minmax.h"
@@ -183,22 +184,27 @@ typedef enum {
 typedef struct
 {
   unsigned int  Elow, Erange;
-  unsigned int  Ebuffer;
-  unsigned int  Ebits_to_go;
-  unsigned int  Ebits_to_follow;
+  unsigned int  Ebuffer;                //!< last complete byte, not written yet (carry)
+  int           Epending;               //!< Ebuffer holds a byte
+  int           Equeue;                 //!< bits shifted out of the interval and not yet in a byte, minus 8
+  int           Eoutstanding;           //!< 0xff bytes after Ebuffer, not written yet (carry)
   byte          *Ecodestrm;
   int           *Ecodestrm_len;
 //  int           *Ecodestrm_laststartcode;
   // storage in case of recode MB
   unsigned int  ElowS, ErangeS;
   unsigned int  EbufferS;
-  unsigned int  Ebits_to_goS;
-  unsigned int  Ebits_to_followS;
+  int           EpendingS;
+  int           EqueueS;
+  int           EoutstandingS;
   byte          *EcodestrmS;
   int           *Ecodestrm_lenS;
   int           C, CS;
   int           E, ES;
   int           B, BS;
+  // rate estimation (rd-optimized mode decision)
+  int           Eestimate;      //!< count the bits of the symbols instead of encoding them
+  int64         Eest_bits;      //!< estimated bits in units of 1/32768 bit
 } EncodingEnvironment;
 
 typedef EncodingEnvironment *EncodingEnvironmentPtr;
@@ -462,15 +468,14 @@ typedef struct
 } Sourceframe;
 
 // global picture format dependend buffers, mem allocation in image.c
-byte   **imgY_org;           //!< Reference luma image
-byte  ***imgUV_org;          //!< Reference croma image
+extern THREAD_LOCAL byte   **imgY_org;           //!< Reference luma image
+extern THREAD_LOCAL byte  ***imgUV_org;          //!< Reference croma image
 //int    **refFrArr;           //!< Array for reference frames of each block
-int    **img4Y_tmp;          //!< for quarter pel interpolation
 
 unsigned int log2_max_frame_num_minus4;
 unsigned int log2_max_pic_order_cnt_lsb_minus4;
 
-int  me_tot_time,me_time;
+extern THREAD_LOCAL int me_tot_time,me_time;
 pic_parameter_set_rbsp_t *active_pps;
 seq_parameter_set_rbsp_t *active_sps;
 
@@ -502,13 +507,13 @@ byte  ***imgUV_org_frm;
 byte   **imgY_com;               //!< Encoded luma images
 byte  ***imgUV_com;              //!< Encoded croma images
 
-int   ***direct_ref_idx;         //!< direct mode reference index buffer
-int    **direct_pdir;         //!< direct mode reference index buffer
+extern THREAD_LOCAL int   ***direct_ref_idx;         //!< direct mode reference index buffer
+extern THREAD_LOCAL int    **direct_pdir;         //!< direct mode reference index buffer
 
 // Buffers for rd optimization with packet losses, Dim. Kontopodis
 byte **pixel_map;   //!< Shows the latest reference frame that is reliable for each pixel
 byte **refresh_map; //!< Stores the new values for pixel_map  
-int intras;         //!< Counts the intra updates in each frame.
+extern THREAD_LOCAL int intras;  //!< Counts the intra updates in each frame.
 
 int  Bframe_ctr, frame_no, nextP_tr_fld, nextP_tr_frm;
 int  tot_time;
@@ -518,15 +523,19 @@ char errortext[ET_SIZE]; //!< buffer for error message for exit with error()
 
 
 //! Info for the "decoders-in-the-encoder" used for rdoptimization with packet losses
+//! Decoder NoOfDecoders holds the common state of all decoders that did not lose a
+//! packet yet, the planes of the other decoders are only allocated when they diverge.
 typedef struct
 {
   int  **resY;             //!< Residue of Luminance
   byte ***decY;            //!< Decoded values at the simulated decoders
   byte ****decref;         //!< Reference frames of the simulated decoders
   byte ***decY_best;       //!< Decoded frames for the best mode for all decoders
-  byte **RefBlock;
   byte **status_map;
   byte **dec_mb_mode;
+  int  *active;            //!< decoders with own state: the common one (if still used) and the diverged ones
+  int  num_active;
+  int  num_diverged;       //!< decoders that no longer share the common state
 } Decoders;
 extern Decoders *decs;
 
@@ -542,6 +551,12 @@ typedef struct
   float snr_ya;              //!< Average SNR Y(dB) remaining frames
   float snr_ua;              //!< Average SNR U(dB) remaining frames
   float snr_va;              //!< Average SNR V(dB) remaining frames
+  float ssim_y;              //!< current Y SSIM (ReportSSIM)
+  float ssim_u;              //!< current U SSIM
+  float ssim_v;              //!< current V SSIM
+  float ssim_ya;             //!< Average SSIM Y all frames
+  float ssim_ua;             //!< Average SSIM U all frames
+  float ssim_va;             //!< Average SSIM V all frames
 } SNRParameters;
 
                              //! all input parameters
@@ -575,12 +590,14 @@ typedef struct
   int blc_size[8][2];           //!< array for different block sizes
   int slice_mode;               //!< Indicate what algorithm to use for setting slices
   int slice_argument;           //!< Argument to the specified slice algorithm
+  int SliceThreads;             //!< number of threads coding the slices of a picture (0,1: no threads)
   int UseConstrainedIntraPred;  //!< 0: Inter MB pixels are allowed for intra prediction 1: Not allowed
   int  infile_header;           //!< If input file has a header set this to the length of the header
   char infile[100];             //!< YUV 4:2:0 input format
   char outfile[100];            //!< H.264 compressed output bitstream
   char ReconFile[100];          //!< Reconstructed Pictures
   char TraceFile[100];          //!< Trace Outputs
+  int ReportSSIM;               //!< report the SSIM of the reconstructed pictures
   int intra_period;             //!< Random Access period though intra
 
   int idr_enable;				//!< Encode intra slices as IDR
@@ -636,6 +653,8 @@ typedef struct
 
   int PicInterlace;           //!< picture adaptive frame/field
   int MbInterlace;            //!< macroblock adaptive frame/field
+  int ConcurrentPAFF;         //!< code the frame and the field trial of picture AFF on two threads
+  int PAFFPreDecision;        //!< margin (percent) of the source activity that skips one PAFF trial (0: off)
 
   int IntraBottom;            //!< Force Intra Bottom at GOP periods.
 
@@ -643,7 +662,10 @@ typedef struct
   int LossRateB;              //!< assumed loss probablility of partition B, in per cent, used for loss-aware R/D 
   int LossRateC;              //!< assumed loss probablility of partition C, in per cent, used for loss-aware R/D 
   int NoOfDecoders;
+  int LossDecoderThreads;     //!< threads running the simulated decoders of RDOptimization = 2 (0: none)
   int RestrictRef;
+  int FastModeDecision;       //!< RD mode decision: 0 full, 1 cost bounded, 2 with skip prediction and mode pruning
+  int CABACRateEstimation;    //!< RD mode decision with CABAC: estimate the rates from the context states instead of encoding
   int NumFramesInELSubSeq;
   int NumFrameIn2ndIGOP;
 
@@ -688,6 +710,17 @@ typedef struct
   // FastME enable
   int FMEnable;
 
+  int SIMDKernels;             //!< SAD/SATD kernels: 0=auto, 1=C, 2=SSE2, 3=SSSE3, 4=AVX2
+  int SIMDSelfCheck;           //!< compare every optimized kernel call with the C reference
+  int WavefrontME;             //!< threads of the integer-pel motion search pre-pass (0: no pre-pass)
+  int WavefrontMERange;        //!< integer-pel refinement range around the pre-pass vectors
+  int FastFullSearchThreads;   //!< threads setting up the fast full search of the reference frames (0: none)
+  int HierarchicalME;          //!< integer-pel search on decimated pictures, coarse to fine (0: off)
+  int HierarchicalMERange;     //!< integer-pel refinement range around the hierarchical search candidates
+  int QPelCacheSize;           //!< memory bound of the quarter pel reference planes in MB (0: unlimited)
+  int InputReadAhead;          //!< source frames read ahead on a separate thread (0: read when needed)
+  int InputMemoryMap;          //!< map the source file into memory instead of reading it
+
 } InputParameters;
 
 //! ImageParameters
@@ -922,8 +955,17 @@ typedef struct
   int  *em_prev_bits;
   int   bit_ctr_parametersets;
   int   bit_ctr_parametersets_n;
+
+  int   fmd_mb   [3][MAXMODE];  //!< fast mode decision, macroblock modes: RD costs [FMD_TESTED], stopped [FMD_BOUNDED], pruned [FMD_PRUNED]
+  int   fmd_b8   [3][8];        //!< the same for the 8x8 sub-partition modes (0: direct, 4..7)
+  int   fmd_i4   [3];           //!< the same for the 4x4 intra prediction modes
+  int   fmd_skip [2];           //!< SKIP/direct prediction: macroblocks checked, predicted
 } StatParameters;
 
+#define FMD_TESTED  0           //!< RD cost computed
+#define FMD_BOUNDED 1           //!< RD cost stopped after the distortion, the mode could not win
+#define FMD_PRUNED  2           //!< RD cost not computed, the mode was ruled out in advance
+
 //!< For MB level field/frame coding tools
 //!< temporary structure to store MB data for field/frame coding
 typedef struct
@@ -950,15 +992,15 @@ typedef struct
   int    prev_delta_qp;
 } RD_DATA;
 
-RD_DATA *rdopt; 
-RD_DATA rddata_top_frame_mb, rddata_bot_frame_mb; //!< For MB level field/frame coding tools
-RD_DATA rddata_top_field_mb, rddata_bot_field_mb; //!< For MB level field/frame coding tools
+extern THREAD_LOCAL RD_DATA *rdopt;
+extern THREAD_LOCAL RD_DATA rddata_top_frame_mb, rddata_bot_frame_mb; //!< For MB level field/frame coding tools
+extern THREAD_LOCAL RD_DATA rddata_top_field_mb, rddata_bot_field_mb; //!< For MB level field/frame coding tools
 
 extern InputParameters *input;
-extern ImageParameters *img;
-extern StatParameters *stat;
+extern THREAD_LOCAL ImageParameters *img;
+extern THREAD_LOCAL StatParameters *enc_stat;
 
-extern SNRParameters *snr;
+extern THREAD_LOCAL SNRParameters *snr;
 
 // files
 FILE *p_dec;                     //!< internal decoded image for debugging
@@ -1010,7 +1052,7 @@ void IntraChromaPrediction8x8 (int*, int*, int*);
 int  writeMBHeader   (int rdopt); 
 
 extern int*   refbits;
-extern int**** motion_cost;
+extern THREAD_LOCAL int**** motion_cost;
 
 void  Get_Direct_Motion_Vectors ();
 void  PartitionMotionSearch     (int, int, double);
@@ -1056,6 +1098,10 @@ Picture *malloc_picture();
 void     free_picture (Picture *pic);
 
 int   encode_one_slice(int SLiceGroupId, Picture *pic);   //! returns the number of MBs in the slice
+int   encode_slices_parallel(Picture *pic);                //! returns the number of MBs coded by the slice threads
+void  init_slice_threads();
+void  free_slice_threads();
+void  add_thread_stats(StatParameters *s);
 
 void  start_macroblock(int mb_addr, int mb_field);
 void  set_MB_parameters (int mb_addr);           //! sets up img-> according to input-> and currSlice->
@@ -1114,11 +1160,12 @@ int   SingleUnifiedMotionSearch   (int, int, int**, int***, int*****, int, int**
 void  clear_rdopt      ();
 void  init_rdopt       ();
 void  RD_Mode_Decision ();
+void  SetLagrangeMultipliers (double *lambda_mode, double *lambda_motion);
 //============= rate-distortion opt with packet losses ===========
 void decode_one_macroblock();
 void decode_one_mb (int, Macroblock*);
 void decode_one_b8block (int, int, int, int, int);
-void Get_Reference_Block(byte **imY, int block_y, int block_x, int mvhor, int mvver, byte **out);
+void Get_Reference_Block(byte **imY, int block_y, int block_x, int mvhor, int mvver, byte out[BLOCK_SIZE][BLOCK_SIZE]);
 byte Get_Reference_Pixel(byte **imY, int y, int x);
 int Half_Upsample(byte **imY, int j, int i);
 void DecOneForthPix(byte **dY, byte ***dref);
@@ -1126,6 +1173,11 @@ void compute_residue(int mode);
 void compute_residue_b8block (int, int);
 void compute_residue_mb (int);
 void UpdateDecoders();
+int  init_decoders();
+void free_decoders();
+int  decoders_distortion (int mbmode, int b8block, int b8mode, int b8ref);
+void store_decoders_mb ();
+void deblock_decoders ();
 void Build_Status_Map(byte **s_map);
 void Error_Concealment(byte **inY, byte **s_map, byte ***refY);
 void Conceal_Error(byte **inY, int mb_y, int mb_x, byte ***refY, byte **s_map);
@@ -1137,6 +1189,14 @@ void UpdatePixelMap();
 void  ClearFastFullIntegerSearch    ();
 void  ResetFastFullIntegerSearch    ();
 #endif
+void  ResetHierarchicalMotionSearch ();
+void  Init_Motion_Search_Thread     ();
+void  Clear_Motion_Search_Thread    ();
+
+//============= wavefront motion search pre-pass ===============
+void  Init_Wavefront_Motion_Search  ();
+void  Clear_Wavefront_Motion_Search ();
+void  WavefrontMotionSearch         ();
 
 void process_2nd_IGOP();
 void SetImgType();
@@ -1153,7 +1213,7 @@ void AllocNalPayloadBuffer();
 void FreeNalPayloadBuffer();
 void SODBtoRBSP(Bitstream *currStream);
 int RBSPtoEBSP(byte *streamBuffer, int begin_bytepos, int end_bytepos, int min_num_bytes);
-int Bytes_After_Header;
+extern THREAD_LOCAL int Bytes_After_Header;
 
 // JVT-D101: the bit for redundant_pic_cnt in slice header may be changed, 
 // therefore the bit position in the bitstream must be stored.
@@ -1165,6 +1225,7 @@ void modify_redundant_pic_cnt(unsigned char *streamBuffer);
 // Fast ME enable
 int BlockMotionSearch (int,int,int,int,int,int,double);
 void encode_one_macroblock (void);
+void ReportFastModeDecision (void);
 
 #endif
 
@@ -31,16 +31,17 @@
 
 #include "mbuffer.h"
 
-extern StorablePicture *enc_picture;
+extern THREAD_LOCAL StorablePicture *enc_picture;
 extern StorablePicture *enc_frame_picture;
 extern StorablePicture *enc_top_picture;
 extern StorablePicture *enc_bottom_picture;
+extern THREAD_LOCAL int paff_worker;
 
 int encode_one_frame ();
+void init_paff_thread ();
+void free_paff_thread ();
 Boolean dummy_slice_too_big(int bits_slice);
 void copy_rdopt_data (int field_type);    //!< For MB level field/frame coding tools
 
-void UnifiedOneForthPix (StorablePicture *s);
-
 #endif
 
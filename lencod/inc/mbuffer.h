@@ -36,6 +36,7 @@
 #include "global.h"
 
 #define MAX_LIST_SIZE 33
+#define PIC_POOL_SIZE 64   //!< maximum number of released pictures kept for reuse
 
 //! definition a picture (field or frame)
 typedef struct storable_picture
@@ -68,8 +69,12 @@ typedef struct storable_picture
   byte **     imgY;          //!< Y picture component
   byte *      imgY_11;       //!< Y picture component with padded borders
   byte *      imgY_11_w;     //!< Y picture component with padded borders for weighted prediction
+  byte *      imgY_sub[2];   //!< Y picture component decimated by 2 and by 4 (HierarchicalME)
   byte **     imgY_ups;      //!< Y picture component upsampled (Quarter pel)
   byte **     imgY_ups_w;    //!< Y picture component upsampled (Quarter pel) for weighted prediction
+  byte *      ups_tiles;     //!< tiles of imgY_ups / imgY_ups_w already interpolated (UPS_PLANE / UPS_PLANE_W flags)
+  int         ups_weight[4]; //!< weight, offset, rounding and log2 denominator of imgY_ups_w
+  int         ups_stamp;     //!< last coded picture that used imgY_ups / imgY_ups_w
   byte ***    imgUV;         //!< U and V picture components
 
   byte *      mb_field;      //!< field macroblock indicator
@@ -91,6 +96,8 @@ typedef struct storable_picture
   struct storable_picture *top_field;     // for mb aff, if frame for referencing the top field
   struct storable_picture *bottom_field;  // for mb aff, if frame for referencing the bottom field
   struct storable_picture *frame;         // for mb aff, if field for referencing the combined frame
+  struct storable_picture *ups_next;      // next picture holding quarter pel planes
+  struct storable_picture *pool_next;     // next released picture in the picture pool
 
 } StorablePicture;
 
@@ -174,8 +181,10 @@ typedef struct decoded_picture_buffer
 
 
 extern DecodedPictureBuffer dpb;
-extern StorablePicture **listX[6];
-extern int listXsize[6];
+extern THREAD_LOCAL StorablePicture **listX[6];
+extern THREAD_LOCAL int listXsize[6];
+extern int pic_pool_hits;
+extern int pic_pool_misses;
 
 void             init_dpb();
 void             free_dpb();
@@ -183,6 +192,10 @@ FrameStore*      alloc_frame_store();
 void             free_frame_store(FrameStore* f);
 StorablePicture* alloc_storable_picture(PictureStructure type, int size_x, int size_y, int size_x_cr, int size_y_cr);
 void             free_storable_picture(StorablePicture* p);
+void             flush_picture_pool();
+void             hold_released_pictures(int hold);
+void             alloc_ref_lists();
+void             free_ref_lists();
 void             store_picture_in_dpb(StorablePicture* p);
 void             replace_top_pic_with_frame(StorablePicture* p);
 void             flush_dpb();
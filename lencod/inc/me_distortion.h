@@ -0,0 +1,68 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file me_distortion.h
+ *
+ * \brief
+ *    SAD/SATD kernels used by the motion search
+ ************************************************************************
+ */
+#ifndef _ME_DISTORTION_H_
+#define _ME_DISTORTION_H_
+
+#include "global.h"
+
+
+/*!
+ *  SAD of the AxB block (A x B given by the block type) between orig_pic
+ *  and the reference block at ref with line stride ref_stride. The SAD is
+ *  added to mcost line by line; the summation stops after the first line
+ *  for which mcost >= min_mcost, exactly as the original loops did.
+ */
+typedef int (*SADFunction) (pel_t **orig_pic, pel_t *ref, int ref_stride, int mcost, int min_mcost);
+
+extern SADFunction computeSAD[8];                        //!< indexed by block type (1-16x16 ... 7-4x4)
+
+//! SATD of a 4x4 difference block (Hadamard)
+extern int  (*computeSATD)       (int *diff);
+//! sum of absolute values of a 4x4 difference block
+extern int  (*computeDiffSAD)    (int *diff);
+//! SA(T)D of a 4x4 block at the quarter-pel position (ry,rx) of an upsampled picture (interior only)
+extern int  (*computeSubPelCost) (pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx);
+/*!
+ *  4x4 SADs of the 16 blocks of a macroblock (orig with stride 16) at width x height
+ *  search positions, used by the fast full search setup. The SAD of block b (4*y+x in
+ *  4x4 blocks) for the macroblock position ref + y*ref_stride + x is stored in
+ *  sad[(b*height+y)*width+x]. width must be a multiple of 16; ref must be readable
+ *  for width+32 samples of height+15 lines.
+ */
+extern void (*computeSADField)   (pel_t *orig, pel_t *ref, int ref_stride, int width, int height, unsigned short *sad);
+//! sad = a + b for n SADs (n a multiple of 16), combines the SAD fields of two blocks
+extern void (*computeSADFieldSum)(unsigned short *sad, unsigned short *a, unsigned short *b, int n);
+//! index of the first of the n SADs that is not larger than threshold (n if there is none)
+extern int  (*computeSADBelow)   (unsigned short *sad, int n, int threshold);
+
+int   SADBlockType           (int blocksize_x, int blocksize_y);
+void  InitDistortionKernels  (int level, int self_check);
+void  CollectDistortionKernelStats();
+void  ReportDistortionKernels();
+
+#endif
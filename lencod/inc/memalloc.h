@@ -34,6 +34,26 @@
 
 #include "global.h"
 
+#define MEM_ALIGN  64     //!< alignment of the array and plane buffers in bytes
+
+//! view of a contiguous sample plane: sample (x,y) is data[y*stride + x]
+typedef struct
+{
+  byte *data;             //!< sample (0,0)
+  int   stride;           //!< distance of two rows in samples
+  int   width;
+  int   height;
+} PlaneView;
+
+void *mem_alloc_aligned (size_t size);
+void  mem_free_aligned  (void *ptr);
+void *get_mem_array     (int dims, const int size[], int elem_size, char *where);
+void  free_mem_array    (void *array, int dims);
+
+int       get_plane  (byte ***plane, int rows, int columns, int pad);
+void      free_plane (byte **plane, int pad);
+PlaneView plane_view (byte **plane, int rows, int columns);
+
 int  get_mem2D(byte ***array2D, int rows, int columns);
 int  get_mem2Dint(int ***array2D, int rows, int columns);
 int  get_mem2Dint64(int64 ***array2D, int rows, int columns);
@@ -162,7 +162,7 @@ Boolean GOPOverdue;
 
 
 //comput macroblock activity for rate control
-int diffy[16][16];
+extern THREAD_LOCAL int diffy[16][16];
 int diffyy[16][16];
 int diffy8[16][16];//for P8X8 mode 
 
@@ -0,0 +1,49 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file upsample.h
+ *
+ * \brief
+ *    Quarter pel luma planes of the reference pictures, interpolated on demand
+ ************************************************************************
+ */
+#ifndef _UPSAMPLE_H_
+#define _UPSAMPLE_H_
+
+#include "mbuffer.h"
+
+#define UPS_TILE_SHIFT  6                     //!< tiles of 64x64 quarter pel samples (16x16 pel)
+#define UPS_TILE_SIZE   (1<<UPS_TILE_SHIFT)
+
+#define UPS_PLANE       1                     //!< tile flag / plane selector: imgY_ups
+#define UPS_PLANE_W     2                     //!< tile flag / plane selector: imgY_ups_w
+
+void InitOneForthPixCache   ();
+void FreeOneForthPixCache   ();
+void ReportOneForthPixCache ();
+void StartOneForthPixPicture();
+
+void UnifiedOneForthPix     (StorablePicture *s);
+void FreeOneForthPix        (StorablePicture *s);
+void SetOneForthPixWeights  (StorablePicture *s, int weight, int offset, int round, int log_denom);
+void FillOneForthPix        (StorablePicture *s, int plane, int y0, int x0, int y1, int x1);
+
+#endif
@@ -31,39 +31,74 @@
  */
 #include <stdlib.h>
 #include <math.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "global.h"
 #include "biariencode.h"
 #include <assert.h>
 
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+//! renormalization shifts of a range (6..511), indexed by range>>3
+static const byte renorm_table_64[64] =
+{
+  6, 5, 4, 4, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+#endif
+
 /*!
  ************************************************************************
  * Macro for writing bytes of code
+ *
+ * Elow keeps the B_BITS of the coding interval below Equeue+8 bits
+ * shifted out of it. Once a byte (and the carry above it) is complete
+ * it replaces the pending byte Ebuffer, unless it is 0xff: a carry out
+ * of a later byte would still change it, so only Eoutstanding is
+ * counted. The carry is added when the pending and the outstanding
+ * bytes are written, the code buffer itself is never touched again.
  ***********************************************************************
  */
 
 #define put_byte() { \
-                     Ecodestrm[(*Ecodestrm_len)++] = Ebuffer; \
-                     Ebits_to_go = 8; \
-                     while (eep->C > 7) { \
-                       eep->C-=8; \
-                       eep->E++; \
+                     unsigned int out = Elow >> (Equeue + B_BITS); \
+                     Elow &= (ONE << Equeue) - 1; \
+                     Equeue -= 8; \
+                     if ((out & 0xff) == 0xff) \
+                       Eoutstanding++; \
+                     else \
+                     { \
+                       unsigned int carry = out >> 8; \
+                       if (Epending) \
+                         Ecodestrm[(*Ecodestrm_len)++] = (byte) (Ebuffer + carry); \
+                       for (; Eoutstanding > 0; Eoutstanding--) \
+                         Ecodestrm[(*Ecodestrm_len)++] = (byte) (0xff + carry); \
+                       Ebuffer  = out & 0xff; \
+                       Epending = 1; \
                      } \
-                    } 
-
-#define put_one_bit(b) { \
-                         Ebuffer <<= 1; Ebuffer |= (b); \
-                         if (--Ebits_to_go == 0) \
-                           put_byte(); \
-                       }
+                   }
 
-#define put_one_bit_plus_outstanding(b) { \
-                                          put_one_bit(b); \
-                                          while (Ebits_to_follow > 0) \
-                                          { \
-                                            Ebits_to_follow--; \
-                                            put_one_bit(!(b)); \
-                                          } \
-                                         }
+/*!
+ ************************************************************************
+ * \brief
+ *    number of shifts that bring a range back to QUARTER or above,
+ *    from the leading zeros of the range
+ ************************************************************************
+ */
+static __inline int renorm_bits(unsigned int range)
+{
+#if defined(__GNUC__)
+  return __builtin_clz(range) - (31 - (B_BITS-2));
+#elif defined(_MSC_VER)
+  unsigned long msb;
+  _BitScanReverse(&msb, range);
+  return (B_BITS-2) - (int) msb;
+#else
+  return renorm_table_64[range >> 3];
+#endif
+}
 
 
 /*!
@@ -114,9 +149,10 @@ void arienco_start_encoding(EncodingEnvironmentPtr eep,
                             int *code_len, /* int *last_startcode, */ int slice_type )
 {
   Elow = 0;
-  Ebits_to_follow = 0;
+  Eoutstanding = 0;
   Ebuffer = 0;
-  Ebits_to_go = 9; // to swallow first redundant bit
+  Epending = 0;
+  Equeue = -9; // the carry of the first byte is the redundant first bit
 
   Ecodestrm = code_buffer;
   Ecodestrm_len = code_len;
@@ -128,6 +164,8 @@ void arienco_start_encoding(EncodingEnvironmentPtr eep,
   eep->B = *code_len;
   eep->E = 0;
 
+  eep->Eestimate = 0;
+
 }
 
 /*!
@@ -138,7 +176,37 @@ void arienco_start_encoding(EncodingEnvironmentPtr eep,
  */
 int arienco_bits_written(EncodingEnvironmentPtr eep)
 {
-   return (8 * (*Ecodestrm_len /*-*Ecodestrm_laststartcode*/) + Ebits_to_follow + 8  - Ebits_to_go);
+   if (eep->Eestimate)
+     return (int) ((eep->Eest_bits + (1<<(EST_BITS_SHIFT-1))) >> EST_BITS_SHIFT);
+
+   return (8 * (*Ecodestrm_len /*-*Ecodestrm_laststartcode*/ + Epending + Eoutstanding) + Equeue + 8);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts the rate estimation: the following symbols are not encoded,
+ *    only their bits are counted from the (unchanged) context states;
+ *    arienco_bits_written() returns the estimated bits meanwhile
+ ************************************************************************
+ */
+void arienco_start_estimation(EncodingEnvironmentPtr eep)
+{
+  eep->Eestimate = 1;
+  eep->Eest_bits = 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Ends the rate estimation, the arithmetic coder continues where it
+ *    was when the estimation started
+ ************************************************************************
+ */
+void arienco_done_estimation(EncodingEnvironmentPtr eep)
+{
+  eep->Eestimate = 0;
 }
 
 
@@ -150,16 +218,28 @@ int arienco_bits_written(EncodingEnvironmentPtr eep)
  */
 void arienco_done_encoding(EncodingEnvironmentPtr eep)
 {
-  put_one_bit_plus_outstanding((Elow >> (B_BITS-1)) & 1);
-  put_one_bit((Elow >> (B_BITS-2))&1);
-  put_one_bit(1);
+  // the two leading bits of low and the stop bit follow the queued bits
+  Elow   = ((Elow & ~(QUARTER-1)) | (QUARTER>>1)) << 3;
+  Equeue += 3;
+  while (Equeue >= 0)
+    put_byte();
 
-  stat->bit_use_stuffingBits[img->type]+=(8-Ebits_to_go);
+  enc_stat->bit_use_stuffingBits[img->type]+=(Equeue+8) & 7;
 
-  while (Ebits_to_go != 8)
-    put_one_bit(0);
+  // align with zero bits, then write the pending and the outstanding bytes
+  if (Equeue > -8)
+  {
+    Elow <<= -Equeue;
+    Equeue = 0;
+    put_byte();
+  }
+  if (Epending)
+    Ecodestrm[(*Ecodestrm_len)++] = (byte) Ebuffer;
+  for (; Eoutstanding > 0; Eoutstanding--)
+    Ecodestrm[(*Ecodestrm_len)++] = 0xff;
+  Epending = 0;
 
-  eep->E= eep->E*8 + eep->C; // no of processed bins
+  eep->E= eep->C; // no of processed bins
   eep->B= (*Ecodestrm_len - eep->B); // no of written bytes
   eep->E -= (img->current_mb_nr-img->currentSlice->start_mb_nr);
   eep->E = (eep->E + 31)>>5;
@@ -179,8 +259,15 @@ void biari_encode_symbol(EncodingEnvironmentPtr eep, signed short symbol, BiCont
   register unsigned int range = Erange;
   register unsigned int low = Elow;
   unsigned int rLPS = rLPS_table_64x4[bi_ct->state][(range>>6) & 3];
+  int shift;
 
-  extern int cabac_encoding;
+  extern THREAD_LOCAL int cabac_encoding;
+
+  if (eep->Eestimate)
+  {
+    eep->Eest_bits += entropy_bits_64x2[bi_ct->state][(symbol != 0) != bi_ct->MPS];
+    return;
+  }
 
   if( cabac_encoding )
   {
@@ -205,32 +292,23 @@ void biari_encode_symbol(EncodingEnvironmentPtr eep, signed short symbol, BiCont
     bi_ct->state = AC_next_state_LPS_64[bi_ct->state]; // next state
   } 
   else 
-    bi_ct->state = AC_next_state_MPS_64[bi_ct->state]; // next state
- 
-
-  /* renormalisation */    
-  while (range < QUARTER)
   {
-    if (low >= HALF)
+    bi_ct->state = AC_next_state_MPS_64[bi_ct->state]; // next state
+    if (range >= QUARTER)
     {
-      put_one_bit_plus_outstanding(1);
-      low -= HALF;
+      Erange = range;
+      eep->C++;
+      return;
     }
-    else 
-      if (low < QUARTER)
-      {
-        put_one_bit_plus_outstanding(0);
-      }
-      else
-      {
-        Ebits_to_follow++;
-        low -= QUARTER;
-      }
-    low <<= 1;
-    range <<= 1;
   }
-  Erange = range;
-  Elow = low;
+
+  /* renormalisation, all shifts at once */
+  shift   = renorm_bits(range);
+  Erange  = range << shift;
+  Elow    = low << shift;
+  Equeue += shift;
+  if (Equeue >= 0)
+    put_byte();
   eep->C++;
 
 }
@@ -248,30 +326,23 @@ void biari_encode_symbol(EncodingEnvironmentPtr eep, signed short symbol, BiCont
 void biari_encode_symbol_eq_prob(EncodingEnvironmentPtr eep, signed short symbol)
 {
   register unsigned int low = (Elow<<1);
+
+  if (eep->Eestimate)
+  {
+    eep->Eest_bits += (1<<EST_BITS_SHIFT);
+    return;
+  }
   
   if (symbol != 0)
     low += Erange;
 
   /* renormalisation as for biari_encode_symbol; 
      note that low has already been doubled */ 
-  if (low >= ONE)
-  {
-    put_one_bit_plus_outstanding(1);
-    low -= ONE;
-  }
-  else 
-    if (low < HALF)
-    {
-      put_one_bit_plus_outstanding(0);
-    }
-    else
-    {
-      Ebits_to_follow++;
-      low -= HALF;
-    }
-    Elow = low;
-    eep->C++;
-    
+  Elow = low;
+  if (++Equeue >= 0)
+    put_byte();
+  eep->C++;
+
 }
 
 /*!
@@ -284,34 +355,33 @@ void biari_encode_symbol_final(EncodingEnvironmentPtr eep, signed short symbol)
 {
   register unsigned int range = Erange-2;
   register unsigned int low = Elow;
+  int shift;
+
+  if (eep->Eestimate)
+  {
+    // the terminating bin costs 7 bits, the others virtually nothing
+    if (symbol)
+      eep->Eest_bits += (7<<EST_BITS_SHIFT);
+    return;
+  }
   
   if (symbol) {
     low += range;
     range = 2;
   }
   
-  while (range < QUARTER)
+  // range is 2 (7 shifts) or at least QUARTER-2 (one shift at most)
+  if (range < QUARTER)
   {
-    if (low >= HALF)
-    {
-      put_one_bit_plus_outstanding(1);
-      low -= HALF;
-    }
-    else 
-      if (low < QUARTER)
-      {
-        put_one_bit_plus_outstanding(0);
-      }
-      else
-      {
-        Ebits_to_follow++;
-        low -= QUARTER;
-      }
-      low <<= 1;
-      range <<= 1;
+    shift   = symbol ? 7 : 1;
+    range <<= shift;
+    low   <<= shift;
+    Equeue += shift;
   }
   Erange = range;
   Elow = low;
+  if (Equeue >= 0)
+    put_byte();
   eep->C++;
 }
 
@@ -38,7 +38,7 @@
 #include "image.h"
 #include "mb_access.h"
 
-int last_dquant = 0;
+THREAD_LOCAL int last_dquant = 0;
 
 /***********************************************************************
  * L O C A L L Y   D E F I N E D   F U N C T I O N   P R O T O T Y P E S
@@ -1296,9 +1296,9 @@ void write_significant_coefficients (Macroblock* currMB, EncodingEnvironmentPtr
  */
 void writeRunLevel_CABAC (SyntaxElement *se, EncodingEnvironmentPtr eep_dp)
 {
-  static int  coeff[64];
-  static int  coeff_ctr = 0;
-  static int  pos       = 0;
+  static THREAD_LOCAL int  coeff[64];
+  static THREAD_LOCAL int  coeff_ctr = 0;
+  static THREAD_LOCAL int  pos       = 0;
 
   Macroblock* currMB    = &img->mb_data[img->current_mb_nr];
   int         i;
@@ -84,6 +84,7 @@
 #include "global.h"
 #include "configfile.h"
 #include "fast_me.h"
+#include "source_reader.h"
 
 
 #include "fmo.h"
@@ -692,11 +693,7 @@ static void PatchInp ()
   }
 
   // Open Files
-  if ((p_in=fopen(input->infile,"rb"))==NULL)
-  {
-    snprintf(errortext, ET_SIZE, "Input file %s does not exist",input->infile);
-    error (errortext, 500);
-  }
+  OpenSourceFile (input->infile);
 
   if (strlen (input->ReconFile) > 0 && (p_dec=fopen(input->ReconFile, "wb"))==NULL)
   {
@@ -826,6 +823,142 @@ static void PatchInp ()
     error (errortext, 500);
   }
 
+  if (input->SIMDKernels < 0 || input->SIMDKernels > 4)
+  {
+    snprintf(errortext, ET_SIZE, "SIMDKernels (%d) is out of range [0,4].", input->SIMDKernels);
+    error (errortext, 400);
+  }
+
+  if (input->SliceThreads < 0 || input->SliceThreads > MAX_SLICE_THREADS)
+  {
+    snprintf(errortext, ET_SIZE, "SliceThreads (%d) is out of range [0,%d].", input->SliceThreads, MAX_SLICE_THREADS);
+    error (errortext, 400);
+  }
+  if (input->SliceThreads > 1)
+  {
+    if (input->slice_mode != FIXED_MB)
+    {
+      snprintf(errortext, ET_SIZE, "SliceThreads requires SliceMode = 1 (fixed number of MBs per slice).");
+      error (errortext, 500);
+    }
+    if (input->RCEnable || input->rdopt == 2 || input->FMEnable || input->MbInterlace)
+    {
+      snprintf(errortext, ET_SIZE, "SliceThreads is not supported with rate control, RDOptimization = 2, UseFME or MB AFF.");
+      error (errortext, 500);
+    }
+  }
+
+  if (input->WavefrontME < 0 || input->WavefrontME > MAX_WAVEFRONT_THREADS)
+  {
+    snprintf(errortext, ET_SIZE, "WavefrontME (%d) is out of range [0,%d].", input->WavefrontME, MAX_WAVEFRONT_THREADS);
+    error (errortext, 400);
+  }
+  if (input->WavefrontME > 0)
+  {
+    if (input->WavefrontMERange < 0 || input->WavefrontMERange > input->search_range)
+    {
+      snprintf(errortext, ET_SIZE, "WavefrontMERange (%d) is out of range [0,SearchRange = %d].", input->WavefrontMERange, input->search_range);
+      error (errortext, 400);
+    }
+    if (input->FMEnable || input->MbInterlace)
+    {
+      snprintf(errortext, ET_SIZE, "WavefrontME is not supported with UseFME or MB AFF.");
+      error (errortext, 500);
+    }
+  }
+
+  if (input->FastFullSearchThreads < 0 || input->FastFullSearchThreads > MAX_FAST_FULL_SEARCH_THREADS)
+  {
+    snprintf(errortext, ET_SIZE, "FastFullSearchThreads (%d) is out of range [0,%d].", input->FastFullSearchThreads, MAX_FAST_FULL_SEARCH_THREADS);
+    error (errortext, 400);
+  }
+  if (input->FastFullSearchThreads > 0 && (input->SliceThreads > 1 || input->WavefrontME || input->ConcurrentPAFF))
+  {
+    snprintf(errortext, ET_SIZE, "FastFullSearchThreads is not supported with SliceThreads, WavefrontME or ConcurrentPAFF.");
+    error (errortext, 500);
+  }
+
+  if (input->HierarchicalME < 0 || input->HierarchicalME > 1)
+  {
+    snprintf(errortext, ET_SIZE, "HierarchicalME (%d) must be 0 or 1.", input->HierarchicalME);
+    error (errortext, 400);
+  }
+  if (input->HierarchicalME)
+  {
+    if (input->HierarchicalMERange < 0 || input->HierarchicalMERange > input->search_range)
+    {
+      snprintf(errortext, ET_SIZE, "HierarchicalMERange (%d) is out of range [0,SearchRange = %d].", input->HierarchicalMERange, input->search_range);
+      error (errortext, 400);
+    }
+    if (input->FMEnable || input->WavefrontME)
+    {
+      snprintf(errortext, ET_SIZE, "HierarchicalME is not supported with UseFME or WavefrontME.");
+      error (errortext, 500);
+    }
+  }
+
+  if (input->ReportSSIM < 0 || input->ReportSSIM > 1)
+  {
+    snprintf(errortext, ET_SIZE, "ReportSSIM (%d) must be 0 or 1.", input->ReportSSIM);
+    error (errortext, 400);
+  }
+
+  if (input->LossDecoderThreads < 0 || input->LossDecoderThreads > MAX_LOSS_DECODER_THREADS)
+  {
+    snprintf(errortext, ET_SIZE, "LossDecoderThreads (%d) is out of range [0,%d].", input->LossDecoderThreads, MAX_LOSS_DECODER_THREADS);
+    error (errortext, 400);
+  }
+
+  if (input->QPelCacheSize < 0)
+  {
+    snprintf(errortext, ET_SIZE, "QPelCacheSize (%d) must not be negative.", input->QPelCacheSize);
+    error (errortext, 400);
+  }
+
+  if (input->ConcurrentPAFF != 0 && input->ConcurrentPAFF != 1)
+  {
+    snprintf(errortext, ET_SIZE, "ConcurrentPAFF (%d) must be 0 or 1.", input->ConcurrentPAFF);
+    error (errortext, 400);
+  }
+  if (input->ConcurrentPAFF && input->PicInterlace == ADAPTIVE_CODING)
+  {
+    if (input->RCEnable || input->rdopt == 2 || input->FMEnable || input->MbInterlace || input->RestrictRef
+      || input->RandomIntraMBRefresh || input->WeightedPrediction || input->WeightedBiprediction
+      || input->SliceThreads > 1 || input->WavefrontME || input->QPelCacheSize)
+    {
+      snprintf(errortext, ET_SIZE, "ConcurrentPAFF is not supported with rate control, RDOptimization = 2, UseFME, MB AFF, RestrictRefFrames, RandomIntraMBRefresh, weighted prediction, SliceThreads, WavefrontME or QPelCacheSize.");
+      error (errortext, 500);
+    }
+  }
+  if (input->PAFFPreDecision < 0)
+  {
+    snprintf(errortext, ET_SIZE, "PAFFPreDecision (%d) must not be negative.", input->PAFFPreDecision);
+    error (errortext, 400);
+  }
+
+  if (input->FastModeDecision < 0 || input->FastModeDecision > 2)
+  {
+    snprintf(errortext, ET_SIZE, "FastModeDecision (%d) must be 0, 1 or 2.", input->FastModeDecision);
+    error (errortext, 400);
+  }
+
+  if (input->CABACRateEstimation != 0 && input->CABACRateEstimation != 1)
+  {
+    snprintf(errortext, ET_SIZE, "CABACRateEstimation (%d) must be 0 or 1.", input->CABACRateEstimation);
+    error (errortext, 400);
+  }
+
+  if (input->InputReadAhead < 0)
+  {
+    snprintf(errortext, ET_SIZE, "InputReadAhead (%d) must not be negative.", input->InputReadAhead);
+    error (errortext, 400);
+  }
+  if (input->InputMemoryMap != 0 && input->InputMemoryMap != 1)
+  {
+    snprintf(errortext, ET_SIZE, "InputMemoryMap (%d) must be 0 or 1.", input->InputMemoryMap);
+    error (errortext, 400);
+  }
+
 
   // Tian Dong: May 31, 2002
   // The number of frames in one sub-seq in enhanced layer should not exceed
@@ -222,6 +222,31 @@ void SetCtxModelNumber ()
 
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    returns 1 if SetCtxModelNumber() selects the context models of all
+ *    num_slices slices of the current picture (slice mode 1) without
+ *    looking at models stored by earlier slices of the same picture,
+ *    i.e. if the slices can be coded in any order
+ ************************************************************************
+ */
+int CtxModelsKnownBeforeCoding (int num_slices)
+{
+  int frame_field = img->field_picture;
+  int img_type    = img->type;
+  int ctx_number;
+
+  if (img->type==I_SLICE || input->context_init_method==FIXED)
+    return 1;
+
+  for (ctx_number=1; ctx_number<num_slices; ctx_number++)
+    if (!initialized [frame_field][img_type][ctx_number])
+      return 0;
+  return 1;
+}
+
+
 void init_contexts ()
 {
   MotionInfoContexts*  mc = img->currentSlice->mot_ctx;
@@ -40,6 +40,27 @@
 #include "global.h"
 #include "refbuf.h"
 #include "image.h"
+#include "memalloc.h"
+#include "metrics.h"
+
+//! group of simulated decoders evaluated by one job of the loss decoder threads
+typedef struct
+{
+  int first;                //!< first entry of decs->active[] of the group
+  int distortion;           //!< weighted distortion of the group
+} DecoderJob;
+
+static ThreadPool      *dec_pool = NULL;
+static DecoderJob       dec_jobs[MAX_LOSS_DECODER_THREADS];
+static int              dec_num_jobs;
+
+//! block decoded by the jobs, set by decoders_distortion()
+static ImageParameters *dec_master_img;
+static StorablePicture *dec_master_picture;
+static byte           **dec_master_org;
+static int              dec_mbmode, dec_b8block, dec_b8mode, dec_b8ref;
+
+static void diverge_decoder (int decoder);
 
 /*! 
  *************************************************************************************
@@ -59,6 +80,7 @@ void decode_one_b8block (int decoder, int mbmode, int b8block, int b8mode, int b
 
   int mv[2][BLOCK_MULTIPLE][BLOCK_MULTIPLE];
   int resY_tmp[MB_BLOCK_SIZE][MB_BLOCK_SIZE];
+  byte RefBlock[BLOCK_SIZE][BLOCK_SIZE];
 
   int i0 = (b8block%2)<<3,   i1 = i0+8,   bx0 = i0>>2,   bx1 = bx0+2;
   int j0 = (b8block/2)<<3,   j1 = j0+8,   by0 = j0>>2,   by1 = by0+2;
@@ -128,17 +150,17 @@ void decode_one_b8block (int decoder, int mbmode, int b8block, int b8mode, int b
                              block_y, block_x,
                              mv[0][by][bx],
                              mv[1][by][bx],
-                             decs->RefBlock);
+                             RefBlock);
         for (j=0; j<4; j++)
         for (i=0; i<4; i++)
         {
           /*
-          if (decs->RefBlock[j][i] != UMVPelY_14 (mref[ref_inx],
+          if (RefBlock[j][i] != UMVPelY_14 (mref[ref_inx],
                                                   (block_y*4+j)*4+mv[1][by][bx],
                                                   (block_x*4+i)*4+mv[0][by][bx]))
           ref_inx = (img->number-ref-1)%img->num_reference_frames;
           */
-          decs->decY[decoder][block_y*4+j][block_x*4+i] = resY_tmp[by*4+j][bx*4+i] + decs->RefBlock[j][i];
+          decs->decY[decoder][block_y*4+j][block_x*4+i] = resY_tmp[by*4+j][bx*4+i] + RefBlock[j][i];
         }
       }
     }
@@ -199,7 +221,7 @@ void Get_Reference_Block(byte **imY,
                          int block_x, 
                          int mvhor, 
                          int mvver, 
-                         byte **out)
+                         byte out[BLOCK_SIZE][BLOCK_SIZE])
 {
   int i,j,y,x;
 
@@ -378,15 +400,30 @@ byte Get_Reference_Pixel(byte **imY, int y_pos, int x_pos)
  */
 void UpdateDecoders()
 {
-  int k;
+  int k, i, j, lost;
+  int common = input->NoOfDecoders;
+
   for (k=0; k<input->NoOfDecoders; k++)
   {
     Build_Status_Map(decs->status_map); // simulates the packet losses
+    if (decs->decref[k] == NULL)
+    {
+      // decoders without losses keep sharing the common state
+      lost = 0;
+      for (j=0; j<img->height/MB_BLOCK_SIZE && !lost; j++)
+        for (i=0; i<img->width/MB_BLOCK_SIZE; i++)
+          lost |= decs->status_map[j][i];
+      if (!lost)
+        continue;
+      diverge_decoder (k);
+    }
     Error_Concealment(decs->decY_best[k], decs->status_map, decs->decref[k]); // for the moment error concealment is just a "copy"
     // Move decoded frames to reference buffers: (at the decoders this is done 
     // without interpolation (upsampling) - upsampling is done while decoding
     DecOneForthPix(decs->decY_best[k], decs->decref[k]); 
   }
+  if (decs->num_diverged < input->NoOfDecoders)
+    DecOneForthPix(decs->decY_best[common], decs->decref[common]);
 }
 /*! 
  *************************************************************************************
@@ -536,6 +573,7 @@ void Conceal_Error(byte **inY, int mb_y, int mb_x, byte ***refY, byte **s_map)
   int pos_y = mb_y*MB_BLOCK_SIZE, pos_x = mb_x*MB_BLOCK_SIZE;
   int mv[2][BLOCK_MULTIPLE][BLOCK_MULTIPLE];
   int resY[MB_BLOCK_SIZE][MB_BLOCK_SIZE];
+  byte RefBlock[BLOCK_SIZE][BLOCK_SIZE];
   int copy  = (decs->dec_mb_mode[mb_x][mb_y]==0 && (img->type==P_SLICE || (img->type==B_SLICE && img->nal_reference_idc>0)));
   int inter = (((decs->dec_mb_mode[mb_x][mb_y]>=1 && decs->dec_mb_mode[mb_x][mb_y]<=3) || decs->dec_mb_mode[mb_x][mb_y]==P8x8) && (img->type==P_SLICE || (img->type==B_SLICE && img->nal_reference_idc>0)));
   int ***tmp_mv = enc_picture->mv[LIST_0];
@@ -589,11 +627,11 @@ void Conceal_Error(byte **inY, int mb_y, int mb_x, byte ***refY, byte **s_map)
                                 block_y, block_x,
                                 mv[0][block_y - mb_y*BLOCK_SIZE][block_x - mb_x*BLOCK_SIZE],
                                 mv[1][block_y - mb_y*BLOCK_SIZE][block_x - mb_x*BLOCK_SIZE],
-                                decs->RefBlock);
+                                RefBlock);
             for (j=0;j<BLOCK_SIZE;j++)
               for (i=0;i<BLOCK_SIZE;i++)
               {
-                inY[block_y*BLOCK_SIZE + j][block_x*BLOCK_SIZE + i] = decs->RefBlock[j][i];
+                inY[block_y*BLOCK_SIZE + j][block_x*BLOCK_SIZE + i] = RefBlock[j][i];
               }
           }
       }
@@ -642,11 +680,11 @@ void Conceal_Error(byte **inY, int mb_y, int mb_x, byte ***refY, byte **s_map)
                                   block_y, block_x,
                                   mv[0][block_y - mb_y*BLOCK_SIZE][block_x - mb_x*BLOCK_SIZE],
                                   mv[1][block_y - mb_y*BLOCK_SIZE][block_x - mb_x*BLOCK_SIZE],
-                                  decs->RefBlock);
+                                  RefBlock);
               for (j=0;j<BLOCK_SIZE;j++)
                 for (i=0;i<BLOCK_SIZE;i++)
                 {
-                  inY[block_y*BLOCK_SIZE + j][block_x*BLOCK_SIZE + i] = decs->RefBlock[j][i];
+                  inY[block_y*BLOCK_SIZE + j][block_x*BLOCK_SIZE + i] = RefBlock[j][i];
                 }
             }
       }
@@ -671,3 +709,251 @@ void Conceal_Error(byte **inY, int mb_y, int mb_x, byte ***refY, byte **s_map)
     break;
   } //! End Switch
 }
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Allocates the state of the simulated decoders and starts the loss decoder
+ *    threads (LossDecoderThreads > 0)
+ *
+ * \note
+ *    All decoders start with the state of the common decoder (index NoOfDecoders),
+ *    which is decoded once for all of them. A decoder gets its own planes when
+ *    UpdateDecoders() simulates a loss for it.
+ *
+ * \return
+ *    memory size in bytes
+ *************************************************************************************
+ */
+int init_decoders()
+{
+  int memory_size = 0;
+  int common = input->NoOfDecoders;
+
+  memory_size += get_mem2Dint(&decs->resY, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
+  if ((decs->decref = (byte****) calloc(input->NoOfDecoders+1, sizeof(byte***))) == NULL) 
+    no_mem_exit("init_decoders: decref");
+  if ((decs->decY = (byte***) calloc(input->NoOfDecoders+1, sizeof(byte**))) == NULL) 
+    no_mem_exit("init_decoders: decY");
+  if ((decs->decY_best = (byte***) calloc(input->NoOfDecoders+1, sizeof(byte**))) == NULL) 
+    no_mem_exit("init_decoders: decY_best");
+  if ((decs->active = (int*) calloc(input->NoOfDecoders+1, sizeof(int))) == NULL) 
+    no_mem_exit("init_decoders: active");
+
+  memory_size += get_mem3D(&decs->decref[common], img->max_num_references+1, img->height, img->width);
+  memory_size += get_mem2D(&decs->decY[common], img->height, img->width);
+  memory_size += get_mem2D(&decs->decY_best[common], img->height, img->width);
+  memory_size += get_mem2D(&decs->status_map, img->height/MB_BLOCK_SIZE,img->width/MB_BLOCK_SIZE);
+  memory_size += get_mem2D(&decs->dec_mb_mode, img->width/MB_BLOCK_SIZE,img->height/MB_BLOCK_SIZE);
+
+  decs->active[0]    = common;
+  decs->num_active   = 1;
+  decs->num_diverged = 0;
+
+  if (input->LossDecoderThreads > 0)
+    dec_pool = create_thread_pool (input->LossDecoderThreads, NULL, NULL);
+
+  return memory_size;
+}
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Stops the loss decoder threads and frees the state of the simulated decoders
+ *************************************************************************************
+ */
+void free_decoders()
+{
+  int k;
+
+  if (dec_pool != NULL)
+  {
+    free_thread_pool (dec_pool);
+    dec_pool = NULL;
+  }
+
+  for (k=0; k<=input->NoOfDecoders; k++)
+  {
+    if (decs->decref[k] == NULL)
+      continue;
+    free_mem3D(decs->decref[k], img->max_num_references+1);
+    free_mem2D(decs->decY[k]);
+    free_mem2D(decs->decY_best[k]);
+  }
+  free(decs->decref);
+  free(decs->decY);
+  free(decs->decY_best);
+  free(decs->active);
+  free_mem2Dint(decs->resY);
+  free_mem2D(decs->status_map);
+  free_mem2D(decs->dec_mb_mode);
+}
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Gives a decoder its own copy of the common state, after the first loss it
+ *    no longer decodes the same pictures as the decoders without losses.
+ *************************************************************************************
+ */
+static void diverge_decoder (int decoder)
+{
+  int ref, j;
+  int common = input->NoOfDecoders;
+
+  get_mem3D(&decs->decref[decoder], img->max_num_references+1, img->height, img->width);
+  get_mem2D(&decs->decY[decoder], img->height, img->width);
+  get_mem2D(&decs->decY_best[decoder], img->height, img->width);
+
+  for (ref=0; ref<=img->max_num_references; ref++)
+    for (j=0; j<img->height; j++)
+      memcpy(decs->decref[decoder][ref][j], decs->decref[common][ref][j], img->width);
+  for (j=0; j<img->height; j++)
+  {
+    memcpy(decs->decY[decoder][j], decs->decY[common][j], img->width);
+    memcpy(decs->decY_best[decoder][j], decs->decY_best[common][j], img->width);
+  }
+
+  decs->num_diverged++;
+  if (decs->num_diverged == input->NoOfDecoders)
+    decs->active[0] = decoder;    // no decoder uses the common state any more
+  else
+    decs->active[decs->num_active++] = decoder;
+}
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Decodes the block set by decoders_distortion() at every step-th entry of
+ *    decs->active[] from first on and returns the distortion, weighted with the
+ *    number of decoders sharing the state
+ *************************************************************************************
+ */
+static int decoder_group_distortion (int first, int step)
+{
+  int n, k, x, y, size, weight;
+  int distortion = 0;
+
+  if (dec_b8block >= 0)
+  {
+    x    = img->opix_x + ((dec_b8block%2)<<3);
+    y    = img->opix_y + ((dec_b8block/2)<<3);
+    size = 8;
+  }
+  else
+  {
+    x    = img->opix_x;
+    y    = img->opix_y;
+    size = MB_BLOCK_SIZE;
+  }
+
+  for (n=first; n<decs->num_active; n+=step)
+  {
+    k = decs->active[n];
+    if (dec_b8block >= 0)
+      decode_one_b8block (k, dec_mbmode, dec_b8block, dec_b8mode, dec_b8ref);
+    else
+      decode_one_mb (k, &img->mb_data[img->current_mb_nr]);
+
+    weight = (k == input->NoOfDecoders) ? input->NoOfDecoders - decs->num_diverged : 1;
+    distortion += weight * block_sse (imgY_org, y, decs->decY[k], y, x, size, size);
+  }
+  return distortion;
+}
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Job of the loss decoder threads: one group of decoders
+ *************************************************************************************
+ */
+static void decoder_job (void *arg)
+{
+  DecoderJob *job = (DecoderJob *) arg;
+
+  // the jobs only read the coding state of the main thread
+  img         = dec_master_img;
+  enc_picture = dec_master_picture;
+  imgY_org    = dec_master_org;
+
+  job->distortion = decoder_group_distortion (job->first, dec_num_jobs);
+}
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Decodes one 8x8 block (b8block 0..3) or the whole macroblock (b8block < 0)
+ *    at all simulated decoders and returns the expected luma distortion
+ *************************************************************************************
+ */
+int decoders_distortion (int mbmode, int b8block, int b8mode, int b8ref)
+{
+  int n, distortion = 0;
+
+  dec_mbmode  = mbmode;
+  dec_b8block = b8block;
+  dec_b8mode  = b8mode;
+  dec_b8ref   = b8ref;
+
+  if (dec_pool == NULL || decs->num_active < 2)
+  {
+    distortion = decoder_group_distortion (0, 1);
+  }
+  else
+  {
+    dec_num_jobs = min (input->LossDecoderThreads, decs->num_active);
+    for (n=0; n<dec_num_jobs; n++)
+      dec_jobs[n].first = n;
+
+    dec_master_img     = img;
+    dec_master_picture = enc_picture;
+    dec_master_org     = imgY_org;
+    run_thread_pool (dec_pool, decoder_job, dec_jobs, sizeof (DecoderJob), dec_num_jobs);
+
+    for (n=0; n<dec_num_jobs; n++)
+      distortion += dec_jobs[n].distortion;
+  }
+
+  return distortion / input->NoOfDecoders;
+}
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Keeps the decoded values of the current macroblock for updating the
+ *    reference frames of the simulated decoders
+ *************************************************************************************
+ */
+void store_decoders_mb ()
+{
+  int n, k, j;
+
+  for (n=0; n<decs->num_active; n++)
+  {
+    k = decs->active[n];
+    for (j=img->pix_y; j<img->pix_y+MB_BLOCK_SIZE; j++)
+      memcpy(&decs->decY_best[k][j][img->pix_x], &decs->decY[k][j][img->pix_x], MB_BLOCK_SIZE);
+  }
+}
+
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Deblocks the decoded pictures of the simulated decoders
+ *************************************************************************************
+ */
+void deblock_decoders ()
+{
+  int n;
+
+  for (n=0; n<decs->num_active; n++)
+    DeblockFrame (img, decs->decY_best[decs->active[n]], NULL);
+}
@@ -77,6 +77,8 @@
 #include "refbuf.h"
 #include "mbuffer.h"
 #include "image.h"
+#include "me_distortion.h"
+#include "upsample.h"
 
 #define Q_BITS          15
 
@@ -159,28 +161,14 @@ void DefineThresholdMB()
 
 int get_mem_mincost (int****** mv)
 {
-  int i, j, k, l;
+  int size[5];
 
-  if ((*mv = (int*****)calloc(input->img_width/4,sizeof(int****))) == NULL)
-    no_mem_exit ("get_mem_mv: mv");
-  for (i=0; i<input->img_width/4; i++)
-  {
-    if (((*mv)[i] = (int****)calloc(input->img_height/4,sizeof(int***))) == NULL)
-      no_mem_exit ("get_mem_mv: mv");
-    for (j=0; j<input->img_height/4; j++)
-    {
-      if (((*mv)[i][j] = (int***)calloc(img->max_num_references, sizeof(int**))) == NULL)
-        no_mem_exit ("get_mem_mv: mv");
-      for (k=0; k<img->max_num_references; k++)
-      {
-        if (((*mv)[i][j][k] = (int**)calloc(9,sizeof(int*))) == NULL)
-          no_mem_exit ("get_mem_mv: mv");
-        for (l=0; l<9; l++)
-          if (((*mv)[i][j][k][l] = (int*)calloc(3,sizeof(int))) == NULL)
-            no_mem_exit ("get_mem_mv: mv");
-      }
-    }
-  }
+  size[0] = input->img_width/4;
+  size[1] = input->img_height/4;
+  size[2] = img->max_num_references;
+  size[3] = 9;
+  size[4] = 3;
+  *mv = (int*****) get_mem_array (5, size, sizeof(int), "get_mem_mincost: mv");
 
   return input->img_width/4*input->img_height/4*img->max_num_references*9*3*sizeof(int);
 }
@@ -195,29 +183,14 @@ int get_mem_mincost (int****** mv)
  */
 int get_mem_bwmincost (int****** mv)
 {
-  int i, j, k, l;
+  int size[5];
 
-
-  if ((*mv = (int*****)calloc(input->img_width/4,sizeof(int****))) == NULL)
-    no_mem_exit ("get_mem_mv: mv");
-  for (i=0; i<input->img_width/4; i++)
-  {
-    if (((*mv)[i] = (int****)calloc(input->img_height/4,sizeof(int***))) == NULL)
-      no_mem_exit ("get_mem_mv: mv");
-    for (j=0; j<input->img_height/4; j++)
-    {
-      if (((*mv)[i][j] = (int***)calloc(img->max_num_references,sizeof(int**))) == NULL)
-        no_mem_exit ("get_mem_mv: mv");
-      for (k=0; k<img->max_num_references; k++)
-      {
-        if (((*mv)[i][j][k] = (int**)calloc(9,sizeof(int*))) == NULL)
-          no_mem_exit ("get_mem_mv: mv");
-        for (l=0; l<9; l++)
-          if (((*mv)[i][j][k][l] = (int*)calloc(3,sizeof(int))) == NULL)
-            no_mem_exit ("get_mem_mv: mv");
-      }
-    }
-  }
+  size[0] = input->img_width/4;
+  size[1] = input->img_height/4;
+  size[2] = img->max_num_references;
+  size[3] = 9;
+  size[4] = 3;
+  *mv = (int*****) get_mem_array (5, size, sizeof(int), "get_mem_bwmincost: mv");
 
   return input->img_width/4*input->img_height/4*img->max_num_references*9*3*sizeof(int);
 }
@@ -242,23 +215,7 @@ int get_mem_FME()
  */
 void free_mem_mincost (int***** mv)
 {
-  int i, j, k, l;
-
-  for (i=0; i<input->img_width/4; i++)
-  {
-    for (j=0; j<input->img_height/4; j++)
-    {
-      for (k=0; k<img->max_num_references; k++)
-      {
-        for (l=0; l<9; l++)
-          free (mv[i][j][k][l]);
-        free (mv[i][j][k]);
-      }
-      free (mv[i][j]);
-    }
-    free (mv[i]);
-  }
-  free (mv);
+  free_mem_array (mv, 5);
 }
 
 /*!
@@ -271,23 +228,7 @@ void free_mem_mincost (int***** mv)
  */
 void free_mem_bwmincost (int***** mv)
 {
-  int i, j, k, l;
-
-  for (i=0; i<input->img_width/4; i++)
-  {
-    for (j=0; j<input->img_height/4; j++)
-    {
-      for (k=0; k<img->max_num_references; k++)
-      {
-        for (l=0; l<9; l++)
-          free (mv[i][j][k][l]);
-        free (mv[i][j][k]);
-      }
-      free (mv[i][j]);
-    }
-    free (mv[i]);
-  }
-  free (mv);
+  free_mem_array (mv, 5);
 }
 
 void free_mem_FME()
@@ -302,27 +243,17 @@ void free_mem_FME()
 
 int PartCalMad(pel_t *ref_pic,pel_t** orig_pic,pel_t *(*get_ref_line)(int, pel_t*, int, int, int, int), int blocksize_y,int blocksize_x, int blocksize_x4,int mcost,int min_mcost,int cand_x,int cand_y)
 {
-  int y,x4;
+  int y;
   int height=((img->MbaffFrameFlag)&&(img->mb_data[img->current_mb_nr].mb_field))?img->height/2:img->height;
-  pel_t *orig_line, *ref_line;
+  int blocktype = SADBlockType (blocksize_x, blocksize_y);
+  pel_t umv_block[16*16];
+
+  if (get_ref_line == FastLineX)
+    return computeSAD[blocktype] (orig_pic, ref_pic + cand_y*img->width + cand_x, img->width, mcost, min_mcost);
+
   for (y=0; y<blocksize_y; y++)
-    {
-    ref_line  = get_ref_line (blocksize_x, ref_pic, cand_y+y, cand_x, /*img->*/height, img->width);//2004.3.3
-    orig_line = orig_pic [y];
-    
-    for (x4=0; x4<blocksize_x4; x4++)
-    {
-      mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-      mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-      mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-      mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-    }
-    if (mcost >= min_mcost)
-    {
-      break;
-    }
-    }
-    return mcost;
+    memcpy (umv_block + 16*y, get_ref_line (blocksize_x, ref_pic, cand_y+y, cand_x, /*img->*/height, img->width), blocksize_x);//2004.3.3
+  return computeSAD[blocktype] (orig_pic, umv_block, 16, mcost, min_mcost);
 }
 
 /*!
@@ -677,10 +608,14 @@ int AddUpSADQuarter(int pic_pix_x,int pic_pix_y,int blocksize_x,int blocksize_y,
   int yy,kk,xx;
   int   curr_diff[MB_BLOCK_SIZE][MB_BLOCK_SIZE]; // for ABT SATD calculation
 //2004.3.3
-  pel_t **ref_pic = ref_picture->imgY_ups;
+  pel_t **ref_pic;
   int img_width  = ref_picture->size_x;
   int img_height = ref_picture->size_y;
 
+  FillOneForthPix (ref_picture, UPS_PLANE, (pic_pix_y<<2) + cand_mv_y, (pic_pix_x<<2) + cand_mv_x,
+                   ((pic_pix_y+blocksize_y-1)<<2) + cand_mv_y, ((pic_pix_x+blocksize_x-1)<<2) + cand_mv_x);
+  ref_pic = ref_picture->imgY_ups;
+
   
   for (y0=0, abort_search=0; y0<blocksize_y && !abort_search; y0+=4)
   {
@@ -689,6 +624,17 @@ int AddUpSADQuarter(int pic_pix_x,int pic_pix_y,int blocksize_x,int blocksize_y,
     for (x0=0; x0<blocksize_x; x0+=4)
     {
       rx0 = ((pic_pix_x+x0)<<2) + cand_mv_x;
+
+      if (!useABT && PelY_14 == FastPelY_14)
+      {
+        if ((mcost += computeSubPelCost (orig_pic + y0, x0, ref_pic, ry0, rx0)) > min_mcost)
+        {
+          abort_search = 1;
+          break;
+        }
+        continue;
+      }
+
       d   = diff;
       
       orig_line = orig_pic [y0  ];    ry=ry0;
@@ -761,7 +707,6 @@ FastSubPelBlockMotionSearch (pel_t**   orig_pic,      // <--  original pixel val
   int   incr            = list==1 ? ((!img->fld_type)&&(enc_picture!=enc_frame_picture)&&(img->type==B_SLICE)) : (enc_picture==enc_frame_picture)&&(img->type==B_SLICE) ;
   int   list_offset   = ((img->MbaffFrameFlag)&&(img->mb_data[img->current_mb_nr].mb_field))? img->current_mb_nr%2 ? 4 : 2 : 0;
   StorablePicture *ref_picture = listX[list+list_offset][ref];
-  pel_t **ref_pic = ref_picture->imgY_ups;
   
   int   lambda_factor   = LAMBDA_FACTOR (lambda);
   int   mv_shift        = 0;
@@ -109,8 +109,8 @@ int start_sequence()
   len += WriteNALU (nalu);
   FreeNALU (nalu);
 
-//  stat->bit_ctr_parametersets = len;
-    stat->bit_ctr_parametersets_n = len;
+//  enc_stat->bit_ctr_parametersets = len;
+    enc_stat->bit_ctr_parametersets_n = len;
   return 0;
 }
 
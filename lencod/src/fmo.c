@@ -82,11 +82,12 @@
 #include "image.h"
 
 
-static int FirstMBInSlice[MAXSLICEGROUPIDS];
+// per thread: the PAFF thread codes the frame while the main thread codes the fields
+static THREAD_LOCAL int FirstMBInSlice[MAXSLICEGROUPIDS];
 
-int *MBAmap = NULL;   
-int *MapUnitToSliceGroupMap = NULL; 
-unsigned PicSizeInMapUnits;
+THREAD_LOCAL int *MBAmap = NULL;   
+THREAD_LOCAL int *MapUnitToSliceGroupMap = NULL; 
+THREAD_LOCAL unsigned PicSizeInMapUnits;
 
 
 static void FmoGenerateType0MapUnitMap (ImageParameters * img, pic_parameter_set_rbsp_t * pps);
@@ -50,7 +50,7 @@
 #define SYMTRACESTRING(s) // do nothing
 #endif
 
-int * assignSE2partition[2] ;
+THREAD_LOCAL int * assignSE2partition[2] ;
 int assignSE2partition_NoDP[SE_MAX_ELEMENTS] =
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 int assignSE2partition_DP[SE_MAX_ELEMENTS] =
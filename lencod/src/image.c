@@ -63,6 +63,10 @@
 #include "nalu.h"
 #include "ratectl.h"
 #include "mb_access.h"
+#include "upsample.h"
+#include "source_reader.h"
+#include "me_distortion.h"
+#include "metrics.h"
 
 void code_a_picture(Picture *pic);
 void frame_picture (Picture *frame);
@@ -70,6 +74,12 @@ void field_picture(Picture *top, Picture *bottom);
 
 static int  writeout_picture(Picture *pic);
 
+static void init_frame_picture();
+static void code_frame_picture(Picture *frame);
+static int  paff_pre_decision();
+static void start_frame_trial();
+static void finish_frame_trial();
+
 static int  picture_structure_decision(Picture *frame, Picture *top, Picture *bot);
 static void distortion_fld (float *dis_fld_y, float *dis_fld_u, float *dis_fld_v);
 static void find_snr();
@@ -86,13 +96,11 @@ static void put_buffer_top();
 static void put_buffer_bot();
 
 static void copy_motion_vectors_MB();
+static void set_chroma_vector_adjustment();
 
 static void CopyFrameToOldImgOrgVariables (Sourceframe *sf);
 static void CopyTopFieldToOldImgOrgVariables (Sourceframe *sf);
 static void CopyBottomFieldToOldImgOrgVariables (Sourceframe *sf);
-static Sourceframe *AllocSourceframe (int xs, int ys);
-static void FreeSourceframe (Sourceframe *sf);
-static void ReadOneFrame (int FrameNoInFile, int HeaderSize, int xs, int ys, Sourceframe *sf);
 static void writeUnit(Bitstream* currStream ,int partition);
 
 #ifdef _ADAPT_LAST_GROUP_
@@ -122,12 +130,34 @@ static int CalculateFrameNumber();  // Calculates the next frame number
 static int FrameNumberInFile;       // The current frame number in the input file
 static Sourceframe *srcframe;
 
-StorablePicture *enc_picture;
+THREAD_LOCAL StorablePicture *enc_picture;
 StorablePicture *enc_frame_picture;
 StorablePicture *enc_top_picture;
 StorablePicture *enc_bottom_picture;
 //Rate control
-int    QP;
+extern THREAD_LOCAL int QP;
+extern THREAD_LOCAL ColocatedParams *Co_located;
+
+/*****
+ *****  ConcurrentPAFF: the frame trial of picture adaptive frame/field coding
+ *****  is coded on the PAFF thread while the main thread codes the fields
+ *****/
+#define PAFF_INIT   0   //!< PAFF thread: setting up its coding state
+#define PAFF_IDLE   1   //!< PAFF thread: waiting for a frame trial
+#define PAFF_CODE   2   //!< main thread: frame trial set up, paff_img holds its img
+#define PAFF_LISTS  3   //!< PAFF thread: reference lists of the frame built, the dpb may change
+#define PAFF_DONE   4   //!< PAFF thread: frame trial coded, results in paff_stat etc.
+#define PAFF_EXIT   5   //!< main thread: the PAFF thread has to free its state and exit
+
+static JMThread        *paff_thread = NULL;
+static JMMutex         *paff_lock;
+static JMCond          *paff_cond;
+static int              paff_state;
+static ImageParameters  paff_img;            //!< img of the main thread at the start of the frame trial
+static ImageParameters *paff_thread_img;     //!< img of the PAFF thread
+static StatParameters   paff_stat;           //!< statistics of the frame trial
+static int              paff_me_time, paff_header_bits, paff_texture_bits;
+THREAD_LOCAL int paff_worker = 0;            //!< set on the PAFF thread
 
 const int ONE_FOURTH_TAP[3][2] =
 {
@@ -196,7 +226,6 @@ void code_a_picture(Picture *pic)
 {
   int NumberOfCodedMBs = 0;
   int SliceGroup = 0;
-  int j;
 
   img->currentPicture = pic;
 
@@ -205,6 +234,8 @@ void code_a_picture(Picture *pic)
   pic->no_slices = 0;
   pic->distortion_u = pic->distortion_v = pic->distortion_y = 0.0;
 
+  StartOneForthPixPicture ();   //! quarter pel planes used from now on are kept by the cache
+
   // restrict list 1 size
   img->num_ref_idx_l0_active = max(1, (img->type==B_SLICE ? active_pps->num_ref_idx_l0_active_minus1 + 1: active_pps->num_ref_idx_l0_active_minus1 +1 )); 
   img->num_ref_idx_l1_active = (img->type==B_SLICE ? active_pps->num_ref_idx_l1_active_minus1 + 1 : 0);
@@ -246,6 +277,18 @@ void code_a_picture(Picture *pic)
   if (img->structure==FRAME)
     init_mbaff_lists();
 
+  if (!img->MbaffFrameFlag)
+    set_chroma_vector_adjustment ();
+
+  // the main thread waits with the field trial and its dpb changes until here
+  if (paff_worker)
+  {
+    lock_mutex (paff_lock);
+    paff_state = PAFF_LISTS;
+    broadcast_cond (paff_cond);
+    unlock_mutex (paff_lock);
+  }
+
   if (img->type != I_SLICE && (input->WeightedPrediction == 1 || (input->WeightedBiprediction > 0 && (img->type == B_SLICE))))
   {
   	if (img->type==P_SLICE || img->type==SP_SLICE)
@@ -255,7 +298,8 @@ void code_a_picture(Picture *pic)
   }
 
   
-  RandomIntraNewPicture ();     //! Allocates forced INTRA MBs (even for fields!)
+  if (!paff_worker)             // RandomIntraMBRefresh is not used with ConcurrentPAFF
+    RandomIntraNewPicture ();     //! Allocates forced INTRA MBs (even for fields!)
 
   // The slice_group_change_cycle can be changed here.
   // FmoInit() is called before coding each picture, frame or field
@@ -264,6 +308,10 @@ void code_a_picture(Picture *pic)
 	
   FmoStartPicture ();           //! picture level initialization of FMO
 
+  WavefrontMotionSearch ();     //! integer-pel motion search pre-pass (WavefrontME)
+
+  NumberOfCodedMBs = encode_slices_parallel (pic);   // 0 if the slices are coded one by one
+
   while (NumberOfCodedMBs < img->total_number_mb)       // loop over slices
   {
     // Encode one SLice Group
@@ -274,7 +322,7 @@ void code_a_picture(Picture *pic)
       FmoSetLastMacroblockInSlice (img->current_mb_nr);
       // Proceed to next slice
       img->current_slice_nr++;
-      stat->bit_slice = 0;
+      enc_stat->bit_slice = 0;
     }
     // Proceed to next SliceGroup
     SliceGroup++;
@@ -282,8 +330,7 @@ void code_a_picture(Picture *pic)
   FmoEndPicture ();
 
   if (input->rdopt == 2 && (img->type != B_SLICE))
-    for (j = 0; j < input->NoOfDecoders; j++)
-      DeblockFrame (img, decs->decY_best[j], NULL);
+    deblock_decoders ();
 
   DeblockFrame (img, enc_picture->imgY, enc_picture->imgUV);
 
@@ -294,6 +341,32 @@ void code_a_picture(Picture *pic)
 
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets the chroma vector offsets of the list 0 and list 1 reference
+ *    pictures for the current picture (per macroblock for MB AFF frames,
+ *    see encode_one_macroblock())
+ ************************************************************************
+ */
+static void set_chroma_vector_adjustment ()
+{
+  int l, k;
+
+  for (l=0; l<2; l++)
+  {
+    for(k = 0; k < listXsize[l]; k++)
+    {
+      listX[l][k]->chroma_vector_adjustment= 0;
+      if(img->structure == TOP_FIELD && img->structure != listX[l][k]->structure)
+        listX[l][k]->chroma_vector_adjustment = -2;
+      if(img->structure == BOTTOM_FIELD && img->structure != listX[l][k]->structure)
+        listX[l][k]->chroma_vector_adjustment = 2;
+    }
+  }
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -322,6 +395,7 @@ int encode_one_frame ()
 #endif
 
   int tmp_time;
+  int trials;                   // structures coded: FRAME_CODING, FIELD_CODING or ADAPTIVE_CODING (both)
   int bits_frm = 0, bits_fld = 0;
   float dis_frm = 0, dis_frm_y = 0, dis_frm_u = 0, dis_frm_v = 0;
   float dis_fld = 0, dis_fld_y = 0, dis_fld_u = 0, dis_fld_v = 0;
@@ -357,8 +431,7 @@ int encode_one_frame ()
   init_frame ();
   FrameNumberInFile = CalculateFrameNumber();
 
-  srcframe = AllocSourceframe (img->width, img->height);
-  ReadOneFrame (FrameNumberInFile, input->infile_header, img->width, img->height, srcframe);
+  srcframe = GetSourceFrame (FrameNumberInFile);
   CopyFrameToOldImgOrgVariables (srcframe);
 
   // Set parameters for directmode and Deblocking filter
@@ -368,7 +441,9 @@ int encode_one_frame ()
   img->LFBetaOffset    = input->LFBetaOffset;
 
   if (img->type == B_SLICE)
-    Bframe_ctr++;         // Bframe_ctr only used for statistics, should go to stat->
+    Bframe_ctr++;         // Bframe_ctr only used for statistics, should go to enc_stat->
+
+  trials = input->PicInterlace;
 
   if (input->PicInterlace == FIELD_CODING)
   {
@@ -412,7 +487,15 @@ int encode_one_frame ()
     if( active_sps->frame_mbs_only_flag)
       img->TopFieldFlag=0;
 
-    frame_picture (frame_pic);
+    if (input->PicInterlace == ADAPTIVE_CODING && input->PAFFPreDecision)
+      trials = paff_pre_decision ();
+
+    if (trials == FIELD_CODING)
+      enc_frame_picture = NULL;
+    else if (trials == ADAPTIVE_CODING && paff_thread)
+      start_frame_trial ();     // the frame is coded on the PAFF thread
+    else
+      frame_picture (frame_pic);
    
     // For field coding, turn MB level field/frame coding flag off
     if (input->MbInterlace)
@@ -420,20 +503,28 @@ int encode_one_frame ()
     
     if (input->PicInterlace == ADAPTIVE_CODING)
     {
-      //Rate control
-      img->FieldControl=1;
-      img->write_macroblock = 0;
-      img->bot_MB = 0;
+      if (trials != FRAME_CODING)
+      {
+        //Rate control
+        img->FieldControl=1;
+        img->write_macroblock = 0;
+        img->bot_MB = 0;
 
-      img->field_picture = 1;  // we encode fields
-      field_picture (top_pic, bottom_pic);
+        img->field_picture = 1;  // we encode fields
+        field_picture (top_pic, bottom_pic);
+      }
+      if (trials == ADAPTIVE_CODING && paff_thread)
+        finish_frame_trial ();
       
       //! Note: the distortion for a field coded picture is stored in the top field
       //! the distortion values in the bottom field are dummies
       dis_fld = top_pic->distortion_y + top_pic->distortion_u + top_pic->distortion_v;
       dis_frm = frame_pic->distortion_y + frame_pic->distortion_u + frame_pic->distortion_v;
       
-      img->fld_flag = picture_structure_decision (frame_pic, top_pic, bottom_pic);
+      if (trials == ADAPTIVE_CODING)
+        img->fld_flag = picture_structure_decision (frame_pic, top_pic, bottom_pic);
+      else
+        img->fld_flag = (trials == FIELD_CODING);
       update_field_frame_contexts (img->fld_flag);
 
       //Rate control
@@ -449,9 +540,9 @@ int encode_one_frame ()
   }
 
   if (img->fld_flag)
-    stat->bit_ctr_emulationprevention += stat->em_prev_bits_fld;
+    enc_stat->bit_ctr_emulationprevention += enc_stat->em_prev_bits_fld;
   else
-    stat->bit_ctr_emulationprevention += stat->em_prev_bits_frm;
+    enc_stat->bit_ctr_emulationprevention += enc_stat->em_prev_bits_frm;
 
   if (img->type != B_SLICE)
   {
@@ -492,7 +583,7 @@ int encode_one_frame ()
   //Rate control
   if(input->RCEnable)
   {
-    bits = stat->bit_ctr-stat->bit_ctr_n;
+    bits = enc_stat->bit_ctr-enc_stat->bit_ctr_n;
     rc_update_pict_frame(bits);
   }
 
@@ -520,7 +611,7 @@ int encode_one_frame ()
   tmp_time = (ltime2 * 1000 + tstruct2.millitm) - (ltime1 * 1000 + tstruct1.millitm);
   tot_time = tot_time + tmp_time;
 
-  if (input->PicInterlace == ADAPTIVE_CODING)
+  if (input->PicInterlace == ADAPTIVE_CODING && trials == ADAPTIVE_CODING)
   {
     if (img->fld_flag)
     {
@@ -550,7 +641,7 @@ int encode_one_frame ()
 
 #ifdef _LEAKYBUCKET_
   // Store bits used for this frame and increment counter of no. of coded frames
-  Bit_Buffer[total_frame_buffer] = stat->bit_ctr - stat->bit_ctr_n;
+  Bit_Buffer[total_frame_buffer] = enc_stat->bit_ctr - enc_stat->bit_ctr_n;
   total_frame_buffer++;
 #endif
 
@@ -566,7 +657,7 @@ int encode_one_frame ()
     prev_frame_no = frame_no;
   }
 
-  if (stat->bit_ctr_parametersets_n!=0)
+  if (enc_stat->bit_ctr_parametersets_n!=0)
     ReportNALNonVLCBits(tmp_time, me_time);
 
   if (IMG_NUMBER == 0)
@@ -578,28 +669,28 @@ int encode_one_frame ()
     if(input->RCEnable)
     {
       if((!input->PicInterlace)&&(!input->MbInterlace))
-        bits=stat->bit_ctr-stat->bit_ctr_n;
+        bits=enc_stat->bit_ctr-enc_stat->bit_ctr_n;
       else
       {
-        bits = stat->bit_ctr -Pprev_bits; // used for rate control update */
-        Pprev_bits = stat->bit_ctr;
+        bits = enc_stat->bit_ctr -Pprev_bits; // used for rate control update */
+        Pprev_bits = enc_stat->bit_ctr;
       }
     }
 
     switch (img->type)
     {
     case I_SLICE:
-      stat->bit_ctr_P += stat->bit_ctr - stat->bit_ctr_n;
+      enc_stat->bit_ctr_P += enc_stat->bit_ctr - enc_stat->bit_ctr_n;
 	  ReportIntra(tmp_time,me_time);
       //ReportIntra(tmp_time);
       break;
     case SP_SLICE:
-      stat->bit_ctr_P += stat->bit_ctr - stat->bit_ctr_n;
+      enc_stat->bit_ctr_P += enc_stat->bit_ctr - enc_stat->bit_ctr_n;
       ReportSP(tmp_time,me_time);
       //ReportSP(tmp_time);
       break;
     case B_SLICE:
-      stat->bit_ctr_B += stat->bit_ctr - stat->bit_ctr_n;
+      enc_stat->bit_ctr_B += enc_stat->bit_ctr - enc_stat->bit_ctr_n;
       if (img->nal_reference_idc>0)
         ReportBS(tmp_time,me_time);
         //ReportBS(tmp_time);
@@ -609,12 +700,12 @@ int encode_one_frame ()
 
       break;
     default:      // P
-      stat->bit_ctr_P += stat->bit_ctr - stat->bit_ctr_n;
+      enc_stat->bit_ctr_P += enc_stat->bit_ctr - enc_stat->bit_ctr_n;
       ReportP(tmp_time,me_time);
       //ReportP(tmp_time);
     }
   }
-  stat->bit_ctr_n = stat->bit_ctr;
+  enc_stat->bit_ctr_n = enc_stat->bit_ctr;
 
   //Rate control
   if(input->RCEnable) 
@@ -628,9 +719,9 @@ int encode_one_frame ()
       updateRCModel();
   }
 
-  stat->bit_ctr_parametersets_n=0;
+  enc_stat->bit_ctr_parametersets_n=0;
 
-  FreeSourceframe (srcframe);
+  ReleaseSourceFrame (srcframe);
 
   if (IMG_NUMBER == 0)
     return 0;
@@ -676,12 +767,12 @@ static int writeout_picture(Picture *pic)
 /*!
  ************************************************************************
  * \brief
- *    Encodes a frame picture
+ *    Sets up the coding of a frame picture and allocates its
+ *    reconstruction
  ************************************************************************
  */
-void frame_picture (Picture *frame)
+static void init_frame_picture ()
 {
-
   img->structure = FRAME;
   img->PicSizeInMbs = img->FrameSizeInMbs;
 
@@ -699,15 +790,25 @@ void frame_picture (Picture *frame)
 
   enc_picture=enc_frame_picture;
 
-  stat->em_prev_bits_frm = 0;
-  stat->em_prev_bits = &stat->em_prev_bits_frm;
+  enc_stat->em_prev_bits_frm = 0;
+  enc_stat->em_prev_bits = &enc_stat->em_prev_bits_frm;
 
   if (img->MbaffFrameFlag)
   {
     CopyTopFieldToOldImgOrgVariables (srcframe);
     CopyBottomFieldToOldImgOrgVariables (srcframe);
   }
+}
+
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Codes a frame picture set up by init_frame_picture()
+ ************************************************************************
+ */
+static void code_frame_picture (Picture *frame)
+{
   img->fld_flag = 0;
   code_a_picture(frame);
 
@@ -723,6 +824,302 @@ void frame_picture (Picture *frame)
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Encodes a frame picture
+ ************************************************************************
+ */
+void frame_picture (Picture *frame)
+{
+  init_frame_picture ();
+  code_frame_picture (frame);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Decides the picture structure before coding (PAFFPreDecision).
+ *    The vertical activity of the source frame, the sum of the absolute
+ *    differences of adjacent lines, is compared with that of its fields,
+ *    the differences of the lines two apart. Interlaced motion makes the
+ *    frame lines jagged, smooth or static content favours the frame.
+ * \return
+ *    FIELD_CODING or FRAME_CODING if the activity of the other structure
+ *    is larger by more than PAFFPreDecision percent, ADAPTIVE_CODING if
+ *    both structures have to be coded
+ ************************************************************************
+ */
+static int paff_pre_decision ()
+{
+  int64 sad_frm = 0, sad_fld = 0;
+  int x, y;
+
+  for (y = 0; y < input->img_height - 2; y++)
+    for (x = 0; x < input->img_width; x++)
+    {
+      sad_frm += abs (imgY_org_frm[y][x] - imgY_org_frm[y+1][x]);
+      sad_fld += abs (imgY_org_frm[y][x] - imgY_org_frm[y+2][x]);
+    }
+
+  if (sad_frm * 100 > sad_fld * (100 + input->PAFFPreDecision))
+    return FIELD_CODING;
+  if (sad_fld * 100 > sad_frm * (100 + input->PAFFPreDecision))
+    return FRAME_CODING;
+  return ADAPTIVE_CODING;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up the coding state of the PAFF thread: private copies of img,
+ *    enc_stat and snr, of the picture buffers written while coding a frame
+ *    and of the per thread motion search and RD buffers.
+ *    Runs on the PAFF thread, where img still points to the main img.
+ ************************************************************************
+ */
+static void paff_thread_init ()
+{
+  if ((paff_thread_img = (ImageParameters *) malloc (sizeof (ImageParameters))) == NULL)
+    no_mem_exit ("paff_thread_init: paff_thread_img");
+  *paff_thread_img = *img;
+  img = paff_thread_img;
+  if ((enc_stat = (StatParameters *) calloc (1, sizeof (StatParameters))) == NULL)
+    no_mem_exit ("paff_thread_init: enc_stat");
+  if ((snr = (SNRParameters *) calloc (1, sizeof (SNRParameters))) == NULL)
+    no_mem_exit ("paff_thread_init: snr");
+
+  get_mem_mv (&(img->pred_mv));
+  get_mem_mv (&(img->all_mv));
+  get_mem_ACcoeff (&(img->cofAC));
+  get_mem_DCcoeff (&(img->cofDC));
+  if ((img->mb_data = (Macroblock *) calloc (img->FrameSizeInMbs, sizeof (Macroblock))) == NULL)
+    no_mem_exit ("paff_thread_init: img->mb_data");
+  get_mem2Dint (&(img->ipredmode), img->width/BLOCK_SIZE, img->height/BLOCK_SIZE);
+  get_mem3Dint (&(img->nz_coeff), img->FrameSizeInMbs, 4, 6);
+  if (input->UseConstrainedIntraPred)
+    if ((img->intra_block = (int *) calloc (img->FrameSizeInMbs, sizeof (int))) == NULL)
+      no_mem_exit ("paff_thread_init: img->intra_block");
+  if (input->successive_Bframe != 0 || input->StoredBPictures > 0)
+  {
+    get_mem3Dint (&direct_ref_idx, 2, img->width/BLOCK_SIZE, img->height/BLOCK_SIZE);
+    get_mem2Dint (&direct_pdir, img->width/BLOCK_SIZE, img->height/BLOCK_SIZE);
+  }
+
+  alloc_ref_lists ();
+  Co_located = alloc_colocated (img->width, img->height, active_sps->mb_adaptive_frame_field_flag);
+
+  init_rdopt ();
+  Init_Motion_Search_Thread ();
+  AllocNalPayloadBuffer ();
+
+  paff_worker = 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Frees the coding state of the PAFF thread
+ ************************************************************************
+ */
+static void paff_thread_exit ()
+{
+  FreeNalPayloadBuffer ();
+  Clear_Motion_Search_Thread ();
+  clear_rdopt ();
+  FmoUninit ();
+
+  free_collocated (Co_located);
+  free_ref_lists ();
+  if (input->successive_Bframe != 0 || input->StoredBPictures > 0)
+  {
+    free_mem3Dint (direct_ref_idx, 2);
+    free_mem2Dint (direct_pdir);
+  }
+  if (input->UseConstrainedIntraPred)
+    free (img->intra_block);
+  free_mem3Dint (img->nz_coeff, img->FrameSizeInMbs);
+  free_mem2Dint (img->ipredmode);
+  free (img->mb_data);
+  free_mem_mv (img->pred_mv);
+  free_mem_mv (img->all_mv);
+  free_mem_ACcoeff (img->cofAC);
+  free_mem_DCcoeff (img->cofDC);
+
+  free (snr);
+  free (enc_stat);
+  free (img);
+
+  CollectDistortionKernelStats ();
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Main loop of the PAFF thread: codes the frame trials set up by
+ *    start_frame_trial()
+ ************************************************************************
+ */
+static void paff_thread_main (void *arg)
+{
+  ImageParameters own;
+
+  paff_thread_init ();
+
+  lock_mutex (paff_lock);
+  paff_state = PAFF_IDLE;
+  broadcast_cond (paff_cond);
+  for (;;)
+  {
+    while (paff_state != PAFF_CODE && paff_state != PAFF_EXIT)
+      wait_cond (paff_cond, paff_lock);
+    if (paff_state == PAFF_EXIT)
+      break;
+    unlock_mutex (paff_lock);
+
+    // picture level state of the main thread, with the thread's own buffers
+    own = *img;
+    *img = paff_img;
+    img->mb_data     = own.mb_data;
+    img->ipredmode   = own.ipredmode;
+    img->nz_coeff    = own.nz_coeff;
+    img->intra_block = own.intra_block;
+    img->pred_mv     = own.pred_mv;
+    img->all_mv      = own.all_mv;
+    img->cofAC       = own.cofAC;
+    img->cofDC       = own.cofDC;
+
+    memset (enc_stat, 0, sizeof (StatParameters));
+    enc_stat->em_prev_bits = &enc_stat->em_prev_bits_frm;
+    me_time = 0;
+
+    enc_picture = enc_frame_picture;
+    imgY_org    = imgY_org_frm;
+    imgUV_org   = imgUV_org_frm;
+
+    code_frame_picture (frame_pic);
+
+    lock_mutex (paff_lock);
+    paff_stat         = *enc_stat;
+    paff_me_time      = me_time;
+    paff_header_bits  = img->NumberofHeaderBits  - paff_img.NumberofHeaderBits;
+    paff_texture_bits = img->NumberofTextureBits - paff_img.NumberofTextureBits;
+    paff_state = PAFF_DONE;
+    broadcast_cond (paff_cond);
+  }
+  unlock_mutex (paff_lock);
+
+  paff_thread_exit ();
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts the PAFF thread (ConcurrentPAFF with PicInterlace = 2)
+ ************************************************************************
+ */
+void init_paff_thread ()
+{
+  if (!input->ConcurrentPAFF || input->PicInterlace != ADAPTIVE_CODING)
+    return;
+
+  paff_lock  = create_mutex ();
+  paff_cond  = create_cond ();
+  paff_state = PAFF_INIT;
+  paff_thread = create_thread (paff_thread_main, NULL);
+
+  // the thread copies img while setting up
+  lock_mutex (paff_lock);
+  while (paff_state != PAFF_IDLE)
+    wait_cond (paff_cond, paff_lock);
+  unlock_mutex (paff_lock);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Stops the PAFF thread
+ ************************************************************************
+ */
+void free_paff_thread ()
+{
+  if (paff_thread == NULL)
+    return;
+
+  lock_mutex (paff_lock);
+  paff_state = PAFF_EXIT;
+  broadcast_cond (paff_cond);
+  unlock_mutex (paff_lock);
+
+  join_thread (paff_thread);
+  paff_thread = NULL;
+  free_cond (paff_cond);
+  free_mutex (paff_lock);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up the frame trial and hands it to the PAFF thread. Returns
+ *    when the thread has built the reference lists of the frame; from
+ *    then on the main thread may code the fields and store the top field
+ *    in the dpb. Pictures released meanwhile are parked, as the frame
+ *    may reference them.
+ ************************************************************************
+ */
+static void start_frame_trial ()
+{
+  int i;
+
+  init_frame_picture ();
+
+  // the frame trial starts from the macroblock state of the main thread, as in sequential coding
+  memcpy (paff_thread_img->mb_data, img->mb_data, img->FrameSizeInMbs * sizeof (Macroblock));
+  memcpy (paff_thread_img->ipredmode[0], img->ipredmode[0], (img->width/BLOCK_SIZE) * (img->height/BLOCK_SIZE) * sizeof (int));
+  for (i = 0; i < img->FrameSizeInMbs; i++)
+    memcpy (paff_thread_img->nz_coeff[i][0], img->nz_coeff[i][0], 4 * 6 * sizeof (int));
+  if (input->UseConstrainedIntraPred)
+    memcpy (paff_thread_img->intra_block, img->intra_block, img->FrameSizeInMbs * sizeof (int));
+
+  hold_released_pictures (1);
+
+  lock_mutex (paff_lock);
+  paff_img   = *img;
+  paff_state = PAFF_CODE;
+  broadcast_cond (paff_cond);
+  while (paff_state != PAFF_LISTS)
+    wait_cond (paff_cond, paff_lock);
+  unlock_mutex (paff_lock);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Waits for the frame trial of the PAFF thread and adds its statistics
+ ************************************************************************
+ */
+static void finish_frame_trial ()
+{
+  lock_mutex (paff_lock);
+  while (paff_state != PAFF_DONE)
+    wait_cond (paff_cond, paff_lock);
+  paff_state = PAFF_IDLE;
+  unlock_mutex (paff_lock);
+
+  hold_released_pictures (0);
+
+  add_thread_stats (&paff_stat);
+  enc_stat->em_prev_bits_frm = paff_stat.em_prev_bits_frm;
+
+  me_time     += paff_me_time;
+  me_tot_time += paff_me_time;
+  img->NumberofHeaderBits  += paff_header_bits;
+  img->NumberofTextureBits += paff_texture_bits;
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -738,8 +1135,8 @@ void field_picture (Picture *top, Picture *bottom)
   //Rate control
   old_pic_type = img->type;
 
-  stat->em_prev_bits_fld = 0;
-  stat->em_prev_bits = &stat->em_prev_bits_fld;
+  enc_stat->em_prev_bits_fld = 0;
+  enc_stat->em_prev_bits = &enc_stat->em_prev_bits_fld;
   img->number *= 2;
   img->buf_cycle *= 2;
   img->height = input->img_height / 2;
@@ -974,7 +1371,7 @@ static void init_frame ()
 
   img->current_mb_nr = 0;
   img->current_slice_nr = 0;
-  stat->bit_slice = 0;
+  enc_stat->bit_slice = 0;
 
   img->mb_y = img->mb_x = 0;
   img->block_y = img->pix_y = img->pix_c_y = 0; 
@@ -1098,15 +1495,16 @@ static void init_field ()
 {
   int i;
   int prevP_no, nextP_no;
+  // GOP structure in fields; input-> is not changed, as the PAFF thread may be reading it
+  int jumpd = 2 * input->jumpd;
+  int successive_Bframe = 2 * input->successive_Bframe;
 
   last_P_no = last_P_no_fld;
 
   img->current_mb_nr = 0;
   img->current_slice_nr = 0;
-  stat->bit_slice = 0;
+  enc_stat->bit_slice = 0;
 
-  input->jumpd *= 2;
-  input->successive_Bframe *= 2;
   img->number /= 2;
   img->buf_cycle /= 2;
 
@@ -1116,7 +1514,7 @@ static void init_field ()
 
   if (img->type != B_SLICE)
     {
-      img->tr = img->number * (input->jumpd + 2) + img->fld_type;
+      img->tr = img->number * (jumpd + 2) + img->fld_type;
 
       if (!img->fld_type)
         {
@@ -1128,7 +1526,7 @@ static void init_field ()
       if (input->last_frame && img->number + 1 == input->no_frames)
         img->tr = input->last_frame;
 #endif
-      if (img->number != 0 && input->successive_Bframe != 0)    // B pictures to encode
+      if (img->number != 0 && successive_Bframe != 0)    // B pictures to encode
         nextP_tr_fld = img->tr;
       
       //Rate control
@@ -1167,7 +1565,7 @@ static void init_field ()
     }
   else
     {
-      img->p_interval = input->jumpd + 2;
+      img->p_interval = jumpd + 2;
       prevP_no = (img->number - 1) * img->p_interval + img->fld_type;
       nextP_no = img->number * img->p_interval + img->fld_type;
 #ifdef _ADAPT_LAST_GROUP_
@@ -1200,7 +1598,7 @@ static void init_field ()
 #endif
 
       img->b_interval =
-      (int) ((float) (input->jumpd + 1) / (input->successive_Bframe + 1.0) + 0.49999);
+      (int) ((float) (jumpd + 1) / (successive_Bframe + 1.0) + 0.49999);
 
       img->tr = prevP_no + (img->b_interval + 1) * img->b_frame_to_code;        // from prev_P
       if (img->tr >= nextP_no)
@@ -1216,8 +1614,6 @@ static void init_field ()
         img->qp = input->qpB;
       }
     }
-  input->jumpd /= 2;
-  input->successive_Bframe /= 2;
   img->buf_cycle *= 2;
   img->number = 2 * img->number + img->fld_type;
   img->total_number_mb = (img->width * img->height) / (MB_BLOCK_SIZE * MB_BLOCK_SIZE);
@@ -1227,168 +1623,6 @@ static void init_field ()
 #define Clip(min,max,val) (((val)<(min))?(min):(((val)>(max))?(max):(val)))
 
 
-
-
-/*!
- ************************************************************************
- * \brief
- *    Generate Full Pel Representation
- ************************************************************************
- */
-static void GenerateFullPelRepresentation (pel_t ** Fourthpel,
-                                           pel_t * Fullpel, int xsize,
-                                           int ysize)
-{
-  int x, y;
-  
-  for (y = 0; y < ysize; y++)
-    for (x = 0; x < xsize; x++)
-      PutPel_11 (Fullpel, y, x, FastPelY_14 (Fourthpel, y * 4, x * 4, ysize, xsize), xsize);
-}
-
-
-/*!
- ************************************************************************
- * \brief
- *    Upsample 4 times, store them in out4x.  Color is simply copied
- *
- * \par Input:
- *    srcy, srcu, srcv, out4y, out4u, out4v
- *
- * \par Side Effects_
- *    Uses (writes) img4Y_tmp.  This should be moved to a static variable
- *    in this module
- ************************************************************************/
-void UnifiedOneForthPix (StorablePicture *s)
-{
-  int is;
-  int i, j, j4;
-  int ie2, je2, jj, maxy;
-  
-  byte **out4Y;
-  byte  *ref11;
-  byte  **imgY = s->imgY;
-
-  int img_width =s->size_x;
-  int img_height=s->size_y;
-  
-  // don't upsample twice
-  if (s->imgY_ups || s->imgY_11)
-    return;
-
-  s->imgY_11 = malloc ((s->size_x * s->size_y) * sizeof (byte));
-  if (NULL == s->imgY_11)
-    no_mem_exit("alloc_storable_picture: s->imgY_11");
-  
-  get_mem2D (&(s->imgY_ups), (2*IMG_PAD_SIZE + s->size_y)*4, (2*IMG_PAD_SIZE + s->size_x)*4);
-
-  if (input->WeightedPrediction || input->WeightedBiprediction)
-  {
-      s->imgY_11_w = malloc ((s->size_x * s->size_y) * sizeof (byte));
-      get_mem2D (&(s->imgY_ups_w), (2*IMG_PAD_SIZE + s->size_y)*4, (2*IMG_PAD_SIZE + s->size_x)*4);
-  }
-  out4Y = s->imgY_ups;
-  ref11 = s->imgY_11;
-
-  for (j = -IMG_PAD_SIZE; j < s->size_y + IMG_PAD_SIZE; j++)
-  {
-    for (i = -IMG_PAD_SIZE; i < s->size_x + IMG_PAD_SIZE; i++)
-    {
-      jj = max (0, min (s->size_y - 1, j));
-      is =
-              (ONE_FOURTH_TAP[0][0] *
-               (imgY[jj][max (0, min (s->size_x - 1, i))] +
-                imgY[jj][max (0, min (s->size_x - 1, i + 1))]) +
-               ONE_FOURTH_TAP[1][0] *
-               (imgY[jj][max (0, min (s->size_x - 1, i - 1))] +
-                imgY[jj][max (0, min (s->size_x - 1, i + 2))]) +
-               ONE_FOURTH_TAP[2][0] *
-               (imgY[jj][max (0, min (s->size_x - 1, i - 2))] +
-                imgY[jj][max (0, min (s->size_x - 1, i + 3))]));
-            img4Y_tmp[j + IMG_PAD_SIZE][(i + IMG_PAD_SIZE) * 2] = imgY[jj][max (0, min (s->size_x - 1, i))] * 1024;    // 1/1 pix pos
-            img4Y_tmp[j + IMG_PAD_SIZE][(i + IMG_PAD_SIZE) * 2 + 1] = is * 32;  // 1/2 pix pos
-    }
-  }
-  
-  for (i = 0; i < (s->size_x + 2 * IMG_PAD_SIZE) * 2; i++)
-  {
-    for (j = 0; j < s->size_y + 2 * IMG_PAD_SIZE; j++)
-    {
-      j4 = j * 4;
-      maxy = s->size_y + 2 * IMG_PAD_SIZE - 1;
-      // change for TML4, use 6 TAP vertical filter
-      is =
-              (ONE_FOURTH_TAP[0][0] *
-               (img4Y_tmp[j][i] + img4Y_tmp[min (maxy, j + 1)][i]) +
-               ONE_FOURTH_TAP[1][0] * (img4Y_tmp[max (0, j - 1)][i] +
-                                       img4Y_tmp[min (maxy, j + 2)][i]) +
-               ONE_FOURTH_TAP[2][0] * (img4Y_tmp[max (0, j - 2)][i] +
-                                       img4Y_tmp[min (maxy, j + 3)][i])) / 32;
-      
-      PutPel_14 (out4Y, (j - IMG_PAD_SIZE) * 4, (i - IMG_PAD_SIZE * 2) * 2, (pel_t) max (0, min (255, (int) ((img4Y_tmp[j][i] + 512) / 1024))));  // 1/2 pix
-      PutPel_14 (out4Y, (j - IMG_PAD_SIZE) * 4 + 2, (i - IMG_PAD_SIZE * 2) * 2, (pel_t) max (0, min (255, (int) ((is + 512) / 1024))));   // 1/2 pix
-    }
-  }
-  
-  /* 1/4 pix */
-  /* luma */
-  ie2 = (s->size_x + 2 * IMG_PAD_SIZE - 1) * 4;
-  je2 = (s->size_y + 2 * IMG_PAD_SIZE - 1) * 4;
-  
-  for (j = 0; j < je2 + 4; j += 2)
-    for (i = 0; i < ie2 + 3; i += 2)
-    {
-      /*  '-'  */
-          PutPel_14 (out4Y, j - IMG_PAD_SIZE * 4, i - IMG_PAD_SIZE * 4 + 1,
-                     (pel_t) (max (0, min (255,(int) (FastPelY_14 (out4Y, j - IMG_PAD_SIZE * 4,
-                      i - IMG_PAD_SIZE * 4, img_height, img_width) + FastPelY_14 (out4Y,
-                      j - IMG_PAD_SIZE * 4, min (ie2 + 2, i + 2) - IMG_PAD_SIZE * 4, img_height, img_width)+1) / 2))));
-    }
-    for (i = 0; i < ie2 + 4; i++)
-    {
-      for (j = 0; j < je2 + 3; j += 2)
-      {
-        if (i % 2 == 0)
-        {
-          /*  '|'  */
-          PutPel_14 (out4Y, j - IMG_PAD_SIZE * 4 + 1, i - IMG_PAD_SIZE * 4,
-                    (pel_t) (max (0, min (255, (int) (FastPelY_14 (out4Y, j - IMG_PAD_SIZE * 4,
-                     i - IMG_PAD_SIZE * 4, img_height, img_width) + FastPelY_14 (out4Y,
-                     min (je2 + 2, j + 2) - IMG_PAD_SIZE * 4, i - IMG_PAD_SIZE * 4, img_height, img_width)+1) / 2))));
-        }
-        else if ((j % 4 == 0 && i % 4 == 1) || (j % 4 == 2 && i % 4 == 3))
-        {
-                /*  '/'  */
-                PutPel_14 (out4Y, j - IMG_PAD_SIZE * 4 + 1, i - IMG_PAD_SIZE * 4,
-                           (pel_t) (max (0, min (255, (int) (FastPelY_14 (out4Y, j - IMG_PAD_SIZE * 4,
-                            min (ie2 + 2, i + 1) - IMG_PAD_SIZE * 4, img_height, img_width) + FastPelY_14 (out4Y,
-                            min (je2 + 2, j + 2) - IMG_PAD_SIZE * 4, i - IMG_PAD_SIZE * 4 - 1, img_height, img_width) + 1) / 2))));
-        }
-        else
-        {
-                /*  '\'  */
-                PutPel_14 (out4Y, j - IMG_PAD_SIZE * 4 + 1, i - IMG_PAD_SIZE * 4,
-                           (pel_t) (max (0, min (255, (int) (FastPelY_14 (out4Y, j - IMG_PAD_SIZE * 4,
-                           i - IMG_PAD_SIZE * 4 - 1, img_height, img_width) + FastPelY_14 (out4Y,
-                           min (je2 + 2, j + 2) - IMG_PAD_SIZE * 4, 
-                           min (ie2 + 2, i + 1) - IMG_PAD_SIZE * 4, img_height, img_width) + 1) / 2))));
-              }
-          }
-      }
-
-    /*  Chroma: */
-/*    for (j = 0; j < img->height_cr; j++)
-      {
-        memcpy (outU[j], imgU[j], img->width_cr);       // just copy 1/1 pix, interpolate "online" 
-        memcpy (outV[j], imgV[j], img->width_cr);
-      }
-*/
-    // Generate 1/1th pel representation (used for integer pel MV search)
-    GenerateFullPelRepresentation (out4Y, ref11, s->size_x, s->size_y);
-
-}
-
-
 /*!
  ************************************************************************
  * \brief
@@ -1397,9 +1631,9 @@ void UnifiedOneForthPix (StorablePicture *s)
  */
 static void find_snr ()
 {
-  int i, j;
-  int diff_y, diff_u, diff_v;
+  int64 diff_y, diff_u, diff_v;
   int impix;
+  byte **recY, ***recUV;
   
   //  Calculate  PSNR for Y, U and V.
   
@@ -1408,28 +1642,8 @@ static void find_snr ()
   
   if (img->fld_flag != 0)
   {
-      
-    diff_y = 0;
-    for (i = 0; i < img->width; ++i)
-    {
-      for (j = 0; j < img->height; ++j)
-      {
-        diff_y += img->quad[imgY_org[j][i] - imgY_com[j][i]];
-      }
-    }
-    
-    //     Chroma.
-    diff_u = 0;
-    diff_v = 0;
-    
-    for (i = 0; i < img->width_cr; i++)
-    {
-      for (j = 0; j < img->height_cr; j++)
-      {
-        diff_u += img->quad[imgUV_org[0][j][i] - imgUV_com[0][j][i]];
-        diff_v += img->quad[imgUV_org[1][j][i] - imgUV_com[1][j][i]];
-       }
-    }
+    recY  = imgY_com;
+    recUV = imgUV_com;
   }
   else
   { 
@@ -1440,28 +1654,21 @@ static void find_snr ()
     {
       enc_picture = enc_frame_picture;
     }  
+    recY  = enc_picture->imgY;
+    recUV = enc_picture->imgUV;
+  }
 
-    diff_y = 0;
-    for (i = 0; i < img->width; ++i)
-    {
-      for (j = 0; j < img->height; ++j)
-      {
-        diff_y += img->quad[imgY_org[j][i] - enc_picture->imgY[j][i]];
-      }
-    }
-    
-    //     Chroma.
-    diff_u = 0;
-    diff_v = 0;
-   
-    for (i = 0; i < img->width_cr; i++)
-    {
-      for (j = 0; j < img->height_cr; j++)
-      {
-        diff_u += img->quad[imgUV_org[0][j][i] - enc_picture->imgUV[0][j][i]];
-        diff_v += img->quad[imgUV_org[1][j][i] - enc_picture->imgUV[1][j][i]];
-      }
-    }
+  diff_y = plane_sse (imgY_org, recY, img->width, img->height);
+
+  //     Chroma.
+  diff_u = plane_sse (imgUV_org[0], recUV[0], img->width_cr, img->height_cr);
+  diff_v = plane_sse (imgUV_org[1], recUV[1], img->width_cr, img->height_cr);
+
+  if (input->ReportSSIM)
+  {
+    snr->ssim_y = (float) plane_ssim (imgY_org, recY, img->width, img->height);
+    snr->ssim_u = (float) plane_ssim (imgUV_org[0], recUV[0], img->width_cr, img->height_cr);
+    snr->ssim_v = (float) plane_ssim (imgUV_org[1], recUV[1], img->width_cr, img->height_cr);
   }
 
 #if ZEROSNR
@@ -1489,6 +1696,9 @@ static void find_snr ()
     snr->snr_ya = snr->snr_y1;
     snr->snr_ua = snr->snr_u1;
     snr->snr_va = snr->snr_v1;
+    snr->ssim_ya = snr->ssim_y;
+    snr->ssim_ua = snr->ssim_u;
+    snr->ssim_va = snr->ssim_v;
   }
   // B pictures
   else
@@ -1496,6 +1706,9 @@ static void find_snr ()
     snr->snr_ya = (float) (snr->snr_ya * (img->number + Bframe_ctr) + snr->snr_y) / (img->number + Bframe_ctr + 1); // average snr lume for all frames inc. first
     snr->snr_ua = (float) (snr->snr_ua * (img->number + Bframe_ctr) + snr->snr_u) / (img->number + Bframe_ctr + 1); // average snr u croma for all frames inc. first
     snr->snr_va = (float) (snr->snr_va * (img->number + Bframe_ctr) + snr->snr_v) / (img->number + Bframe_ctr + 1); // average snr v croma for all frames inc. first
+    snr->ssim_ya = (float) (snr->ssim_ya * (img->number + Bframe_ctr) + snr->ssim_y) / (img->number + Bframe_ctr + 1);
+    snr->ssim_ua = (float) (snr->ssim_ua * (img->number + Bframe_ctr) + snr->ssim_u) / (img->number + Bframe_ctr + 1);
+    snr->ssim_va = (float) (snr->ssim_va * (img->number + Bframe_ctr) + snr->ssim_v) / (img->number + Bframe_ctr + 1);
 
   }
 }
@@ -1508,68 +1721,28 @@ static void find_snr ()
  */
 static void find_distortion ()
 {
-  int i, j;
-  int diff_y, diff_u, diff_v;
-  int impix;
-  
-  //  Calculate  PSNR for Y, U and V.
-  
-  //     Luma.
-  impix = img->height * img->width;
+  int64 diff_y, diff_u, diff_v;
+  byte **recY, ***recUV;
   
   if (img->structure!=FRAME)
   {
-
-    diff_y = 0;
-    for (i = 0; i < img->width; ++i)
-    {
-      for (j = 0; j < img->height; ++j)
-      {
-        diff_y += img->quad[abs (imgY_org[j][i] - imgY_com[j][i])];
-      }
-    }
-    
-    //     Chroma.
-    
-    diff_u = 0;
-    diff_v = 0;
-    
-    for (i = 0; i < img->width_cr; i++)
-    {
-      for (j = 0; j < img->height_cr; j++)
-      {
-        diff_u += img->quad[abs (imgUV_org[0][j][i] - imgUV_com[0][j][i])];
-        diff_v += img->quad[abs (imgUV_org[1][j][i] - imgUV_com[1][j][i])];
-      }
-    }
+    recY  = imgY_com;
+    recUV = imgUV_com;
   }else
   {
-      imgY_org   = imgY_org_frm;
-      imgUV_org = imgUV_org_frm;
+    imgY_org   = imgY_org_frm;
+    imgUV_org = imgUV_org_frm;
 
-      diff_y = 0;
-      for (i = 0; i < img->width; ++i)
-      {
-        for (j = 0; j < img->height; ++j)
-        {
-          diff_y += img->quad[abs (imgY_org[j][i] - enc_picture->imgY[j][i])];
-        }
-      }
-      
-      //     Chroma.
-      
-      diff_u = 0;
-      diff_v = 0;
-      
-      for (i = 0; i < img->width_cr; i++)
-      {
-        for (j = 0; j < img->height_cr; j++)
-        {
-          diff_u += img->quad[abs (imgUV_org[0][j][i] - enc_picture->imgUV[0][j][i])];
-          diff_v += img->quad[abs (imgUV_org[1][j][i] - enc_picture->imgUV[1][j][i])];
-        }
-      }
+    recY  = enc_picture->imgY;
+    recUV = enc_picture->imgUV;
   }
+
+  diff_y = plane_sse (imgY_org, recY, img->width, img->height);
+
+  //     Chroma.
+  diff_u = plane_sse (imgUV_org[0], recUV[0], img->width_cr, img->height_cr);
+  diff_v = plane_sse (imgUV_org[1], recUV[1], img->width_cr, img->height_cr);
+
   // Calculate real PSNR at find_snr_avg()
   snr->snr_y = (float) diff_y;
   snr->snr_u = (float) diff_u;
@@ -1786,7 +1959,7 @@ static void copy_motion_vectors_MB ()
 static void ReportNALNonVLCBits(int tmp_time, int me_time)
 {
   //! Need to add type (i.e. SPS, PPS, SEI etc).
-    printf ("%04d(NVB)%8d \n", frame_no, stat->bit_ctr_parametersets_n);
+    printf ("%04d(NVB)%8d \n", frame_no, enc_stat->bit_ctr_parametersets_n);
 
 }
 static void ReportFirstframe(int tmp_time,int me_time)
@@ -1794,7 +1967,7 @@ static void ReportFirstframe(int tmp_time,int me_time)
   //Rate control
   int bits;
   printf ("%04d(IDR)%8d %1d %2d %7.3f %7.3f %7.3f  %7d   %5d     %3s   %3d\n",
-    frame_no, stat->bit_ctr - stat->bit_ctr_n,0,
+    frame_no, enc_stat->bit_ctr - enc_stat->bit_ctr_n,0,
     img->qp, snr->snr_y, snr->snr_u, snr->snr_v, tmp_time, me_time,
     img->fld_flag ? "FLD" : "FRM", intras);
 
@@ -1802,17 +1975,17 @@ static void ReportFirstframe(int tmp_time,int me_time)
   if(input->RCEnable)
   {
     if((!input->PicInterlace)&&(!input->MbInterlace))
-        bits = stat->bit_ctr-stat->bit_ctr_n; // used for rate control update 
+        bits = enc_stat->bit_ctr-enc_stat->bit_ctr_n; // used for rate control update 
     else
     {
-      bits = stat->bit_ctr - Iprev_bits; // used for rate control update 
-      Iprev_bits = stat->bit_ctr;
+      bits = enc_stat->bit_ctr - Iprev_bits; // used for rate control update 
+      Iprev_bits = enc_stat->bit_ctr;
     }
   }
 
-  stat->bitr0 = stat->bitr;
-  stat->bit_ctr_0 = stat->bit_ctr;
-  stat->bit_ctr = 0;
+  enc_stat->bitr0 = enc_stat->bitr;
+  enc_stat->bit_ctr_0 = enc_stat->bit_ctr;
+  enc_stat->bit_ctr = 0;
 }
 
 
@@ -1821,12 +1994,12 @@ static void ReportIntra(int tmp_time, int me_time)
 	
   if (img->currentPicture->idr_flag == 1)
     printf ("%04d(IDR)%8d %1d %2d %7.3f %7.3f %7.3f  %7d   %5d     %3s   %3d\n",
-    frame_no, stat->bit_ctr - stat->bit_ctr_n, 0,
+    frame_no, enc_stat->bit_ctr - enc_stat->bit_ctr_n, 0,
     img->qp, snr->snr_y, snr->snr_u, snr->snr_v, tmp_time, me_time,
     img->fld_flag ? "FLD" : "FRM", intras); 
   else
     printf ("%04d(I)  %8d %1d %2d %7.3f %7.3f %7.3f  %7d   %5d     %3s   %3d\n",
-    frame_no, stat->bit_ctr - stat->bit_ctr_n, 0,
+    frame_no, enc_stat->bit_ctr - enc_stat->bit_ctr_n, 0,
     img->qp, snr->snr_y, snr->snr_u, snr->snr_v, tmp_time, me_time,
     img->fld_flag ? "FLD" : "FRM", intras);
 
@@ -1835,7 +2008,7 @@ static void ReportIntra(int tmp_time, int me_time)
 static void ReportSP(int tmp_time, int me_time)
 {
   printf ("%04d(SP) %8d %1d %2d %7.3f %7.3f %7.3f  %7d   %5d     %3s   %3d\n",
-    frame_no, stat->bit_ctr - stat->bit_ctr_n, active_pps->weighted_pred_flag, img->qp, snr->snr_y,
+    frame_no, enc_stat->bit_ctr - enc_stat->bit_ctr_n, active_pps->weighted_pred_flag, img->qp, snr->snr_y,
     snr->snr_u, snr->snr_v, tmp_time, me_time,
     img->fld_flag ? "FLD" : "FRM", intras);
 }
@@ -1843,7 +2016,7 @@ static void ReportSP(int tmp_time, int me_time)
 static void ReportBS(int tmp_time, int me_time)
 {
   printf ("%04d(BS) %8d %1d %2d %7.3f %7.3f %7.3f  %7d   %5d     %3s   %3d %1d\n",
-    frame_no, stat->bit_ctr - stat->bit_ctr_n, active_pps->weighted_bipred_idc, img->qp, snr->snr_y,
+    frame_no, enc_stat->bit_ctr - enc_stat->bit_ctr_n, active_pps->weighted_bipred_idc, img->qp, snr->snr_y,
     snr->snr_u, snr->snr_v, tmp_time, me_time,
     img->fld_flag ? "FLD" : "FRM", intras,img->direct_type);
 }
@@ -1851,7 +2024,7 @@ static void ReportBS(int tmp_time, int me_time)
 static void ReportB(int tmp_time, int me_time)
 {
     printf ("%04d(B)  %8d %1d %2d %7.3f %7.3f %7.3f  %7d   %5d     %3s   %3d %1d\n",
-    frame_no, stat->bit_ctr - stat->bit_ctr_n, active_pps->weighted_bipred_idc,img->qp,
+    frame_no, enc_stat->bit_ctr - enc_stat->bit_ctr_n, active_pps->weighted_bipred_idc,img->qp,
     snr->snr_y, snr->snr_u, snr->snr_v, tmp_time,me_time,
     img->fld_flag ? "FLD" : "FRM",intras,img->direct_type);
 }
@@ -1860,7 +2033,7 @@ static void ReportB(int tmp_time, int me_time)
 static void ReportP(int tmp_time, int me_time)
 {            
     printf ("%04d(P)  %8d %1d %2d %7.3f %7.3f %7.3f  %7d   %5d     %3s   %3d\n",
-    frame_no, stat->bit_ctr - stat->bit_ctr_n, active_pps->weighted_pred_flag, img->qp, snr->snr_y,
+    frame_no, enc_stat->bit_ctr - enc_stat->bit_ctr_n, active_pps->weighted_pred_flag, img->qp, snr->snr_y,
     snr->snr_u, snr->snr_v, tmp_time, me_time,
     img->fld_flag ? "FLD" : "FRM", intras);
 
@@ -1941,72 +2114,6 @@ static void CopyBottomFieldToOldImgOrgVariables (Sourceframe *sf)
 }
 
 
-/*!
- ************************************************************************
- * \brief
- *    Allocates Sourceframe structure
- * \param xs
- *    horizontal size of frame in pixels
- * \param ys
- *    vertical size of frame in pixels, must be divisible by 2
- * \return
- *    pointer to initialized source frame structure
- ************************************************************************
- */
-
-static Sourceframe *AllocSourceframe (int xs, int ys)
-{
-  Sourceframe *sf = NULL;
-  const unsigned int bytes_y = xs*ys;
-  const unsigned int bytes_uv = (xs*ys)/4;
-
-  if ((sf = calloc (1, sizeof (Sourceframe))) == NULL) no_mem_exit ("ReadOneFrame: sf");
-  if (sf->yf == NULL) if ((sf->yf = calloc (1, bytes_y)) == NULL) no_mem_exit ("ReadOneFrame: sf->yf");
-  if (sf->yt == NULL) if ((sf->yt = calloc (1, bytes_y/2)) == NULL) no_mem_exit ("ReadOneFrame: sf->yt");
-  if (sf->yb == NULL) if ((sf->yb = calloc (1, bytes_y/2)) == NULL) no_mem_exit ("ReadOneFrame: sf->yb");
-  if (sf->uf == NULL) if ((sf->uf = calloc (1, bytes_uv)) == NULL) no_mem_exit ("ReadOneFrame: sf->uf");
-  if (sf->ut == NULL) if ((sf->ut = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("ReadOneFrame: sf->ut");
-  if (sf->ub == NULL) if ((sf->ub = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("ReadOneFrame: sf->ub");
-  if (sf->vf == NULL) if ((sf->vf = calloc (1, bytes_uv)) == NULL) no_mem_exit ("ReadOneFrame: sf->vf");
-  if (sf->vt == NULL) if ((sf->vt = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("ReadOneFrame: sf->vt");
-  if (sf->vb == NULL) if ((sf->vb = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("ReadOneFrame: sf->vb");
-  sf->x_size = xs;
-  sf->y_framesize = ys;
-  sf->y_fieldsize = ys/2;
-
-  return sf;
-}
-
-
-
-/*!
- ************************************************************************
- * \brief
- *    Frees Sourceframe structure
- * \param sf
- *    pointer to Sourceframe previoously allocated with ALlocSourceframe()
- * \return
- *    none
- ************************************************************************
- */
-
-static void FreeSourceframe (Sourceframe *sf)
-{
-  if (sf!=NULL) 
-  {
-    if (sf->yf != NULL) free (sf->yf);
-    if (sf->yt != NULL) free (sf->yt);
-    if (sf->yb != NULL) free (sf->yb);
-    if (sf->uf != NULL) free (sf->uf);
-    if (sf->ut != NULL) free (sf->ut);
-    if (sf->ub != NULL) free (sf->ub);
-    if (sf->vf != NULL) free (sf->vf);
-    if (sf->vt != NULL) free (sf->vt);
-    if (sf->vb != NULL) free (sf->vb);
-    free (sf);
-  }
-}
-
 /*!
  ************************************************************************
  * \brief
@@ -2034,124 +2141,6 @@ static int CalculateFrameNumber()
 }
 
 
-/*!
- ************************************************************************
- * \brief
- *    Generate Field Component from Frame Components by copying
- * \param src
- *    source frame component
- * \param top
- *    destination top field component
- * \param bot
- *    destination bottom field component
- * \param xs
- *    horizontal size of frame in pixels
- * \param ys
- *    vertical size of frame in pixels, must be divisible by 2
- ************************************************************************
- */
-static void GenerateFieldComponent (char *src, char *top, char *bot, int xs, int ys)
-{
-  int fieldline;
-  assert (ys % 2 == 0);
-
-  for (fieldline = 0; fieldline < ys/2; fieldline++)
-  {
-    memcpy (&top[xs * fieldline], &src[xs * (fieldline * 2 + 0)], xs);
-    memcpy (&bot[xs * fieldline], &src[xs * (fieldline * 2 + 1)], xs);
-  }
-}
-
-
-/*!
- ************************************************************************
- * \brief
- *    Reads one new frame from file
- * \param FrameNoInFile
- *    Frame number in the source file
- * \param HeaderSize
- *    Number of bytes in the source file to be skipped
- * \param xs
- *    horizontal size of frame in pixels, must be divisible by 16
- * \param ys
- *    vertical size of frame in pixels, must be divisible by 16 or
- *    32 in case of MB-adaptive frame/field coding
- * \param sf
- *    Sourceframe structure to which the frame is written
- ************************************************************************
- */
-static void ReadOneFrame (int FrameNoInFile, int HeaderSize, int xs, int ys, Sourceframe *sf)
-{
-  int i;
-
-  const unsigned int bytes_y = xs*ys;
-  const unsigned int bytes_uv = (xs*ys)/4;
-  const int framesize_in_bytes = bytes_y + 2*bytes_uv;
-
-  assert (xs % MB_BLOCK_SIZE == 0);
-  assert (ys % MB_BLOCK_SIZE == 0);
-  assert (p_in != NULL);
-  assert (sf != NULL);
-  assert (sf->yf != NULL);
-
-  assert (FrameNumberInFile == FrameNoInFile);
-  // printf ("ReadOneFrame: frame_no %d xs %d ys %d\n", FrameNoInFile, xs, ys);
-
-  if (fseek (p_in, HeaderSize, SEEK_SET) != 0)
-    error ("ReadOneFrame: cannot fseek to (Header size) in p_in", -1);
-
-  // the reason for the following loop is to support source files bigger than
-  // MAXINT.  In most operating systems, including Windows, it is possible to
-  // fseek to file positions bigger than MAXINT by using this relative seeking
-  // technique.  StW, 12/30/02
-  // Skip starting frames
-  for (i=0; i<input->start_frame; i++)
-    if (fseek (p_in, framesize_in_bytes, SEEK_CUR) != 0) 
-    {
-      printf ("ReadOneFrame: cannot advance file pointer in p_in beyond frame %d, looping to picture zero\n", i);
-      if (fseek (p_in, HeaderSize, SEEK_SET) != 0)
-        report_stats_on_error();
-        exit (-1);
-    } 
-
-  for (i=0; i<FrameNoInFile; i++)
-    if (fseek (p_in, framesize_in_bytes, SEEK_CUR) != 0) 
-    {
-      printf ("ReadOneFrame: cannot advance file pointer in p_in beyond frame %d, looping to picture zero\n", i);
-      if (fseek (p_in, HeaderSize, SEEK_SET) != 0)
-        error ("ReadOneFrame: cannot fseek to (Header size) in p_in", -1);
-    }
-
-  // Here we are at the correct position for the source frame in the file.  Now
-  // read it.
-  if (fread (sf->yf, 1, bytes_y, p_in) != bytes_y)
-  {
-    printf ("ReadOneFrame: cannot read %d bytes from input file, unexpected EOF?, exiting", bytes_y);
-    report_stats_on_error();
-    exit (-1);
-  }
-  if (fread (sf->uf, 1, bytes_uv, p_in) != bytes_uv)
-  {
-    printf ("ReadOneFrame: cannot read %d bytes from input file, unexpected EOF?, exiting", bytes_uv);
-    report_stats_on_error();
-    exit (-1);
-  }
-  if (fread (sf->vf, 1, bytes_uv, p_in) != bytes_uv)
-  {
-    printf ("ReadOneFrame: cannot read %d bytes from input file, unexpected EOF?, exiting", bytes_uv);
-    report_stats_on_error();
-    exit (-1);
-  }
-
-  // Complete frame is read into sf->?f, now setup 
-  // top and bottom field (sf->?t and sf->?b)
-
-  GenerateFieldComponent (sf->yf, sf->yt, sf->yb, xs, ys);
-  GenerateFieldComponent (sf->uf, sf->ut, sf->ub, xs/2, ys/2);
-  GenerateFieldComponent (sf->vf, sf->vt, sf->vb, xs/2, ys/2);
-}
-
-
 /*!
  ************************************************************************
  * \brief
@@ -2256,7 +2245,7 @@ static void writeUnit(Bitstream* currStream,int partition)
     }
   }
   nalu->forbidden_bit = 0;
-  stat->bit_ctr += WriteNALU (nalu);
+  enc_stat->bit_ctr += WriteNALU (nalu);
   
   FreeNALU(nalu);
 }
@@ -78,14 +78,25 @@
 #include "output.h"
 #include "fast_me.h"
 #include "ratectl.h"
+#include "me_distortion.h"
+#include "metrics.h"
+#include "upsample.h"
+#include "source_reader.h"
 
 #define JM      "8"
 #define VERSION "8.6"
 
 InputParameters inputs, *input = &inputs;
-ImageParameters images, *img   = &images;
-StatParameters  stats,  *stat  = &stats;
-SNRParameters   snrs,   *snr   = &snrs;
+ImageParameters images;
+StatParameters  stats;
+THREAD_LOCAL ImageParameters *img      = &images;   //!< slice threads point these to their own copies
+THREAD_LOCAL StatParameters  *enc_stat = &stats;
+SNRParameters   snrs;
+THREAD_LOCAL SNRParameters *snr = &snrs;        //!< the PAFF thread points this to its own copy
+THREAD_LOCAL byte  **imgY_org;
+THREAD_LOCAL byte ***imgUV_org;
+THREAD_LOCAL int  ***direct_ref_idx;
+THREAD_LOCAL int   **direct_pdir;
 Decoders decoders, *decs=&decoders;
 
 
@@ -97,8 +108,8 @@ Boolean In2ndIGOP = FALSE;
 int    start_frame_no_in_this_IGOP = 0;
 int    start_tr_in_this_IGOP = 0;
 int    FirstFrameIn2ndIGOP=0;
-int    cabac_encoding = 0;
-extern ColocatedParams *Co_located;
+THREAD_LOCAL int cabac_encoding = 0;
+extern THREAD_LOCAL ColocatedParams *Co_located;
 
 void Init_Motion_Search_Module ();
 void Clear_Motion_Search_Module ();
@@ -148,6 +159,11 @@ int main(int argc,char **argv)
   create_context_memory ();
 
   Init_Motion_Search_Module ();
+  init_metrics ();
+  init_slice_threads ();
+  Init_Wavefront_Motion_Search ();
+  InitOneForthPixCache ();
+  init_paff_thread ();
 
   information_init();
 
@@ -169,11 +185,12 @@ int main(int argc,char **argv)
 #endif
 
   PatchInputNoFrames();
+  InitSourceReader (img->width, img->height);
 
   // Write sequence header (with parameter sets)
-  stat->bit_ctr_parametersets = 0;
-  stat->bit_slice = start_sequence();
-  stat->bit_ctr_parametersets += stat->bit_ctr_parametersets_n;
+  enc_stat->bit_ctr_parametersets = 0;
+  enc_stat->bit_slice = start_sequence();
+  enc_stat->bit_ctr_parametersets += enc_stat->bit_ctr_parametersets_n;
   start_frame_no_in_this_IGOP = 0;
 
   for (img->number=0; img->number < input->no_frames; img->number++)
@@ -351,12 +368,15 @@ int main(int argc,char **argv)
 
   flush_dpb();
 
-  fclose(p_in);
+  CloseSourceFile();
   if (p_dec)
     fclose(p_dec);
   if (p_trace)
     fclose(p_trace);
 
+  free_paff_thread ();
+  free_slice_threads ();
+  Clear_Wavefront_Motion_Search ();
   Clear_Motion_Search_Module ();
 
   RandomIntraUninit();
@@ -379,8 +399,10 @@ int main(int argc,char **argv)
     free_picture (bottom_pic);
 
   free_dpb();
+  FreeOneForthPixCache ();
   free_collocated(Co_located);
   uninit_out_buffer();
+  flush_picture_pool();
 
   free_global_buffers();
 
@@ -405,7 +427,7 @@ void report_stats_on_error()
   
   flush_dpb();
   
-  fclose(p_in);
+  CloseSourceFile();
   if (p_dec)
     fclose(p_dec);
   if (p_trace)
@@ -435,6 +457,7 @@ void report_stats_on_error()
   free_dpb();
   free_collocated(Co_located);
   uninit_out_buffer();
+  flush_picture_pool();
   
   free_global_buffers();
   
@@ -755,15 +778,15 @@ void report()
   for (j=0;j<NUM_PIC_TYPE;j++)
   {
     for(i=0; i<MAXMODE; i++)
-      bit_use[j][1] += stat->bit_use_mode    [j][i]; 
-
-    bit_use[j][1]+=stat->bit_use_header      [j];
-    bit_use[j][1]+=stat->bit_use_mb_type     [j];
-    bit_use[j][1]+=stat->tmp_bit_use_cbp     [j];
-    bit_use[j][1]+=stat->bit_use_coeffY      [j];
-    bit_use[j][1]+=stat->bit_use_coeffC      [j];
-    bit_use[j][1]+=stat->bit_use_delta_quant [j];
-    bit_use[j][1]+=stat->bit_use_stuffingBits[j];
+      bit_use[j][1] += enc_stat->bit_use_mode    [j][i]; 
+
+    bit_use[j][1]+=enc_stat->bit_use_header      [j];
+    bit_use[j][1]+=enc_stat->bit_use_mb_type     [j];
+    bit_use[j][1]+=enc_stat->tmp_bit_use_cbp     [j];
+    bit_use[j][1]+=enc_stat->bit_use_coeffY      [j];
+    bit_use[j][1]+=enc_stat->bit_use_coeffC      [j];
+    bit_use[j][1]+=enc_stat->bit_use_delta_quant [j];
+    bit_use[j][1]+=enc_stat->bit_use_stuffingBits[j];
   }
 
   // B pictures
@@ -772,13 +795,13 @@ void report()
     frame_rate = (float)(img->framerate *(input->successive_Bframe + 1)) / (float) (input->jumpd+1);
 
 //! Currently adding NVB bits on P rate. Maybe additional stat info should be created instead and added in log file
-//    stat->bitrate_P=(stat->bit_ctr_0+stat->bit_ctr_P)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);
-    stat->bitrate_P=(stat->bit_ctr_0+stat->bit_ctr_P + stat->bit_ctr_parametersets)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);
+//    enc_stat->bitrate_P=(enc_stat->bit_ctr_0+enc_stat->bit_ctr_P)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);
+    enc_stat->bitrate_P=(enc_stat->bit_ctr_0+enc_stat->bit_ctr_P + enc_stat->bit_ctr_parametersets)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);
 
 #ifdef _ADAPT_LAST_GROUP_
-    stat->bitrate_B=(stat->bit_ctr_B)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);    
+    enc_stat->bitrate_B=(enc_stat->bit_ctr_B)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);    
 #else
-    stat->bitrate_B=(stat->bit_ctr_B)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);    
+    enc_stat->bitrate_B=(enc_stat->bit_ctr_B)*(float)(frame_rate)/(float) (input->no_frames + Bframe_ctr);    
 #endif
 
   }
@@ -786,7 +809,7 @@ void report()
   {
     if (input->no_frames > 1)
     {
-      stat->bitrate=(bit_use[I_SLICE][1]+bit_use[P_SLICE][1])*(float)img->framerate/(input->no_frames*(input->jumpd+1));
+      enc_stat->bitrate=(bit_use[I_SLICE][1]+bit_use[P_SLICE][1])*(float)img->framerate/(input->no_frames*(input->jumpd+1));
     }
   }
 
@@ -796,6 +819,17 @@ void report()
     fprintf(stdout," Hadamard transform                : Used\n");
   else
     fprintf(stdout," Hadamard transform                : Not used\n");
+  ReportDistortionKernels();
+  if (input->SliceThreads > 1)
+    fprintf(stdout," Slice threads                     : %d\n", input->SliceThreads);
+  if (input->WavefrontME > 0)
+    fprintf(stdout," Wavefront ME pre-pass threads     : %d (refinement range %d)\n", input->WavefrontME, input->WavefrontMERange);
+  if (input->FastFullSearchThreads > 0 && !input->FMEnable)
+    fprintf(stdout," Fast full search setup threads    : %d\n", input->FastFullSearchThreads);
+  if (input->HierarchicalME)
+    fprintf(stdout," Hierarchical ME                   : 1/4, 1/2, 1/1 (refinement range %d)\n", input->HierarchicalMERange);
+  ReportOneForthPixCache();
+  fprintf(stdout," Picture pool (reused/allocated)   : %d/%d\n", pic_pool_hits, pic_pool_misses);
 
   fprintf(stdout," Image format                      : %dx%d\n",input->img_width,input->img_height);
 
@@ -845,7 +879,11 @@ void report()
 #endif
 
   if (input->rdopt)
+  {
     fprintf(stdout," RD-optimized mode decision        : used\n");
+    if (input->FastModeDecision)
+      ReportFastModeDecision ();
+  }
   else
     fprintf(stdout," RD-optimized mode decision        : not used\n");
 
@@ -881,49 +919,55 @@ void report()
   fprintf(stdout," SNR Y(dB)                         : %5.2f\n",snr->snr_ya);
   fprintf(stdout," SNR U(dB)                         : %5.2f\n",snr->snr_ua);
   fprintf(stdout," SNR V(dB)                         : %5.2f\n",snr->snr_va);
+  if (input->ReportSSIM)
+  {
+    fprintf(stdout," SSIM Y                            : %6.4f\n",snr->ssim_ya);
+    fprintf(stdout," SSIM U                            : %6.4f\n",snr->ssim_ua);
+    fprintf(stdout," SSIM V                            : %6.4f\n",snr->ssim_va);
+  }
 
   if(Bframe_ctr!=0)
   {
 
 //      fprintf(stdout, " Total bits                        : %d (I %5d, P %5d, B %d) \n",
-//            total_bits=stat->bit_ctr_P + stat->bit_ctr_0 + stat->bit_ctr_B, stat->bit_ctr_0, stat->bit_ctr_P, stat->bit_ctr_B);
+//            total_bits=enc_stat->bit_ctr_P + enc_stat->bit_ctr_0 + enc_stat->bit_ctr_B, enc_stat->bit_ctr_0, enc_stat->bit_ctr_P, enc_stat->bit_ctr_B);
       fprintf(stdout, " Total bits                        : %d (I %5d, P %5d, B %d NVB %d) \n",
-            total_bits=stat->bit_ctr_P + stat->bit_ctr_0 + stat->bit_ctr_B + stat->bit_ctr_parametersets, stat->bit_ctr_0, stat->bit_ctr_P, stat->bit_ctr_B,stat->bit_ctr_parametersets);
+            total_bits=enc_stat->bit_ctr_P + enc_stat->bit_ctr_0 + enc_stat->bit_ctr_B + enc_stat->bit_ctr_parametersets, enc_stat->bit_ctr_0, enc_stat->bit_ctr_P, enc_stat->bit_ctr_B,enc_stat->bit_ctr_parametersets);
 
     frame_rate = (float)(img->framerate *(input->successive_Bframe + 1)) / (float) (input->jumpd+1);
-    stat->bitrate= ((float) total_bits * frame_rate)/((float) (input->no_frames + Bframe_ctr));
+    enc_stat->bitrate= ((float) total_bits * frame_rate)/((float) (input->no_frames + Bframe_ctr));
 
-    fprintf(stdout, " Bit rate (kbit/s)  @ %2.2f Hz     : %5.2f\n", frame_rate, stat->bitrate/1000);
+    fprintf(stdout, " Bit rate (kbit/s)  @ %2.2f Hz     : %5.2f\n", frame_rate, enc_stat->bitrate/1000);
 
   }
   else if (input->sp_periodicity==0)
   {
 //    fprintf(stdout, " Total bits                        : %d (I %5d, P %5d) \n",
-//    total_bits=stat->bit_ctr_P + stat->bit_ctr_0 , stat->bit_ctr_0, stat->bit_ctr_P);
+//    total_bits=enc_stat->bit_ctr_P + enc_stat->bit_ctr_0 , enc_stat->bit_ctr_0, enc_stat->bit_ctr_P);
       fprintf(stdout, " Total bits                        : %d (I %5d, P %5d, NVB %d) \n",
-      total_bits=stat->bit_ctr_P + stat->bit_ctr_0 + stat->bit_ctr_parametersets, stat->bit_ctr_0, stat->bit_ctr_P, stat->bit_ctr_parametersets);
+      total_bits=enc_stat->bit_ctr_P + enc_stat->bit_ctr_0 + enc_stat->bit_ctr_parametersets, enc_stat->bit_ctr_0, enc_stat->bit_ctr_P, enc_stat->bit_ctr_parametersets);
 
 
     frame_rate = (float)img->framerate / ( (float) (input->jumpd + 1) );
-    stat->bitrate= ((float) total_bits * frame_rate)/((float) input->no_frames );
+    enc_stat->bitrate= ((float) total_bits * frame_rate)/((float) input->no_frames );
 
-    fprintf(stdout, " Bit rate (kbit/s)  @ %2.2f Hz     : %5.2f\n", frame_rate, stat->bitrate/1000);
+    fprintf(stdout, " Bit rate (kbit/s)  @ %2.2f Hz     : %5.2f\n", frame_rate, enc_stat->bitrate/1000);
   }else
   {
     //fprintf(stdout, " Total bits                        : %d (I %5d, P %5d) \n",
-    //total_bits=stat->bit_ctr_P + stat->bit_ctr_0 , stat->bit_ctr_0, stat->bit_ctr_P);
+    //total_bits=enc_stat->bit_ctr_P + enc_stat->bit_ctr_0 , enc_stat->bit_ctr_0, enc_stat->bit_ctr_P);
       fprintf(stdout, " Total bits                        : %d (I %5d, P %5d, NVB %d) \n",
-      total_bits=stat->bit_ctr_P + stat->bit_ctr_0 + stat->bit_ctr_parametersets, stat->bit_ctr_0, stat->bit_ctr_P, stat->bit_ctr_parametersets);
+      total_bits=enc_stat->bit_ctr_P + enc_stat->bit_ctr_0 + enc_stat->bit_ctr_parametersets, enc_stat->bit_ctr_0, enc_stat->bit_ctr_P, enc_stat->bit_ctr_parametersets);
 
 
     frame_rate = (float)img->framerate / ( (float) (input->jumpd + 1) );
-    stat->bitrate= ((float) total_bits * frame_rate)/((float) input->no_frames );
+    enc_stat->bitrate= ((float) total_bits * frame_rate)/((float) input->no_frames );
 
-    fprintf(stdout, " Bit rate (kbit/s)  @ %2.2f Hz     : %5.2f\n", frame_rate, stat->bitrate/1000);
+    fprintf(stdout, " Bit rate (kbit/s)  @ %2.2f Hz     : %5.2f\n", frame_rate, enc_stat->bitrate/1000);
   }
 
-  fprintf(stdout, " Bits to avoid Startcode Emulation : %d \n", stat->bit_ctr_emulationprevention);
-  fprintf(stdout, " Bits for parameter sets           : %d \n", stat->bit_ctr_parametersets);
+  fprintf(stdout, " Bits to avoid Startcode Emulation : %d \n", enc_stat->bit_ctr_emulationprevention);
+  fprintf(stdout, " Bits for parameter sets           : %d \n", enc_stat->bit_ctr_parametersets);
 
   fprintf(stdout,"-------------------------------------------------------------------------------\n");
   fprintf(stdout,"Exit JM %s encoder ver %s ", JM, VERSION);
@@ -945,11 +989,11 @@ void report()
   // B pictures
   if(input->successive_Bframe != 0)
   {
-    fprintf(p_stat,   " BaseLayer Bitrate(kb/s)      : %6.2f\n", stat->bitrate_P/1000);
-    fprintf(p_stat,   " EnhancedLayer Bitrate(kb/s)  : %6.2f\n", stat->bitrate_B/1000);
+    fprintf(p_stat,   " BaseLayer Bitrate(kb/s)      : %6.2f\n", enc_stat->bitrate_P/1000);
+    fprintf(p_stat,   " EnhancedLayer Bitrate(kb/s)  : %6.2f\n", enc_stat->bitrate_B/1000);
   }
   else
-    fprintf(p_stat,   " Bitrate(kb/s)                : %6.2f\n", stat->bitrate/1000);
+    fprintf(p_stat,   " Bitrate(kb/s)                : %6.2f\n", enc_stat->bitrate/1000);
 
   if(input->hadamard)
     fprintf(p_stat," Hadamard transform           : Used\n");
@@ -1004,28 +1048,28 @@ void report()
   // QUANT.
   fprintf(p_stat," Average quant        |");
   fprintf(p_stat,"  %5d         |",absm(input->qp0));
-  fprintf(p_stat," %5.2f         |\n",(float)stat->quant1/max(1.0,(float)stat->quant0));
+  fprintf(p_stat," %5.2f         |\n",(float)enc_stat->quant1/max(1.0,(float)enc_stat->quant0));
 
   // MODE
   fprintf(p_stat,"\n ---------------------|----------------|\n");
   fprintf(p_stat,"   Intra              |    Mode used   |\n");
   fprintf(p_stat," ---------------------|----------------|\n");
 
-  fprintf(p_stat," Mode 0  intra 4x4    |  %5d         |\n",stat->mode_use[I_SLICE][I4MB]);
-  fprintf(p_stat," Mode 1+ intra 16x16  |  %5d         |\n",stat->mode_use[I_SLICE][I16MB]);
+  fprintf(p_stat," Mode 0  intra 4x4    |  %5d         |\n",enc_stat->mode_use[I_SLICE][I4MB]);
+  fprintf(p_stat," Mode 1+ intra 16x16  |  %5d         |\n",enc_stat->mode_use[I_SLICE][I16MB]);
 
   fprintf(p_stat,"\n ---------------------|----------------|-----------------|\n");
   fprintf(p_stat,"   Inter              |    Mode used   | MotionInfo bits |\n");
   fprintf(p_stat," ---------------------|----------------|-----------------|");
-  fprintf(p_stat,"\n Mode  0  (copy)      |  %5d         |    %8.2f     |",stat->mode_use[P_SLICE][0   ],(float)stat->bit_use_mode[P_SLICE][0   ]/(float)bit_use[P_SLICE][0]);
-  fprintf(p_stat,"\n Mode  1  (16x16)     |  %5d         |    %8.2f     |",stat->mode_use[P_SLICE][1   ],(float)stat->bit_use_mode[P_SLICE][1   ]/(float)bit_use[P_SLICE][0]);
-  fprintf(p_stat,"\n Mode  2  (16x8)      |  %5d         |    %8.2f     |",stat->mode_use[P_SLICE][2   ],(float)stat->bit_use_mode[P_SLICE][2   ]/(float)bit_use[P_SLICE][0]);
-  fprintf(p_stat,"\n Mode  3  (8x16)      |  %5d         |    %8.2f     |",stat->mode_use[P_SLICE][3   ],(float)stat->bit_use_mode[P_SLICE][3   ]/(float)bit_use[P_SLICE][0]);
-  fprintf(p_stat,"\n Mode  4  (8x8)       |  %5d         |    %8.2f     |",stat->mode_use[P_SLICE][P8x8],(float)stat->bit_use_mode[P_SLICE][P8x8]/(float)bit_use[P_SLICE][0]);
-  fprintf(p_stat,"\n Mode  5  intra 4x4   |  %5d         |-----------------|",stat->mode_use[P_SLICE][I4MB]);
-  fprintf(p_stat,"\n Mode  6+ intra 16x16 |  %5d         |",stat->mode_use[P_SLICE][I16MB]);
-  mean_motion_info_bit_use[0] = (float)(stat->bit_use_mode[P_SLICE][0] + stat->bit_use_mode[P_SLICE][1] + stat->bit_use_mode[P_SLICE][2] 
-                                      + stat->bit_use_mode[P_SLICE][3] + stat->bit_use_mode[P_SLICE][P8x8])/(float) bit_use[P_SLICE][0]; 
+  fprintf(p_stat,"\n Mode  0  (copy)      |  %5d         |    %8.2f     |",enc_stat->mode_use[P_SLICE][0   ],(float)enc_stat->bit_use_mode[P_SLICE][0   ]/(float)bit_use[P_SLICE][0]);
+  fprintf(p_stat,"\n Mode  1  (16x16)     |  %5d         |    %8.2f     |",enc_stat->mode_use[P_SLICE][1   ],(float)enc_stat->bit_use_mode[P_SLICE][1   ]/(float)bit_use[P_SLICE][0]);
+  fprintf(p_stat,"\n Mode  2  (16x8)      |  %5d         |    %8.2f     |",enc_stat->mode_use[P_SLICE][2   ],(float)enc_stat->bit_use_mode[P_SLICE][2   ]/(float)bit_use[P_SLICE][0]);
+  fprintf(p_stat,"\n Mode  3  (8x16)      |  %5d         |    %8.2f     |",enc_stat->mode_use[P_SLICE][3   ],(float)enc_stat->bit_use_mode[P_SLICE][3   ]/(float)bit_use[P_SLICE][0]);
+  fprintf(p_stat,"\n Mode  4  (8x8)       |  %5d         |    %8.2f     |",enc_stat->mode_use[P_SLICE][P8x8],(float)enc_stat->bit_use_mode[P_SLICE][P8x8]/(float)bit_use[P_SLICE][0]);
+  fprintf(p_stat,"\n Mode  5  intra 4x4   |  %5d         |-----------------|",enc_stat->mode_use[P_SLICE][I4MB]);
+  fprintf(p_stat,"\n Mode  6+ intra 16x16 |  %5d         |",enc_stat->mode_use[P_SLICE][I16MB]);
+  mean_motion_info_bit_use[0] = (float)(enc_stat->bit_use_mode[P_SLICE][0] + enc_stat->bit_use_mode[P_SLICE][1] + enc_stat->bit_use_mode[P_SLICE][2] 
+                                      + enc_stat->bit_use_mode[P_SLICE][3] + enc_stat->bit_use_mode[P_SLICE][P8x8])/(float) bit_use[P_SLICE][0]; 
 
   // B pictures
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
@@ -1034,15 +1078,15 @@ void report()
     fprintf(p_stat,"\n\n ---------------------|----------------|-----------------|\n");
     fprintf(p_stat,"   B frame            |    Mode used   | MotionInfo bits |\n");
     fprintf(p_stat," ---------------------|----------------|-----------------|");
-    fprintf(p_stat,"\n Mode  0  (copy)      |  %5d         |    %8.2f     |",stat->mode_use[B_SLICE][0   ],(float)stat->bit_use_mode[B_SLICE][0   ]/(float)Bframe_ctr);
-    fprintf(p_stat,"\n Mode  1  (16x16)     |  %5d         |    %8.2f     |",stat->mode_use[B_SLICE][1   ],(float)stat->bit_use_mode[B_SLICE][1   ]/(float)Bframe_ctr);
-    fprintf(p_stat,"\n Mode  2  (16x8)      |  %5d         |    %8.2f     |",stat->mode_use[B_SLICE][2   ],(float)stat->bit_use_mode[B_SLICE][2   ]/(float)Bframe_ctr);
-    fprintf(p_stat,"\n Mode  3  (8x16)      |  %5d         |    %8.2f     |",stat->mode_use[B_SLICE][3   ],(float)stat->bit_use_mode[B_SLICE][3   ]/(float)Bframe_ctr);
-    fprintf(p_stat,"\n Mode  4  (8x8)       |  %5d         |    %8.2f     |",stat->mode_use[B_SLICE][P8x8],(float)stat->bit_use_mode[B_SLICE][P8x8]/(float)Bframe_ctr);
-    fprintf(p_stat,"\n Mode  5  intra 4x4   |  %5d         |-----------------|",stat->mode_use[B_SLICE][I4MB]);
-    fprintf(p_stat,"\n Mode  6+ intra 16x16 |  %5d         |",stat->mode_use[B_SLICE][I16MB]);
-    mean_motion_info_bit_use[1] = (float)(stat->bit_use_mode[B_SLICE][0] + stat->bit_use_mode[B_SLICE][1] + stat->bit_use_mode[B_SLICE][2] 
-                                      + stat->bit_use_mode[B_SLICE][3] + stat->bit_use_mode[B_SLICE][P8x8])/(float) Bframe_ctr; 
+    fprintf(p_stat,"\n Mode  0  (copy)      |  %5d         |    %8.2f     |",enc_stat->mode_use[B_SLICE][0   ],(float)enc_stat->bit_use_mode[B_SLICE][0   ]/(float)Bframe_ctr);
+    fprintf(p_stat,"\n Mode  1  (16x16)     |  %5d         |    %8.2f     |",enc_stat->mode_use[B_SLICE][1   ],(float)enc_stat->bit_use_mode[B_SLICE][1   ]/(float)Bframe_ctr);
+    fprintf(p_stat,"\n Mode  2  (16x8)      |  %5d         |    %8.2f     |",enc_stat->mode_use[B_SLICE][2   ],(float)enc_stat->bit_use_mode[B_SLICE][2   ]/(float)Bframe_ctr);
+    fprintf(p_stat,"\n Mode  3  (8x16)      |  %5d         |    %8.2f     |",enc_stat->mode_use[B_SLICE][3   ],(float)enc_stat->bit_use_mode[B_SLICE][3   ]/(float)Bframe_ctr);
+    fprintf(p_stat,"\n Mode  4  (8x8)       |  %5d         |    %8.2f     |",enc_stat->mode_use[B_SLICE][P8x8],(float)enc_stat->bit_use_mode[B_SLICE][P8x8]/(float)Bframe_ctr);
+    fprintf(p_stat,"\n Mode  5  intra 4x4   |  %5d         |-----------------|",enc_stat->mode_use[B_SLICE][I4MB]);
+    fprintf(p_stat,"\n Mode  6+ intra 16x16 |  %5d         |",enc_stat->mode_use[B_SLICE][I16MB]);
+    mean_motion_info_bit_use[1] = (float)(enc_stat->bit_use_mode[B_SLICE][0] + enc_stat->bit_use_mode[B_SLICE][1] + enc_stat->bit_use_mode[B_SLICE][2] 
+                                      + enc_stat->bit_use_mode[B_SLICE][3] + enc_stat->bit_use_mode[B_SLICE][P8x8])/(float) Bframe_ctr; 
 
   }
 
@@ -1051,18 +1095,18 @@ void report()
   fprintf(p_stat," ---------------------|----------------|----------------|----------------|\n");
 
   fprintf(p_stat," Header               |");
-  fprintf(p_stat," %10.2f     |",(float) stat->bit_use_header[I_SLICE]/bit_use[I_SLICE][0]);
-  fprintf(p_stat," %10.2f     |",(float) stat->bit_use_header[P_SLICE]/bit_use[P_SLICE][0]);
+  fprintf(p_stat," %10.2f     |",(float) enc_stat->bit_use_header[I_SLICE]/bit_use[I_SLICE][0]);
+  fprintf(p_stat," %10.2f     |",(float) enc_stat->bit_use_header[P_SLICE]/bit_use[P_SLICE][0]);
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
-    fprintf(p_stat," %10.2f      |",(float) stat->bit_use_header[B_SLICE]/Bframe_ctr);
+    fprintf(p_stat," %10.2f      |",(float) enc_stat->bit_use_header[B_SLICE]/Bframe_ctr);
   else fprintf(p_stat," %10.2f      |", 0.);
   fprintf(p_stat,"\n");
 
   fprintf(p_stat," Mode                 |");
-  fprintf(p_stat," %10.2f     |",(float)stat->bit_use_mb_type[I_SLICE]/bit_use[I_SLICE][0]);
-  fprintf(p_stat," %10.2f     |",(float)stat->bit_use_mb_type[P_SLICE]/bit_use[P_SLICE][0]);
+  fprintf(p_stat," %10.2f     |",(float)enc_stat->bit_use_mb_type[I_SLICE]/bit_use[I_SLICE][0]);
+  fprintf(p_stat," %10.2f     |",(float)enc_stat->bit_use_mb_type[P_SLICE]/bit_use[P_SLICE][0]);
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
-    fprintf(p_stat," %10.2f     |",(float)stat->bit_use_mb_type[B_SLICE]/Bframe_ctr);
+    fprintf(p_stat," %10.2f     |",(float)enc_stat->bit_use_mb_type[B_SLICE]/Bframe_ctr);
   else fprintf(p_stat," %10.2f     |", 0.);
   fprintf(p_stat,"\n");
 
@@ -1075,40 +1119,40 @@ void report()
   fprintf(p_stat,"\n");
 
   fprintf(p_stat," CBP Y/C              |");
-  fprintf(p_stat," %10.2f     |", (float)stat->tmp_bit_use_cbp[I_SLICE]/bit_use[I_SLICE][0]);
-  fprintf(p_stat," %10.2f     |", (float)stat->tmp_bit_use_cbp[P_SLICE]/bit_use[P_SLICE][0]);
+  fprintf(p_stat," %10.2f     |", (float)enc_stat->tmp_bit_use_cbp[I_SLICE]/bit_use[I_SLICE][0]);
+  fprintf(p_stat," %10.2f     |", (float)enc_stat->tmp_bit_use_cbp[P_SLICE]/bit_use[P_SLICE][0]);
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
-    fprintf(p_stat," %10.2f     |", (float)stat->tmp_bit_use_cbp[B_SLICE]/Bframe_ctr);
+    fprintf(p_stat," %10.2f     |", (float)enc_stat->tmp_bit_use_cbp[B_SLICE]/Bframe_ctr);
   else fprintf(p_stat," %10.2f     |", 0.);
   fprintf(p_stat,"\n");
 
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
     fprintf(p_stat," Coeffs. Y            | %10.2f     | %10.2f     | %10.2f     |\n",
-    (float)stat->bit_use_coeffY[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_coeffY[P_SLICE]/bit_use[P_SLICE][0], (float)stat->bit_use_coeffY[B_SLICE]/Bframe_ctr);
+    (float)enc_stat->bit_use_coeffY[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_coeffY[P_SLICE]/bit_use[P_SLICE][0], (float)enc_stat->bit_use_coeffY[B_SLICE]/Bframe_ctr);
   else
     fprintf(p_stat," Coeffs. Y            | %10.2f     | %10.2f     | %10.2f     |\n",
-      (float)stat->bit_use_coeffY[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_coeffY[P_SLICE]/(float)bit_use[P_SLICE][0], 0.);
+      (float)enc_stat->bit_use_coeffY[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_coeffY[P_SLICE]/(float)bit_use[P_SLICE][0], 0.);
 
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
     fprintf(p_stat," Coeffs. C            | %10.2f     | %10.2f     | %10.2f     |\n",
-      (float)stat->bit_use_coeffC[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_coeffC[P_SLICE]/bit_use[P_SLICE][0], (float)stat->bit_use_coeffC[B_SLICE]/Bframe_ctr);
+      (float)enc_stat->bit_use_coeffC[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_coeffC[P_SLICE]/bit_use[P_SLICE][0], (float)enc_stat->bit_use_coeffC[B_SLICE]/Bframe_ctr);
   else
     fprintf(p_stat," Coeffs. C            | %10.2f     | %10.2f     | %10.2f     |\n",
-      (float)stat->bit_use_coeffC[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_coeffC[P_SLICE]/bit_use[P_SLICE][0], 0.);
+      (float)enc_stat->bit_use_coeffC[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_coeffC[P_SLICE]/bit_use[P_SLICE][0], 0.);
 
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
     fprintf(p_stat," Delta quant          | %10.2f     | %10.2f     | %10.2f     |\n",
-      (float)stat->bit_use_delta_quant[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_delta_quant[P_SLICE]/bit_use[P_SLICE][0], (float)stat->bit_use_delta_quant[B_SLICE]/Bframe_ctr);
+      (float)enc_stat->bit_use_delta_quant[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_delta_quant[P_SLICE]/bit_use[P_SLICE][0], (float)enc_stat->bit_use_delta_quant[B_SLICE]/Bframe_ctr);
   else
     fprintf(p_stat," Delta quant          | %10.2f     | %10.2f     | %10.2f     |\n",
-      (float)stat->bit_use_delta_quant[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_delta_quant[P_SLICE]/bit_use[P_SLICE][0], 0.);
+      (float)enc_stat->bit_use_delta_quant[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_delta_quant[P_SLICE]/bit_use[P_SLICE][0], 0.);
 
   if(input->successive_Bframe!=0 && Bframe_ctr!=0)
     fprintf(p_stat," Stuffing Bits        | %10.2f     | %10.2f     | %10.2f     |\n",
-      (float)stat->bit_use_stuffingBits[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_stuffingBits[P_SLICE]/bit_use[P_SLICE][0], (float)stat->bit_use_stuffingBits[B_SLICE]/Bframe_ctr);
+      (float)enc_stat->bit_use_stuffingBits[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_stuffingBits[P_SLICE]/bit_use[P_SLICE][0], (float)enc_stat->bit_use_stuffingBits[B_SLICE]/Bframe_ctr);
   else
     fprintf(p_stat," Stuffing Bits        | %10.2f     | %10.2f     | %10.2f     |\n",
-      (float)stat->bit_use_stuffingBits[I_SLICE]/bit_use[I_SLICE][0], (float)stat->bit_use_stuffingBits[P_SLICE]/bit_use[P_SLICE][0], 0.);
+      (float)enc_stat->bit_use_stuffingBits[I_SLICE]/bit_use[I_SLICE][0], (float)enc_stat->bit_use_stuffingBits[P_SLICE]/bit_use[P_SLICE][0], 0.);
 
 
 
@@ -1219,12 +1263,12 @@ void report()
   fprintf(p_log,"%-5.3f|",snr->snr_va);
   if(input->successive_Bframe != 0)
   {
-    fprintf(p_log,"%7.0f|",stat->bitrate_P);
-    fprintf(p_log,"%7.0f|",stat->bitrate_B);
+    fprintf(p_log,"%7.0f|",enc_stat->bitrate_P);
+    fprintf(p_log,"%7.0f|",enc_stat->bitrate_B);
   }
   else
   {
-    fprintf(p_log,"%7.0f|",stat->bitrate);
+    fprintf(p_log,"%7.0f|",enc_stat->bitrate);
     fprintf(p_log,"%7.0f|",0.0);
   }
 
@@ -1235,12 +1279,12 @@ void report()
 /*
   if(input->successive_Bframe != 0)
   {
-    fprintf(p_log,"%7.0f|",stat->bitrate_P);
-    fprintf(p_log,"%7.0f|\n",stat->bitrate_B);
+    fprintf(p_log,"%7.0f|",enc_stat->bitrate_P);
+    fprintf(p_log,"%7.0f|\n",enc_stat->bitrate_B);
   }
   else
   {
-    fprintf(p_log,"%7.0f|",stat->bitrate);
+    fprintf(p_log,"%7.0f|",enc_stat->bitrate);
     fprintf(p_log,"%7.0f|\n",0.0);
   }
 */
@@ -1258,7 +1302,7 @@ void report()
         snr->snr_y1,
         snr->snr_u1,
         snr->snr_v1,
-        stat->bit_ctr_0,
+        enc_stat->bit_ctr_0,
         0.0,
         0.0,
         0.0,
@@ -1266,8 +1310,8 @@ void report()
         snr->snr_ya,
         snr->snr_ua,
         snr->snr_va,
-        (stat->bit_ctr_0+stat->bit_ctr)/(input->no_frames+Bframe_ctr),
-        stat->bit_ctr_B/Bframe_ctr,
+        (enc_stat->bit_ctr_0+enc_stat->bit_ctr)/(input->no_frames+Bframe_ctr),
+        enc_stat->bit_ctr_B/Bframe_ctr,
         (double)0.001*tot_time/(input->no_frames+Bframe_ctr));
   }
   else
@@ -1279,7 +1323,7 @@ void report()
         snr->snr_y1,
         snr->snr_u1,
         snr->snr_v1,
-        stat->bit_ctr_0,
+        enc_stat->bit_ctr_0,
         0.0,
         0.0,
         0.0,
@@ -1287,7 +1331,7 @@ void report()
         snr->snr_ya,
         snr->snr_ua,
         snr->snr_va,
-        (stat->bit_ctr_0+stat->bit_ctr)/input->no_frames,
+        (enc_stat->bit_ctr_0+enc_stat->bit_ctr)/input->no_frames,
         0,
         (double)0.001*tot_time/input->no_frames);
   }
@@ -1339,7 +1383,7 @@ void information_init()
  */
 int init_global_buffers()
 {
-  int j,memory_size=0;
+  int memory_size=0;
   int height_field = img->height/2;
 #ifdef _ADAPT_LAST_GROUP_
   extern int *last_P_no_frm;
@@ -1379,24 +1423,9 @@ int init_global_buffers()
     memory_size += get_mem2Dint(&direct_pdir, img->width/BLOCK_SIZE, img->height/BLOCK_SIZE);
   }
 
-  // allocate memory for temp quarter pel luma frame buffer: img4Y_tmp
-  // int img4Y_tmp[576][704];  (previously int imgY_tmp in global.h)
-  memory_size += get_mem2Dint(&img4Y_tmp, img->height+2*IMG_PAD_SIZE, (img->width+2*IMG_PAD_SIZE)*4);
-
   if (input->rdopt==2)
   {
-    memory_size += get_mem2Dint(&decs->resY, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
-    if ((decs->decref = (byte****) calloc(input->NoOfDecoders,sizeof(byte***))) == NULL) 
-      no_mem_exit("init_global_buffers: decref");
-    for (j=0 ; j<input->NoOfDecoders; j++)
-    {
-      memory_size += get_mem3D(&decs->decref[j], img->max_num_references+1, img->height, img->width);
-    }
-    memory_size += get_mem2D(&decs->RefBlock, BLOCK_SIZE,BLOCK_SIZE);
-    memory_size += get_mem3D(&decs->decY, input->NoOfDecoders, img->height, img->width);
-    memory_size += get_mem3D(&decs->decY_best, input->NoOfDecoders, img->height, img->width);
-    memory_size += get_mem2D(&decs->status_map, img->height/MB_BLOCK_SIZE,img->width/MB_BLOCK_SIZE);
-    memory_size += get_mem2D(&decs->dec_mb_mode, img->width/MB_BLOCK_SIZE,img->height/MB_BLOCK_SIZE);
+    memory_size += init_decoders();
   }
   if (input->RestrictRef)
   {
@@ -1439,8 +1468,6 @@ int init_global_buffers()
  */
 void free_global_buffers()
 {
-  int  i,j;
-
 #ifdef _ADAPT_LAST_GROUP_
   extern int *last_P_no_frm;
   extern int *last_P_no_fld;
@@ -1468,8 +1495,6 @@ void free_global_buffers()
   } // end if B frame
 
 
-  free_mem2Dint(img4Y_tmp);    // free temp quarter pel frame buffer
-
   // free mem, allocated in init_img()
   // free intra pred mode buffer for blocks
   free_mem2Dint(img->ipredmode);
@@ -1482,37 +1507,12 @@ void free_global_buffers()
 
   if (input->rdopt==2)
   {
-    free(decs->resY[0]);
-    free(decs->resY);
-    free(decs->RefBlock[0]);
-    free(decs->RefBlock);
-    for (j=0; j<input->NoOfDecoders; j++)
-    {
-      free(decs->decY[j][0]);
-      free(decs->decY[j]);
-      free(decs->decY_best[j][0]);
-      free(decs->decY_best[j]);
-      for (i=0; i<img->max_num_references+1; i++)
-      {
-        free(decs->decref[j][i][0]);
-        free(decs->decref[j][i]);
-      }
-      free(decs->decref[j]);
-    }
-    free(decs->decY);
-    free(decs->decY_best);
-    free(decs->decref);
-    free(decs->status_map[0]);
-    free(decs->status_map);
-    free(decs->dec_mb_mode[0]);
-    free(decs->dec_mb_mode);
+    free_decoders();
   }
   if (input->RestrictRef)
   {
-    free(pixel_map[0]);
-    free(pixel_map);
-    free(refresh_map[0]);
-    free(refresh_map);
+    free_mem2D(pixel_map);
+    free_mem2D(refresh_map);
   }
 
   if(!active_sps->frame_mbs_only_flag)
@@ -1544,33 +1544,16 @@ void free_global_buffers()
  */
 int get_mem_mv (int******* mv)
 {
-  int i, j, k, l, m;
+  int size[6];
+
+  size[0] = 4;
+  size[1] = 4;
+  size[2] = 2;
+  size[3] = img->max_num_references;
+  size[4] = 9;
+  size[5] = 2;
+  *mv = (int******) get_mem_array (6, size, sizeof(int), "get_mem_mv: mv");
 
-  if ((*mv = (int******)calloc(4,sizeof(int*****))) == NULL)
-    no_mem_exit ("get_mem_mv: mv");
-  for (i=0; i<4; i++)
-  {
-    if (((*mv)[i] = (int*****)calloc(4,sizeof(int****))) == NULL)
-      no_mem_exit ("get_mem_mv: mv");
-    for (j=0; j<4; j++)
-    {
-      if (((*mv)[i][j] = (int****)calloc(2,sizeof(int***))) == NULL)
-        no_mem_exit ("get_mem_mv: mv");
-      for (k=0; k<2; k++)
-      {
-        if (((*mv)[i][j][k] = (int***)calloc(img->max_num_references,sizeof(int**))) == NULL)
-          no_mem_exit ("get_mem_mv: mv");
-        for (l=0; l<img->max_num_references; l++)
-        {
-          if (((*mv)[i][j][k][l] = (int**)calloc(9,sizeof(int*))) == NULL)
-            no_mem_exit ("get_mem_mv: mv");
-          for (m=0; m<9; m++)
-            if (((*mv)[i][j][k][l][m] = (int*)calloc(2,sizeof(int))) == NULL)
-              no_mem_exit ("get_mem_mv: mv");
-        }
-      }
-    }
-  }
   return 4*4*img->max_num_references*9*2*sizeof(int);
 }
 
@@ -1585,29 +1568,7 @@ int get_mem_mv (int******* mv)
  */
 void free_mem_mv (int****** mv)
 {
-  int i, j, k, l, m;
-
-  for (i=0; i<4; i++)
-  {
-    for (j=0; j<4; j++)
-    {
-      for (k=0; k<2; k++)
-      {
-        for (l=0; l<img->max_num_references; l++)
-        {
-          for (m=0; m<9; m++)
-          {
-            free (mv[i][j][k][l][m]);
-          }
-          free (mv[i][j][k][l]);
-        }
-        free (mv[i][j][k]);
-      }
-      free (mv[i][j]);
-    }
-    free (mv[i]);
-  }
-  free (mv);
+  free_mem_array (mv, 6);
 }
 
 
@@ -41,6 +41,11 @@
 #include "global.h"
 #include "image.h"
 #include "mb_access.h"
+#include "simd.h"
+
+#if defined(HAVE_X86_SIMD)
+  #include <emmintrin.h>
+#endif
 
 extern const byte QP_SCALE_CR[52] ;
 
@@ -70,6 +75,9 @@ void GetStrength(byte Strength[16],ImageParameters *img,int MbQAddr,int dir,int
 void EdgeLoop(byte** Img, byte Strength[16],ImageParameters *img, int MbQAddr, int AlphaC0Offset, int BetaOffset, int dir, int edge, int width, int yuv);
 void DeblockMb(ImageParameters *img, byte **imgY, byte ***imgUV, int MbQAddr) ;
 
+static void DeblockMbEdges (ImageParameters *img, byte **imgY, byte ***imgUV, int MbQAddr, int mb_x, int mb_y,
+                            int filterLeftMbEdgeFlag, int filterTopMbEdgeFlag, int mvlimit);
+
 /*!
  *****************************************************************************************
  * \brief
@@ -138,6 +146,16 @@ void DeblockMb(ImageParameters *img, byte **imgY, byte ***imgUV, int MbQAddr)
   img->current_mb_nr = MbQAddr;
   CheckAvailabilityOfNeighbors();
 
+  if (!img->MbaffFrameFlag
+    && (!filterLeftMbEdgeFlag || img->mb_data[MbQ->mbAddrA].mb_field == MbQ->mb_field)
+    && (!filterTopMbEdgeFlag  || img->mb_data[MbQ->mbAddrB].mb_field == MbQ->mb_field))
+  {
+    // no mixed edges: all strengths of the MB at once, the edges are filtered line parallel
+    DeblockMbEdges (img, imgY, imgUV, MbQAddr, mb_x, mb_y, filterLeftMbEdgeFlag, filterTopMbEdgeFlag, mvlimit);
+    img->DeblockCall = 0;
+    return;
+  }
+
   for( dir=0 ; dir<2 ; dir++ )                                             // vertical edges, than horicontal edges
   {
     EdgeCondition = (dir && filterTopMbEdgeFlag) || (!dir && filterLeftMbEdgeFlag); // can not filter beyond picture boundaries
@@ -325,6 +343,88 @@ void GetStrength(byte Strength[16],ImageParameters *img,int MbQAddr,int dir,int
 
 #define CQPOF(qp) (Clip3(0, 51, qp + active_pps->chroma_qp_index_offset))
 
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters one line across an edge, SrcPtrP and SrcPtrQ point to the samples next to it
+ *****************************************************************************************
+ */
+static void FilterLine (byte *SrcPtrP, byte *SrcPtrQ, int incP, int incQ, int Strng,
+                        int Alpha, int Beta, const byte *ClipTab, int yuv)
+{
+  int      ap = 0, aq = 0;
+  int      C0, c0, Delta, dif, AbsDelta ;
+  int      L2, L1, L0, R0, R1, R2, RL0, L3, R3 ;
+  int      small_gap;
+
+  L0  = SrcPtrP[0] ;
+  R0  = SrcPtrQ[0] ;
+  L1  = SrcPtrP[-incP] ;
+  R1  = SrcPtrQ[ incQ] ;
+
+  AbsDelta  = abs( Delta = R0 - L0 )  ;
+
+  if( AbsDelta < Alpha )
+  {
+    C0  = ClipTab[ Strng ] ;
+    if( ((abs( R0 - R1) - Beta )  & (abs(L0 - L1) - Beta )) < 0  ) 
+    {
+      L2  = yuv ? 0 : SrcPtrP[-incP*2] ;
+      R2  = yuv ? 0 : SrcPtrQ[ incQ*2] ;
+      if( !yuv)
+      {
+        aq  = (abs( R0 - R2) - Beta ) < 0  ;
+        ap  = (abs( L0 - L2) - Beta ) < 0  ;
+      }
+    
+      RL0             = L0 + R0 ;
+    
+      if(Strng == 4 )    // INTRA strong filtering
+      {
+        if( yuv)  // Chroma
+        {
+          SrcPtrQ[0] = ((R1 << 1) + R0 + L1 + 2) >> 2; 
+          SrcPtrP[0] = ((L1 << 1) + L0 + R1 + 2) >> 2;                                           
+        }
+        else  // Luma
+        {
+          L3  = SrcPtrP[-incP*3] ;
+          R3  = SrcPtrQ[ incQ*3] ;
+          small_gap = (AbsDelta < ((Alpha >> 2) + 2));
+        
+          aq &= small_gap;
+          ap &= small_gap;
+        
+          SrcPtrQ[0]   = aq ? ( L1 + ((R1 + RL0) << 1) +  R2 + 4) >> 3 : ((R1 << 1) + R0 + L1 + 2) >> 2 ;
+          SrcPtrP[0]   = ap ? ( R1 + ((L1 + RL0) << 1) +  L2 + 4) >> 3 : ((L1 << 1) + L0 + R1 + 2) >> 2 ;
+        
+          SrcPtrQ[ incQ] =   aq  ? ( R2 + R0 + R1 + L0 + 2) >> 2 : R1;
+          SrcPtrP[-incP] =   ap  ? ( L2 + L1 + L0 + R0 + 2) >> 2 : L1;
+        
+          SrcPtrQ[ incQ*2] = aq ? (((R3 + R2) <<1) + R2 + R1 + RL0 + 4) >> 3 : R2;
+          SrcPtrP[-incP*2] = ap ? (((L3 + L2) <<1) + L2 + L1 + RL0 + 4) >> 3 : L2;
+        }
+      }
+      else                                                                                   // normal filtering
+      {
+        c0               = yuv? (C0+1):(C0 + ap + aq) ;
+        dif              = IClip( -c0, c0, ( (Delta << 2) + (L1 - R1) + 4) >> 3 ) ;
+        SrcPtrP[0]  = IClip(0, 255, L0 + dif) ;
+        SrcPtrQ[0]  = IClip(0, 255, R0 - dif) ;
+      
+        if( !yuv )
+        {
+          if( ap )
+            SrcPtrP[-incP] += IClip( -C0,  C0, ( L2 + ((RL0 + 1) >> 1) - (L1<<1)) >> 1 ) ;
+          if( aq  )
+            SrcPtrQ[ incQ] += IClip( -C0,  C0, ( R2 + ((RL0 + 1) >> 1) - (R1<<1)) >> 1 ) ;
+        } ;
+      } ;
+    } ; 
+  } ;
+}
+
+
 /*!
  *****************************************************************************************
  * \brief
@@ -334,19 +434,16 @@ void GetStrength(byte Strength[16],ImageParameters *img,int MbQAddr,int dir,int
 void EdgeLoop(byte** Img, byte Strength[16],ImageParameters *img, int MbQAddr, int AlphaC0Offset, int BetaOffset,
               int dir, int edge, int width, int yuv)
 {
-  int      pel, ap = 0, aq = 0, Strng ;
+  int      pel, Strng ;
   int      incP, incQ;
-  int      C0, c0, Delta, dif, AbsDelta ;
-  int      L2 = 0, L1, L0, R0, R1, R2 = 0, RL0, L3, R3 ;
   int      Alpha = 0, Beta = 0 ;
   byte*    ClipTab = NULL;   
-  int      small_gap;
   int      indexA, indexB;
   int      PelNum;
   int      StrengthIdx;
   byte     *SrcPtrP, *SrcPtrQ;
   int      QP;
-  int      xP, xQ, yP, yQ;
+  int      xQ, yQ;
   Macroblock *MbQ, *MbP;
   PixelPos pixP, pixQ;
   
@@ -358,8 +455,6 @@ void EdgeLoop(byte** Img, byte Strength[16],ImageParameters *img, int MbQAddr, i
     yQ = dir ? (edge < 4 ? edge << 2 : 1) : pel;
     getNeighbour(MbQAddr, xQ, yQ, 1-yuv, &pixQ);
     getNeighbour(MbQAddr, xQ - (1 - dir), yQ - dir, 1-yuv, &pixP);
-    xP = pixP.x;
-    yP = pixP.y;
     MbQ = &(img->mb_data[MbQAddr]);
     MbP = &(img->mb_data[pixP.mb_addr]);
     fieldModeFilteringFlag = MbQ->mb_field || MbP->mb_field;
@@ -381,74 +476,423 @@ void EdgeLoop(byte** Img, byte Strength[16],ImageParameters *img, int MbQAddr, i
       Beta=BETA_TABLE[indexB];  
       ClipTab=CLIP_TAB[indexA];
 
-      L0  = SrcPtrP[0] ;
-      R0  = SrcPtrQ[0] ;
-      L1  = SrcPtrP[-incP] ;
-      R1  = SrcPtrQ[ incQ] ;
-      L2  = SrcPtrP[-incP*2] ;
-      R2  = SrcPtrQ[ incQ*2] ;
-      L3  = SrcPtrP[-incP*3] ;
-      R3  = SrcPtrQ[ incQ*3] ;
       if( (Strng = Strength[StrengthIdx]) )
+        FilterLine (SrcPtrP, SrcPtrQ, incP, incQ, Strng, Alpha, Beta, ClipTab, yuv);
+    } ;
+  }
+}
+
+
+
+/*
+ *****************************************************************************************
+ *  MB edges without mixed frame/field macroblocks (frame and field pictures)
+ *****************************************************************************************
+ */
+#define MB_IS_INTRA(MB) ((MB)->mb_type==I4MB || (MB)->mb_type==I16MB || (MB)->mb_type==IPCM)
+#define MV_DIFFERS(a,b) ((abs ((a)[0] - (b)[0]) >= 4) | (abs ((a)[1] - (b)[1]) >= mvlimit))
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Strength 0 or 1 of an edge between the inter 4x4 blocks q and p from their
+ *    references and motion vectors, same rules as GetStrength()
+ *****************************************************************************************
+ */
+static byte MvStrength (int64 ref[2][5][5], int mv[2][5][5][2], int xq, int yq, int xp, int yp, int mvlimit, int bipred)
+{
+  int64 ref_q0 = ref[LIST_0][yq][xq], ref_q1;
+  int64 ref_p0 = ref[LIST_0][yp][xp], ref_p1;
+  int   *mv_q0 = mv[LIST_0][yq][xq],  *mv_q1 = mv[LIST_1][yq][xq];
+  int   *mv_p0 = mv[LIST_0][yp][xp],  *mv_p1 = mv[LIST_1][yp][xp];
+
+  if (!bipred)   // P slice
+    return (ref_q0 != ref_p0) | MV_DIFFERS (mv_q0, mv_p0);
+
+  ref_q1 = ref[LIST_1][yq][xq];
+  ref_p1 = ref[LIST_1][yp][xp];
+  if (!((ref_q0==ref_p0 && ref_q1==ref_p1) || (ref_q0==ref_p1 && ref_q1==ref_p0)))
+    return 1;
+
+  if (ref_q0 != ref_q1)
+  {
+    // compare MV for the same reference picture
+    if (ref_q0 == ref_p0)
+      return MV_DIFFERS (mv_q0, mv_p0) | MV_DIFFERS (mv_q1, mv_p1);
+    else
+      return MV_DIFFERS (mv_q0, mv_p1) | MV_DIFFERS (mv_q1, mv_p0);
+  }
+  // L0 and L1 reference pictures of q are the same; p as well
+  return (MV_DIFFERS (mv_q0, mv_p0) | MV_DIFFERS (mv_q1, mv_p1)) &&
+         (MV_DIFFERS (mv_q0, mv_p1) | MV_DIFFERS (mv_q1, mv_p0));
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Strength values of all edges of a macroblock without mixed edges [dir][edge][pel].
+ *    The references and vectors of the MB and of the 4x4 blocks left of and above it
+ *    are gathered once, one value is derived per 4x4 block edge.
+ *****************************************************************************************
+ */
+static void GetStrengthMb (byte Strength[2][4][16], ImageParameters *img, int MbQAddr,
+                           int filterLeftMbEdgeFlag, int filterTopMbEdgeFlag, int mvlimit)
+{
+  int64  ref[2][5][5];        // [list][y+1][x+1] of the 4x4 blocks, row and column 0 are the neighbours
+  int    mv[2][5][5][2];
+  int    list, x, y, xp, yp, k, dir, edge, blk_x, blk_y;
+  int    StrValue, Strng;
+  int    sp_slice = (img->type==SP_SLICE) || (img->type==SI_SLICE);
+  int    bipred   = (img->type==B_SLICE);
+  StorablePicture *p = enc_picture;
+  Macroblock *MbQ = &(img->mb_data[MbQAddr]);
+  Macroblock *MbP;
+
+  get_mb_block_pos (MbQAddr, &blk_x, &blk_y);
+  blk_x <<= 2;
+  blk_y <<= 2;
+
+  if (!sp_slice && !MB_IS_INTRA(MbQ))
+  {
+    for (list=0; list<=bipred; list++)
+      for (y = filterTopMbEdgeFlag ? -1 : 0; y<4; y++)
+        for (x = filterLeftMbEdgeFlag ? -1 : 0; x<4; x++)
+        {
+          if (x < 0 && y < 0)
+            continue;
+          ref[list][y+1][x+1]   = p->ref_idx[list][blk_x+x][blk_y+y] < 0 ? -1 : p->ref_pic_id[list][blk_x+x][blk_y+y];
+          mv[list][y+1][x+1][0] = p->mv[list][blk_x+x][blk_y+y][0];
+          mv[list][y+1][x+1][1] = p->mv[list][blk_x+x][blk_y+y][1];
+        }
+  }
+
+  for (dir=0; dir<2; dir++)
+  {
+    for (edge=0; edge<4; edge++)
+    {
+      if (!edge && !(dir ? filterTopMbEdgeFlag : filterLeftMbEdgeFlag))
+        continue;
+
+      MbP = edge ? MbQ : &(img->mb_data[dir ? MbQ->mbAddrB : MbQ->mbAddrA]);
+      // Strength=4 for Mb-edge (vertical ones only in field pictures), 3 otherwise
+      StrValue = (edge == 0 && (img->structure==FRAME || !dir)) ? 4 : 3;
+
+      for (k=0; k<4; k++)
       {
-        AbsDelta  = abs( Delta = R0 - L0 )  ;
-      
-        if( AbsDelta < Alpha )
+        x  = dir ? k : edge;
+        y  = dir ? edge : k;
+        xp = x - (1 - dir);
+        yp = y - dir;
+
+        Strng = StrValue;
+        if (!sp_slice && !MB_IS_INTRA(MbP) && !MB_IS_INTRA(MbQ))
         {
-          C0  = ClipTab[ Strng ] ;
-          if( ((abs( R0 - R1) - Beta )  & (abs(L0 - L1) - Beta )) < 0  ) 
-          {
-            if( !yuv)
-            {
-              aq  = (abs( R0 - R2) - Beta ) < 0  ;
-              ap  = (abs( L0 - L2) - Beta ) < 0  ;
-            }
-          
-            RL0             = L0 + R0 ;
-          
-            if(Strng == 4 )    // INTRA strong filtering
-            {
-              if( yuv)  // Chroma
-              {
-                SrcPtrQ[0] = ((R1 << 1) + R0 + L1 + 2) >> 2; 
-                SrcPtrP[0] = ((L1 << 1) + L0 + R1 + 2) >> 2;                                           
-              }
-              else  // Luma
-              {
-                small_gap = (AbsDelta < ((Alpha >> 2) + 2));
-              
-                aq &= small_gap;
-                ap &= small_gap;
-              
-                SrcPtrQ[0]   = aq ? ( L1 + ((R1 + RL0) << 1) +  R2 + 4) >> 3 : ((R1 << 1) + R0 + L1 + 2) >> 2 ;
-                SrcPtrP[0]   = ap ? ( R1 + ((L1 + RL0) << 1) +  L2 + 4) >> 3 : ((L1 << 1) + L0 + R1 + 2) >> 2 ;
-              
-                SrcPtrQ[ incQ] =   aq  ? ( R2 + R0 + R1 + L0 + 2) >> 2 : R1;
-                SrcPtrP[-incP] =   ap  ? ( L2 + L1 + L0 + R0 + 2) >> 2 : L1;
-              
-                SrcPtrQ[ incQ*2] = aq ? (((R3 + R2) <<1) + R2 + R1 + RL0 + 4) >> 3 : R2;
-                SrcPtrP[-incP*2] = ap ? (((L3 + L2) <<1) + L2 + L1 + RL0 + 4) >> 3 : L2;
-              }
-            }
-            else                                                                                   // normal filtering
-            {
-              c0               = yuv? (C0+1):(C0 + ap + aq) ;
-              dif              = IClip( -c0, c0, ( (Delta << 2) + (L1 - R1) + 4) >> 3 ) ;
-              SrcPtrP[0]  = IClip(0, 255, L0 + dif) ;
-              SrcPtrQ[0]  = IClip(0, 255, R0 - dif) ;
-            
-              if( !yuv )
-              {
-                if( ap )
-                  SrcPtrP[-incP] += IClip( -C0,  C0, ( L2 + ((RL0 + 1) >> 1) - (L1<<1)) >> 1 ) ;
-                if( aq  )
-                  SrcPtrQ[ incQ] += IClip( -C0,  C0, ( R2 + ((RL0 + 1) >> 1) - (R1<<1)) >> 1 ) ;
-              } ;
-            } ;
-          } ; 
-        } ;
-      } ;
-    } ;
+          if ((MbQ->cbp_blk & (1 << ((y<<2) + x))) || (MbP->cbp_blk & (1 << (((yp&3)<<2) + (xp&3)))))
+            Strng = 2;
+          else
+            Strng = MvStrength (ref, mv, x+1, y+1, xp+1, yp+1, mvlimit, bipred);
+        }
+        memset (&Strength[dir][edge][k<<2], Strng, 4);
+      }
+    }
+  }
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters the lines of an edge in C, (x,y) is the first q0 sample
+ *****************************************************************************************
+ */
+static void EdgeLinesC (byte **Img, int x, int y, int dir, int lines, int width, const byte *Strength,
+                        int Alpha, int Beta, const byte *ClipTab, int yuv)
+{
+  int pel;
+
+  if (dir)
+  {
+    for (pel=0; pel<lines; pel++)
+      if (Strength[pel])
+        FilterLine (&Img[y-1][x+pel], &Img[y][x+pel], width, width, Strength[pel], Alpha, Beta, ClipTab, yuv);
+  }
+  else
+  {
+    for (pel=0; pel<lines; pel++)
+      if (Strength[pel])
+        FilterLine (&Img[y+pel][x-1], &Img[y+pel][x], 1, 1, Strength[pel], Alpha, Beta, ClipTab, yuv);
   }
 }
 
+
+#if defined(HAVE_X86_SIMD)
+
+#define ABS_DIFF(a,b)  _mm_sub_epi16 (_mm_max_epi16 (a, b), _mm_min_epi16 (a, b))
+#define SELECT(m,a,b)  _mm_or_si128 (_mm_and_si128 (m, a), _mm_andnot_si128 (m, b))
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters 8 lines, v[] holds p3 p2 p1 p0 q0 q1 q2 q3 of the lines as words and
+ *    returns 0 if no sample changes. Values of the normal filter are clipped to
+ *    0..255 by the packing of the caller.
+ *****************************************************************************************
+ */
+static int SIMD_TARGET("sse2") filter8_sse2 (__m128i v[8], __m128i bs, __m128i tc0, int Alpha, int Beta, int yuv)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i two  = _mm_set1_epi16 (2);
+  const __m128i four = _mm_set1_epi16 (4);
+  const __m128i beta = _mm_set1_epi16 ((short) Beta);
+  __m128i L3 = v[0], L2 = v[1], L1 = v[2], L0 = v[3], R0 = v[4], R1 = v[5], R2 = v[6], R3 = v[7];
+  __m128i AbsDelta = ABS_DIFF (R0, L0);
+  __m128i filt, strong, normal, ap, aq, aps, aqs, RL0, c0, dif, t, P0, Q0;
+
+  filt = _mm_andnot_si128 (_mm_cmpeq_epi16 (bs, zero), _mm_cmplt_epi16 (AbsDelta, _mm_set1_epi16 ((short) Alpha)));
+  filt = _mm_and_si128 (filt, _mm_cmplt_epi16 (ABS_DIFF (R0, R1), beta));
+  filt = _mm_and_si128 (filt, _mm_cmplt_epi16 (ABS_DIFF (L0, L1), beta));
+  if (!_mm_movemask_epi8 (filt))
+    return 0;
+
+  strong = _mm_and_si128 (filt, _mm_cmpeq_epi16 (bs, four));
+  normal = _mm_andnot_si128 (strong, filt);
+  RL0    = _mm_add_epi16 (L0, R0);
+
+  // normal filtering of p0 and q0, the masks ap and aq are -1 where set
+  if (yuv)
+  {
+    ap = aq = zero;
+    c0 = _mm_add_epi16 (tc0, _mm_set1_epi16 (1));
+  }
+  else
+  {
+    ap = _mm_cmplt_epi16 (ABS_DIFF (L0, L2), beta);
+    aq = _mm_cmplt_epi16 (ABS_DIFF (R0, R2), beta);
+    c0 = _mm_sub_epi16 (_mm_sub_epi16 (tc0, ap), aq);
+  }
+  t   = _mm_add_epi16 (_mm_slli_epi16 (_mm_sub_epi16 (R0, L0), 2), _mm_sub_epi16 (L1, R1));
+  dif = _mm_srai_epi16 (_mm_add_epi16 (t, four), 3);
+  dif = _mm_max_epi16 (_mm_sub_epi16 (zero, c0), _mm_min_epi16 (c0, dif));
+  P0  = _mm_add_epi16 (L0, dif);
+  Q0  = _mm_sub_epi16 (R0, dif);
+
+  if (yuv)
+  {
+    // strong filtering: P0 = (2*L1 + L0 + R1 + 2) >> 2
+    t    = _mm_add_epi16 (_mm_add_epi16 (L1, R1), two);
+    v[3] = SELECT (strong, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, L1), L0), 2), SELECT (normal, P0, L0));
+    v[4] = SELECT (strong, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, R1), R0), 2), SELECT (normal, Q0, R0));
+    return 1;
+  }
+
+  // normal filtering of p1 and q1
+  t    = _mm_sub_epi16 (_mm_srai_epi16 (_mm_add_epi16 (RL0, _mm_set1_epi16 (1)), 1), _mm_slli_epi16 (L1, 1));
+  t    = _mm_srai_epi16 (_mm_add_epi16 (L2, t), 1);
+  t    = _mm_max_epi16 (_mm_sub_epi16 (zero, tc0), _mm_min_epi16 (tc0, t));
+  v[2] = _mm_add_epi16 (L1, _mm_and_si128 (_mm_and_si128 (normal, ap), t));
+  t    = _mm_sub_epi16 (_mm_srai_epi16 (_mm_add_epi16 (RL0, _mm_set1_epi16 (1)), 1), _mm_slli_epi16 (R1, 1));
+  t    = _mm_srai_epi16 (_mm_add_epi16 (R2, t), 1);
+  t    = _mm_max_epi16 (_mm_sub_epi16 (zero, tc0), _mm_min_epi16 (tc0, t));
+  v[5] = _mm_add_epi16 (R1, _mm_and_si128 (_mm_and_si128 (normal, aq), t));
+  v[3] = SELECT (normal, P0, L0);
+  v[4] = SELECT (normal, Q0, R0);
+
+  if (_mm_movemask_epi8 (strong))
+  {
+    t   = _mm_cmplt_epi16 (AbsDelta, _mm_set1_epi16 ((short) ((Alpha >> 2) + 2)));   // small gap
+    aps = _mm_and_si128 (ap, t);
+    aqs = _mm_and_si128 (aq, t);
+
+    // P0 = ap ? (R1 + 2*(L1 + RL0) + L2 + 4) >> 3 : (2*L1 + L0 + R1 + 2) >> 2
+    t  = _mm_add_epi16 (_mm_add_epi16 (R1, L2), _mm_slli_epi16 (_mm_add_epi16 (L1, RL0), 1));
+    P0 = SELECT (aps, _mm_srai_epi16 (_mm_add_epi16 (t, four), 3),
+                 _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (_mm_slli_epi16 (L1, 1), L0), _mm_add_epi16 (R1, two)), 2));
+    t  = _mm_add_epi16 (_mm_add_epi16 (L1, R2), _mm_slli_epi16 (_mm_add_epi16 (R1, RL0), 1));
+    Q0 = SELECT (aqs, _mm_srai_epi16 (_mm_add_epi16 (t, four), 3),
+                 _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (_mm_slli_epi16 (R1, 1), R0), _mm_add_epi16 (L1, two)), 2));
+    v[3] = SELECT (strong, P0, v[3]);
+    v[4] = SELECT (strong, Q0, v[4]);
+
+    // P1 = (L2 + L1 + L0 + R0 + 2) >> 2, P2 = (2*(L3 + L2) + L2 + L1 + RL0 + 4) >> 3
+    aps  = _mm_and_si128 (strong, aps);
+    aqs  = _mm_and_si128 (strong, aqs);
+    t    = _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (L2, L1), _mm_add_epi16 (RL0, two)), 2);
+    v[2] = SELECT (aps, t, v[2]);
+    t    = _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (R2, R1), _mm_add_epi16 (RL0, two)), 2);
+    v[5] = SELECT (aqs, t, v[5]);
+    t    = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (L3, L2), 1), _mm_add_epi16 (L2, L1));
+    v[1] = SELECT (aps, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, RL0), four), 3), L2);
+    t    = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (R3, R2), 1), _mm_add_epi16 (R2, R1));
+    v[6] = SELECT (aqs, _mm_srai_epi16 (_mm_add_epi16 (_mm_add_epi16 (t, RL0), four), 3), R2);
+  }
+  return 1;
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Transposes 8x8 samples: the low 8 bytes of r[i] are row i, out[k] returns the
+ *    columns 2k and 2k+1 in its low and high 8 bytes
+ *****************************************************************************************
+ */
+static void SIMD_TARGET("sse2") transpose8x8_sse2 (__m128i r[8], __m128i out[4])
+{
+  __m128i t0 = _mm_unpacklo_epi8 (r[0], r[1]);
+  __m128i t1 = _mm_unpacklo_epi8 (r[2], r[3]);
+  __m128i t2 = _mm_unpacklo_epi8 (r[4], r[5]);
+  __m128i t3 = _mm_unpacklo_epi8 (r[6], r[7]);
+  __m128i u0 = _mm_unpacklo_epi16 (t0, t1);
+  __m128i u1 = _mm_unpackhi_epi16 (t0, t1);
+  __m128i u2 = _mm_unpacklo_epi16 (t2, t3);
+  __m128i u3 = _mm_unpackhi_epi16 (t2, t3);
+
+  out[0] = _mm_unpacklo_epi32 (u0, u2);
+  out[1] = _mm_unpackhi_epi32 (u0, u2);
+  out[2] = _mm_unpacklo_epi32 (u1, u3);
+  out[3] = _mm_unpackhi_epi32 (u1, u3);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters the lines of an edge 8 at a time, (x,y) is the first q0 sample
+ *****************************************************************************************
+ */
+static void SIMD_TARGET("sse2") EdgeLinesSSE2 (byte **Img, int x, int y, int dir, int lines, const byte *Strength,
+                                                int Alpha, int Beta, const byte *ClipTab, int yuv)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i v[8], r[8], c[4], bs, tc0;
+  const byte *s;
+  int line, i;
+
+  for (line=0; line<lines; line+=8)
+  {
+    s = Strength + line;
+    if (!(s[0] | s[1] | s[2] | s[3] | s[4] | s[5] | s[6] | s[7]))
+      continue;
+    bs  = _mm_setr_epi16 (s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+    tc0 = _mm_setr_epi16 (ClipTab[s[0]], ClipTab[s[1]], ClipTab[s[2]], ClipTab[s[3]],
+                          ClipTab[s[4]], ClipTab[s[5]], ClipTab[s[6]], ClipTab[s[7]]);
+    if (dir)
+    {
+      // horizontal edge: the lines are columns, each row holds one sample position
+      for (i=0; i<8; i++)
+        v[i] = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i*) &Img[y-4+i][x+line]), zero);
+      if (filter8_sse2 (v, bs, tc0, Alpha, Beta, yuv))
+        for (i=1; i<7; i++)
+          _mm_storel_epi64 ((__m128i*) &Img[y-4+i][x+line], _mm_packus_epi16 (v[i], v[i]));
+    }
+    else
+    {
+      // vertical edge: the lines are rows, transposed to sample positions and back
+      for (i=0; i<8; i++)
+        r[i] = _mm_loadl_epi64 ((__m128i*) &Img[y+line+i][x-4]);
+      transpose8x8_sse2 (r, c);
+      for (i=0; i<4; i++)
+      {
+        v[2*i]   = _mm_unpacklo_epi8 (c[i], zero);
+        v[2*i+1] = _mm_unpackhi_epi8 (c[i], zero);
+      }
+      if (filter8_sse2 (v, bs, tc0, Alpha, Beta, yuv))
+      {
+        for (i=0; i<8; i++)
+          r[i] = _mm_packus_epi16 (v[i], v[i]);
+        transpose8x8_sse2 (r, c);
+        for (i=0; i<4; i++)
+        {
+          _mm_storel_epi64 ((__m128i*) &Img[y+line+2*i  ][x-4], c[i]);
+          _mm_storel_epi64 ((__m128i*) &Img[y+line+2*i+1][x-4], _mm_srli_si128 (c[i], 8));
+        }
+      }
+    }
+  }
+}
+#endif // HAVE_X86_SIMD
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Filters one edge of 16 (luma) or 8 (chroma) pel of a macroblock without mixed
+ *    edges. QP, Alpha, Beta and the clipping table are the same for all lines.
+ *****************************************************************************************
+ */
+static void EdgeLoopMb (byte **Img, byte Strength[16], Macroblock *MbQ, Macroblock *MbP,
+                        int dir, int edge, int mb_x, int mb_y, int width, int yuv)
+{
+  int   QP, indexA, indexB, Alpha, Beta, pel, x, y;
+  byte  StrengthCr[8];
+  byte *ClipTab;
+
+  QP     = yuv ? (QP_SCALE_CR[CQPOF(MbP->qp)] + QP_SCALE_CR[CQPOF(MbQ->qp)] + 1) >> 1 : (MbP->qp + MbQ->qp + 1) >> 1;
+  indexA = IClip(0, MAX_QP, QP + MbQ->LFAlphaC0Offset);
+  indexB = IClip(0, MAX_QP, QP + MbQ->LFBetaOffset);
+  Alpha  = ALPHA_TABLE[indexA];
+  Beta   = BETA_TABLE[indexB];
+  ClipTab= CLIP_TAB[indexA];
+  if (!Alpha || !Beta)
+    return;
+
+  if (yuv)
+  {
+    for (pel=0; pel<8; pel++)
+      StrengthCr[pel] = Strength[((pel>>1)<<2)+(pel%2)];
+    Strength = StrengthCr;
+    mb_x >>= 1;
+    mb_y >>= 1;
+  }
+  x = mb_x + (dir ? 0 : edge << 2);
+  y = mb_y + (dir ? edge << 2 : 0);
+
+#if defined(HAVE_X86_SIMD)
+  if (simd_level >= SIMD_SSE2)
+  {
+    EdgeLinesSSE2 (Img, x, y, dir, yuv ? 8 : 16, Strength, Alpha, Beta, ClipTab, yuv);
+    return;
+  }
+#endif
+  EdgeLinesC (Img, x, y, dir, yuv ? 8 : 16, width, Strength, Alpha, Beta, ClipTab, yuv);
+}
+
+
+/*!
+ *****************************************************************************************
+ * \brief
+ *    Deblocks a macroblock without mixed edges (mb_x, mb_y in samples)
+ *****************************************************************************************
+ */
+static void DeblockMbEdges (ImageParameters *img, byte **imgY, byte ***imgUV, int MbQAddr, int mb_x, int mb_y,
+                            int filterLeftMbEdgeFlag, int filterTopMbEdgeFlag, int mvlimit)
+{
+  byte        Strength[2][4][16];
+  int         dir, edge, i, StrengthSum;
+  Macroblock *MbQ = &(img->mb_data[MbQAddr]);
+  Macroblock *MbP;
+
+  GetStrengthMb (Strength, img, MbQAddr, filterLeftMbEdgeFlag, filterTopMbEdgeFlag, mvlimit);
+
+  for (dir=0; dir<2; dir++)
+  {
+    for (edge=0; edge<4; edge++)
+    {
+      if (!edge && !(dir ? filterTopMbEdgeFlag : filterLeftMbEdgeFlag))
+        continue;
+      for (StrengthSum=0, i=0; i<16; i+=4)
+        StrengthSum += Strength[dir][edge][i];
+      if (!StrengthSum)
+        continue;
+
+      MbP = edge ? MbQ : &(img->mb_data[dir ? MbQ->mbAddrB : MbQ->mbAddrA]);
+      EdgeLoopMb (imgY, Strength[dir][edge], MbQ, MbP, dir, edge, mb_x, mb_y, img->width, 0);
+      if ((imgUV != NULL) && !(edge & 1))
+      {
+        EdgeLoopMb (imgUV[0], Strength[dir][edge], MbQ, MbP, dir, edge/2, mb_x, mb_y, img->width_cr, 1);
+        EdgeLoopMb (imgUV[1], Strength[dir][edge], MbQ, MbP, dir, edge/2, mb_x, mb_y, img->width_cr, 1);
+      }
+    }
+  }
+}
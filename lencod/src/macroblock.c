@@ -50,11 +50,13 @@
 #include "mb_access.h"
 #include "ratectl.h"              // head file for rate control
 #include "cabac.h"
+#include "upsample.h"
 
 //Rate control
 int predict_error,dq;
-extern int DELTA_QP,DELTA_QP2;
-extern int QP,QP2;
+THREAD_LOCAL int intras;
+extern THREAD_LOCAL int DELTA_QP,DELTA_QP2;
+extern THREAD_LOCAL int QP,QP2;
 
  /*!
  ************************************************************************
@@ -146,20 +148,20 @@ void proceed2nextMacroblock()
 #endif
 
   // Update the statistics
-  stat->bit_use_mb_type    [img->type]  += bitCount[BITS_MB_MODE];
-  stat->bit_use_coeffY     [img->type]  += bitCount[BITS_COEFF_Y_MB] ;
-  stat->tmp_bit_use_cbp    [img->type]  += bitCount[BITS_CBP_MB];
-  stat->bit_use_coeffC     [img->type]  += bitCount[BITS_COEFF_UV_MB];
-  stat->bit_use_delta_quant[img->type]  += bitCount[BITS_DELTA_QUANT_MB];
+  enc_stat->bit_use_mb_type    [img->type]  += bitCount[BITS_MB_MODE];
+  enc_stat->bit_use_coeffY     [img->type]  += bitCount[BITS_COEFF_Y_MB] ;
+  enc_stat->tmp_bit_use_cbp    [img->type]  += bitCount[BITS_CBP_MB];
+  enc_stat->bit_use_coeffC     [img->type]  += bitCount[BITS_COEFF_UV_MB];
+  enc_stat->bit_use_delta_quant[img->type]  += bitCount[BITS_DELTA_QUANT_MB];
 
-  ++stat->mode_use[img->type][currMB->mb_type];
-  stat->bit_use_mode[img->type][currMB->mb_type]+= bitCount[BITS_INTER_MB];
+  ++enc_stat->mode_use[img->type][currMB->mb_type];
+  enc_stat->bit_use_mode[img->type][currMB->mb_type]+= bitCount[BITS_INTER_MB];
 
   // Statistics
   if ((img->type == P_SLICE)||(img->type==SP_SLICE) )
   {
-    ++stat->quant0;
-    stat->quant1 += currMB->qp;      // to find average quant for inter frames
+    ++enc_stat->quant0;
+    enc_stat->quant1 += currMB->qp;      // to find average quant for inter frames
   }
 }
 
@@ -203,8 +205,9 @@ void start_macroblock(int mb_addr, int mb_field)
           eep->ElowS            = eep->Elow;
           eep->ErangeS           = eep->Erange;
           eep->EbufferS         = eep->Ebuffer;
-          eep->Ebits_to_goS     = eep->Ebits_to_go;
-          eep->Ebits_to_followS = eep->Ebits_to_follow;
+          eep->EpendingS        = eep->Epending;
+          eep->EqueueS          = eep->Equeue;
+          eep->EoutstandingS    = eep->Eoutstanding;
           eep->EcodestrmS       = eep->Ecodestrm;
           eep->Ecodestrm_lenS   = eep->Ecodestrm_len;
           eep->CS               = eep->C;
@@ -216,7 +219,9 @@ void start_macroblock(int mb_addr, int mb_field)
 
   // Save the slice number of this macroblock. When the macroblock below
   // is coded it will use this to decide if prediction for above is possible
-  currMB->slice_nr = img->current_slice_nr;
+  // (already set if the slices are coded by the slice threads)
+  if (currMB->slice_nr != img->current_slice_nr)
+    currMB->slice_nr = img->current_slice_nr;
 
   // Initialize delta qp change from last macroblock. Feature may be used for future rate control
   // Rate control
@@ -428,7 +433,7 @@ void start_macroblock(int mb_addr, int mb_field)
     Slice* currSlice = img->currentSlice;
   	
     int prev_mb = FmoGetPreviousMBNr(img->current_mb_nr);
-    if (prev_mb>-1)
+    if (prev_mb>-1 && img->mb_data[prev_mb].slice_nr == img->current_slice_nr)
     {
       currMB->prev_qp = img->mb_data[prev_mb].qp;
       currMB->prev_delta_qp = img->mb_data[prev_mb].delta_qp;
@@ -543,6 +548,8 @@ void start_macroblock(int mb_addr, int mb_field)
   if(!input->FMEnable)
     ResetFastFullIntegerSearch ();
 #endif
+  if (input->HierarchicalME)
+    ResetHierarchicalMotionSearch ();
 }
 
 /*!
@@ -565,7 +572,7 @@ void terminate_macroblock(Boolean *end_of_slice, Boolean *recode_macroblock)
   EncodingEnvironmentPtr eep;
   int use_bitstream_backing = (input->slice_mode == FIXED_RATE || input->slice_mode == CALLBACK);
   int new_slice;
-  static int skip = FALSE;
+  static THREAD_LOCAL int skip = FALSE;
 
 	 
   // if previous mb in the same slice group has different slice number as the current, it's the
@@ -699,8 +706,9 @@ void terminate_macroblock(Boolean *end_of_slice, Boolean *recode_macroblock)
         eep->Elow            = eep->ElowS;
         eep->Erange           = eep->ErangeS;
         eep->Ebuffer         = eep->EbufferS;
-        eep->Ebits_to_go     = eep->Ebits_to_goS;
-        eep->Ebits_to_follow = eep->Ebits_to_followS;
+        eep->Epending        = eep->EpendingS;
+        eep->Equeue          = eep->EqueueS;
+        eep->Eoutstanding    = eep->EoutstandingS;
         eep->Ecodestrm       = eep->EcodestrmS;
         eep->Ecodestrm_len   = eep->Ecodestrm_lenS;
         eep->C               = eep->CS;
@@ -849,6 +857,7 @@ OneComponentLumaPrediction4x4 (int*   mpred,      //  --> array of prediction va
   int img_width =list[ref]->size_x;
   int img_height=list[ref]->size_y;
 
+  FillOneForthPix (list[ref], UPS_PLANE, j0, i0, j3, i3);
   ref_pic   = list[ref]->imgY_ups;
   
   *mpred++ = get_pel (ref_pic, j0, i0, img_height, img_width);
@@ -914,8 +923,8 @@ LumaPrediction4x4 (int  block_x,    // <--  relative horizontal block coordinate
                    int  fw_ref_idx, // <--  reference frame for forward prediction (-1: Intra4x4 pred. with fw_mode)
                    int  bw_ref_idx  )    
 {
-  static int fw_pred[16];
-  static int bw_pred[16];
+  static THREAD_LOCAL int fw_pred[16];
+  static THREAD_LOCAL int bw_pred[16];
 
   int  i, j;
   int  block_x4  = block_x+4;
@@ -1331,8 +1340,8 @@ ChromaPrediction4x4 (int  uv,           // <-- colour component
                      int  fw_ref_idx,   // <-- reference frame for forward prediction (if (<0) -> intra prediction)
                      int  bw_ref_idx)   // <-- reference frame for backward prediction 
 {
-  static int fw_pred[16];
-  static int bw_pred[16];
+  static THREAD_LOCAL int fw_pred[16];
+  static THREAD_LOCAL int bw_pred[16];
 
   int  i, j;
   int  block_x4   = block_x+4;
@@ -1645,14 +1654,10 @@ void IntraChromaPrediction8x8 (int *mb_up, int *mb_left, int*mb_up_left)
     }
   }
 
-  if (!input->rdopt) // the rd-opt part does not work correctly (see encode_one_macroblock)
+  if (!input->rdopt || input->FastModeDecision > 1) // the rd-opt part does not work correctly (see encode_one_macroblock)
   {                       // since ipredmodes could be overwritten => encoder-decoder-mismatches
     // pick lowest cost prediction mode
     min_cost = 1<<20;
-    for (i=0;i<8;i++)
-    {
-      getNeighbour(mb_nr, 0 ,  i , 0, &left[i]);
-    }
     for (mode=DC_PRED_8; mode<=PLANE_8; mode++)
     {
       if ((mode==VERT_PRED_8 && !mb_available_up) ||
@@ -1670,7 +1675,7 @@ void IntraChromaPrediction8x8 (int *mb_up, int *mb_left, int*mb_up_left)
           for (k=0,j=block_y; j<block_y+4; j++)
           for (i=block_x; i<block_x+4; i++,k++)
           {
-            diff[k] = image[left[j].pos_y][left[j].pos_x+i] - img->mprr_c[uv][mode][i][j];
+            diff[k] = image[img->opix_c_y+j][img->opix_c_x+i] - img->mprr_c[uv][mode][i][j];
           }
           cost += SATD(diff, input->hadamard);
         }
@@ -2237,7 +2242,7 @@ int writeChromaIntraPredMode()
 ************************************************************************
 */
 
-extern int last_dquant;
+extern THREAD_LOCAL int last_dquant;
 
 void set_last_dquant()
 {
@@ -2269,7 +2274,7 @@ void write_one_macroblock (int eos_bit)
   int*        bitCount = currMB->bitcounter;
   int i,j;
 
-  extern int cabac_encoding;
+  extern THREAD_LOCAL int cabac_encoding;
 
   //===== init and update number of intra macroblocks =====
   if (img->current_mb_nr==0)
@@ -2334,7 +2339,7 @@ void write_one_macroblock (int eos_bit)
   /*record the total number of MBs*/
   img->NumberofCodedMacroBlocks++;
   
-  stat->bit_slice += bitCount[BITS_TOTAL_MB];
+  enc_stat->bit_slice += bitCount[BITS_TOTAL_MB];
 
   cabac_encoding = 0;
 }
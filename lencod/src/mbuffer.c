@@ -42,8 +42,11 @@
 #include "memalloc.h"
 #include "output.h"
 #include "image.h"
+#include "upsample.h"
 
 static void insert_picture_in_dpb(FrameStore* fs, StorablePicture* p);
+static void clear_storable_picture(StorablePicture* s);
+static void free_picture_memory(StorablePicture* p);
 static void output_one_frame_from_dpb();
 static int  is_used_for_reference(FrameStore* fs);
 static void get_smallest_poc(int *poc,int * pos);
@@ -54,15 +57,41 @@ void gen_field_ref_ids(StorablePicture *p);
 
 DecodedPictureBuffer dpb;
 
-StorablePicture **listX[6];
+THREAD_LOCAL StorablePicture **listX[6];
 
-ColocatedParams *Co_located = NULL;
+THREAD_LOCAL ColocatedParams *Co_located = NULL;
 
 
-int listXsize[6];
+THREAD_LOCAL int listXsize[6];
 
 #define MAX_LIST_SIZE 33
 
+//! initial reference lists of the current picture for the I, P and B slices (init_lists),
+//! valid for the picture they were built for until the dpb changes. One per thread, as
+//! the PAFF thread builds the lists of the frame while the main thread codes the fields.
+static THREAD_LOCAL struct
+{
+  int              valid;                              //!< bit n: set n holds the lists
+  unsigned         generation;                         //!< dpb_generation the lists were built for
+  PictureStructure structure;
+  unsigned         frame_num;
+  int              poc, framepoc;
+  int              size[3][2];
+  StorablePicture *list[3][2][MAX_LIST_SIZE];
+} list_cache;
+
+static unsigned dpb_generation = 0;                    //!< incremented whenever the dpb changes
+
+//! size of the field macroblock indicator; big enough for the MBs of a frame if the picture is a field
+#define MB_FIELD_SIZE(size_x, size_y)  ((size_x)*(size_y)/128)
+
+static StorablePicture *pic_pool      = NULL;  //!< released pictures kept for reuse, linked by pool_next
+static int              pic_pool_size = 0;
+int pic_pool_hits   = 0;                       //!< pictures taken from the pool
+int pic_pool_misses = 0;                       //!< pictures that had to be allocated
+static int              pic_hold      = 0;     //!< released pictures are parked, see hold_released_pictures()
+static StorablePicture *pic_held      = NULL;  //!< parked pictures, linked by pool_next
+
 /*!
  ************************************************************************
  * \brief
@@ -176,12 +205,14 @@ int getDpbSize()
  */
 void init_dpb()
 {
-  unsigned i,j;
+  unsigned i;
+  dpb_generation++;
 
   if (dpb.init_done)
   {
     free_dpb();
   }
+  flush_picture_pool();
 
   dpb.size      = getDpbSize();
   
@@ -218,21 +249,7 @@ void init_dpb()
     dpb.fs_ltref[i] = NULL;
   }
   
-  for (i=0; i<6; i++)
-  {
-    listX[i] = calloc(MAX_LIST_SIZE, sizeof (StorablePicture*)); // +1 for reordering
-    if (NULL==listX[i]) 
-      no_mem_exit("init_dpb: listX[i]");
-  }
-
-  for (j=0;j<6;j++)
-  {
-    for (i=0; i<MAX_LIST_SIZE; i++)
-    {
-      listX[j][i] = NULL;
-    }
-    listXsize[j]=0;
-  }
+  alloc_ref_lists();
 
   dpb.last_output_poc = INT_MIN;
 
@@ -269,13 +286,9 @@ void free_dpb()
     free (dpb.fs_ltref);
   }
   dpb.last_output_poc = INT_MIN;
+  dpb_generation++;
 
-  for (i=0; i<6; i++)
-    if (listX[i])
-    {
-      free (listX[i]);
-      listX[i] = NULL;
-    }
+  free_ref_lists();
 
   dpb.init_done = 0;
 }
@@ -330,40 +343,61 @@ FrameStore* alloc_frame_store()
  *
  * \return
  *    the allocated StorablePicture structure
+ *
+ * \note
+ *    A released picture of the same size is taken from the picture pool
+ *    if there is one. It is cleared, so it looks like a newly allocated one.
  ************************************************************************
  */
 StorablePicture* alloc_storable_picture(PictureStructure structure, int size_x, int size_y, int size_x_cr, int size_y_cr)
 {
-  StorablePicture *s;
+  StorablePicture *s, **pp;
 
   //printf ("Allocating (%s) picture (x=%d, y=%d, x_cr=%d, y_cr=%d)\n", (type == FRAME)?"FRAME":(type == TOP_FIELD)?"TOP_FIELD":"BOTTOM_FIELD", size_x, size_y, size_x_cr, size_y_cr);
 
-  s = calloc (1, sizeof(StorablePicture));
-  if (NULL==s) 
-    no_mem_exit("alloc_storable_picture: s");
-
-  get_mem2D (&(s->imgY), size_y, size_x);
-  
-  s->imgY_11 = NULL;
-  s->imgY_ups = NULL;
+  for (pp = &pic_pool; *pp; pp = &(*pp)->pool_next)
+  {
+    s = *pp;
+    if (s->size_x == size_x && s->size_y == size_y && s->size_x_cr == size_x_cr && s->size_y_cr == size_y_cr)
+      break;
+  }
 
-  if (input->WeightedPrediction || input->WeightedBiprediction)
+  if (*pp)
   {
-    s->imgY_11_w = NULL;
-    s->imgY_ups_w = NULL;
+    *pp = s->pool_next;
+    pic_pool_size--;
+    pic_pool_hits++;
+    clear_storable_picture (s);
   }
+  else
+  {
+    pic_pool_misses++;
 
-  get_mem3D (&(s->imgUV), 2, size_y_cr, size_x_cr );
+    s = calloc (1, sizeof(StorablePicture));
+    if (NULL==s) 
+      no_mem_exit("alloc_storable_picture: s");
 
-  s->mb_field = calloc (img->PicSizeInMbs, sizeof(int));
+    get_mem2D (&(s->imgY), size_y, size_x);
+    get_mem3D (&(s->imgUV), 2, size_y_cr, size_x_cr );
 
-  get_mem3Dint (&(s->ref_idx), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem3Dint64 (&(s->ref_pic_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem3Dint64 (&(s->ref_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem4Dint (&(s->mv), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE,2 );
+    s->mb_field = calloc (MB_FIELD_SIZE(size_x, size_y), sizeof(int));
 
-  get_mem2D (&(s->moving_block), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
-  get_mem2D (&(s->field_frame), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem3Dint (&(s->ref_idx), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem3Dint64 (&(s->ref_pic_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem3Dint64 (&(s->ref_id), 6, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem4Dint (&(s->mv), 2, size_x / BLOCK_SIZE, size_y / BLOCK_SIZE,2 );
+
+    get_mem2D (&(s->moving_block), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+    get_mem2D (&(s->field_frame), size_x / BLOCK_SIZE, size_y / BLOCK_SIZE);
+  }
+
+  s->imgY_11 = NULL;
+  s->imgY_ups = NULL;
+  s->imgY_11_w = NULL;
+  s->imgY_ups_w = NULL;
+  s->imgY_sub[0] = s->imgY_sub[1] = NULL;
+  s->ups_tiles = NULL;
+  s->ups_next = NULL;
 
   s->pic_num=0;
   s->long_term_frame_idx=0;
@@ -431,69 +465,169 @@ void free_frame_store(FrameStore* f)
  * \param p
  *    Picture to be freed
  *
+ * \note
+ *    The picture is kept in the picture pool for reuse by
+ *    alloc_storable_picture() unless the pool is full. Its quarter pel
+ *    planes are released in any case.
  ************************************************************************
  */
 void free_storable_picture(StorablePicture* p)
 {
-  if (p)
+  if (p && pic_hold)
   {
-    free_mem3Dint (p->ref_idx, 2);
-    free_mem3Dint64 (p->ref_pic_id, 6);
-    free_mem3Dint64 (p->ref_id, 6);
-    free_mem4Dint (p->mv, 2, p->size_x / BLOCK_SIZE);
-
-    if (p->moving_block)
+    p->pool_next = pic_held;
+    pic_held     = p;
+  }
+  else if (p)
+  {
+    FreeOneForthPix (p);
+    if (pic_pool_size < PIC_POOL_SIZE)
     {
-      free_mem2D (p->moving_block);
-      p->moving_block=NULL;
+      p->pool_next = pic_pool;
+      pic_pool     = p;
+      pic_pool_size++;
     }
+    else
+      free_picture_memory (p);
+  }
+}
 
-    if (p->field_frame)
-    {
-      free_mem2D (p->field_frame);
-      p->field_frame=NULL;
-    }
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts (hold = 1) or ends (hold = 0) a period in which released
+ *    pictures are parked instead of being reused or freed, so that the
+ *    reference pictures of the PAFF thread stay intact while the main
+ *    thread changes the dpb. The parked pictures are released at the end.
+ ************************************************************************
+ */
+void hold_released_pictures(int hold)
+{
+  StorablePicture *p;
 
-    
-    if (p->imgY)
-    {
-      free_mem2D (p->imgY);
-      p->imgY=NULL;
-    }
-    if (p->imgY_11)
-    {
-      free (p->imgY_11);
-      p->imgY_11=NULL;
-    }
-    if (p->imgY_ups)
-    {
-      free_mem2D (p->imgY_ups);
-      p->imgY_ups=NULL;
-    }
-    if (p->imgUV)
-    {
-      free_mem3D (p->imgUV, 2);
-      p->imgUV=NULL;
-    }
+  pic_hold = hold;
+  while (!hold && pic_held)
+  {
+    p        = pic_held;
+    pic_held = p->pool_next;
+    free_storable_picture (p);
+  }
+}
 
-    if (input->WeightedPrediction || input->WeightedBiprediction)
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate the reference lists of the calling thread.
+ ************************************************************************
+ */
+void alloc_ref_lists()
+{
+  int i;
+
+  for (i=0; i<6; i++)
+  {
+    listX[i] = calloc(MAX_LIST_SIZE, sizeof (StorablePicture*)); // +1 for reordering
+    if (NULL==listX[i]) 
+      no_mem_exit("alloc_ref_lists: listX[i]");
+    listXsize[i] = 0;
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Free the reference lists of the calling thread.
+ ************************************************************************
+ */
+void free_ref_lists()
+{
+  int i;
+
+  for (i=0; i<6; i++)
+    if (listX[i])
     {
-      if (p->imgY_11_w)
-      {
-        free (p->imgY_11_w);
-        p->imgY_11_w=NULL;
-      }
-      if (p->imgY_ups_w)
-      {
-        free_mem2D (p->imgY_ups_w);
-        p->imgY_ups_w=NULL;
-      }
+      free (listX[i]);
+      listX[i] = NULL;
     }
+}
 
-    free(p->mb_field);
+/*!
+ ************************************************************************
+ * \brief
+ *    Free all pictures of the picture pool.
+ ************************************************************************
+ */
+void flush_picture_pool()
+{
+  StorablePicture *p;
 
-    free(p);
+  while (pic_pool)
+  {
+    p        = pic_pool;
+    pic_pool = p->pool_next;
+    free_picture_memory (p);
   }
+  pic_pool_size = 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Clear a picture taken from the picture pool: all fields and
+ *    sample / motion arrays are set to zero as after calloc(), the
+ *    arrays stay allocated.
+ ************************************************************************
+ */
+static void clear_storable_picture(StorablePicture* s)
+{
+  StorablePicture keep = *s;
+  int bx = s->size_x / BLOCK_SIZE;
+  int by = s->size_y / BLOCK_SIZE;
+
+  memset (s->imgY[0],         0, s->size_y * s->size_x);
+  memset (s->imgUV[0][0],     0, 2 * s->size_y_cr * s->size_x_cr);
+  memset (s->mb_field,        0, MB_FIELD_SIZE(s->size_x, s->size_y) * sizeof(int));
+  memset (s->ref_idx[0][0],   0, 2 * bx * by * sizeof(int));
+  memset (s->ref_pic_id[0][0],0, 6 * bx * by * sizeof(int64));
+  memset (s->ref_id[0][0],    0, 6 * bx * by * sizeof(int64));
+  memset (s->mv[0][0][0],     0, 2 * bx * by * 2 * sizeof(int));
+  memset (s->moving_block[0], 0, bx * by);
+  memset (s->field_frame[0],  0, bx * by);
+
+  memset (s, 0, sizeof(StorablePicture));
+  s->size_x       = keep.size_x;
+  s->size_y       = keep.size_y;
+  s->size_x_cr    = keep.size_x_cr;
+  s->size_y_cr    = keep.size_y_cr;
+  s->imgY         = keep.imgY;
+  s->imgUV        = keep.imgUV;
+  s->mb_field     = keep.mb_field;
+  s->ref_idx      = keep.ref_idx;
+  s->ref_pic_id   = keep.ref_pic_id;
+  s->ref_id       = keep.ref_id;
+  s->mv           = keep.mv;
+  s->moving_block = keep.moving_block;
+  s->field_frame  = keep.field_frame;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Free the memory of a picture.
+ ************************************************************************
+ */
+static void free_picture_memory(StorablePicture* p)
+{
+  free_mem3Dint (p->ref_idx, 2);
+  free_mem3Dint64 (p->ref_pic_id, 6);
+  free_mem3Dint64 (p->ref_id, 6);
+  free_mem4Dint (p->mv, 2, p->size_x / BLOCK_SIZE);
+  free_mem2D (p->moving_block);
+  free_mem2D (p->field_frame);
+  free_mem2D (p->imgY);
+  free_mem3D (p->imgUV, 2);
+  free(p->mb_field);
+  free(p);
 }
 
 /*!
@@ -834,11 +968,12 @@ static void gen_pic_list_from_frame_list(PictureStructure currStrcture, FrameSto
 /*!
  ************************************************************************
  * \brief
- *    Initialize listX[0] and list 1 depending on current picture type
+ *    Generates the initial reference picture lists of the current slice
+ *    type in listX[0] and listX[1], not limited to the active sizes
  *
  ************************************************************************
  */
-void init_lists(int currSliceType, PictureStructure currPicStructure)
+static void build_lists(int currSliceType, PictureStructure currPicStructure)
 {
   int add_top = 0, add_bottom = 0;
   unsigned i;
@@ -1177,6 +1312,50 @@ void init_lists(int currSliceType, PictureStructure currPicStructure)
       listX[1][1]=tmp_s;
     }
   }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Initialize listX[0] and list 1 depending on current picture type
+ *
+ ************************************************************************
+ */
+void init_lists(int currSliceType, PictureStructure currPicStructure)
+{
+  int i;
+  int set = ((currSliceType == I_SLICE)||(currSliceType == SI_SLICE)) ? 0 : (currSliceType == B_SLICE) ? 2 : 1;
+
+  // the lists only change with the picture and the contents of the dpb
+  if (!list_cache.valid || list_cache.generation != dpb_generation || list_cache.structure != currPicStructure
+    || list_cache.frame_num != img->frame_num || list_cache.poc != img->ThisPOC || list_cache.framepoc != img->framepoc)
+  {
+    list_cache.valid      = 0;
+    list_cache.generation = dpb_generation;
+    list_cache.structure  = currPicStructure;
+    list_cache.frame_num  = img->frame_num;
+    list_cache.poc        = img->ThisPOC;
+    list_cache.framepoc   = img->framepoc;
+  }
+
+  if (list_cache.valid & (1 << set))
+  {
+    listXsize[0] = list_cache.size[set][0];
+    listXsize[1] = list_cache.size[set][1];
+    memcpy (listX[0], list_cache.list[set][0], listXsize[0] * sizeof (StorablePicture*));
+    memcpy (listX[1], list_cache.list[set][1], listXsize[1] * sizeof (StorablePicture*));
+  }
+  else
+  {
+    build_lists(currSliceType, currPicStructure);
+    list_cache.size[set][0] = listXsize[0];
+    list_cache.size[set][1] = listXsize[1];
+    memcpy (list_cache.list[set][0], listX[0], listXsize[0] * sizeof (StorablePicture*));
+    memcpy (list_cache.list[set][1], listX[1], listXsize[1] * sizeof (StorablePicture*));
+    list_cache.valid |= 1 << set;
+  }
+
   // set max size
   listXsize[0] = min (listXsize[0], img->num_ref_idx_l0_active);
   listXsize[1] = min (listXsize[1], img->num_ref_idx_l1_active);
@@ -2135,6 +2314,7 @@ void store_picture_in_dpb(StorablePicture* p)
   //printf ("Storing (%s) non-ref pic with frame_num #%d\n", (p->type == FRAME)?"FRAME":(p->type == TOP_FIELD)?"TOP_FIELD":"BOTTOM_FIELD", img->frame_num);
   // if frame, check for new store, 
   assert (p!=NULL);
+  dpb_generation++;
 
   p->used_for_reference = (img->nal_reference_idc != 0);
 
@@ -2664,6 +2844,7 @@ static void output_one_frame_from_dpb()
 void flush_dpb()
 {
   unsigned i;
+  dpb_generation++;
 
   //diagnostics
 //  printf("Flush remaining frames from dpb. dpb.size=%d, dpb.used_size=%d\n",dpb.size,dpb.used_size);
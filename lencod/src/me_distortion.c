@@ -0,0 +1,915 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ *************************************************************************************
+ * \file me_distortion.c
+ *
+ * \brief
+ *    SAD/SATD kernels used by the motion search.
+ *
+ *    Every kernel exists as plain C reference code and, where it pays off,
+ *    as SSE2, SSSE3 and AVX2 version. The versions are selected once by
+ *    InitDistortionKernels() according to the SIMDKernels parameter and
+ *    the capabilities of the CPU.
+ *
+ *    With SIMDSelfCheck=1 every call of an optimized kernel is repeated
+ *    with the C reference code and the encoder stops on the first
+ *    difference. The C reference code is identical to the loops that
+ *    were used in mv-search.c and fast_me.c before.
+ *
+ *************************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "global.h"
+#include "simd.h"
+#include "me_distortion.h"
+
+#if defined(HAVE_X86_SIMD)
+  #include <emmintrin.h>
+  #include <tmmintrin.h>
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #endif
+#endif
+
+SADFunction computeSAD[8];
+int  (*computeSATD)       (int *diff);
+int  (*computeDiffSAD)    (int *diff);
+int  (*computeSubPelCost) (pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx);
+void (*computeSADField)   (pel_t *orig, pel_t *ref, int ref_stride, int width, int height, unsigned short *sad);
+void (*computeSADFieldSum)(unsigned short *sad, unsigned short *a, unsigned short *b, int n);
+int  (*computeSADBelow)   (unsigned short *sad, int n, int threshold);
+
+static int    subpel_hadamard;       //!< SubPel cost is SATD (1) or SAD (0)
+static int    self_check;
+static THREAD_LOCAL int64 self_check_calls;   //!< checked calls of the current thread
+static int64    self_check_total;             //!< checked calls of finished threads
+static JMMutex *self_check_lock = NULL;
+
+//! block sizes for the block types (same as input->blc_size)
+static const int blk_size[8][2] = {{16,16},{16,16},{16,8},{8,16},{8,8},{8,4},{4,8},{4,4}};
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    returns the block type (1-16x16 ... 7-4x4) of a block size, used to
+ *    index computeSAD[] where only the size is known
+ ************************************************************************
+ */
+int SADBlockType (int blocksize_x, int blocksize_y)
+{
+  int bt;
+
+  for (bt=1; bt<8; bt++)
+    if (blk_size[bt][0] == blocksize_x && blk_size[bt][1] == blocksize_y)
+      return bt;
+
+  snprintf (errortext, ET_SIZE, "SADBlockType: no block type for %dx%d", blocksize_x, blocksize_y);
+  error (errortext, 600);
+  return 0;
+}
+
+
+/*
+ *************************************************************************************
+ *  C reference kernels
+ *************************************************************************************
+ */
+
+static int sad_c (pel_t **orig_pic, pel_t *ref, int ref_stride, int bsx, int bsy, int mcost, int min_mcost)
+{
+  int x, y;
+  pel_t *orig_line;
+
+  for (y=0; y<bsy; y++, ref+=ref_stride)
+  {
+    orig_line = orig_pic[y];
+    for (x=0; x<bsx; x++)
+      mcost += absm (orig_line[x] - ref[x]);
+
+    if (mcost >= min_mcost)
+      break;
+  }
+  return mcost;
+}
+
+#define SAD_C(bt, bsx, bsy)                                                                   \
+static int sad_c_##bt (pel_t **orig_pic, pel_t *ref, int ref_stride, int mcost, int min_mcost) \
+{                                                                                             \
+  return sad_c (orig_pic, ref, ref_stride, bsx, bsy, mcost, min_mcost);                       \
+}
+
+SAD_C(1, 16, 16)
+SAD_C(2, 16,  8)
+SAD_C(3,  8, 16)
+SAD_C(4,  8,  8)
+SAD_C(5,  8,  4)
+SAD_C(6,  4,  8)
+SAD_C(7,  4,  4)
+
+static const SADFunction sad_c_table[8] = {NULL, sad_c_1, sad_c_2, sad_c_3, sad_c_4, sad_c_5, sad_c_6, sad_c_7};
+
+
+static int satd_c (int *diff)
+{
+  int k, satd = 0, m[16], *d=diff;
+
+  /*===== hadamard transform =====*/
+  m[ 0] = d[ 0] + d[12];
+  m[ 4] = d[ 4] + d[ 8];
+  m[ 8] = d[ 4] - d[ 8];
+  m[12] = d[ 0] - d[12];
+  m[ 1] = d[ 1] + d[13];
+  m[ 5] = d[ 5] + d[ 9];
+  m[ 9] = d[ 5] - d[ 9];
+  m[13] = d[ 1] - d[13];
+  m[ 2] = d[ 2] + d[14];
+  m[ 6] = d[ 6] + d[10];
+  m[10] = d[ 6] - d[10];
+  m[14] = d[ 2] - d[14];
+  m[ 3] = d[ 3] + d[15];
+  m[ 7] = d[ 7] + d[11];
+  m[11] = d[ 7] - d[11];
+  m[15] = d[ 3] - d[15];
+
+  d[ 0] = m[ 0] + m[ 4];
+  d[ 8] = m[ 0] - m[ 4];
+  d[ 4] = m[ 8] + m[12];
+  d[12] = m[12] - m[ 8];
+  d[ 1] = m[ 1] + m[ 5];
+  d[ 9] = m[ 1] - m[ 5];
+  d[ 5] = m[ 9] + m[13];
+  d[13] = m[13] - m[ 9];
+  d[ 2] = m[ 2] + m[ 6];
+  d[10] = m[ 2] - m[ 6];
+  d[ 6] = m[10] + m[14];
+  d[14] = m[14] - m[10];
+  d[ 3] = m[ 3] + m[ 7];
+  d[11] = m[ 3] - m[ 7];
+  d[ 7] = m[11] + m[15];
+  d[15] = m[15] - m[11];
+
+  m[ 0] = d[ 0] + d[ 3];
+  m[ 1] = d[ 1] + d[ 2];
+  m[ 2] = d[ 1] - d[ 2];
+  m[ 3] = d[ 0] - d[ 3];
+  m[ 4] = d[ 4] + d[ 7];
+  m[ 5] = d[ 5] + d[ 6];
+  m[ 6] = d[ 5] - d[ 6];
+  m[ 7] = d[ 4] - d[ 7];
+  m[ 8] = d[ 8] + d[11];
+  m[ 9] = d[ 9] + d[10];
+  m[10] = d[ 9] - d[10];
+  m[11] = d[ 8] - d[11];
+  m[12] = d[12] + d[15];
+  m[13] = d[13] + d[14];
+  m[14] = d[13] - d[14];
+  m[15] = d[12] - d[15];
+
+  d[ 0] = m[ 0] + m[ 1];
+  d[ 1] = m[ 0] - m[ 1];
+  d[ 2] = m[ 2] + m[ 3];
+  d[ 3] = m[ 3] - m[ 2];
+  d[ 4] = m[ 4] + m[ 5];
+  d[ 5] = m[ 4] - m[ 5];
+  d[ 6] = m[ 6] + m[ 7];
+  d[ 7] = m[ 7] - m[ 6];
+  d[ 8] = m[ 8] + m[ 9];
+  d[ 9] = m[ 8] - m[ 9];
+  d[10] = m[10] + m[11];
+  d[11] = m[11] - m[10];
+  d[12] = m[12] + m[13];
+  d[13] = m[12] - m[13];
+  d[14] = m[14] + m[15];
+  d[15] = m[15] - m[14];
+
+  /*===== sum up =====*/
+  for (k=0; k<16; k++)
+  {
+    satd += absm (diff[k]);
+  }
+  satd >>= 1;
+
+  return satd;
+}
+
+static int diff_sad_c (int *diff)
+{
+  int k, sad = 0;
+
+  for (k = 0; k < 16; k++)
+    sad += absm (diff[k]);
+
+  return sad;
+}
+
+static int subpel_cost_c (pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx)
+{
+  int   diff[16], *d = diff;
+  int   x, y;
+  pel_t *orig_line, *ref_line;
+
+  for (y=0; y<4; y++)
+  {
+    orig_line = orig_pic[y] + x0;
+    ref_line  = ref_pic[IMG_PAD_SIZE*4 + ry + 4*y] + IMG_PAD_SIZE*4 + rx;
+    for (x=0; x<4; x++)
+      *d++ = orig_line[x] - ref_line[4*x];
+  }
+  return subpel_hadamard ? satd_c (diff) : diff_sad_c (diff);
+}
+
+static void sad_field_c (pel_t *orig, pel_t *ref, int ref_stride, int width, int height, unsigned short *sad)
+{
+  int   b, x, y, i, j, s;
+  pel_t *o, *r;
+
+  for (b=0; b<16; b++)
+  {
+    o = orig + 64*(b>>2) + 4*(b&3);
+    r = ref  + 4*(b>>2)*ref_stride + 4*(b&3);
+    for (y=0; y<height; y++, r+=ref_stride)
+      for (x=0; x<width; x++)
+      {
+        for (s=0, j=0; j<4; j++)
+          for (i=0; i<4; i++)
+            s += absm (o[16*j+i] - r[j*ref_stride+x+i]);
+        *sad++ = (unsigned short) s;
+      }
+  }
+}
+
+static void sad_field_sum_c (unsigned short *sad, unsigned short *a, unsigned short *b, int n)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    sad[i] = (unsigned short) (a[i] + b[i]);
+}
+
+static int sad_below_c (unsigned short *sad, int n, int threshold)
+{
+  int i;
+
+  for (i=0; i<n && sad[i] > threshold; i++)
+    ;
+  return i;
+}
+
+
+#if defined(HAVE_X86_SIMD)
+/*
+ *************************************************************************************
+ *  SSE2 / SSSE3 / AVX2 kernels
+ *************************************************************************************
+ */
+
+static __inline __m128i load32 (pel_t *p)
+{
+  int v;
+  memcpy (&v, p, sizeof(int));
+  return _mm_cvtsi32_si128 (v);
+}
+
+static __inline int hsum_epi64 (__m128i s)
+{
+  return _mm_cvtsi128_si32 (s) + _mm_cvtsi128_si32 (_mm_srli_si128 (s, 8));
+}
+
+//--- SAD, 16 pixels wide: one psadbw per line ---
+SIMD_TARGET("sse2")
+static int sad16_sse2 (pel_t **orig_pic, pel_t *ref, int ref_stride, int bsy, int mcost, int min_mcost)
+{
+  int y;
+
+  for (y=0; y<bsy; y++, ref+=ref_stride)
+  {
+    mcost += hsum_epi64 (_mm_sad_epu8 (_mm_loadu_si128 ((__m128i*) orig_pic[y]), _mm_loadu_si128 ((__m128i*) ref)));
+    if (mcost >= min_mcost)
+      break;
+  }
+  return mcost;
+}
+
+//--- SAD, 8 pixels wide: two lines per psadbw, one line in each half ---
+SIMD_TARGET("sse2")
+static int sad8_sse2 (pel_t **orig_pic, pel_t *ref, int ref_stride, int bsy, int mcost, int min_mcost)
+{
+  int y;
+  __m128i o, r, s;
+
+  for (y=0; y<bsy; y+=2, ref+=2*ref_stride)
+  {
+    o = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((__m128i*) orig_pic[y]), _mm_loadl_epi64 ((__m128i*) orig_pic[y+1]));
+    r = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((__m128i*) ref), _mm_loadl_epi64 ((__m128i*) (ref+ref_stride)));
+    s = _mm_sad_epu8 (o, r);
+
+    if ((mcost += _mm_cvtsi128_si32 (s)) >= min_mcost)
+      break;
+    if ((mcost += _mm_cvtsi128_si32 (_mm_srli_si128 (s, 8))) >= min_mcost)
+      break;
+  }
+  return mcost;
+}
+
+//--- SAD, 4 pixels wide: two lines per psadbw, one line in each half ---
+SIMD_TARGET("sse2")
+static int sad4_sse2 (pel_t **orig_pic, pel_t *ref, int ref_stride, int bsy, int mcost, int min_mcost)
+{
+  int y;
+  __m128i o, r, s;
+
+  for (y=0; y<bsy; y+=2, ref+=2*ref_stride)
+  {
+    o = _mm_unpacklo_epi64 (load32 (orig_pic[y]), load32 (orig_pic[y+1]));
+    r = _mm_unpacklo_epi64 (load32 (ref), load32 (ref+ref_stride));
+    s = _mm_sad_epu8 (o, r);
+
+    if ((mcost += _mm_cvtsi128_si32 (s)) >= min_mcost)
+      break;
+    if ((mcost += _mm_cvtsi128_si32 (_mm_srli_si128 (s, 8))) >= min_mcost)
+      break;
+  }
+  return mcost;
+}
+
+#define SAD_SIMD(isa, bt, bsx, bsy)                                                                \
+SIMD_TARGET(#isa)                                                                                 \
+static int sad_##isa##_##bt (pel_t **orig_pic, pel_t *ref, int ref_stride, int mcost, int min_mcost) \
+{                                                                                                 \
+  return sad##bsx##_##isa (orig_pic, ref, ref_stride, bsy, mcost, min_mcost);                     \
+}
+
+SAD_SIMD(sse2, 1, 16, 16)
+SAD_SIMD(sse2, 2, 16,  8)
+SAD_SIMD(sse2, 3,  8, 16)
+SAD_SIMD(sse2, 4,  8,  8)
+SAD_SIMD(sse2, 5,  8,  4)
+SAD_SIMD(sse2, 6,  4,  8)
+SAD_SIMD(sse2, 7,  4,  4)
+
+static const SADFunction sad_sse2_table[8] = {NULL, sad_sse2_1, sad_sse2_2, sad_sse2_3, sad_sse2_4, sad_sse2_5, sad_sse2_6, sad_sse2_7};
+
+//--- SAD, 16 pixels wide: two lines per vpsadbw, one line in each 128 bit lane ---
+SIMD_TARGET("avx2")
+static int sad16_avx2 (pel_t **orig_pic, pel_t *ref, int ref_stride, int bsy, int mcost, int min_mcost)
+{
+  int y;
+  __m256i o, r, s;
+
+  for (y=0; y<bsy; y+=2, ref+=2*ref_stride)
+  {
+    o = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((__m128i*) orig_pic[y])),
+                                 _mm_loadu_si128 ((__m128i*) orig_pic[y+1]), 1);
+    r = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((__m128i*) ref)),
+                                 _mm_loadu_si128 ((__m128i*) (ref+ref_stride)), 1);
+    s = _mm256_sad_epu8 (o, r);
+
+    if ((mcost += hsum_epi64 (_mm256_castsi256_si128 (s))) >= min_mcost)
+      break;
+    if ((mcost += hsum_epi64 (_mm256_extracti128_si256 (s, 1))) >= min_mcost)
+      break;
+  }
+  return mcost;
+}
+
+SAD_SIMD(avx2, 1, 16, 16)
+SAD_SIMD(avx2, 2, 16,  8)
+
+//--- 4x4 Hadamard on four rows of 32 bit differences ---
+#define HADAMARD4(a, b, c, d)                                              \
+{                                                                          \
+  __m128i t0 = _mm_add_epi32 (a, b), t1 = _mm_sub_epi32 (a, b);            \
+  __m128i t2 = _mm_add_epi32 (c, d), t3 = _mm_sub_epi32 (c, d);            \
+  a = _mm_add_epi32 (t0, t2); b = _mm_sub_epi32 (t0, t2);                  \
+  c = _mm_add_epi32 (t1, t3); d = _mm_sub_epi32 (t1, t3);                  \
+}
+
+#define TRANSPOSE4(a, b, c, d)                                             \
+{                                                                          \
+  __m128i t0 = _mm_unpacklo_epi32 (a, b), t1 = _mm_unpacklo_epi32 (c, d);  \
+  __m128i t2 = _mm_unpackhi_epi32 (a, b), t3 = _mm_unpackhi_epi32 (c, d);  \
+  a = _mm_unpacklo_epi64 (t0, t1); b = _mm_unpackhi_epi64 (t0, t1);        \
+  c = _mm_unpacklo_epi64 (t2, t3); d = _mm_unpackhi_epi64 (t2, t3);        \
+}
+
+static __inline __m128i abs_epi32_sse2 (__m128i a)
+{
+  __m128i s = _mm_srai_epi32 (a, 31);
+  return _mm_sub_epi32 (_mm_xor_si128 (a, s), s);
+}
+
+static __inline int hsum_epi32 (__m128i a)
+{
+  a = _mm_add_epi32 (a, _mm_shuffle_epi32 (a, 0x4E));
+  a = _mm_add_epi32 (a, _mm_shuffle_epi32 (a, 0xB1));
+  return _mm_cvtsi128_si32 (a);
+}
+
+SIMD_TARGET("sse2")
+static __inline int satd_rows_sse2 (__m128i r0, __m128i r1, __m128i r2, __m128i r3)
+{
+  HADAMARD4  (r0, r1, r2, r3);
+  TRANSPOSE4 (r0, r1, r2, r3);
+  HADAMARD4  (r0, r1, r2, r3);
+
+  r0 = _mm_add_epi32 (_mm_add_epi32 (abs_epi32_sse2 (r0), abs_epi32_sse2 (r1)),
+                      _mm_add_epi32 (abs_epi32_sse2 (r2), abs_epi32_sse2 (r3)));
+  return hsum_epi32 (r0) >> 1;
+}
+
+SIMD_TARGET("ssse3")
+static __inline int satd_rows_ssse3 (__m128i r0, __m128i r1, __m128i r2, __m128i r3)
+{
+  HADAMARD4  (r0, r1, r2, r3);
+  TRANSPOSE4 (r0, r1, r2, r3);
+  HADAMARD4  (r0, r1, r2, r3);
+
+  r0 = _mm_add_epi32 (_mm_add_epi32 (_mm_abs_epi32 (r0), _mm_abs_epi32 (r1)),
+                      _mm_add_epi32 (_mm_abs_epi32 (r2), _mm_abs_epi32 (r3)));
+  return hsum_epi32 (r0) >> 1;
+}
+
+SIMD_TARGET("sse2")
+static __inline int sad_rows_sse2 (__m128i r0, __m128i r1, __m128i r2, __m128i r3)
+{
+  return hsum_epi32 (_mm_add_epi32 (_mm_add_epi32 (abs_epi32_sse2 (r0), abs_epi32_sse2 (r1)),
+                                    _mm_add_epi32 (abs_epi32_sse2 (r2), abs_epi32_sse2 (r3))));
+}
+
+SIMD_TARGET("sse2")
+static int satd_sse2 (int *diff)
+{
+  return satd_rows_sse2 (_mm_loadu_si128 ((__m128i*) diff    ), _mm_loadu_si128 ((__m128i*)(diff+ 4)),
+                         _mm_loadu_si128 ((__m128i*)(diff+ 8)), _mm_loadu_si128 ((__m128i*)(diff+12)));
+}
+
+SIMD_TARGET("ssse3")
+static int satd_ssse3 (int *diff)
+{
+  return satd_rows_ssse3 (_mm_loadu_si128 ((__m128i*) diff    ), _mm_loadu_si128 ((__m128i*)(diff+ 4)),
+                          _mm_loadu_si128 ((__m128i*)(diff+ 8)), _mm_loadu_si128 ((__m128i*)(diff+12)));
+}
+
+SIMD_TARGET("sse2")
+static int diff_sad_sse2 (int *diff)
+{
+  return sad_rows_sse2 (_mm_loadu_si128 ((__m128i*) diff    ), _mm_loadu_si128 ((__m128i*)(diff+ 4)),
+                        _mm_loadu_si128 ((__m128i*)(diff+ 8)), _mm_loadu_si128 ((__m128i*)(diff+12)));
+}
+
+/*
+ * The quarter-pel samples of one 4x4 block are every 4th byte of a line of
+ * the upsampled picture. Only these four bytes are read: a 16 byte load would
+ * run 3 bytes past the 13 bytes of the block, into the tile another thread
+ * may be interpolating.
+ */
+#define SUBPEL_LINE(p)  _mm_set_epi32 ((p)[12], (p)[8], (p)[4], (p)[0])
+
+#define SUBPEL_ROWS(r0, r1, r2, r3)                                                                \
+  __m128i zero = _mm_setzero_si128 ();                                                             \
+  pel_t   **ref_rows = ref_pic + IMG_PAD_SIZE*4 + ry;                                              \
+  int     ref_x = IMG_PAD_SIZE*4 + rx;                                                             \
+  __m128i r0 = _mm_sub_epi32 (_mm_unpacklo_epi16 (_mm_unpacklo_epi8 (load32 (orig_pic[0]+x0), zero), zero), \
+                              SUBPEL_LINE (ref_rows[ 0]+ref_x));                                   \
+  __m128i r1 = _mm_sub_epi32 (_mm_unpacklo_epi16 (_mm_unpacklo_epi8 (load32 (orig_pic[1]+x0), zero), zero), \
+                              SUBPEL_LINE (ref_rows[ 4]+ref_x));                                   \
+  __m128i r2 = _mm_sub_epi32 (_mm_unpacklo_epi16 (_mm_unpacklo_epi8 (load32 (orig_pic[2]+x0), zero), zero), \
+                              SUBPEL_LINE (ref_rows[ 8]+ref_x));                                   \
+  __m128i r3 = _mm_sub_epi32 (_mm_unpacklo_epi16 (_mm_unpacklo_epi8 (load32 (orig_pic[3]+x0), zero), zero), \
+                              SUBPEL_LINE (ref_rows[12]+ref_x));
+
+SIMD_TARGET("sse2")
+static int subpel_satd_sse2 (pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx)
+{
+  SUBPEL_ROWS(r0, r1, r2, r3)
+  return satd_rows_sse2 (r0, r1, r2, r3);
+}
+
+SIMD_TARGET("ssse3")
+static int subpel_satd_ssse3 (pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx)
+{
+  SUBPEL_ROWS(r0, r1, r2, r3)
+  return satd_rows_ssse3 (r0, r1, r2, r3);
+}
+
+SIMD_TARGET("sse2")
+static int subpel_sad_sse2 (pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx)
+{
+  SUBPEL_ROWS(r0, r1, r2, r3)
+  return sad_rows_sse2 (r0, r1, r2, r3);
+}
+
+//--- SAD field, one position at a time: blocks 0/2 and 1/3 of a 16x4 strip are masked into the psadbw halves ---
+SIMD_TARGET("sse2")
+static void sad_field_sse2 (pel_t *orig, pel_t *ref, int ref_stride, int width, int height, unsigned short *sad)
+{
+  int     plane = width*height;
+  int     by, x, y, j, pos;
+  __m128i m02 = _mm_set_epi32 (0, -1, 0, -1);
+  __m128i m13 = _mm_set_epi32 (-1, 0, -1, 0);
+  __m128i o02[4], o13[4], s02, s13, r;
+  pel_t   *line;
+  unsigned short *out;
+
+  for (by=0; by<4; by++)
+  {
+    for (j=0; j<4; j++)
+    {
+      r      = _mm_loadu_si128 ((__m128i*) (orig + 64*by + 16*j));
+      o02[j] = _mm_and_si128 (r, m02);
+      o13[j] = _mm_and_si128 (r, m13);
+    }
+    out = sad + 4*by*plane;
+    for (y=0, pos=0; y<height; y++)
+      for (x=0; x<width; x++, pos++)
+      {
+        s02  = s13 = _mm_setzero_si128 ();
+        line = ref + (4*by+y)*ref_stride + x;
+        for (j=0; j<4; j++, line+=ref_stride)
+        {
+          r   = _mm_loadu_si128 ((__m128i*) line);
+          s02 = _mm_add_epi64 (s02, _mm_sad_epu8 (o02[j], _mm_and_si128 (r, m02)));
+          s13 = _mm_add_epi64 (s13, _mm_sad_epu8 (o13[j], _mm_and_si128 (r, m13)));
+        }
+        out[        pos] = (unsigned short) _mm_cvtsi128_si32 (s02);
+        out[  plane+pos] = (unsigned short) _mm_cvtsi128_si32 (s13);
+        out[2*plane+pos] = (unsigned short) _mm_cvtsi128_si32 (_mm_srli_si128 (s02, 8));
+        out[3*plane+pos] = (unsigned short) _mm_cvtsi128_si32 (_mm_srli_si128 (s13, 8));
+      }
+  }
+}
+
+//--- SAD field, 16 positions at a time: vpmpsadbw slides each 4 pixel line of a block over
+//    8 reference positions per 128 bit lane, the upper lane covers the positions x+8..x+15.
+//    The load at x serves blocks 0 and 1 (source offset 0 / 4), the load at x+8 blocks 2 and 3 ---
+#define MPSAD_IMM(bx)  (((bx) | (((bx)&1)<<2)) * 9)
+
+SIMD_TARGET("avx2")
+static void sad_field_avx2 (pel_t *orig, pel_t *ref, int ref_stride, int width, int height, unsigned short *sad)
+{
+  int     plane = width*height;
+  int     by, x, y, j;
+  __m256i o[4], l0, l8, s0, s1, s2, s3;
+  pel_t   *line;
+  unsigned short *out;
+
+  for (by=0; by<4; by++)
+  {
+    for (j=0; j<4; j++)
+      o[j] = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((__m128i*) (orig + 64*by + 16*j)));
+    out = sad + 4*by*plane;
+    for (y=0; y<height; y++, out+=width)
+      for (x=0; x<width; x+=16)
+      {
+        s0 = s1 = s2 = s3 = _mm256_setzero_si256 ();
+        line = ref + (4*by+y)*ref_stride + x;
+        for (j=0; j<4; j++, line+=ref_stride)
+        {
+          l0 = _mm256_permute4x64_epi64 (_mm256_loadu_si256 ((__m256i*)  line),    0x94);
+          l8 = _mm256_permute4x64_epi64 (_mm256_loadu_si256 ((__m256i*) (line+8)), 0x94);
+          s0 = _mm256_add_epi16 (s0, _mm256_mpsadbw_epu8 (l0, o[j], MPSAD_IMM(0)));
+          s1 = _mm256_add_epi16 (s1, _mm256_mpsadbw_epu8 (l0, o[j], MPSAD_IMM(1)));
+          s2 = _mm256_add_epi16 (s2, _mm256_mpsadbw_epu8 (l8, o[j], MPSAD_IMM(2)));
+          s3 = _mm256_add_epi16 (s3, _mm256_mpsadbw_epu8 (l8, o[j], MPSAD_IMM(3)));
+        }
+        _mm256_storeu_si256 ((__m256i*) (out +         x), s0);
+        _mm256_storeu_si256 ((__m256i*) (out +   plane+x), s1);
+        _mm256_storeu_si256 ((__m256i*) (out + 2*plane+x), s2);
+        _mm256_storeu_si256 ((__m256i*) (out + 3*plane+x), s3);
+      }
+  }
+}
+
+SIMD_TARGET("sse2")
+static void sad_field_sum_sse2 (unsigned short *sad, unsigned short *a, unsigned short *b, int n)
+{
+  int i;
+
+  for (i=0; i<n; i+=8)
+    _mm_storeu_si128 ((__m128i*) (sad+i), _mm_add_epi16 (_mm_loadu_si128 ((__m128i*) (a+i)), _mm_loadu_si128 ((__m128i*) (b+i))));
+}
+
+SIMD_TARGET("avx2")
+static void sad_field_sum_avx2 (unsigned short *sad, unsigned short *a, unsigned short *b, int n)
+{
+  int i;
+
+  for (i=0; i<n; i+=16)
+    _mm256_storeu_si256 ((__m256i*) (sad+i), _mm256_add_epi16 (_mm256_loadu_si256 ((__m256i*) (a+i)), _mm256_loadu_si256 ((__m256i*) (b+i))));
+}
+
+//--- index of the lowest set bit of a non-zero mask ---
+static __inline int first_bit (unsigned int mask)
+{
+#if defined(__GNUC__)
+  return __builtin_ctz (mask);
+#else
+  unsigned long bit;
+  _BitScanForward (&bit, mask);
+  return (int) bit;
+#endif
+}
+
+//--- first SAD <= threshold: saturating subtraction of the threshold leaves zero exactly there ---
+SIMD_TARGET("sse2")
+static int sad_below_sse2 (unsigned short *sad, int n, int threshold)
+{
+  int     i, mask;
+  __m128i t, zero = _mm_setzero_si128 ();
+
+  if (threshold < 0)
+    return n;
+  t = _mm_set1_epi16 ((short) min (threshold, 65535));
+  for (i=0; i+8<=n; i+=8)
+  {
+    mask = _mm_movemask_epi8 (_mm_cmpeq_epi16 (_mm_subs_epu16 (_mm_loadu_si128 ((__m128i*) (sad+i)), t), zero));
+    if (mask)
+      return i + (first_bit (mask) >> 1);
+  }
+  for (; i<n && sad[i] > threshold; i++)
+    ;
+  return i;
+}
+#endif // HAVE_X86_SIMD
+
+
+/*
+ *************************************************************************************
+ *  self check: compare each call of an optimized kernel with the C reference
+ *************************************************************************************
+ */
+static SADFunction sad_opt[8];
+static int  (*satd_opt)       (int *diff);
+static int  (*diff_sad_opt)   (int *diff);
+static int  (*subpel_cost_opt)(pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx);
+static void (*sad_field_opt)  (pel_t *orig, pel_t *ref, int ref_stride, int width, int height, unsigned short *sad);
+static void (*sad_field_sum_opt) (unsigned short *sad, unsigned short *a, unsigned short *b, int n);
+static int  (*sad_below_opt)  (unsigned short *sad, int n, int threshold);
+
+static void self_check_failed (char *kernel)
+{
+  snprintf (errortext, ET_SIZE, "SIMD self check: %s kernel (%s) differs from C reference", kernel, simd_name (simd_level));
+  error (errortext, 600);
+}
+
+#define SAD_CHECK(bt)                                                                            \
+static int sad_check_##bt (pel_t **orig_pic, pel_t *ref, int ref_stride, int mcost, int min_mcost) \
+{                                                                                                \
+  int cost = sad_opt[bt] (orig_pic, ref, ref_stride, mcost, min_mcost);                          \
+  if (cost != sad_c_table[bt] (orig_pic, ref, ref_stride, mcost, min_mcost))                     \
+    self_check_failed ("SAD");                                                                   \
+  self_check_calls++;                                                                            \
+  return cost;                                                                                   \
+}
+
+SAD_CHECK(1)
+SAD_CHECK(2)
+SAD_CHECK(3)
+SAD_CHECK(4)
+SAD_CHECK(5)
+SAD_CHECK(6)
+SAD_CHECK(7)
+
+static const SADFunction sad_check_table[8] = {NULL, sad_check_1, sad_check_2, sad_check_3, sad_check_4, sad_check_5, sad_check_6, sad_check_7};
+
+static int satd_check (int *diff)
+{
+  int tmp[16], cost = satd_opt (diff);
+
+  memcpy (tmp, diff, sizeof(tmp));   // the C version works in place
+  if (cost != satd_c (tmp))
+    self_check_failed ("SATD");
+  self_check_calls++;
+  return cost;
+}
+
+static int diff_sad_check (int *diff)
+{
+  int cost = diff_sad_opt (diff);
+
+  if (cost != diff_sad_c (diff))
+    self_check_failed ("SAD 4x4");
+  self_check_calls++;
+  return cost;
+}
+
+static int subpel_cost_check (pel_t **orig_pic, int x0, pel_t **ref_pic, int ry, int rx)
+{
+  int cost = subpel_cost_opt (orig_pic, x0, ref_pic, ry, rx);
+
+  if (cost != subpel_cost_c (orig_pic, x0, ref_pic, ry, rx))
+    self_check_failed ("sub-pel SATD");
+  self_check_calls++;
+  return cost;
+}
+
+static void sad_field_check (pel_t *orig, pel_t *ref, int ref_stride, int width, int height, unsigned short *sad)
+{
+  unsigned short *ref_sad;
+
+  if ((ref_sad = (unsigned short *) malloc (16*width*height*sizeof(unsigned short))) == NULL)
+    no_mem_exit ("sad_field_check: ref_sad");
+  sad_field_opt (orig, ref, ref_stride, width, height, sad);
+  sad_field_c   (orig, ref, ref_stride, width, height, ref_sad);
+  if (memcmp (sad, ref_sad, 16*width*height*sizeof(unsigned short)))
+    self_check_failed ("4x4 SAD field");
+  free (ref_sad);
+  self_check_calls++;
+}
+
+static void sad_field_sum_check (unsigned short *sad, unsigned short *a, unsigned short *b, int n)
+{
+  int i;
+
+  sad_field_sum_opt (sad, a, b, n);
+  for (i=0; i<n; i++)
+    if (sad[i] != (unsigned short) (a[i] + b[i]))
+      self_check_failed ("SAD field sum");
+  self_check_calls++;
+}
+
+static int sad_below_check (unsigned short *sad, int n, int threshold)
+{
+  int i = sad_below_opt (sad, n, threshold);
+
+  if (i != sad_below_c (sad, n, threshold))
+    self_check_failed ("SAD threshold");
+  self_check_calls++;
+  return i;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    runs all kernels on random and extreme blocks before encoding starts
+ ************************************************************************
+ */
+static void self_test ()
+{
+  static pel_t orig_val[16*16], ref_val[64*64];
+  static unsigned short field[16*16*16], sum[256];
+  pel_t  *orig_pic[16], *ref_pic[64];
+  int    diff[16], tmp[16], bt, i, k, test, cost;
+
+  for (i=0; i<16; i++) orig_pic[i] = orig_val + 16*i;
+  for (i=0; i<64; i++) ref_pic[i]  = ref_val  + 64*i;
+
+  srand (4711);
+  for (test=0; test<1000; test++)
+  {
+    // random data, every 8th test with extreme values only
+    for (i=0; i<256;   i++) orig_val[i] = (pel_t) ((test&7) ? rand() : (rand()&1)*255);
+    for (i=0; i<64*64; i++) ref_val[i]  = (pel_t) ((test&7) ? rand() : (rand()&1)*255);
+    for (k=0; k<16;    k++) diff[k]     = orig_val[k] - ref_val[k];
+
+    for (bt=1; bt<8; bt++)
+    {
+      // once without and once with early termination
+      cost = computeSAD[bt] (orig_pic, ref_val + test%16, 64, test, INT_MAX);
+      cost = computeSAD[bt] (orig_pic, ref_val + test%16, 64, test, cost/2+1);
+    }
+    memcpy (tmp, diff, sizeof(tmp));
+    computeSATD (tmp);
+    computeDiffSAD (diff);
+    computeSubPelCost (orig_pic, 4*(test%4), ref_pic, 4*(test%8) - 16, (test%32) - 16);
+    if ((test & 15) == 0)
+      computeSADField (orig_val, ref_val + (test>>4)%16, 64, 16, 16, field);
+    computeSADFieldSum (sum, field + 16*(test%16), field + 256*(test%15), 256);
+    computeSADBelow (field + test%64, 1 + test%67, (test&7) ? (rand()&4095) : (test&8) ? -1 : INT_MAX);
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    selects the distortion kernels
+ * \param level
+ *    requested SIMD level (SIMDKernels parameter)
+ * \param check
+ *    compare all optimized kernel calls with the C reference
+ ************************************************************************
+ */
+void InitDistortionKernels (int level, int check)
+{
+  int bt;
+
+  init_simd (level);
+
+  subpel_hadamard = input->hadamard;
+  self_check      = check;
+  if (self_check_lock == NULL)
+    self_check_lock = create_mutex ();
+
+  for (bt=1; bt<8; bt++)
+    computeSAD[bt] = sad_c_table[bt];
+  computeSATD       = satd_c;
+  computeDiffSAD    = diff_sad_c;
+  computeSubPelCost = subpel_cost_c;
+  computeSADField   = sad_field_c;
+  computeSADFieldSum= sad_field_sum_c;
+  computeSADBelow   = sad_below_c;
+
+#if defined(HAVE_X86_SIMD)
+  if (simd_level >= SIMD_SSE2)
+  {
+    for (bt=1; bt<8; bt++)
+      computeSAD[bt] = sad_sse2_table[bt];
+    computeSATD       = satd_sse2;
+    computeDiffSAD    = diff_sad_sse2;
+    computeSubPelCost = subpel_hadamard ? subpel_satd_sse2 : subpel_sad_sse2;
+    computeSADField   = sad_field_sse2;
+    computeSADFieldSum= sad_field_sum_sse2;
+    computeSADBelow   = sad_below_sse2;
+  }
+  if (simd_level >= SIMD_SSSE3)
+  {
+    computeSATD       = satd_ssse3;
+    if (subpel_hadamard)
+      computeSubPelCost = subpel_satd_ssse3;
+  }
+  if (simd_level >= SIMD_AVX2)
+  {
+    computeSAD[1] = sad_avx2_1;
+    computeSAD[2] = sad_avx2_2;
+    computeSADField = sad_field_avx2;
+    computeSADFieldSum = sad_field_sum_avx2;
+  }
+#endif
+
+  if (self_check && simd_level > SIMD_C)
+  {
+    for (bt=1; bt<8; bt++)
+    {
+      sad_opt[bt]    = computeSAD[bt];
+      computeSAD[bt] = sad_check_table[bt];
+    }
+    satd_opt          = computeSATD;
+    computeSATD       = satd_check;
+    diff_sad_opt      = computeDiffSAD;
+    computeDiffSAD    = diff_sad_check;
+    subpel_cost_opt   = computeSubPelCost;
+    computeSubPelCost = subpel_cost_check;
+    sad_field_opt     = computeSADField;
+    computeSADField   = sad_field_check;
+    sad_field_sum_opt = computeSADFieldSum;
+    computeSADFieldSum= sad_field_sum_check;
+    sad_below_opt     = computeSADBelow;
+    computeSADBelow   = sad_below_check;
+
+    self_test ();
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    adds the self check counter of the calling thread to the total;
+ *    called by every thread that used the kernels before it ends
+ ************************************************************************
+ */
+void CollectDistortionKernelStats ()
+{
+  lock_mutex (self_check_lock);
+  self_check_total += self_check_calls;
+  self_check_calls  = 0;
+  unlock_mutex (self_check_lock);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    prints the selected kernels and the self check result
+ ************************************************************************
+ */
+void ReportDistortionKernels ()
+{
+  CollectDistortionKernelStats ();
+  fprintf (stdout, " SIMD distortion kernels           : %s\n", simd_name (simd_level));
+  if (self_check && simd_level > SIMD_C)
+    fprintf (stdout, " SIMD self check                   : %.0f calls identical to C\n", (double) self_check_total);
+}
@@ -30,8 +30,174 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "memalloc.h"
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate size bytes of zeroed memory aligned to MEM_ALIGN bytes.
+ *    The address returned by calloc() is kept in front of the block.
+ ************************************************************************
+ */
+void *mem_alloc_aligned (size_t size)
+{
+  byte *raw, *ptr;
+
+  if ((raw = (byte*) calloc (size + MEM_ALIGN + sizeof(void*), 1)) == NULL)
+    return NULL;
+
+  ptr  = raw + sizeof(void*);
+  ptr += (MEM_ALIGN - ((size_t) ptr & (MEM_ALIGN - 1))) & (MEM_ALIGN - 1);
+  ((void**) ptr)[-1] = raw;
+
+  return ptr;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    free memory allocated with mem_alloc_aligned()
+ ************************************************************************
+ */
+void mem_free_aligned (void *ptr)
+{
+  if (ptr)
+    free (((void**) ptr)[-1]);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate a dims dimensional array array[size[0]]...[size[dims-1]]
+ *    of elem_size byte elements (dims >= 2). The elements are one
+ *    contiguous block aligned to MEM_ALIGN bytes, the pointers of all
+ *    levels above are a second block that starts with the top level.
+ ************************************************************************
+ */
+void *get_mem_array (int dims, const int size[], int elem_size, char *where)
+{
+  void **ptrs, **level, **next;
+  byte  *data;
+  int    l, i, n, num_ptrs = 0, num_elems = 1;
+
+  for (l=0; l<dims-1; l++)
+  {
+    num_elems *= size[l];
+    num_ptrs  += num_elems;
+  }
+  num_elems *= size[dims-1];
+
+  if ((ptrs = (void**) calloc (num_ptrs ? num_ptrs : 1, sizeof(void*))) == NULL)
+    no_mem_exit (where);
+  if ((data = (byte*) mem_alloc_aligned ((size_t) num_elems * elem_size)) == NULL)
+    no_mem_exit (where);
+
+  level = ptrs;
+  n     = size[0];
+  for (l=0; l<dims-2; l++)
+  {
+    next = level + n;
+    for (i=0; i<n; i++)
+      level[i] = next + i * size[l+1];
+    level = next;
+    n    *= size[l+1];
+  }
+  for (i=0; i<n; i++)
+    level[i] = data + i * size[dims-1] * elem_size;
+
+  return ptrs;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    free an array of get_mem_array()
+ ************************************************************************
+ */
+void free_mem_array (void *array, int dims)
+{
+  void **p = (void**) array;
+  int    l;
+
+  if (array == NULL)
+    return;
+
+  for (l=0; l<dims-2 && p[0]; l++)
+    p = (void**) p[0];
+  mem_free_aligned (p[0]);
+  free (array);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate a sample plane of rows x columns with a border of pad
+ *    samples: plane[-pad .. rows+pad-1][-pad .. columns+pad-1]. The rows
+ *    start at a MEM_ALIGN boundary and the stride is a multiple of it;
+ *    the kernels may read up to MEM_ALIGN bytes beyond the last sample.
+ *
+ * \par Output:
+ *    memory size in bytes
+ ************************************************************************
+ */
+int get_plane (byte ***plane, int rows, int columns, int pad)
+{
+  int    left   = (pad + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+  int    stride = (left + columns + pad + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+  int    i;
+  byte **ptrs;
+  byte  *data;
+
+  if ((ptrs = (byte**) calloc (rows + 2*pad, sizeof(byte*))) == NULL)
+    no_mem_exit ("get_plane: plane");
+  if ((data = (byte*) mem_alloc_aligned ((rows + 2*pad) * stride + MEM_ALIGN)) == NULL)
+    no_mem_exit ("get_plane: plane");
+
+  for (i=0; i<rows+2*pad; i++)
+    ptrs[i] = data + i*stride + left;
+  *plane = ptrs + pad;
+
+  return (rows + 2*pad) * stride;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    free a plane of get_plane()
+ ************************************************************************
+ */
+void free_plane (byte **plane, int pad)
+{
+  int left = (pad + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+
+  if (plane == NULL)
+  {
+    error ("free_plane: trying to free unused memory",100);
+    return;
+  }
+  mem_free_aligned (plane[-pad] - left);
+  free (plane - pad);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    returns the view of a contiguous plane (get_plane(), get_mem2D())
+ ************************************************************************
+ */
+PlaneView plane_view (byte **plane, int rows, int columns)
+{
+  PlaneView view;
+
+  view.data   = plane[0];
+  view.stride = rows > 1 ? (int) (plane[1] - plane[0]) : columns;
+  view.width  = columns;
+  view.height = rows;
+
+  return view;
+}
+
 /*!
  ************************************************************************
  * \brief
@@ -45,15 +211,11 @@
 // to the next line with an offset of img->width
 int get_mem2D(byte ***array2D, int rows, int columns)
 {
-  int i;
-
-  if((*array2D      = (byte**)calloc(rows,        sizeof(byte*))) == NULL)
-    no_mem_exit("get_mem2D: array2D");
-  if(((*array2D)[0] = (byte* )calloc(columns*rows,sizeof(byte ))) == NULL)
-    no_mem_exit("get_mem2D: array2D");
+  int size[2];
 
-  for(i=1;i<rows;i++)
-    (*array2D)[i] = (*array2D)[i-1] + columns ;
+  size[0] = rows;
+  size[1] = columns;
+  *array2D = (byte**) get_mem_array (2, size, sizeof(byte), "get_mem2D: array2D");
 
   return rows*columns;
 }
@@ -70,15 +232,11 @@ int get_mem2D(byte ***array2D, int rows, int columns)
 // same change as in get_mem2Dint
 int get_mem2Dint(int ***array2D, int rows, int columns)
 {
-  int i;
+  int size[2];
 
-  if((*array2D      = (int**)calloc(rows,        sizeof(int*))) == NULL)
-    no_mem_exit("get_mem2Dint: array2D");
-  if(((*array2D)[0] = (int* )calloc(rows*columns,sizeof(int ))) == NULL)
-    no_mem_exit("get_mem2Dint: array2D");
-
-  for(i=1 ; i<rows ; i++)
-    (*array2D)[i] =  (*array2D)[i-1] + columns  ;
+  size[0] = rows;
+  size[1] = columns;
+  *array2D = (int**) get_mem_array (2, size, sizeof(int), "get_mem2Dint: array2D");
 
   return rows*columns*sizeof(int);
 }
@@ -95,15 +253,11 @@ int get_mem2Dint(int ***array2D, int rows, int columns)
 // same change as in get_mem2Dint
 int get_mem2Dint64(int64 ***array2D, int rows, int columns)
 {
-  int i;
-
-  if((*array2D      = (int64**)calloc(rows,        sizeof(int64*))) == NULL)
-    no_mem_exit("get_mem2Dint64: array2D");
-  if(((*array2D)[0] = (int64* )calloc(rows*columns,sizeof(int64 ))) == NULL)
-    no_mem_exit("get_mem2Dint64: array2D");
+  int size[2];
 
-  for(i=1 ; i<rows ; i++)
-    (*array2D)[i] =  (*array2D)[i-1] + columns  ;
+  size[0] = rows;
+  size[1] = columns;
+  *array2D = (int64**) get_mem_array (2, size, sizeof(int64), "get_mem2Dint64: array2D");
 
   return rows*columns*sizeof(int64);
 }
@@ -120,13 +274,12 @@ int get_mem2Dint64(int64 ***array2D, int rows, int columns)
 // same change as in get_mem2Dint
 int get_mem3D(byte ****array3D, int frames, int rows, int columns)
 {
-  int  j;
+  int size[3];
 
-  if(((*array3D) = (byte***)calloc(frames,sizeof(byte**))) == NULL)
-    no_mem_exit("get_mem3D: array3D");
-
-  for(j=0;j<frames;j++)
-    get_mem2D( (*array3D)+j, rows, columns ) ;
+  size[0] = frames;
+  size[1] = rows;
+  size[2] = columns;
+  *array3D = (byte***) get_mem_array (3, size, sizeof(byte), "get_mem3D: array3D");
 
   return frames*rows*columns;
 }
@@ -143,13 +296,12 @@ int get_mem3D(byte ****array3D, int frames, int rows, int columns)
 // same change as in get_mem2Dint
 int get_mem3Dint(int ****array3D, int frames, int rows, int columns)
 {
-  int  j;
-
-  if(((*array3D) = (int***)calloc(frames,sizeof(int**))) == NULL)
-    no_mem_exit("get_mem3Dint: array3D");
+  int size[3];
 
-  for(j=0;j<frames;j++)
-    get_mem2Dint( (*array3D)+j, rows, columns ) ;
+  size[0] = frames;
+  size[1] = rows;
+  size[2] = columns;
+  *array3D = (int***) get_mem_array (3, size, sizeof(int), "get_mem3Dint: array3D");
 
   return frames*rows*columns*sizeof(int);
 }
@@ -166,13 +318,12 @@ int get_mem3Dint(int ****array3D, int frames, int rows, int columns)
 // same change as in get_mem2Dint
 int get_mem3Dint64(int64 ****array3D, int frames, int rows, int columns)
 {
-  int  j;
-
-  if(((*array3D) = (int64***)calloc(frames,sizeof(int64**))) == NULL)
-    no_mem_exit("get_mem3Dint64: array3D");
+  int size[3];
 
-  for(j=0;j<frames;j++)
-    get_mem2Dint64( (*array3D)+j, rows, columns ) ;
+  size[0] = frames;
+  size[1] = rows;
+  size[2] = columns;
+  *array3D = (int64***) get_mem_array (3, size, sizeof(int64), "get_mem3Dint64: array3D");
 
   return frames*rows*columns*sizeof(int64);
 }
@@ -189,13 +340,13 @@ int get_mem3Dint64(int64 ****array3D, int frames, int rows, int columns)
 // same change as in get_mem2Dint
 int get_mem4Dint(int *****array4D, int idx, int frames, int rows, int columns )
 {
-  int  j;
+  int size[4];
 
-  if(((*array4D) = (int****)calloc(idx,sizeof(int**))) == NULL)
-    no_mem_exit("get_mem4Dint: array4D");
-
-  for(j=0;j<idx;j++)
-    get_mem3Dint( (*array4D)+j, frames, rows, columns ) ;
+  size[0] = idx;
+  size[1] = frames;
+  size[2] = rows;
+  size[3] = columns;
+  *array4D = (int****) get_mem_array (4, size, sizeof(int), "get_mem4Dint: array4D");
 
   return idx*frames*rows*columns*sizeof(int);
 }
@@ -212,10 +363,8 @@ void free_mem2D(byte **array2D)
   if (array2D)
   {
     if (array2D[0])
-      free (array2D[0]);
+      free_mem_array (array2D, 2);
     else error ("free_mem2D: trying to free unused memory",100);
-
-    free (array2D);
   } else
   {
     error ("free_mem2D: trying to free unused memory",100);
@@ -234,11 +383,9 @@ void free_mem2Dint(int **array2D)
   if (array2D)
   {
     if (array2D[0]) 
-      free (array2D[0]);
+      free_mem_array (array2D, 2);
     else error ("free_mem2D: trying to free unused memory",100);
 
-    free (array2D);
-
   } else
   {
     error ("free_mem2D: trying to free unused memory",100);
@@ -257,11 +404,9 @@ void free_mem2Dint64(int64 **array2D)
   if (array2D)
   {
     if (array2D[0]) 
-      free (array2D[0]);
+      free_mem_array (array2D, 2);
     else error ("free_mem2Dint64: trying to free unused memory",100);
 
-    free (array2D);
-
   } else
   {
     error ("free_mem2Dint64: trying to free unused memory",100);
@@ -277,15 +422,9 @@ void free_mem2Dint64(int64 **array2D)
  */
 void free_mem3D(byte ***array3D, int frames)
 {
-  int i;
-
   if (array3D)
   {
-    for (i=0;i<frames;i++)
-    { 
-      free_mem2D(array3D[i]);
-    }
-   free (array3D);
+    free_mem_array (array3D, 3);
   } else
   {
     error ("free_mem3D: trying to free unused memory",100);
@@ -301,15 +440,9 @@ void free_mem3D(byte ***array3D, int frames)
  */
 void free_mem3Dint(int ***array3D, int frames)
 {
-  int i;
-
   if (array3D)
   {
-    for (i=0;i<frames;i++)
-    { 
-      free_mem2Dint(array3D[i]);
-    }
-   free (array3D);
+    free_mem_array (array3D, 3);
   } else
   {
     error ("free_mem3D: trying to free unused memory",100);
@@ -326,15 +459,9 @@ void free_mem3Dint(int ***array3D, int frames)
  */
 void free_mem3Dint64(int64 ***array3D, int frames)
 {
-  int i;
-
   if (array3D)
   {
-    for (i=0;i<frames;i++)
-    { 
-      free_mem2Dint64(array3D[i]);
-    }
-   free (array3D);
+    free_mem_array (array3D, 3);
   } else
   {
     error ("free_mem3Dint64: trying to free unused memory",100);
@@ -350,13 +477,9 @@ void free_mem3Dint64(int64 ***array3D, int frames)
  */
 void free_mem4Dint(int ****array4D, int idx, int frames )
 {
-  int  j;
-
   if (array4D)
   {
-    for(j=0;j<idx;j++)
-      free_mem3Dint( array4D[j], frames) ;
-    free (array4D);
+    free_mem_array (array4D, 4);
   } else
   {
     error ("free_mem4D: trying to free unused memory",100);
@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 
 #include "global.h"
 #include "image.h"
@@ -52,13 +53,14 @@
 #include "memalloc.h"
 #include "mb_access.h"
 #include "fast_me.h"
+#include "me_distortion.h"
+#include "upsample.h"
 
 #include <time.h>
 #include <sys/timeb.h>
 
 // These procedure pointers are used by motion_search() and one_eigthpel()
-static pel_t  (*PelY_14)     (pel_t**, int, int, int, int);
-static pel_t *(*PelYline_11) (pel_t *, int, int, int, int);
+static THREAD_LOCAL pel_t  (*PelY_14)     (pel_t**, int, int, int, int);
 
 // Statistics, temporary
 int     max_mvd;
@@ -67,7 +69,49 @@ int*    spiral_search_y;
 int*    mvbits;
 int*    refbits;
 int*    byte_abs;
-int**** motion_cost;
+THREAD_LOCAL int**** motion_cost;
+THREAD_LOCAL int     me_tot_time, me_time;
+
+/*****
+ *****  wavefront integer-pel motion search pre-pass
+ *****
+ */
+static ThreadPool      *wf_pool       = NULL;
+static ImageParameters *wf_master_img = NULL;  //!< img of the main thread while the pre-pass runs
+static THREAD_LOCAL int wf_worker     = 0;     //!< set on the pre-pass threads
+static int    ******wf_mv       = NULL;        //!< pre-pass vectors [ref][blocktype][list][block_x][block_y][2] (integer-pel, in sub-pel units)
+static int    ***wf_ref_idx     = NULL;        //!< all-zero reference index field used to predict from wf_mv
+static int     *wf_rows         = NULL;        //!< MB row numbers, the jobs of the pre-pass
+static int     *wf_row_done     = NULL;        //!< number of finished MBs of each MB row
+static JMMutex *wf_lock         = NULL;
+static JMCond  *wf_cond         = NULL;        //!< signalled whenever an MB of the pre-pass is finished
+static double   wf_lambda;                     //!< lagrangian parameter of the pre-pass
+static int      wf_valid        = 0;           //!< wf_mv holds the vectors of the current picture
+
+//! picture level state of the main thread, thread local since the PAFF thread codes pictures as well
+static struct
+{
+  StorablePicture  *enc_picture;
+  StorablePicture **listX[6];
+  int               listXsize[6];
+  byte            **imgY_org;
+} wf_master_pic;
+
+static int  WavefrontSearchCenter (int ref, int list, int blocktype, int block_x, int block_y,
+                                   int pred_mv_x, int pred_mv_y, int search_range, int *mv_x, int *mv_y);
+
+/*****
+ *****  hierarchical integer-pel motion search
+ *****
+ */
+#define HME_CANDIDATES  5   //!< candidates of a MB: 16x16 and the four 8x8 blocks
+
+static THREAD_LOCAL int ****hme_mv;      //!< candidates of the current MB [list][ref][HME_CANDIDATES][2] (integer-pel)
+static THREAD_LOCAL int  **hme_done;     //!< hme_mv of the current MB are set [list][ref]
+
+static void InitHierarchicalSearch  ();
+static void ClearHierarchicalSearch ();
+static int  BlockSearchRange (int ref, int blocktype);
 
 
 void SetMotionVectorPredictor (int  pmv[2],
@@ -86,14 +130,65 @@ void SetMotionVectorPredictor (int  pmv[2],
  *****  static variables for fast integer motion estimation
  *****
  */
-static int  **search_setup_done;  //!< flag if all block SAD's have been calculated yet
-static int  **search_center_x;    //!< absolute search center for fast full motion search
-static int  **search_center_y;    //!< absolute search center for fast full motion search
-static int  **pos_00;             //!< position of (0,0) vector
-static int  *****BlockSAD;        //!< SAD for all blocksize, ref. frames and motion vectors
-static int  **max_search_range;
+#define SAD_BLOCKS  41   //!< blocks of a MB: 16 4x4, 8 4x8, 8 8x4, 4 8x8, 2 8x16, 2 16x8, 1 16x16
+
+//! line length of the SAD fields of a search range (the positions of a line padded to 16)
+#define SAD_FIELD_WIDTH(range)  ((2*(range)+1+15) & ~15)
+
+static THREAD_LOCAL int  **search_setup_done;  //!< flag if all block SAD's have been calculated yet
+static THREAD_LOCAL int  **search_center_x;    //!< absolute search center for fast full motion search
+static THREAD_LOCAL int  **search_center_y;    //!< absolute search center for fast full motion search
+static THREAD_LOCAL unsigned short *BlockSAD;  //!< SAD fields of all blocks and ref. frames [list][ref][SAD_BLOCKS][sad_plane]
+static THREAD_LOCAL int  **max_search_range;
+static THREAD_LOCAL pel_t *sad_window;         //!< reference samples of the search window
+static int          sad_plane;                 //!< size of the SAD field of one block for the full search range
+static int         *spiral_search_rank = NULL; //!< position of each vector in the spiral search [y][x]
+static ThreadPool  *ffs_pool = NULL;           //!< threads setting up the reference frames of a MB (FastFullSearchThreads)
+
+//! BlockSAD field of block type (1-16x16 ... 7-4x4) and block index (4*y+x in 4x4 blocks)
+static const int sad_row[8][16] =
+{
+  { -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1},
+  { 40,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1},
+  { 38,-1,-1,-1, -1,-1,-1,-1, 39,-1,-1,-1, -1,-1,-1,-1},
+  { 36,-1,37,-1, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1},
+  { 32,-1,33,-1, -1,-1,-1,-1, 34,-1,35,-1, -1,-1,-1,-1},
+  { 24,-1,25,-1, 26,-1,27,-1, 28,-1,29,-1, 30,-1,31,-1},
+  { 16,17,18,19, -1,-1,-1,-1, 20,21,22,23, -1,-1,-1,-1},
+  {  0, 1, 2, 3,  4, 5, 6, 7,  8, 9,10,11, 12,13,14,15}
+};
+
+//! setup of the block SADs of one reference frame
+typedef struct
+{
+  pel_t *orig;                   //!< original MB (stride 16)
+  pel_t *ref_pic;                //!< integer-pel reference picture
+  int    img_width, img_height;
+  int    center_x, center_y;     //!< absolute search center
+  int    search_range;
+  unsigned short *block_sad;     //!< BlockSAD fields of the reference frame
+} FastFullSearchJob;
+
+extern THREAD_LOCAL ColocatedParams *Co_located;
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    allocates / frees the search window of the calling thread
+ ***********************************************************************
+ */
+static void
+AllocSADWindow ()
+{
+  int range = 2*input->search_range+1;
+
+  if ((sad_window = (pel_t*)malloc ((range+15) * (SAD_FIELD_WIDTH(input->search_range)+32) * sizeof(pel_t))) == NULL)
+    no_mem_exit ("AllocSADWindow: sad_window");
+}
 
-extern ColocatedParams *Co_located;
+static void FreeSADWindow ()                          { free (sad_window); }
+static void FastFullSearchThreadInit (int thread_id)  { AllocSADWindow (); }
+static void FastFullSearchThreadExit (int thread_id)  { FreeSADWindow (); CollectDistortionKernelStats (); }
 
 /*!
  ***********************************************************************
@@ -104,43 +199,20 @@ extern ColocatedParams *Co_located;
 void
 InitializeFastFullIntegerSearch ()
 {
-  int  i, j, k, list;
+  int  i, list;
   int  search_range = input->search_range;
-  int  max_pos      = (2*search_range+1) * (2*search_range+1);
 
-  if ((BlockSAD = (int*****)malloc (2 * sizeof(int****))) == NULL)
+  if ((BlockSAD = (unsigned short*)malloc (2 * (img->max_num_references+1) * SAD_BLOCKS * sad_plane * sizeof(unsigned short))) == NULL)
     no_mem_exit ("InitializeFastFullIntegerSearch: BlockSAD");
+  AllocSADWindow ();
 
-  for (list=0; list<2;list++)
-  {
-    if ((BlockSAD[list] = (int****)malloc ((img->max_num_references+1) * sizeof(int***))) == NULL)
-      no_mem_exit ("InitializeFastFullIntegerSearch: BlockSAD");
-    for (i = 0; i <= img->max_num_references; i++)
-    {
-      if ((BlockSAD[list][i] = (int***)malloc (8 * sizeof(int**))) == NULL)
-        no_mem_exit ("InitializeFastFullIntegerSearch: BlockSAD");
-      for (j = 1; j < 8; j++)
-      {
-        if ((BlockSAD[list][i][j] = (int**)malloc (16 * sizeof(int*))) == NULL)
-          no_mem_exit ("InitializeFastFullIntegerSearch: BlockSAD");
-        for (k = 0; k < 16; k++)
-        {
-          if ((BlockSAD[list][i][j][k] = (int*)malloc (max_pos * sizeof(int))) == NULL)
-            no_mem_exit ("InitializeFastFullIntegerSearch: BlockSAD");
-        }
-      }
-    }
-  }
-
-  if ((search_setup_done = (int**)malloc (2*sizeof(int)))==NULL)
+  if ((search_setup_done = (int**)malloc (2*sizeof(int*)))==NULL)
     no_mem_exit ("InitializeFastFullIntegerSearch: search_setup_done");
-  if ((search_center_x = (int**)malloc (2*sizeof(int)))==NULL)
+  if ((search_center_x = (int**)malloc (2*sizeof(int*)))==NULL)
     no_mem_exit ("InitializeFastFullIntegerSearch: search_center_x");
-  if ((search_center_y = (int**)malloc (2*sizeof(int)))==NULL)
+  if ((search_center_y = (int**)malloc (2*sizeof(int*)))==NULL)
     no_mem_exit ("InitializeFastFullIntegerSearch: search_center_y");
-  if ((pos_00 = (int**)malloc (2*sizeof(int)))==NULL)
-    no_mem_exit ("InitializeFastFullIntegerSearch: pos_00");
-  if ((max_search_range = (int**)malloc (2*sizeof(int)))==NULL)
+  if ((max_search_range = (int**)malloc (2*sizeof(int*)))==NULL)
     no_mem_exit ("InitializeFastFullIntegerSearch: max_search_range");
 
   for (list=0; list<2; list++)
@@ -151,8 +223,6 @@ InitializeFastFullIntegerSearch ()
     no_mem_exit ("InitializeFastFullIntegerSearch: search_center_x");
   if ((search_center_y[list] = (int*)malloc ((img->max_num_references+1)*sizeof(int)))==NULL)
     no_mem_exit ("InitializeFastFullIntegerSearch: search_center_y");
-  if ((pos_00[list] = (int*)malloc ((img->max_num_references+1)*sizeof(int)))==NULL)
-    no_mem_exit ("InitializeFastFullIntegerSearch: pos_00");
   if ((max_search_range[list] = (int*)malloc ((img->max_num_references+1)*sizeof(int)))==NULL)
     no_mem_exit ("InitializeFastFullIntegerSearch: max_search_range");
   }
@@ -186,38 +256,21 @@ InitializeFastFullIntegerSearch ()
 void
 ClearFastFullIntegerSearch ()
 {
-  int  i, j, k, list;
+  int  list;
 
-  for (list=0; list<2; list++)
-  {
-    for (i = 0; i <= img->max_num_references; i++)
-    {
-      for (j = 1; j < 8; j++)
-      {
-        for (k = 0; k < 16; k++)
-        {
-          free (BlockSAD[list][i][j][k]);
-        }
-        free (BlockSAD[list][i][j]);
-      }
-      free (BlockSAD[list][i]);
-    }
-    free (BlockSAD[list]);
-  }
   free (BlockSAD);
+  FreeSADWindow ();
 
   for (list=0; list<2; list++)
   {
     free (search_setup_done[list]);
     free (search_center_x[list]);
     free (search_center_y[list]);
-    free (pos_00[list]);
     free (max_search_range[list]);
   }
   free (search_setup_done);
   free (search_center_x);
   free (search_center_y);
-  free (pos_00);
   free (max_search_range);
 
 }
@@ -240,99 +293,103 @@ ResetFastFullIntegerSearch ()
       search_setup_done [list][i] = 0;
 }
 
+/*!
+ ***********************************************************************
+ * \brief
+ *    BlockSAD fields of a reference frame
+ ***********************************************************************
+ */
+static unsigned short *
+RefBlockSAD (int list, int ref)
+{
+  return BlockSAD + (list*(img->max_num_references+1) + ref) * SAD_BLOCKS * sad_plane;
+}
+
 /*!
  ***********************************************************************
  * \brief
  *    calculation of SAD for larger blocks on the basis of 4x4 blocks
  ***********************************************************************
  */
-void
-SetupLargerBlocks (int list, int refindex, int max_pos)
+static void
+SetupLargerBlocks (unsigned short *block_sad, int plane)
 {
-#define ADD_UP_BLOCKS()   _o=*_bo; _i=*_bi; _j=*_bj; for(pos=0;pos<max_pos;pos++) _o[pos] = _i[pos] + _j[pos];
-#define INCREMENT(inc)    _bo+=inc; _bi+=inc; _bj+=inc;
-
-  int    pos, **_bo, **_bi, **_bj;
-  register int *_o,   *_i,   *_j;
-
-  //--- blocktype 6 ---
-  _bo = BlockSAD[list][refindex][6];
-  _bi = BlockSAD[list][refindex][7];
-  _bj = _bi + 4;
-  ADD_UP_BLOCKS(); INCREMENT(1);
-  ADD_UP_BLOCKS(); INCREMENT(1);
-  ADD_UP_BLOCKS(); INCREMENT(1);
-  ADD_UP_BLOCKS(); INCREMENT(5);
-  ADD_UP_BLOCKS(); INCREMENT(1);
-  ADD_UP_BLOCKS(); INCREMENT(1);
-  ADD_UP_BLOCKS(); INCREMENT(1);
-  ADD_UP_BLOCKS();
-
-  //--- blocktype 5 ---
-  _bo = BlockSAD[list][refindex][5];
-  _bi = BlockSAD[list][refindex][7];
-  _bj = _bi + 1;
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS();
-
-  //--- blocktype 4 ---
-  _bo = BlockSAD[list][refindex][4];
-  _bi = BlockSAD[list][refindex][6];
-  _bj = _bi + 1;
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS(); INCREMENT(6);
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS();
-
-  //--- blocktype 3 ---
-  _bo = BlockSAD[list][refindex][3];
-  _bi = BlockSAD[list][refindex][4];
-  _bj = _bi + 8;
-  ADD_UP_BLOCKS(); INCREMENT(2);
-  ADD_UP_BLOCKS();
-
-  //--- blocktype 2 ---
-  _bo = BlockSAD[list][refindex][2];
-  _bi = BlockSAD[list][refindex][4];
-  _bj = _bi + 2;
-  ADD_UP_BLOCKS(); INCREMENT(8);
-  ADD_UP_BLOCKS();
-
-  //--- blocktype 1 ---
-  _bo = BlockSAD[list][refindex][1];
-  _bi = BlockSAD[list][refindex][3];
-  _bj = _bi + 2;
-  ADD_UP_BLOCKS();
+  //! block type and index offset of the two halves of each block type
+  static const int halves[7][2] = {{0,0}, {3,2}, {4,2}, {4,8}, {6,1}, {7,1}, {7,4}};
+
+  int  blocktype, index, src;
+
+  for (blocktype = 6; blocktype >= 1; blocktype--)
+    for (index = 0; index < 16; index++)
+    {
+      if (sad_row[blocktype][index] < 0)
+        continue;
+      src = halves[blocktype][0];
+      computeSADFieldSum (block_sad + sad_row[blocktype][index] * plane,
+                          block_sad + sad_row[src][index] * plane,
+                          block_sad + sad_row[src][index+halves[blocktype][1]] * plane, plane);
+    }
 }
 
 
 /*!
  ***********************************************************************
  * \brief
- *    Setup the fast search for an macroblock
+ *    calculates the SAD fields of all blocks of one reference frame:
+ *    the SADs of the search positions are stored line by line, with
+ *    SAD_FIELD_WIDTH samples per line
  ***********************************************************************
  */
-void SetupFastFullPelSearch (int ref, int list)  // <--  reference frame parameter, list0 or 1
+static void
+SetupBlockSADs (FastFullSearchJob *job)
 {
-  int     pmv[2];
-  pel_t   orig_blocks[256], *orgptr=orig_blocks, *refptr;
-  int     offset_x, offset_y, x, y, range_partly_outside, ref_x, ref_y, pos, abs_x, abs_y, bindex, blky;
-  int     LineSadBlk0, LineSadBlk1, LineSadBlk2, LineSadBlk3;
-  int     max_width, max_height;
-  int     img_width, img_height;
+  int    search_range = job->search_range;
+  int    range   = 2*search_range+1;
+  int    width   = SAD_FIELD_WIDTH(search_range);
+  int    stride  = width+32;
+  int    x0      = job->center_x - search_range;
+  int    y0      = job->center_y - search_range;
+  int    xl      = min (stride, max (0, -x0));
+  int    xr      = min (stride, max (0, job->img_width - x0));
+  int    y;
+  pel_t  *line, *win;
+
+  //===== copy the search window, samples outside the picture are taken from the border =====
+  for (y = 0, win = sad_window; y < range+15; y++, win += stride)
+  {
+    line = job->ref_pic + max (0, min (job->img_height-1, y0+y)) * job->img_width;
+    memset (win, line[0], xl);
+    if (xr > xl)
+      memcpy (win+xl, line+x0+xl, xr-xl);
+    memset (win+xr, line[job->img_width-1], stride-xr);
+  }
+
+  //===== 4x4 SADs, then SAD's for larger block types =====
+  computeSADField (job->orig, sad_window, stride, width, range, job->block_sad);
+  SetupLargerBlocks (job->block_sad, width*range);
+}
+
+static void
+FastFullSearchJobRun (void *arg)
+{
+  SetupBlockSADs ((FastFullSearchJob *) arg);
+}
+
 
+/*!
+ ***********************************************************************
+ * \brief
+ *    determines the search center of a reference frame for the current
+ *    macroblock and describes its setup in job
+ ***********************************************************************
+ */
+static void
+PrepareFastFullPelSearch (FastFullSearchJob *job, int ref, int list, pel_t *orig)
+{
+  int     pmv[2];
   StorablePicture *ref_picture;
-  pel_t   *ref_pic;
 
-  int**   block_sad     = BlockSAD[list][ref][7];
   int     search_range  = max_search_range[list][ref];
-  int     max_pos       = (2*search_range+1) * (2*search_range+1);
 
   int     list_offset   = ((img->MbaffFrameFlag)&&(img->mb_data[img->current_mb_nr].mb_field))? img->current_mb_nr%2 ? 4 : 2 : 0;
 
@@ -343,18 +400,21 @@ void SetupFastFullPelSearch (int ref, int list)  // <--  reference frame paramet
   ref_picture     = listX[list+list_offset][ref];
 
   if (apply_weights)
-    ref_pic       = ref_picture->imgY_11_w;
+    job->ref_pic  = ref_picture->imgY_11_w;
   else
-    ref_pic       = ref_picture->imgY_11;
+    job->ref_pic  = ref_picture->imgY_11;
 
-  max_width     = ref_picture->size_x - 17;
-  max_height    = ref_picture->size_y - 17;
-  
-  img_width     = ref_picture->size_x;
-  img_height    = ref_picture->size_y;
+  job->img_width    = ref_picture->size_x;
+  job->img_height   = ref_picture->size_y;
+  job->orig         = orig;
+  job->search_range = search_range;
+  job->block_sad    = RefBlockSAD (list, ref);
 
   //===== get search center: predictor of 16x16 block =====
-  SetMotionVectorPredictor (pmv, enc_picture->ref_idx, enc_picture->mv, ref, list, 0, 0, 16, 16);
+  if (wf_worker)
+    SetMotionVectorPredictor (pmv, wf_ref_idx, wf_mv[ref][1], 0, list, 0, 0, 16, 16);
+  else
+    SetMotionVectorPredictor (pmv, enc_picture->ref_idx, enc_picture->mv, ref, list, 0, 0, 16, 16);
   search_center_x[list][ref] = pmv[0] / 4;
   search_center_y[list][ref] = pmv[1] / 4;
 
@@ -368,102 +428,48 @@ void SetupFastFullPelSearch (int ref, int list)  // <--  reference frame paramet
   search_center_x[list][ref] += img->opix_x;
   search_center_y[list][ref] += img->opix_y;
 
-  offset_x = search_center_x[list][ref];
-  offset_y = search_center_y[list][ref];
+  job->center_x = search_center_x[list][ref];
+  job->center_y = search_center_y[list][ref];
+}
+
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    Setup the fast search for an macroblock. With FastFullSearchThreads
+ *    all reference frames of the list are set up at once on the threads.
+ ***********************************************************************
+ */
+void SetupFastFullPelSearch (int ref, int list)  // <--  reference frame parameter, list0 or 1
+{
+  pel_t   orig_blocks[256], *orgptr=orig_blocks;
+  int     x, y, r, num_jobs;
+  FastFullSearchJob jobs[MAX_LIST_SIZE];
+
+  int     list_offset   = ((img->MbaffFrameFlag)&&(img->mb_data[img->current_mb_nr].mb_field))? img->current_mb_nr%2 ? 4 : 2 : 0;
 
   //===== copy original block for fast access =====
   for   (y = img->opix_y; y < img->opix_y+16; y++)
     for (x = img->opix_x; x < img->opix_x+16; x++)
       *orgptr++ = imgY_org [y][x];
 
-
-  //===== check if whole search range is inside image =====
-  if (offset_x >= search_range && offset_x <= max_width  - search_range &&
-      offset_y >= search_range && offset_y <= max_height - search_range   )
-  {
-    range_partly_outside = 0; PelYline_11 = FastLine16Y_11;
-  }
-  else
-  {
-    range_partly_outside = 1;
-  }
-
-  //===== determine position of (0,0)-vector =====
-  if (!input->rdopt)
+  if (ffs_pool == NULL)
   {
-    ref_x = img->opix_x - offset_x;
-    ref_y = img->opix_y - offset_y;
-
-    for (pos = 0; pos < max_pos; pos++)
-    {
-      if (ref_x == spiral_search_x[pos] &&
-          ref_y == spiral_search_y[pos])
-      {
-        pos_00[list][ref] = pos;
-        break;
-      }
-    }
+    PrepareFastFullPelSearch (&jobs[0], ref, list, orig_blocks);
+    SetupBlockSADs (&jobs[0]);
+    search_setup_done[list][ref] = 1;
+    return;
   }
 
-  //===== loop over search range (spiral search): get blockwise SAD =====
-  for (pos = 0; pos < max_pos; pos++)
+  for (r = 0, num_jobs = 0; r < listXsize[list+list_offset]; r++)
   {
-    abs_y = offset_y + spiral_search_y[pos];
-    abs_x = offset_x + spiral_search_x[pos];
-
-    if (range_partly_outside)
-    {
-      if (abs_y >= 0 && abs_y <= max_height &&
-          abs_x >= 0 && abs_x <= max_width    )
-      {
-        PelYline_11 = FastLine16Y_11;
-      }
-      else
-      {
-        PelYline_11 = UMVLine16Y_11;
-      }
-    }
-
-    orgptr = orig_blocks;
-    bindex = 0;
-    for (blky = 0; blky < 4; blky++)
+    if (!search_setup_done[list][r])
     {
-      LineSadBlk0 = LineSadBlk1 = LineSadBlk2 = LineSadBlk3 = 0;
-      for (y = 0; y < 4; y++)
-      {
-        refptr = PelYline_11 (ref_pic, abs_y++, abs_x, img_height, img_width);
-
-        LineSadBlk0 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk0 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk0 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk0 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk1 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk1 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk1 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk1 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk2 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk2 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk2 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk2 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk3 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk3 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk3 += byte_abs [*refptr++ - *orgptr++];
-        LineSadBlk3 += byte_abs [*refptr++ - *orgptr++];
-      }
-      block_sad[bindex++][pos] = LineSadBlk0;
-      block_sad[bindex++][pos] = LineSadBlk1;
-      block_sad[bindex++][pos] = LineSadBlk2;
-      block_sad[bindex++][pos] = LineSadBlk3;
+      PrepareFastFullPelSearch (&jobs[num_jobs++], r, list, orig_blocks);
+      search_setup_done[list][r] = 1;
     }
   }
-
-
-  //===== combine SAD's for larger block types =====
-  SetupLargerBlocks (list, ref, max_pos);
-
-
-  //===== set flag marking that search setup have been done =====
-  search_setup_done[list][ref] = 1;
+  run_thread_pool (ffs_pool, FastFullSearchJobRun, jobs, sizeof(FastFullSearchJob), num_jobs);
 }
 #endif // _FAST_FULL_ME_
 
@@ -784,10 +790,29 @@ Init_Motion_Search_Module ()
       spiral_search_x[k] =  l;  spiral_search_y[k++] =  i;
     }
   }
+#ifdef _FAST_FULL_ME_
+  //--- init array: position of each vector in the search pattern ---
+  if ((spiral_search_rank = (int*)malloc (max_search_points * sizeof(int))) == NULL)
+    no_mem_exit ("Init_Motion_Search_Module: spiral_search_rank");
+  for (k=0; k<max_search_points; k++)
+    spiral_search_rank[(spiral_search_y[k]+search_range)*(2*search_range+1) + spiral_search_x[k]+search_range] = k;
+#endif
+
+  //--- select SAD/SATD kernels ---
+  InitDistortionKernels (input->SIMDKernels, input->SIMDSelfCheck);
+
+  if (input->HierarchicalME)
+    InitHierarchicalSearch ();
 
 #ifdef _FAST_FULL_ME_
   if(!input->FMEnable)
+  {
+    // set once here, the slice threads only allocate their fields
+    sad_plane = (2*search_range+1) * SAD_FIELD_WIDTH(search_range);
     InitializeFastFullIntegerSearch ();
+    if (input->FastFullSearchThreads > 0)
+      ffs_pool = create_thread_pool (input->FastFullSearchThreads, FastFullSearchThreadInit, FastFullSearchThreadExit);
+  }
 #endif
 }
 
@@ -813,6 +838,57 @@ Clear_Motion_Search_Module ()
   free (byte_abs);
   free_mem4Dint (motion_cost, 8, 2);
 
+  if (input->HierarchicalME)
+    ClearHierarchicalSearch ();
+
+#ifdef _FAST_FULL_ME_
+  if(!input->FMEnable)
+  {
+    free_thread_pool (ffs_pool);
+    ffs_pool = NULL;
+    ClearFastFullIntegerSearch ();
+  }
+  free (spiral_search_rank);
+#endif
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocate the motion search buffers of a slice thread (the tables
+ *    created by Init_Motion_Search_Module() are shared read-only)
+ ************************************************************************
+ */
+void
+Init_Motion_Search_Thread ()
+{
+  get_mem4Dint (&motion_cost, 8, 2, img->max_num_references+1, 4);
+
+  if (input->HierarchicalME)
+    InitHierarchicalSearch ();
+
+#ifdef _FAST_FULL_ME_
+  if(!input->FMEnable)
+    InitializeFastFullIntegerSearch ();
+#endif
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Free the motion search buffers of a slice thread
+ ************************************************************************
+ */
+void
+Clear_Motion_Search_Thread ()
+{
+  free_mem4Dint (motion_cost, 8, 2);
+
+  if (input->HierarchicalME)
+    ClearHierarchicalSearch ();
+
 #ifdef _FAST_FULL_ME_
   if(!input->FMEnable)
     ClearFastFullIntegerSearch ();
@@ -842,9 +918,9 @@ FullPelBlockMotionSearch (pel_t**   orig_pic,     // <--  original pixel values
                           int       min_mcost,    // <--  minimum motion cost (cost for center or huge value)
                           double    lambda)       // <--  lagrangian parameter for determining motion cost
 {
-  int   pos, cand_x, cand_y, y, x4, mcost;
+  int   pos, cand_x, cand_y, y, mcost;
   
-  pel_t *orig_line, *ref_line;
+  pel_t umv_block[16*16];
   pel_t *(*get_ref_line)(int, pel_t*, int, int, int, int);
 
   int   list_offset   = ((img->MbaffFrameFlag)&&(img->mb_data[img->current_mb_nr].mb_field))? img->current_mb_nr%2 ? 4 : 2 : 0;
@@ -857,7 +933,6 @@ FullPelBlockMotionSearch (pel_t**   orig_pic,     // <--  original pixel values
   int   lambda_factor = LAMBDA_FACTOR (lambda);                   // factor for determining lagragian motion cost
   int   blocksize_y   = input->blc_size[blocktype][1];            // vertical block size
   int   blocksize_x   = input->blc_size[blocktype][0];            // horizontal block size
-  int   blocksize_x4  = blocksize_x >> 2;                         // horizontal block size in 4-pel units
   int   pred_x        = (pic_pix_x << 2) + pred_mv_x;       // predicted position x (in sub-pel units)
   int   pred_y        = (pic_pix_y << 2) + pred_mv_y;       // predicted position y (in sub-pel units)
   int   center_x      = pic_pix_x + *mv_x;                        // center position x (in pel units)
@@ -892,23 +967,15 @@ FullPelBlockMotionSearch (pel_t**   orig_pic,     // <--  original pixel values
     if (mcost >= min_mcost)   continue;
 
     //--- add residual cost to motion cost ---
-    for (y=0; y<blocksize_y; y++)
+    if (get_ref_line == FastLineX)
     {
-      ref_line  = get_ref_line (blocksize_x, ref_pic, cand_y+y, cand_x, img_height, img_width);
-      orig_line = orig_pic [y];
-
-      for (x4=0; x4<blocksize_x4; x4++)
-      {
-        mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-        mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-        mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-        mcost += byte_abs[ *orig_line++ - *ref_line++ ];
-      }
-
-      if (mcost >= min_mcost)
-      {
-        break;
-      }
+      mcost = computeSAD[blocktype] (orig_pic, ref_pic + cand_y*img_width + cand_x, img_width, mcost, min_mcost);
+    }
+    else
+    {
+      for (y=0; y<blocksize_y; y++)
+        memcpy (umv_block + 16*y, get_ref_line (blocksize_x, ref_pic, cand_y+y, cand_x, img_height, img_width), blocksize_x);
+      mcost = computeSAD[blocktype] (orig_pic, umv_block, 16, mcost, min_mcost);
     }
 
     //--- check if motion cost is less than minimum cost ---
@@ -952,16 +1019,15 @@ FastFullPelBlockMotionSearch (pel_t**   orig_pic,     // <--  not used
                               int       min_mcost,    // <--  minimum motion cost (cost for center or huge value)
                               double    lambda)       // <--  lagrangian parameter for determining motion cost
 {
-  int   pos, offset_x, offset_y, cand_x, cand_y, mcost;
+  int   x, y, offset_x, offset_y, cand_x, cand_y, mcost, rank, threshold;
+  int   setup_range, width;
+  unsigned short *block_sad, *line;
 
-  int   max_pos       = (2*search_range+1)*(2*search_range+1);              // number of search positions
   int   lambda_factor = LAMBDA_FACTOR (lambda);                             // factor for determining lagragian motion cost
-  int   best_pos      = 0;                                                  // position with minimum motion cost
+  int   best_x        = 0;                                                  // best position relative to the search center
+  int   best_y        = 0;
+  int   best_rank     = -1;                                                 // spiral search position of the best vector (-1: wins all ties)
   int   block_index;                                                        // block index for indexing SAD array
-  int*  block_sad;                                                          // pointer to SAD array
-
-  block_index   = (pic_pix_y-img->opix_y)+((pic_pix_x-img->opix_x)>>2); // block index for indexing SAD array
-  block_sad     = BlockSAD[list][ref][blocktype][block_index];         // pointer to SAD array
 
   //===== set up fast full integer search if needed / set search center =====
   if (!search_setup_done[list][ref])
@@ -969,45 +1035,75 @@ FastFullPelBlockMotionSearch (pel_t**   orig_pic,     // <--  not used
     SetupFastFullPelSearch (ref, list);
   }
 
+  setup_range   = max_search_range[list][ref];
+  width         = SAD_FIELD_WIDTH(setup_range);
+  block_index   = (pic_pix_y-img->opix_y)+((pic_pix_x-img->opix_x)>>2); // block index for indexing SAD array
+  block_sad     = RefBlockSAD (list, ref) + sad_row[blocktype][block_index] * (2*setup_range+1) * width;
+  block_sad    += setup_range * width + setup_range;                      // SAD of the search center
+
   offset_x = search_center_x[list][ref] - img->opix_x;
   offset_y = search_center_y[list][ref] - img->opix_y;
 
   //===== cost for (0,0)-vector: it is done before, because MVCost can be negative =====
   if (!input->rdopt)
   {
-    mcost = block_sad[pos_00[list][ref]] + MV_COST (lambda_factor, 2, 0, 0, pred_mv_x, pred_mv_y);
+    mcost = block_sad[-offset_y*width - offset_x] + MV_COST (lambda_factor, 2, 0, 0, pred_mv_x, pred_mv_y);
 
     if (mcost < min_mcost)
     {
       min_mcost = mcost;
-      best_pos  = pos_00[list][ref];
+      best_x    = -offset_x;
+      best_y    = -offset_y;
     }
   }
 
-  //===== loop over all search positions =====
-  for (pos=0; pos<max_pos; pos++, block_sad++)
+  //===== search center first, it is the first position of the spiral search =====
+  mcost = block_sad[0] + MV_COST (lambda_factor, 2, offset_x, offset_y, pred_mv_x, pred_mv_y);
+  if (mcost < min_mcost)
   {
-    //--- check residual cost ---
-    if (*block_sad < min_mcost)
+    min_mcost = mcost;
+    best_x    = best_y = 0;
+    best_rank = 0;
+  }
+
+  //===== loop over all search positions, line by line: only positions whose SAD does not
+  //      exceed the minimum cost minus the vertical motion vector cost of the line are checked,
+  //      ties go to the earlier spiral search position =====
+  for (y = -search_range; y <= search_range; y++)
+  {
+    line = block_sad + y*width;
+    for (x = -search_range; ; x++)
     {
+      threshold = min_mcost - WEIGHTED_COST (lambda_factor, mvbits[((offset_y+y)<<2) - pred_mv_y]);
+      if (threshold < 0)
+        break;
+      x += computeSADBelow (line + x, search_range - x + 1, threshold);
+      if (x > search_range)
+        break;
+
       //--- get motion vector cost ---
-      cand_x = offset_x + spiral_search_x[pos];
-      cand_y = offset_y + spiral_search_y[pos];
-      mcost  = *block_sad;
-      mcost += MV_COST (lambda_factor, 2, cand_x, cand_y, pred_mv_x, pred_mv_y);
+      cand_x = offset_x + x;
+      cand_y = offset_y + y;
+      mcost  = line[x] + MV_COST (lambda_factor, 2, cand_x, cand_y, pred_mv_x, pred_mv_y);
 
       //--- check motion cost ---
-      if (mcost < min_mcost)
+      if (mcost <= min_mcost)
       {
-        min_mcost = mcost;
-        best_pos  = pos;
+        rank = spiral_search_rank[(y+input->search_range)*(2*input->search_range+1) + x+input->search_range];
+        if (mcost < min_mcost || rank < best_rank)
+        {
+          min_mcost = mcost;
+          best_x    = x;
+          best_y    = y;
+          best_rank = rank;
+        }
       }
     }
   }
 
   //===== set best motion vector and return minimum motion cost =====
-  *mv_x = offset_x + spiral_search_x[best_pos];
-  *mv_y = offset_y + spiral_search_y[best_pos];
+  *mv_x = offset_x + best_x;
+  *mv_y = offset_y + best_y;
   return min_mcost;
 }
 #endif
@@ -1016,104 +1112,260 @@ FastFullPelBlockMotionSearch (pel_t**   orig_pic,     // <--  not used
 /*!
  ***********************************************************************
  * \brief
- *    Calculate SA(T)D
+ *    allocates the candidates of the hierarchical motion search
  ***********************************************************************
  */
-int
-SATD (int* diff, int use_hadamard)
+static void
+InitHierarchicalSearch ()
 {
-  int k, satd = 0, m[16], dd, *d=diff;
-  
-  if (use_hadamard)
-  {
-    /*===== hadamard transform =====*/
-    m[ 0] = d[ 0] + d[12];
-    m[ 4] = d[ 4] + d[ 8];
-    m[ 8] = d[ 4] - d[ 8];
-    m[12] = d[ 0] - d[12];
-    m[ 1] = d[ 1] + d[13];
-    m[ 5] = d[ 5] + d[ 9];
-    m[ 9] = d[ 5] - d[ 9];
-    m[13] = d[ 1] - d[13];
-    m[ 2] = d[ 2] + d[14];
-    m[ 6] = d[ 6] + d[10];
-    m[10] = d[ 6] - d[10];
-    m[14] = d[ 2] - d[14];
-    m[ 3] = d[ 3] + d[15];
-    m[ 7] = d[ 7] + d[11];
-    m[11] = d[ 7] - d[11];
-    m[15] = d[ 3] - d[15];
-    
-    d[ 0] = m[ 0] + m[ 4];
-    d[ 8] = m[ 0] - m[ 4];
-    d[ 4] = m[ 8] + m[12];
-    d[12] = m[12] - m[ 8];
-    d[ 1] = m[ 1] + m[ 5];
-    d[ 9] = m[ 1] - m[ 5];
-    d[ 5] = m[ 9] + m[13];
-    d[13] = m[13] - m[ 9];
-    d[ 2] = m[ 2] + m[ 6];
-    d[10] = m[ 2] - m[ 6];
-    d[ 6] = m[10] + m[14];
-    d[14] = m[14] - m[10];
-    d[ 3] = m[ 3] + m[ 7];
-    d[11] = m[ 3] - m[ 7];
-    d[ 7] = m[11] + m[15];
-    d[15] = m[15] - m[11];
-    
-    m[ 0] = d[ 0] + d[ 3];
-    m[ 1] = d[ 1] + d[ 2];
-    m[ 2] = d[ 1] - d[ 2];
-    m[ 3] = d[ 0] - d[ 3];
-    m[ 4] = d[ 4] + d[ 7];
-    m[ 5] = d[ 5] + d[ 6];
-    m[ 6] = d[ 5] - d[ 6];
-    m[ 7] = d[ 4] - d[ 7];
-    m[ 8] = d[ 8] + d[11];
-    m[ 9] = d[ 9] + d[10];
-    m[10] = d[ 9] - d[10];
-    m[11] = d[ 8] - d[11];
-    m[12] = d[12] + d[15];
-    m[13] = d[13] + d[14];
-    m[14] = d[13] - d[14];
-    m[15] = d[12] - d[15];
-    
-    d[ 0] = m[ 0] + m[ 1];
-    d[ 1] = m[ 0] - m[ 1];
-    d[ 2] = m[ 2] + m[ 3];
-    d[ 3] = m[ 3] - m[ 2];
-    d[ 4] = m[ 4] + m[ 5];
-    d[ 5] = m[ 4] - m[ 5];
-    d[ 6] = m[ 6] + m[ 7];
-    d[ 7] = m[ 7] - m[ 6];
-    d[ 8] = m[ 8] + m[ 9];
-    d[ 9] = m[ 8] - m[ 9];
-    d[10] = m[10] + m[11];
-    d[11] = m[11] - m[10];
-    d[12] = m[12] + m[13];
-    d[13] = m[12] - m[13];
-    d[14] = m[14] + m[15];
-    d[15] = m[15] - m[14];
-    
-    /*===== sum up =====*/
-    for (dd=diff[k=0]; k<16; dd=diff[++k])
+  get_mem4Dint (&hme_mv, 6, img->max_num_references+1, HME_CANDIDATES, 2);
+  get_mem2Dint (&hme_done, 6, img->max_num_references+1);
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    frees the candidates of the hierarchical motion search
+ ***********************************************************************
+ */
+static void
+ClearHierarchicalSearch ()
+{
+  free_mem4Dint (hme_mv, 6, img->max_num_references+1);
+  free_mem2Dint (hme_done);
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    function resetting the candidates of the hierarchical motion search
+ *    (have to be called in start_macroblock())
+ ***********************************************************************
+ */
+void
+ResetHierarchicalMotionSearch ()
+{
+  int list, ref;
+
+  for (list=0; list<6; list++)
+    for (ref=0; ref<=img->max_num_references; ref++)
+      hme_done[list][ref] = 0;
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    SAD of a size x size block of a decimated original and the block
+ *    at (x,y) of a decimated reference plane; positions outside the
+ *    plane are clamped to its border
+ ***********************************************************************
+ */
+static int
+SubSampledSAD (pel_t *orig, int orig_stride, int size, pel_t *plane, int width, int height, int x, int y, int min_sad)
+{
+  int   i, j, sad = 0;
+  pel_t *line;
+
+  if (x >= 0 && y >= 0 && x+size <= width && y+size <= height)
+  {
+    for (j=0; j<size && sad<min_sad; j++, orig+=orig_stride)
     {
-      satd += (dd < 0 ? -dd : dd);
+      line = plane + (y+j)*width + x;
+      for (i=0; i<size; i++)
+        sad += byte_abs[orig[i] - line[i]];
     }
-    satd >>= 1;
   }
   else
   {
-    /*===== sum up =====*/
-    for (k = 0; k < 16; k++)
+    for (j=0; j<size && sad<min_sad; j++, orig+=orig_stride)
     {
-      satd += byte_abs [diff [k]];
+      line = plane + max (0, min (height-1, y+j))*width;
+      for (i=0; i<size; i++)
+        sad += byte_abs[orig[i] - line[max (0, min (width-1, x+i))]];
     }
   }
-  
-  return satd;
+  return sad;
 }
 
+/*!
+ ***********************************************************************
+ * \brief
+ *    spiral search of a block of a decimated picture around the vector
+ *    (mv_x, mv_y), which is replaced by the vector with the minimum SAD
+ ***********************************************************************
+ */
+static void
+SubSampledBlockSearch (pel_t *orig, int orig_stride, int size, pel_t *plane, int width, int height,
+                       int pos_x, int pos_y, int range, int *mv_x, int *mv_y)
+{
+  int pos, sad;
+  int best_pos = 0;
+  int min_sad  = INT_MAX;
+  int max_pos  = (2*range+1)*(2*range+1);
+
+  for (pos=0; pos<max_pos; pos++)
+  {
+    sad = SubSampledSAD (orig, orig_stride, size, plane, width, height,
+                         pos_x + *mv_x + spiral_search_x[pos], pos_y + *mv_y + spiral_search_y[pos], min_sad);
+    if (sad < min_sad)
+    {
+      min_sad  = sad;
+      best_pos = pos;
+    }
+  }
+  *mv_x += spiral_search_x[best_pos];
+  *mv_y += spiral_search_y[best_pos];
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    Hierarchical search of the current MB in a reference frame: the MB
+ *    is searched in the 1/4 decimated pictures over the whole search
+ *    range, the vector is refined in the 1/2 decimated pictures for the
+ *    MB and for each of its 8x8 blocks. The results are the integer-pel
+ *    candidates of the MB, which are refined by
+ *    HierarchicalBlockMotionSearch().
+ ***********************************************************************
+ */
+static void
+HierarchicalMacroblockSearch (int ref, int list, int list_offset)
+{
+  pel_t org2[8*8], org4[4*4];
+  int   i, j, k, mv_x, mv_y, q_x, q_y;
+
+  StorablePicture *ref_picture = listX[list+list_offset][ref];
+  int   width        = ref_picture->size_x;
+  int   height       = ref_picture->size_y;
+  int   search_range = BlockSearchRange (ref, 1);
+  int   **cand       = hme_mv[list+list_offset][ref];
+
+  //===== decimate the original MB =====
+  for (j=0; j<8; j++)
+    for (i=0; i<8; i++)
+      org2[8*j+i] = (imgY_org[img->opix_y+2*j  ][img->opix_x+2*i] + imgY_org[img->opix_y+2*j  ][img->opix_x+2*i+1] +
+                     imgY_org[img->opix_y+2*j+1][img->opix_x+2*i] + imgY_org[img->opix_y+2*j+1][img->opix_x+2*i+1] + 2) >> 2;
+  for (j=0; j<4; j++)
+    for (i=0; i<4; i++)
+      org4[4*j+i] = (org2[16*j+2*i] + org2[16*j+2*i+1] + org2[16*j+8+2*i] + org2[16*j+8+2*i+1] + 2) >> 2;
+
+  //===== 1/4: whole search range =====
+  mv_x = mv_y = 0;
+  SubSampledBlockSearch (org4, 4, 4, ref_picture->imgY_sub[1], width>>2, height>>2,
+                         img->opix_x>>2, img->opix_y>>2, (search_range+3)>>2, &mv_x, &mv_y);
+
+  //===== 1/2: refinement of the MB and of its 8x8 blocks =====
+  mv_x *= 2;
+  mv_y *= 2;
+  SubSampledBlockSearch (org2, 8, 8, ref_picture->imgY_sub[0], width>>1, height>>1,
+                         img->opix_x>>1, img->opix_y>>1, 1, &mv_x, &mv_y);
+  cand[0][0] = max (-search_range, min (search_range, 2*mv_x));
+  cand[0][1] = max (-search_range, min (search_range, 2*mv_y));
+
+  for (k=0; k<4; k++)
+  {
+    q_x = mv_x;
+    q_y = mv_y;
+    SubSampledBlockSearch (org2 + 32*(k>>1) + 4*(k&1), 8, 4, ref_picture->imgY_sub[0], width>>1, height>>1,
+                           (img->opix_x>>1) + 4*(k&1), (img->opix_y>>1) + 4*(k>>1), 1, &q_x, &q_y);
+    cand[1+k][0] = max (-search_range, min (search_range, 2*q_x));
+    cand[1+k][1] = max (-search_range, min (search_range, 2*q_y));
+  }
+
+  hme_done[list+list_offset][ref] = 1;
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    Integer-pel motion search with HierarchicalME: the candidate of the
+ *    hierarchical search (of the MB for 16x16, 16x8 and 8x16 blocks, of
+ *    the 8x8 block otherwise) and the motion vector predictor are
+ *    refined by a full search of HierarchicalMERange.
+ ***********************************************************************
+ */
+static int                                            //  ==> minimum motion cost after search
+HierarchicalBlockMotionSearch (pel_t**   orig_pic,    // <--  original pixel values for the AxB block
+                               int       ref,         // <--  reference frame (0... or -1 (backward))
+                               int       list,
+                               int       pic_pix_x,   // <--  absolute x-coordinate of regarded AxB block
+                               int       pic_pix_y,   // <--  absolute y-coordinate of regarded AxB block
+                               int       blocktype,   // <--  block type (1-16x16 ... 7-4x4)
+                               int       pred_mv_x,   // <--  motion vector predictor (x) in sub-pel units
+                               int       pred_mv_y,   // <--  motion vector predictor (y) in sub-pel units
+                               int*      mv_x,        //  --> motion vector (x) - in pel units
+                               int*      mv_y,        //  --> motion vector (y) - in pel units
+                               int       search_range,// <--  1-d search range in pel units
+                               int       min_mcost,   // <--  minimum motion cost (cost for center or huge value)
+                               double    lambda)      // <--  lagrangian parameter for determining motion cost
+{
+  int   cand_x, cand_y, mcost;
+  int   list_offset = ((img->MbaffFrameFlag)&&(img->mb_data[img->current_mb_nr].mb_field))? img->current_mb_nr%2 ? 4 : 2 : 0;
+  int   candidate   = (blocktype < 4 ? 0 : 1 + ((pic_pix_y-img->opix_y)>>3)*2 + ((pic_pix_x-img->opix_x)>>3));
+
+  if (!hme_done[list+list_offset][ref])
+    HierarchicalMacroblockSearch (ref, list, list_offset);
+
+  //--- candidate of the hierarchical search ---
+  *mv_x = max (-search_range, min (search_range, hme_mv[list+list_offset][ref][candidate][0]));
+  *mv_y = max (-search_range, min (search_range, hme_mv[list+list_offset][ref][candidate][1]));
+
+  min_mcost = FullPelBlockMotionSearch (orig_pic, ref, list, pic_pix_x, pic_pix_y, blocktype,
+                                        pred_mv_x, pred_mv_y, mv_x, mv_y, input->HierarchicalMERange,
+                                        min_mcost, lambda);
+
+  //--- motion vector predictor ---
+  cand_x = pred_mv_x / 4;
+  cand_y = pred_mv_y / 4;
+  if (!input->rdopt)
+  {
+    cand_x = max (-search_range, min (search_range, cand_x));
+    cand_y = max (-search_range, min (search_range, cand_y));
+  }
+  if (cand_x != *mv_x || cand_y != *mv_y)
+  {
+    mcost = FullPelBlockMotionSearch (orig_pic, ref, list, pic_pix_x, pic_pix_y, blocktype,
+                                      pred_mv_x, pred_mv_y, &cand_x, &cand_y, input->HierarchicalMERange,
+                                      min_mcost, lambda);
+    if (mcost < min_mcost)
+    {
+      min_mcost = mcost;
+      *mv_x     = cand_x;
+      *mv_y     = cand_y;
+    }
+  }
+  return min_mcost;
+}
+
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    Calculate SA(T)D
+ ***********************************************************************
+ */
+int
+SATD (int* diff, int use_hadamard)
+{
+  return use_hadamard ? computeSATD (diff) : computeDiffSAD (diff);
+}
+
+
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    largest horizontal / vertical offset of the first positions of the spiral search
+ ***********************************************************************
+ */
+static int SpiralSearchRadius (int positions)
+{
+  int pos, radius = 0;
+
+  for (pos = 0; pos < positions; pos++)
+    radius = max (radius, max (abs (spiral_search_x[pos]), abs (spiral_search_y[pos])));
+  return radius;
+}
 
 
 /*!
@@ -1162,15 +1414,10 @@ SubPelBlockMotionSearch (pel_t**   orig_pic,      // <--  original pixel values
                          (active_pps->weighted_bipred_idc && (img->type == B_SLICE)));  
 
   int   img_width, img_height;
+  int   plane, radius;
   
   ref_picture     = listX[list+list_offset][ref];
-
-  if (apply_weights)
-  {
-    ref_pic = listX[list+list_offset][ref]->imgY_ups_w;
-  }
-  else
-    ref_pic = listX[list+list_offset][ref]->imgY_ups;
+  plane           = (apply_weights ? UPS_PLANE_W : UPS_PLANE);
 
   img_width  = ref_picture->size_x;
   img_height = ref_picture->size_y;
@@ -1186,6 +1433,11 @@ SubPelBlockMotionSearch (pel_t**   orig_pic,      // <--  original pixel values
   //===== convert search center to quarter-pel units =====
   *mv_x <<= 2;
   *mv_y <<= 2;
+  //===== interpolate the reference area of the half-pel positions =====
+  radius = 2 * SpiralSearchRadius (max_pos2);
+  FillOneForthPix (ref_picture, plane, pic4_pix_y + *mv_y - radius, pic4_pix_x + *mv_x - radius,
+                   pic4_pix_y + *mv_y + radius + ((blocksize_y-1)<<2), pic4_pix_x + *mv_x + radius + ((blocksize_x-1)<<2));
+  ref_pic = (apply_weights ? ref_picture->imgY_ups_w : ref_picture->imgY_ups);
   //===== set function for getting pixel values =====
   if ((pic4_pix_x + *mv_x > 1) && (pic4_pix_x + *mv_x < max_pos_x4 - 2) &&
       (pic4_pix_y + *mv_y > 1) && (pic4_pix_y + *mv_y < max_pos_y4 - 2)   )
@@ -1219,33 +1471,41 @@ SubPelBlockMotionSearch (pel_t**   orig_pic,      // <--  original pixel values
       for (x0=0; x0<blocksize_x; x0+=4)
       {
         rx0 = ((pic_pix_x+x0)<<2) + cand_mv_x;
-        d   = diff;
-
-        orig_line = orig_pic [y0  ];    ry=ry0;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        orig_line = orig_pic [y0+1];    ry=ry0+4;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        orig_line = orig_pic [y0+2];    ry=ry0+8;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        orig_line = orig_pic [y0+3];    ry=ry0+12;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d        = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        if ((mcost += SATD (diff, input->hadamard)) > min_mcost)
+        if (PelY_14 == FastPelY_14)
+        {
+          mcost += computeSubPelCost (orig_pic + y0, x0, ref_pic, ry0, rx0);
+        }
+        else
+        {
+          d   = diff;
+
+          orig_line = orig_pic [y0  ];    ry=ry0;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          orig_line = orig_pic [y0+1];    ry=ry0+4;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          orig_line = orig_pic [y0+2];    ry=ry0+8;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          orig_line = orig_pic [y0+3];    ry=ry0+12;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d        = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          mcost += SATD (diff, input->hadamard);
+        }
+        if (mcost > min_mcost)
         {
           abort_search = 1;
           break;
@@ -1271,6 +1531,10 @@ SubPelBlockMotionSearch (pel_t**   orig_pic,      // <--  original pixel values
    *****  QUARTER-PEL REFINEMENT  *****
    *****                          *****
    ************************************/
+  //===== interpolate the reference area of the quarter-pel positions =====
+  radius = SpiralSearchRadius (search_pos4);
+  FillOneForthPix (ref_picture, plane, pic4_pix_y + *mv_y - radius, pic4_pix_x + *mv_x - radius,
+                   pic4_pix_y + *mv_y + radius + ((blocksize_y-1)<<2), pic4_pix_x + *mv_x + radius + ((blocksize_x-1)<<2));
   //===== set function for getting pixel values =====
   if ((pic4_pix_x + *mv_x > 1) && (pic4_pix_x + *mv_x < max_pos_x4 - 1) &&
       (pic4_pix_y + *mv_y > 1) && (pic4_pix_y + *mv_y < max_pos_y4 - 1)   )
@@ -1300,33 +1564,41 @@ SubPelBlockMotionSearch (pel_t**   orig_pic,      // <--  original pixel values
       for (x0=0; x0<blocksize_x; x0+=4)
       {
         rx0 = ((pic_pix_x+x0)<<2) + cand_mv_x;
-        d   = diff;
-
-        orig_line = orig_pic [y0  ];    ry=ry0;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        orig_line = orig_pic [y0+1];    ry=ry0+4;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        orig_line = orig_pic [y0+2];    ry=ry0+8;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        orig_line = orig_pic [y0+3];    ry=ry0+12;
-        *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
-        *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
-        *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
-        *d        = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
-
-        if ((mcost += SATD (diff, input->hadamard)) > min_mcost)
+        if (PelY_14 == FastPelY_14)
+        {
+          mcost += computeSubPelCost (orig_pic + y0, x0, ref_pic, ry0, rx0);
+        }
+        else
+        {
+          d   = diff;
+
+          orig_line = orig_pic [y0  ];    ry=ry0;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          orig_line = orig_pic [y0+1];    ry=ry0+4;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          orig_line = orig_pic [y0+2];    ry=ry0+8;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d++      = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          orig_line = orig_pic [y0+3];    ry=ry0+12;
+          *d++      = orig_line[x0  ]  -  PelY_14 (ref_pic, ry, rx0   , img_height, img_width);
+          *d++      = orig_line[x0+1]  -  PelY_14 (ref_pic, ry, rx0+ 4, img_height, img_width);
+          *d++      = orig_line[x0+2]  -  PelY_14 (ref_pic, ry, rx0+ 8, img_height, img_width);
+          *d        = orig_line[x0+3]  -  PelY_14 (ref_pic, ry, rx0+12, img_height, img_width);
+
+          mcost += SATD (diff, input->hadamard);
+        }
+        if (mcost > min_mcost)
         {
           abort_search = 1;
           break;
@@ -1352,6 +1624,29 @@ SubPelBlockMotionSearch (pel_t**   orig_pic,      // <--  original pixel values
 
 
 
+/*!
+ ***********************************************************************
+ * \brief
+ *    Returns the time in ms, for the ME time statistics
+ ***********************************************************************
+ */
+static int64
+MotionSearchClock ()
+{
+#ifdef WIN32
+  struct _timeb tstruct;
+
+  _ftime (&tstruct);
+#else
+  struct timeb tstruct;
+
+  ftime (&tstruct);
+#endif
+  return (int64) tstruct.time * 1000 + tstruct.millitm;
+}
+
+
+
 /*!
  ***********************************************************************
  * \brief
@@ -1368,11 +1663,8 @@ BlockMotionSearch (int       ref,           //!< reference idx
                    double    lambda         //!< lagrangian parameter for determining motion cost
                    )
 {
-  static pel_t   orig_val [256];
-  static pel_t  *orig_pic  [16] = {orig_val,     orig_val+ 16, orig_val+ 32, orig_val+ 48,
-                                   orig_val+ 64, orig_val+ 80, orig_val+ 96, orig_val+112,
-                                   orig_val+128, orig_val+144, orig_val+160, orig_val+176,
-                                   orig_val+192, orig_val+208, orig_val+224, orig_val+240};
+  static THREAD_LOCAL pel_t orig_val [256];
+  pel_t    *orig_pic  [16];
 
   int       pred_mv_x, pred_mv_y, mv_x, mv_y, i, j;
 
@@ -1394,15 +1686,8 @@ BlockMotionSearch (int       ref,           //!< reference idx
 
   int****** all_mv    = img->all_mv;
 
-#ifdef WIN32
-  struct _timeb tstruct1;
-  struct _timeb tstruct2;
-#else
-  struct timeb tstruct1;
-  struct timeb tstruct2;
-#endif
-  
-  int me_tmp_time;
+  int64 me_start;
+  int   me_tmp_time;
 
   int  N_Bframe=0, n_Bframe=0;
   if(input->FMEnable)
@@ -1411,6 +1696,9 @@ BlockMotionSearch (int       ref,           //!< reference idx
     n_Bframe =(N_Bframe) ? ((Bframe_ctr%N_Bframe)+1) : 0 ;
   }
 
+  for (j = 0; j < 16; j++)
+    orig_pic[j] = orig_val + 16*j;
+
    pred_mv = img->pred_mv[block_x][block_y][list][ref][blocktype];
 
   //==================================
@@ -1559,11 +1847,7 @@ BlockMotionSearch (int       ref,           //!< reference idx
 
   pred_mv_x = pred_mv[0];
   pred_mv_y = pred_mv[1];
-#ifdef WIN32
-  _ftime( &tstruct1 );    // start time ms
-#else
-  ftime(&tstruct1);
-#endif
+  me_start  = MotionSearchClock ();    // start time ms
 
   //==================================
   //=====   INTEGER-PEL SEARCH   =====
@@ -1595,6 +1879,37 @@ BlockMotionSearch (int       ref,           //!< reference idx
       }
     }
   }
+  else if (wf_valid && WavefrontSearchCenter (ref, list, blocktype, img->block_x+block_x, img->block_y+block_y,
+                                               pred_mv_x, pred_mv_y, search_range, &mv_x, &mv_y))
+  {
+    int wf_mcost;
+    int center_x   = pred_mv_x / 4;
+    int center_y   = pred_mv_y / 4;
+    int off_center = (mv_x != center_x || mv_y != center_y);
+
+    //--- refine the vector of the wavefront pre-pass and the predictor, the pre-pass predicts from its own vectors ---
+    min_mcost = FullPelBlockMotionSearch     (orig_pic, ref, list, pic_pix_x, pic_pix_y, blocktype,
+                                              pred_mv_x, pred_mv_y, &mv_x, &mv_y, input->WavefrontMERange,
+                                              min_mcost, lambda);
+    if (off_center)
+    {
+      wf_mcost  = min_mcost;
+      min_mcost = FullPelBlockMotionSearch   (orig_pic, ref, list, pic_pix_x, pic_pix_y, blocktype,
+                                              pred_mv_x, pred_mv_y, &center_x, &center_y, input->WavefrontMERange,
+                                              wf_mcost, lambda);
+      if (min_mcost < wf_mcost)
+      {
+        mv_x = center_x;
+        mv_y = center_y;
+      }
+    }
+  }
+  else if (input->HierarchicalME)
+  {
+    min_mcost = HierarchicalBlockMotionSearch (orig_pic, ref, list, pic_pix_x, pic_pix_y, blocktype,
+                                               pred_mv_x, pred_mv_y, &mv_x, &mv_y, search_range,
+                                               min_mcost, lambda);
+  }
   else
   {
 #ifndef _FAST_FULL_ME_
@@ -1625,13 +1940,7 @@ BlockMotionSearch (int       ref,           //!< reference idx
 #endif
   }
 
-#ifdef WIN32
-      _ftime(&tstruct2);   // end time ms
-#else
-      ftime(&tstruct2);    // end time ms
-#endif
-      
-      me_tmp_time=(tstruct2.time*1000+tstruct2.millitm) - (tstruct1.time*1000+tstruct1.millitm); 
+      me_tmp_time=(int) (MotionSearchClock () - me_start);    // end time ms
       me_tot_time += me_tmp_time;
       me_time += me_tmp_time;
 
@@ -1993,6 +2302,26 @@ int Get_Direct_CostMB (double lambda)
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    1-d integer-pel search range for a reference index and block type
+ ************************************************************************
+ */
+static int
+BlockSearchRange (int ref,
+                  int blocktype)
+{
+#ifdef _FULL_SEARCH_RANGE_
+  if      (input->full_search == 2) return input->search_range;
+  else if (input->full_search == 1) return input->search_range /  (min(ref,1)+1);
+  else                              return input->search_range / ((min(ref,1)+1) * min(2,blocktype));
+#else
+  return input->search_range / ((min(ref,1)+1) * min(2,blocktype));
+#endif
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -2040,13 +2369,7 @@ PartitionMotionSearch (int    blocktype,
     for (ref=0; ref < listXsize[list+list_offset]; ref++)
     {
         //----- set search range ---
-#ifdef _FULL_SEARCH_RANGE_
-        if      (input->full_search == 2) search_range = input->search_range;
-        else if (input->full_search == 1) search_range = input->search_range /  (min(ref,1)+1);
-        else                              search_range = input->search_range / ((min(ref,1)+1) * min(2,blocktype));
-#else
-        search_range = input->search_range / ((min(ref,1)+1) * min(2,blocktype));
-#endif
+        search_range = BlockSearchRange (ref, blocktype);
         
         //----- set arrays -----
         ref_array = enc_picture->ref_idx[list];
@@ -2087,6 +2410,376 @@ PartitionMotionSearch (int    blocktype,
 
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets the search center to the pre-pass vector of a block. Returns 0
+ *    if the refinement would leave the search range around the predictor,
+ *    whose MV cost table is all that is allocated; the block is then
+ *    searched without the pre-pass.
+ ************************************************************************
+ */
+static int
+WavefrontSearchCenter (int  ref,
+                       int  list,
+                       int  blocktype,
+                       int  block_x,
+                       int  block_y,
+                       int  pred_mv_x,
+                       int  pred_mv_y,
+                       int  search_range,
+                       int *mv_x,
+                       int *mv_y)
+{
+  int max_shift = search_range - input->WavefrontMERange;
+
+  *mv_x = wf_mv[ref][blocktype][list][block_x][block_y][0] / 4;
+  *mv_y = wf_mv[ref][blocktype][list][block_x][block_y][1] / 4;
+
+  return (abs (*mv_x - pred_mv_x / 4) <= max_shift && abs (*mv_y - pred_mv_y / 4) <= max_shift);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Integer-pel search of one block in the wavefront pre-pass. The
+ *    vector is predicted from the pre-pass vectors of the same block
+ *    type and reference and stored in wf_mv.
+ ************************************************************************
+ */
+static void
+WavefrontBlockSearch (int ref,
+                      int list,
+                      int mb_x,
+                      int mb_y,
+                      int blocktype,
+                      int search_range)
+{
+  static THREAD_LOCAL pel_t orig_val [256];
+  pel_t    *orig_pic  [16];
+
+  int       pred_mv[2], mv_x, mv_y, i, j;
+
+  int       block_x   = (mb_x>>2);
+  int       block_y   = (mb_y>>2);
+  int       bsx       = input->blc_size[blocktype][0];
+  int       bsy       = input->blc_size[blocktype][1];
+  int       pic_pix_x = img->opix_x + mb_x;
+  int       pic_pix_y = img->opix_y + mb_y;
+  int****   mv_array  = wf_mv[ref][blocktype];
+
+  for (j = 0; j < 16; j++)
+    orig_pic[j] = orig_val + 16*j;
+
+  for (j = 0; j < bsy; j++)
+    for (i = 0; i < bsx; i++)
+      orig_pic[j][i] = imgY_org[pic_pix_y+j][pic_pix_x+i];
+
+  // all vectors in mv_array refer to the searched reference, which is index 0 of wf_ref_idx
+  SetMotionVectorPredictor (pred_mv, wf_ref_idx, mv_array, 0, list, block_x, block_y, bsx, bsy);
+
+#ifndef _FAST_FULL_ME_
+  mv_x = pred_mv[0] / 4;
+  mv_y = pred_mv[1] / 4;
+  if (!input->rdopt)
+  {
+    mv_x = max (-search_range, min (search_range, mv_x));
+    mv_y = max (-search_range, min (search_range, mv_y));
+  }
+  FullPelBlockMotionSearch     (orig_pic, ref, list, pic_pix_x, pic_pix_y, blocktype,
+                                pred_mv[0], pred_mv[1], &mv_x, &mv_y, search_range,
+                                (1<<20), wf_lambda);
+#else
+  FastFullPelBlockMotionSearch (orig_pic, ref, list, pic_pix_x, pic_pix_y, blocktype,
+                                pred_mv[0], pred_mv[1], &mv_x, &mv_y, search_range,
+                                (1<<20), wf_lambda);
+#endif
+
+  for (j=0; j < (bsy>>2); j++)
+    for (i=0; i < (bsx>>2); i++)
+    {
+      mv_array[list][img->block_x+block_x+i][img->block_y+block_y+j][0] = mv_x * 4;
+      mv_array[list][img->block_x+block_x+i][img->block_y+block_y+j][1] = mv_y * 4;
+    }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Integer-pel search of all block types, lists and references of a
+ *    macroblock in the wavefront pre-pass, in the order of
+ *    PartitionMotionSearch(). The neighbours are treated as available
+ *    across slice boundaries.
+ ************************************************************************
+ */
+static void
+WavefrontMacroblockSearch (int mb_nr)
+{
+  static int  bx0[5][4] = {{0,0,0,0}, {0,0,0,0}, {0,0,0,0}, {0,2,0,0}, {0,2,0,2}};
+  static int  by0[5][4] = {{0,0,0,0}, {0,0,0,0}, {0,2,0,0}, {0,0,0,0}, {0,0,2,2}};
+  static int  num_8x8[5] = {0, 1, 2, 2, 4};
+
+  Macroblock *currMB = &img->mb_data[mb_nr];
+  Macroblock  saved  = *currMB;
+
+  int   search[8];
+  int   blocktype, block8x8, parttype, list, ref, v, h;
+  int   step_h0, step_v0, step_h, step_v;
+  int   numlists = (img->type==B_SLICE) ? 2 : 1;
+
+  search[1] = input->InterSearch16x16;
+  search[2] = input->InterSearch16x8;
+  search[3] = input->InterSearch8x16;
+  search[4] = input->InterSearch8x8;
+  search[5] = input->InterSearch8x4;
+  search[6] = input->InterSearch4x8;
+  search[7] = input->InterSearch4x4;
+
+  set_MB_parameters (mb_nr);
+
+  currMB->mbAddrA  = mb_nr - 1;
+  currMB->mbAddrB  = mb_nr - img->PicWidthInMbs;
+  currMB->mbAddrC  = mb_nr - img->PicWidthInMbs + 1;
+  currMB->mbAddrD  = mb_nr - img->PicWidthInMbs - 1;
+  currMB->mbAvailA = (img->mb_x > 0);
+  currMB->mbAvailB = (img->mb_y > 0);
+  currMB->mbAvailC = (img->mb_y > 0 && img->mb_x < img->PicWidthInMbs - 1);
+  currMB->mbAvailD = (img->mb_y > 0 && img->mb_x > 0);
+
+#ifdef _FAST_FULL_ME_
+  ResetFastFullIntegerSearch ();
+#endif
+
+  for (blocktype=1; blocktype<8; blocktype++)
+  {
+    if (!search[blocktype])
+      continue;
+
+    parttype = (blocktype<4?blocktype:4);
+    step_h0  = (input->blc_size[ parttype][0]>>2);
+    step_v0  = (input->blc_size[ parttype][1]>>2);
+    step_h   = (input->blc_size[blocktype][0]>>2);
+    step_v   = (input->blc_size[blocktype][1]>>2);
+
+    for (block8x8=0; block8x8<num_8x8[parttype]; block8x8++)
+      for (list=0; list<numlists; list++)
+        for (ref=0; ref<listXsize[list]; ref++)
+          for (v=by0[parttype][block8x8]; v<by0[parttype][block8x8]+step_v0; v+=step_v)
+            for (h=bx0[parttype][block8x8]; h<bx0[parttype][block8x8]+step_h0; h+=step_h)
+              WavefrontBlockSearch (ref, list, h<<2, v<<2, blocktype, BlockSearchRange (ref, blocktype));
+  }
+
+  *currMB = saved;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Pre-pass job: searches one MB row. Each macroblock waits until the
+ *    row above is finished up to its above-right neighbour, so all
+ *    vectors the predictors depend on are final.
+ ************************************************************************
+ */
+static void
+WavefrontRowJob (void *arg)
+{
+  int mb_y  = *(int *) arg;
+  int width = wf_master_img->PicWidthInMbs;
+  int mb_x;
+
+  *img = *wf_master_img;
+
+  enc_picture = wf_master_pic.enc_picture;
+  memcpy (listX,     wf_master_pic.listX,     sizeof (listX));
+  memcpy (listXsize, wf_master_pic.listXsize, sizeof (listXsize));
+  imgY_org    = wf_master_pic.imgY_org;
+
+  for (mb_x=0; mb_x<width; mb_x++)
+  {
+    if (mb_y > 0)
+    {
+      lock_mutex (wf_lock);
+      while (wf_row_done[mb_y-1] < min (mb_x+2, width))
+        wait_cond (wf_cond, wf_lock);
+      unlock_mutex (wf_lock);
+    }
+
+    WavefrontMacroblockSearch (mb_y * width + mb_x);
+
+    lock_mutex (wf_lock);
+    wf_row_done[mb_y] = mb_x + 1;
+    broadcast_cond (wf_cond);
+    unlock_mutex (wf_lock);
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up a pre-pass thread: private copy of img and motion
+ *    search buffers
+ ************************************************************************
+ */
+static void
+WavefrontThreadInit (int thread_id)
+{
+  ImageParameters *thread_img;
+
+  if ((thread_img = (ImageParameters *) malloc (sizeof (ImageParameters))) == NULL)
+    no_mem_exit ("WavefrontThreadInit: thread_img");
+
+  *thread_img = *img;
+  img = thread_img;
+
+  Init_Motion_Search_Thread ();
+
+  wf_worker = 1;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Frees the state of a pre-pass thread
+ ************************************************************************
+ */
+static void
+WavefrontThreadExit (int thread_id)
+{
+  Clear_Motion_Search_Thread ();
+  free (img);
+
+  CollectDistortionKernelStats ();
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocates the pre-pass vectors and starts the pre-pass threads
+ *    (WavefrontME > 0)
+ ************************************************************************
+ */
+void
+Init_Wavefront_Motion_Search ()
+{
+  int ref, blocktype, n;
+  int num_rows = img->height / MB_BLOCK_SIZE;
+
+  if (input->WavefrontME < 1)
+    return;
+
+  if ((wf_mv = (int******) calloc (img->max_num_references+1, sizeof(int*****))) == NULL)
+    no_mem_exit ("Init_Wavefront_Motion_Search: wf_mv");
+  for (ref=0; ref<=img->max_num_references; ref++)
+  {
+    if ((wf_mv[ref] = (int*****) calloc (8, sizeof(int****))) == NULL)
+      no_mem_exit ("Init_Wavefront_Motion_Search: wf_mv");
+    for (blocktype=1; blocktype<8; blocktype++)
+      get_mem4Dint (&wf_mv[ref][blocktype], 2, img->width/BLOCK_SIZE, img->height/BLOCK_SIZE, 2);
+  }
+  get_mem3Dint (&wf_ref_idx, 2, img->width/BLOCK_SIZE, img->height/BLOCK_SIZE);
+
+  if ((wf_rows = (int*) calloc (num_rows, sizeof(int))) == NULL)
+    no_mem_exit ("Init_Wavefront_Motion_Search: wf_rows");
+  if ((wf_row_done = (int*) calloc (num_rows, sizeof(int))) == NULL)
+    no_mem_exit ("Init_Wavefront_Motion_Search: wf_row_done");
+  for (n=0; n<num_rows; n++)
+    wf_rows[n] = n;
+
+  wf_lock = create_mutex ();
+  wf_cond = create_cond ();
+  wf_pool = create_thread_pool (input->WavefrontME, WavefrontThreadInit, WavefrontThreadExit);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Stops the pre-pass threads and frees the pre-pass vectors
+ ************************************************************************
+ */
+void
+Clear_Wavefront_Motion_Search ()
+{
+  int ref, blocktype;
+
+  if (wf_pool == NULL)
+    return;
+
+  free_thread_pool (wf_pool);
+  wf_pool = NULL;
+  free_cond (wf_cond);
+  free_mutex (wf_lock);
+
+  for (ref=0; ref<=img->max_num_references; ref++)
+  {
+    for (blocktype=1; blocktype<8; blocktype++)
+      free_mem4Dint (wf_mv[ref][blocktype], 2, img->width/BLOCK_SIZE);
+    free (wf_mv[ref]);
+  }
+  free (wf_mv);
+  free_mem3Dint (wf_ref_idx, 2);
+  free (wf_rows);
+  free (wf_row_done);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Wavefront motion search pre-pass: computes the integer-pel vectors
+ *    of all block types and references for the whole picture before
+ *    mode decision. The MB rows are searched on the pre-pass threads in
+ *    wavefront order, predicting each vector from the pre-pass vectors
+ *    of the neighbours. BlockMotionSearch() then only refines these
+ *    vectors (WavefrontMERange) before the sub-pel search.
+ ************************************************************************
+ */
+void
+WavefrontMotionSearch ()
+{
+  double lambda_mode;
+  int    num_rows;
+  int    me_tmp_time;
+  int64  me_start;
+
+  if (wf_pool == NULL)
+    return;
+
+  wf_valid = 0;
+
+  if (img->type == I_SLICE || img->type == SI_SLICE)
+    return;
+
+  me_start = MotionSearchClock ();
+
+  num_rows = img->PicSizeInMbs / img->PicWidthInMbs;
+  memset (wf_row_done, 0, num_rows * sizeof(int));
+
+  SetLagrangeMultipliers (&lambda_mode, &wf_lambda);
+
+  wf_master_img = img;
+  wf_master_pic.enc_picture = enc_picture;
+  memcpy (wf_master_pic.listX,     listX,     sizeof (listX));
+  memcpy (wf_master_pic.listXsize, listXsize, sizeof (listXsize));
+  wf_master_pic.imgY_org    = imgY_org;
+  run_thread_pool (wf_pool, WavefrontRowJob, wf_rows, sizeof(int), num_rows);
+  wf_master_img = NULL;
+
+  wf_valid = 1;
+
+  me_tmp_time = (int) (MotionSearchClock () - me_start);
+  me_tot_time += me_tmp_time;
+  me_time     += me_tmp_time;
+}
+
+
+
 extern int* last_P_no;
 /*********************************************
  *****                                   *****
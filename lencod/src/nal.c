@@ -59,7 +59,7 @@
  ************************************************************************
 */
 
-static byte *NAL_Payload_buffer;
+static THREAD_LOCAL byte *NAL_Payload_buffer;   //!< one per slice thread
 
 void SODBtoRBSP(Bitstream *currStream)
 {
@@ -127,7 +127,7 @@ int RBSPtoEBSP(byte *streamBuffer, int begin_bytepos, int end_bytepos, int min_n
     streamBuffer[j+1] = 0x00;
     streamBuffer[j+2] = 0x03;
     j += 3;
-    stat->bit_use_stuffingBits[img->type]+=16;
+    enc_stat->bit_use_stuffingBits[img->type]+=16;
   }
   return j;
 }
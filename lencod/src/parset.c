@@ -53,7 +53,7 @@ static int IdentifyLevel();
 static int IdentifyNumRefFrames();
 static int GenerateVUISequenceParameters();
 
-extern ColocatedParams *Co_located;
+extern THREAD_LOCAL ColocatedParams *Co_located;
 
 
 /*! 
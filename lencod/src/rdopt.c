@@ -47,36 +47,48 @@
 #include "fast_me.h"
 #include "ratectl.h"            // head file for rate control
 #include "cabac.h"            // head file for rate control
+#include "metrics.h"
 
 //Rate control
 
-int QP,QP2;
-int DELTA_QP,DELTA_QP2;
-int diffy[16][16];
-static int pred[16][16];
+THREAD_LOCAL int QP,QP2;
+THREAD_LOCAL int DELTA_QP,DELTA_QP2;
+THREAD_LOCAL int diffy[16][16];
+static THREAD_LOCAL int pred[16][16];
 
 extern       int  QP2QUANT  [40];
 
 //==== MODULE PARAMETERS ====
-int   best_mode;
-int   rec_mbY[16][16], rec_mbU[8][8], rec_mbV[8][8], rec_mbY8x8[16][16];    // reconstruction values
-int   mpr8x8[16][16];
-int   ****cofAC=NULL, ****cofAC8x8=NULL;        // [8x8block][4x4block][level/run][scan_pos]
-int   ***cofDC=NULL;                       // [yuv][level/run][scan_pos]
-int   **cofAC4x4=NULL, ****cofAC4x4intern=NULL; // [level/run][scan_pos]
-int   cbp, cbp8x8, cnt_nonz_8x8;
-int   cbp_blk, cbp_blk8x8;
-int   frefframe[4][4], brefframe[4][4], b8mode[4], b8pdir[4];
-int   best8x8mode [4];                // [block]
-int   best8x8pdir [MAXMODE][4];       // [mode][block]
-int   best8x8fwref  [MAXMODE][4];       // [mode][block]
-int   b8_ipredmode[16], b8_intra_pred_modes[16];
-CSptr cs_mb=NULL, cs_b8=NULL, cs_cm=NULL, cs_imb=NULL, cs_ib8=NULL, cs_ib4=NULL, cs_pc=NULL;
-int   best_c_imode;
-int   best_i16offset;
-
-int   best8x8bwref     [MAXMODE][4];       // [mode][block]
-int   abp_typeframe[4][4];
+THREAD_LOCAL RD_DATA *rdopt;
+THREAD_LOCAL RD_DATA rddata_top_frame_mb, rddata_bot_frame_mb;
+THREAD_LOCAL RD_DATA rddata_top_field_mb, rddata_bot_field_mb;
+THREAD_LOCAL int   best_mode;
+THREAD_LOCAL int   rec_mbY[16][16], rec_mbU[8][8], rec_mbV[8][8], rec_mbY8x8[16][16];    // reconstruction values
+THREAD_LOCAL int   mpr8x8[16][16];
+THREAD_LOCAL int   ****cofAC=NULL, ****cofAC8x8=NULL;        // [8x8block][4x4block][level/run][scan_pos]
+THREAD_LOCAL int   ***cofDC=NULL;                       // [yuv][level/run][scan_pos]
+THREAD_LOCAL int   **cofAC4x4=NULL, ****cofAC4x4intern=NULL; // [level/run][scan_pos]
+THREAD_LOCAL int   cbp, cbp8x8, cnt_nonz_8x8;
+THREAD_LOCAL int   cbp_blk, cbp_blk8x8;
+THREAD_LOCAL int   frefframe[4][4], brefframe[4][4], b8mode[4], b8pdir[4];
+THREAD_LOCAL int   best8x8mode [4];                // [block]
+THREAD_LOCAL int   best8x8pdir [MAXMODE][4];       // [mode][block]
+THREAD_LOCAL int   best8x8fwref  [MAXMODE][4];       // [mode][block]
+THREAD_LOCAL int   b8_ipredmode[16], b8_intra_pred_modes[16];
+THREAD_LOCAL CSptr cs_mb=NULL, cs_b8=NULL, cs_cm=NULL, cs_imb=NULL, cs_ib8=NULL, cs_ib4=NULL, cs_pc=NULL;
+THREAD_LOCAL int   best_c_imode;
+THREAD_LOCAL int   best_i16offset;
+
+THREAD_LOCAL int   best8x8bwref     [MAXMODE][4];       // [mode][block]
+THREAD_LOCAL int   abp_typeframe[4][4];
+
+//==== FAST MODE DECISION (FastModeDecision = 2) ====
+// limits in units of the motion lambda, see FastSkipPrediction() and encode_one_macroblock()
+static const int fmd_skip_limit[3] = {24, 40, 56};  //!< SKIP/direct SATD limit for 0, 1, 2 skipped neighbours
+#define FMD_P8x8_LIMIT    128   //!< 16x16 motion cost below which P8x8 is not tested
+#define FMD_SUB8x8_LIMIT   32   //!< 8x8 motion cost below which 8x4, 4x8 and 4x4 are not tested
+#define FMD_INTRA_LIMIT   256   //!< inter motion cost below which the intra modes are not tested
+#define FMD_I4_SATD_SHIFT   3   //!< 4x4 intra modes within 1/8 of the best SATD cost are tested
 
 /*!
  ************************************************************************
@@ -333,7 +345,7 @@ double RDCost_for_4x4IntraBlocks (int*    nonzero,
                            int mostProbableMode)
 {
   double  rdcost;
-  int     dummy, x, y, rate;
+  int     dummy, rate;
   int     distortion  = 0;
   int     block_x     = 8*(b8%2)+4*(b4%2);
   int     block_y     = 8*(b8/2)+4*(b4/2);
@@ -353,9 +365,15 @@ double RDCost_for_4x4IntraBlocks (int*    nonzero,
   *nonzero = dct_luma (block_x, block_y, &dummy, 1);
 
   //===== get distortion (SSD) of 4x4 block =====
-  for (y=0; y<4; y++)
-  for (x=pic_pix_x; x<pic_pix_x+4; x++)  
-    distortion += img->quad [imgY_org[pic_opix_y+y][x] - imgY[pic_pix_y+y][x]];
+  distortion = block_sse (imgY_org, pic_opix_y, imgY, pic_pix_y, pic_pix_x, 4, 4);
+
+  //===== the rate cannot make up for the distortion =====
+  enc_stat->fmd_i4[FMD_TESTED]++;
+  if (input->FastModeDecision && (double)distortion >= min_rdcost)
+  {
+    enc_stat->fmd_i4[FMD_BOUNDED]++;
+    return (double)distortion;
+  }
 
   //===== RATE for INTRA PREDICTION MODE  (SYMBOL MODE MUST BE SET TO UVLC) =====
   currSE->value1 = (mostProbableMode == ipmode) ? -1 : ipmode < mostProbableMode ? ipmode : ipmode-1;
@@ -392,6 +410,19 @@ double RDCost_for_4x4IntraBlocks (int*    nonzero,
   return rdcost;
 }
 
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Checks if a 4x4 intra prediction mode can be used with the given neighbours
+ *************************************************************************************
+ */
+static int Intra4x4ModeAvailable (int ipmode, int left_available, int up_available, int all_available)
+{
+  return (ipmode==DC_PRED) ||
+         ((ipmode==VERT_PRED||ipmode==VERT_LEFT_PRED||ipmode==DIAG_DOWN_LEFT_PRED) && up_available ) ||
+         ((ipmode==HOR_PRED||ipmode==HOR_UP_PRED) && left_available ) ||(all_available);
+}
+
 /*! 
  *************************************************************************************
  * \brief
@@ -402,6 +433,7 @@ int Mode_Decision_for_4x4IntraBlocks (int  b8,  int  b4,  double  lambda,  int*
 {
   int     ipmode, best_ipmode = 0, i, j, k, x, y, cost, dummy;
   int     c_nz, nonzero = 0, rec4x4[4][4], diff[16];
+  int     satd_cost[NO_INTRA_PMODE], satd_limit = (1<<30);
   double  rdcost;
   int     block_x     = 8*(b8%2)+4*(b4%2);
   int     block_y     = 8*(b8/2)+4*(b4/2);
@@ -443,15 +475,38 @@ int Mode_Decision_for_4x4IntraBlocks (int  b8,  int  b4,  double  lambda,  int*
   //===== INTRA PREDICTION FOR 4x4 BLOCK =====
   intrapred_luma (pic_pix_x, pic_pix_y, &left_available, &up_available, &all_available);
 
+  //===== SATD PRESELECTION OF THE MODES TESTED WITH RD COSTS (FastModeDecision = 2) =====
+  if (input->rdopt && input->FastModeDecision > 1)
+  {
+    int mode_cost = (int)floor(4 * sqrt(lambda) + 0.4999);
+
+    for (ipmode=0; ipmode<NO_INTRA_PMODE; ipmode++)
+    {
+      if (Intra4x4ModeAvailable (ipmode, left_available, up_available, all_available))
+      {
+        for (k=j=0; j<4; j++)
+          for (i=0; i<4; i++, k++)
+          {
+            diff[k] = imgY_org[pic_opix_y+j][pic_opix_x+i] - img->mprr[ipmode][j][i];
+          }
+        satd_cost[ipmode]  = (ipmode == mostProbableMode) ? 0 : mode_cost;
+        satd_cost[ipmode] += SATD (diff, input->hadamard);
+        satd_limit = min (satd_limit, satd_cost[ipmode]);
+      }
+    }
+    satd_limit += (satd_limit >> FMD_I4_SATD_SHIFT);
+  }
+
   //===== LOOP OVER ALL 4x4 INTRA PREDICTION MODES =====
   for (ipmode=0; ipmode<NO_INTRA_PMODE; ipmode++)
   {
-    int available_mode =  (ipmode==DC_PRED) ||
-        ((ipmode==VERT_PRED||ipmode==VERT_LEFT_PRED||ipmode==DIAG_DOWN_LEFT_PRED) && up_available ) ||
-        ((ipmode==HOR_PRED||ipmode==HOR_UP_PRED) && left_available ) ||(all_available);
-    if( available_mode)
+    if (Intra4x4ModeAvailable (ipmode, left_available, up_available, all_available))
     {
-      if (!input->rdopt)
+      if (input->rdopt && input->FastModeDecision > 1 && satd_cost[ipmode] > satd_limit)
+      {
+        enc_stat->fmd_i4[FMD_PRUNED]++;
+      }
+      else if (!input->rdopt)
       {
         for (k=j=0; j<4; j++)
           for (i=0; i<4; i++, k++)
@@ -597,9 +652,9 @@ double RDCost_for_8x8blocks (int*    cnt_nonz,   // --> number of nonzero coeffi
                              int     mode,       // <-- partitioning mode
                              int     pdir,       // <-- prediction direction
                              int     ref,        // <-- reference frame
-                             int     bwd_ref)    // <-- abp type
+                             int     bwd_ref,    // <-- abp type
+                             double  min_rdcost) // <-- minimum rate-distortion cost of the block
 {
-  int  i, j, k;
   int  rate=0, distortion=0;
   int  dummy, mrate;
   int  fw_mode, bw_mode;
@@ -653,24 +708,19 @@ double RDCost_for_8x8blocks (int*    cnt_nonz,   // --> number of nonzero coeffi
   //=====
   if (input->rdopt==2 && img->type!=B_SLICE)
   {
-    for (k=0; k<input->NoOfDecoders ;k++)
-    {
-      decode_one_b8block (k, P8x8, block, mode, ref);
-      for (j=img->opix_y+pay; j<img->opix_y+pay+8; j++)
-      for (i=img->opix_x+pax; i<img->opix_x+pax+8; i++)
-      {
-        distortion += img->quad[imgY_org[j][i] - decs->decY[k][j][i]];
-      }
-    }
-    distortion /= input->NoOfDecoders;
+    distortion = decoders_distortion (P8x8, block, mode, ref);
   }
   else
   {
-    for (j=pay; j<pay+8; j++)
-    for (i=img->pix_x+pax; i<img->pix_x+pax+8; i++)
-    {
-      distortion += img->quad [imgY_org[img->opix_y+j][i] - enc_picture->imgY[img->pix_y+j][i]];
-    }
+    distortion = block_sse (imgY_org, img->opix_y+pay, enc_picture->imgY, img->pix_y+pay, img->pix_x+pax, 8, 8);
+  }
+
+  //===== the rate cannot make up for the distortion =====
+  enc_stat->fmd_b8[FMD_TESTED][mode]++;
+  if (input->FastModeDecision && (double)distortion >= min_rdcost)
+  {
+    enc_stat->fmd_b8[FMD_BOUNDED][mode]++;
+    return (double)distortion;
   }
 
   //=====
@@ -1082,7 +1132,7 @@ int RDCost_for_macroblocks (double   lambda,      // <-- lagrange multiplier
                         int      mode,        // <-- modus (0-COPY/DIRECT, 1-16x16, 2-16x8, 3-8x16, 4-8x8(+), 5-Intra4x4, 6-Intra16x16)
                         double*  min_rdcost)  // <-> minimum rate-distortion cost
 {
-  int         i, j, k; //, k, ****ip4;
+  int         i, j; //, k, ****ip4;
   int         i16mode, rate=0, distortion=0;
   double      rdcost;
   Macroblock  *currMB   = &img->mb_data[img->current_mb_nr];
@@ -1109,6 +1159,7 @@ int RDCost_for_macroblocks (double   lambda,      // <-- lagrange multiplier
         if (direct_pdir[block_x+i][block_y+j]<0)
           return 0;
   }
+  enc_stat->fmd_mb[FMD_TESTED][mode]++;
 
   if (mode<P8x8)
   {
@@ -1158,32 +1209,23 @@ int RDCost_for_macroblocks (double   lambda,      // <-- lagrange multiplier
   // LUMA
   if (input->rdopt==2 && img->type!=B_SLICE)
   {
-    for (k=0; k<input->NoOfDecoders ;k++)
-    {
-      decode_one_mb (k, currMB);
-      for (j=0; j<MB_BLOCK_SIZE; j++)
-      for (i=img->opix_x; i<img->opix_x+MB_BLOCK_SIZE; i++)
-      {
-        distortion += img->quad [imgY_org[img->opix_y+j][i] - decs->decY[k][img->opix_y+j][i]];
-      }
-    }
-    distortion /= input->NoOfDecoders;
+    distortion = decoders_distortion (mode, -1, 0, 0);
   }
   else
   {
-    for (j=0; j<16; j++)
-    for (i=img->opix_x; i<img->opix_x+16; i++)
-    {
-      distortion += img->quad [imgY_org[j+img->opix_y][i] - enc_picture->imgY[img->pix_y+j][i]];
-    }
+    distortion = block_sse (imgY_org, img->opix_y, enc_picture->imgY, img->pix_y, img->opix_x, 16, 16);
   }
 
   // CHROMA
-  for (j=0; j<8; j++)
-  for (i=img->opix_c_x; i<img->opix_c_x+8; i++)
+  distortion += block_sse (imgUV_org[0], img->opix_c_y, enc_picture->imgUV[0], img->pix_c_y, img->opix_c_x, 8, 8);
+  distortion += block_sse (imgUV_org[1], img->opix_c_y, enc_picture->imgUV[1], img->pix_c_y, img->opix_c_x, 8, 8);
+
+
+  //=====   the rate cannot make up for the distortion   =====
+  if (input->FastModeDecision && (double)distortion >= *min_rdcost)
   {
-    distortion += img->quad [imgUV_org[0][j+img->opix_c_y][i] - enc_picture->imgUV[0][img->pix_c_y+j][i]];
-    distortion += img->quad [imgUV_org[1][j+img->opix_c_y][i] - enc_picture->imgUV[1][img->pix_c_y+j][i]];
+    enc_stat->fmd_mb[FMD_BOUNDED][mode]++;
+    return 0;
   }
 
 
@@ -1276,7 +1318,7 @@ int RDCost_for_macroblocks (double   lambda,      // <-- lagrange multiplier
  */
 void store_macroblock_parameters (int mode)
 {
-  int  i, j, k, ****i4p, ***i3p;
+  int  i, j, ****i4p, ***i3p;
   Macroblock *currMB  = &img->mb_data[img->current_mb_nr];
   int        bframe   = (img->type==B_SLICE);
 
@@ -1307,15 +1349,8 @@ void store_macroblock_parameters (int mode)
   //--- store results of decoders ---
   if (input->rdopt==2 && img->type!=B_SLICE)
   {
-    for (k=0; k<input->NoOfDecoders; k++)
-    {
-      for (j=img->pix_y; j<img->pix_y+16; j++)
-      for (i=img->pix_x; i<img->pix_x+16; i++)
-      {
-        // Keep the decoded values of each MB for updating the ref frames
-        decs->decY_best[k][j][i] = decs->decY[k][j][i];
-      }
-    }
+    // Keep the decoded values of each MB for updating the ref frames
+    store_decoders_mb ();
   }
 
   //--- coeff, cbp, kac ---
@@ -1668,6 +1703,113 @@ int field_flag_inference()
   return mb_field;
 }
 
+/*!
+ *************************************************************************************
+ * \brief
+ *    Lagrange parameters for mode decision and motion estimation at the
+ *    current QP (img->qp) and picture type
+ *************************************************************************************
+ */
+void SetLagrangeMultipliers (double *lambda_mode, double *lambda_motion)
+{
+  double qp;
+  int    spframe = (img->type==SP_SLICE);
+
+  if (input->rdopt)
+  {
+    qp = (double)img->qp - SHIFT_QP;
+
+    if (input->successive_Bframe>0)
+      *lambda_mode   = 0.68 * pow (2, qp/3.0) * (img->type==B_SLICE? max(2.00,min(4.00,(qp / 6.0))):spframe?max(1.4,min(3.0,(qp / 12.0))):1.0);  
+    else
+      *lambda_mode   = 0.85 * pow (2, qp/3.0) * (img->type==B_SLICE? 4.0:spframe?max(1.4,min(3.0,(qp / 12.0))):1.0);  
+
+    *lambda_motion = sqrt (*lambda_mode);
+  }
+  else
+  {
+    *lambda_mode = *lambda_motion = QP2QUANT[max(0,img->qp-SHIFT_QP)];
+  }
+}
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Predicts the SKIP (P) or direct (B) mode of the current macroblock from the
+ *    SATD of its prediction and the modes of the left and upper neighbours
+ *    (FastModeDecision = 2)
+ *
+ * \return
+ *    1 if the other macroblock modes need not be tested
+ *************************************************************************************
+ */
+static int FastSkipPrediction (double lambda_motion, int bframe)
+{
+  Macroblock *mb_data  = img->mb_data;
+  int         skipped  = 0;
+  int         cost;
+  PixelPos    left, up;
+
+  getNeighbour (img->current_mb_nr, -1,  0, 1, &left);
+  getNeighbour (img->current_mb_nr,  0, -1, 1, &up);
+  if (left.available && mb_data[left.mb_addr].mb_type == 0)  skipped++;
+  if (up.available   && mb_data[up.mb_addr  ].mb_type == 0)  skipped++;
+
+  if (bframe)
+  {
+    cost = Get_Direct_CostMB (lambda_motion);   // (1<<30) if direct is not allowed
+  }
+  else
+  {
+    FindSkipModeMotionVector ();
+    cost = GetSkipCostMB (lambda_motion);
+  }
+
+  enc_stat->fmd_skip[0]++;
+  if (cost < fmd_skip_limit[skipped] * lambda_motion)
+  {
+    enc_stat->fmd_skip[1]++;
+    return 1;
+  }
+  return 0;
+}
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Starts or ends the CABAC rate estimation for all partitions of the slice
+ *    (CABACRateEstimation)
+ *************************************************************************************
+ */
+static void SetCABACRateEstimation (int estimate)
+{
+  Slice *currSlice = img->currentSlice;
+  int    i;
+
+  for (i=0; i<currSlice->max_part_nr; i++)
+  {
+    if (estimate)
+      arienco_start_estimation (&currSlice->partArr[i].ee_cabac);
+    else
+      arienco_done_estimation  (&currSlice->partArr[i].ee_cabac);
+  }
+}
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Excludes a macroblock mode from the mode decision (FastModeDecision = 2)
+ *************************************************************************************
+ */
+static void PruneMode (int *valid, int mode)
+{
+  if (valid[mode])
+  {
+    valid[mode] = 0;
+    enc_stat->fmd_mb[FMD_PRUNED][mode]++;
+  }
+}
+
 /*! 
  *************************************************************************************
  * \brief
@@ -1681,21 +1823,23 @@ int field_flag_inference()
    
    int         valid[MAXMODE];
    int         rerun, block, index, mode, i0, i1, j0, j1, pdir, ref, i, j, k, ctr16x16, dummy;
-   double      qp, lambda_mode, lambda_motion, min_rdcost, rdcost = 0, max_rdcost=1e30;
+   double      lambda_mode, lambda_motion, min_rdcost, rdcost = 0, max_rdcost=1e30;
    int         lambda_motion_factor;
    int         fw_mcost, bw_mcost, bid_mcost, mcost, max_mcost=(1<<30);
    int         curr_cbp_blk, cnt_nonz = 0, best_cnt_nonz = 0, best_fw_ref = 0, best_pdir;
    int         cost=0;
    int         min_cost = max_mcost, min_cost8x8, cost8x8, cost_direct=0, have_direct=0, i16mode;
    int         intra1 = 0;
+   int         cost_sub8x8, fast_c_ipred_mode = DC_PRED_8;
    
    int         intra       = (((img->type==P_SLICE||img->type==SP_SLICE) && img->mb_y==img->mb_y_upd && img->mb_y_upd!=img->mb_y_intra) || img->type==I_SLICE);
-   int         spframe     = (img->type==SP_SLICE);
    int         siframe     = (img->type==SI_SLICE);
    int         bframe      = (img->type==B_SLICE);
    int         runs        = (input->RestrictRef==1 && input->rdopt==2 && (img->type==P_SLICE || img->type==SP_SLICE || (img->type==B_SLICE && img->nal_reference_idc>0)) ? 2 : 1);
    
    int         checkref    = (input->rdopt && input->RestrictRef && (img->type==P_SLICE || img->type==SP_SLICE));
+   int         fast_md     = (input->rdopt && input->FastModeDecision > 1 && runs == 1);
+   int         estimate    = (input->rdopt && input->symbol_mode == CABAC && input->CABACRateEstimation);
    Macroblock* currMB      = &img->mb_data[img->current_mb_nr];
    Macroblock* prevMB      = img->current_mb_nr ? &img->mb_data[img->current_mb_nr-1]:NULL ;
    
@@ -1741,21 +1885,8 @@ int field_flag_inference()
    valid[P8x8]   = (valid[4] || valid[5] || valid[6] || valid[7]);
    valid[12]     = (siframe);
 
-   if (!img->MbaffFrameFlag)
-   {
-     for (l=0+list_offset;l<(2+list_offset);l++)
-     {
-       for(k = 0; k < listXsize[l]; k++)
-       {
-         listX[l][k]->chroma_vector_adjustment= 0;
-         if(img->structure == TOP_FIELD && img->structure != listX[l][k]->structure)
-           listX[l][k]->chroma_vector_adjustment = -2;
-         if(img->structure == BOTTOM_FIELD && img->structure != listX[l][k]->structure)
-           listX[l][k]->chroma_vector_adjustment = 2;
-       }
-     }
-   }
-   else
+   // without MB AFF the chroma vector adjustment is set per picture in code_a_picture()
+   if (img->MbaffFrameFlag)
    {
      if (curr_mb_field)
      {
@@ -1784,23 +1915,12 @@ int field_flag_inference()
      
    }
    //===== SET LAGRANGE PARAMETERS =====
-   if (input->rdopt)
-   {
-     qp = (double)img->qp - SHIFT_QP;
-
-     if (input->successive_Bframe>0)
-       lambda_mode   = 0.68 * pow (2, qp/3.0) * (img->type==B_SLICE? max(2.00,min(4.00,(qp / 6.0))):spframe?max(1.4,min(3.0,(qp / 12.0))):1.0);  
-     else
-       lambda_mode   = 0.85 * pow (2, qp/3.0) * (img->type==B_SLICE? 4.0:spframe?max(1.4,min(3.0,(qp / 12.0))):1.0);  
-
-     lambda_motion = sqrt (lambda_mode);
-   }
-   else
-   {
-     lambda_mode = lambda_motion = QP2QUANT[max(0,img->qp-SHIFT_QP)];
-   }
+   SetLagrangeMultipliers (&lambda_mode, &lambda_motion);
    lambda_motion_factor = LAMBDA_FACTOR (lambda_motion);
    
+   //===== the rates of the candidates are estimated, not encoded =====
+   if (estimate)
+     SetCABACRateEstimation (1);
    
    for (rerun=0; rerun<runs; rerun++)
    {
@@ -1820,6 +1940,14 @@ int field_flag_inference()
        {
          Get_Direct_Motion_Vectors ();
        }
+
+       //===== predict SKIP / direct mode, the other modes are not tested then =====
+       if (fast_md && !img->MbaffFrameFlag && (bframe || img->type==P_SLICE) &&
+           FastSkipPrediction (lambda_motion, bframe))
+       {
+         for (mode=1; mode<MAXMODE; mode++)
+           PruneMode (valid, mode);
+       }
        
        //===== MOTION ESTIMATION FOR 16x16, 16x8, 8x16 BLOCKS =====
        for (min_cost=1<<20, best_mode=1, mode=1; mode<4; mode++)
@@ -2078,6 +2206,10 @@ int field_flag_inference()
           }
         } // if (valid[mode])
       } // for (mode=1; mode<4; mode++)
+
+      //===== a well predicted 16x16 block is not split further =====
+      if (fast_md && best_mode==1 && min_cost < FMD_P8x8_LIMIT * lambda_motion)
+        PruneMode (valid, P8x8);
       
       if (valid[P8x8])
       {
@@ -2094,10 +2226,17 @@ int field_flag_inference()
           i0 = ((block%2)<<3);    i1 = (i0>>2);
           
           //=====  LOOP OVER POSSIBLE CODING MODES FOR 8x8 SUB-PARTITION  =====
-          for (min_cost8x8=(1<<20), min_rdcost=1e30, index=(bframe?0:1); index<5; index++)
+          for (min_cost8x8=(1<<20), min_rdcost=1e30, cost_sub8x8=max_mcost, index=(bframe?0:1); index<5; index++)
           {
             if (valid[mode=b8_mode_table[index]])
             {
+              //--- a well predicted 8x8 block is not split further ---
+              if (fast_md && mode > 4 && cost_sub8x8 < FMD_SUB8x8_LIMIT * lambda_motion)
+              {
+                enc_stat->fmd_b8[FMD_PRUNED][mode]++;
+                continue;
+              }
+
               curr_cbp_blk = 0;
               
               if (mode==0)
@@ -2194,6 +2333,8 @@ int field_flag_inference()
                   best_pdir = 0;
                   cost      = fw_mcost;
                 }
+                if (mode == 4)
+                  cost_sub8x8 = cost;
               } // if (mode!=0)
               
               //--- store coding state before coding with current mode ---
@@ -2203,7 +2344,7 @@ int field_flag_inference()
               {
                 //--- get and check rate-distortion cost ---
                 rdcost = RDCost_for_8x8blocks (&cnt_nonz, &curr_cbp_blk, lambda_mode,
-                                               block, mode, best_pdir, best_fw_ref, best_bw_ref);
+                                               block, mode, best_pdir, best_fw_ref, best_bw_ref, min_rdcost);
               }
               else
               {
@@ -2350,6 +2491,13 @@ int field_flag_inference()
       // Find a motion vector for the Skip mode
       if((img->type == P_SLICE)||(img->type == SP_SLICE))
         FindSkipModeMotionVector ();
+
+      //===== intra modes are not tested for well predicted macroblocks =====
+      if (fast_md && min_cost < FMD_INTRA_LIMIT * lambda_motion)
+      {
+        PruneMode (valid, I16MB);
+        PruneMode (valid, I4MB);
+      }
     }
     else // if (img->type!=I_SLICE)
     {
@@ -2365,7 +2513,9 @@ int field_flag_inference()
       min_rdcost = max_rdcost;
       
       // precompute all new chroma intra prediction modes
+      // (with FastModeDecision = 2 the mode of the lowest SATD is selected as well)
       IntraChromaPrediction8x8(&mb_available_up, &mb_available_left, &mb_available_up_left);
+      fast_c_ipred_mode = currMB->c_ipred_mode;
       
       for (currMB->c_ipred_mode=DC_PRED_8; currMB->c_ipred_mode<=PLANE_8; currMB->c_ipred_mode++)
       {
@@ -2375,6 +2525,10 @@ int field_flag_inference()
           (currMB->c_ipred_mode==HOR_PRED_8 && !mb_available_left) ||
           (currMB->c_ipred_mode==PLANE_8 && (!mb_available_left || !mb_available_up || !mb_available_up_left)))
           continue;
+
+        // the inter modes are tested with DC_PRED_8, the intra modes with the selected mode only
+        if (fast_md && currMB->c_ipred_mode!=DC_PRED_8 && currMB->c_ipred_mode!=fast_c_ipred_mode)
+          continue;
         
         
         //===== GET BEST MACROBLOCK MODE =====
@@ -2396,7 +2550,11 @@ int field_flag_inference()
           {
             // bypass if c_ipred_mode not used
             SetModesAndRefframeForBlocks (mode);
-            if (currMB->c_ipred_mode == DC_PRED_8 ||
+            if (fast_md && IS_INTRA(currMB) && currMB->c_ipred_mode != fast_c_ipred_mode)
+            {
+              enc_stat->fmd_mb[FMD_PRUNED][mode]++;
+            }
+            else if (currMB->c_ipred_mode == DC_PRED_8 ||
               (IS_INTRA(currMB) ))
             {
               if (RDCost_for_macroblocks (lambda_mode, mode, &min_rdcost))
@@ -2486,6 +2644,9 @@ int field_flag_inference()
       intra1 = (currMB->mb_type==I16MB || currMB->mb_type==I4MB ? 1 : 0);
     }
   } // for (rerun=0; rerun<runs; rerun++)
+
+  if (estimate)
+    SetCABACRateEstimation (0);
   
   if (input->rdopt)
   {
@@ -2646,6 +2807,48 @@ int field_flag_inference()
 }
 
 
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Prints one line of the fast mode decision statistics
+ *************************************************************************************
+ */
+static void report_fmd_counters (const char *name, int tested, int bounded, int pruned)
+{
+  fprintf (stdout, "   %-14s: %9d RD costs, %5.1f%% stopped early, %9d pruned\n",
+           name, tested, tested ? 100.0 * bounded / tested : 0.0, pruned);
+}
+
+/*! 
+ *************************************************************************************
+ * \brief
+ *    Prints the statistics of the fast mode decision
+ *************************************************************************************
+ */
+void ReportFastModeDecision ()
+{
+  static const int   mb_modes[7] = {0, 1, 2, 3, P8x8, I16MB, I4MB};
+  static const char *mb_names[7] = {"SKIP/direct", "16x16", "16x8", "8x16", "8x8", "intra 16x16", "intra 4x4"};
+  static const int   b8_modes[5] = {0, 4, 5, 6, 7};
+  static const char *b8_names[5] = {"direct 8x8", "8x8 sub 8x8", "8x8 sub 8x4", "8x8 sub 4x8", "8x8 sub 4x4"};
+  int i;
+
+  fprintf (stdout, " Fast mode decision                : %s\n",
+           input->FastModeDecision > 1 ? "cost bounded, SKIP prediction and mode pruning" : "cost bounded");
+  if (input->FastModeDecision > 1)
+    fprintf (stdout, "   SKIP/direct predicted           : %d of %d MBs (%.1f%%)\n", enc_stat->fmd_skip[1], enc_stat->fmd_skip[0],
+             enc_stat->fmd_skip[0] ? 100.0 * enc_stat->fmd_skip[1] / enc_stat->fmd_skip[0] : 0.0);
+
+  for (i=0; i<7; i++)
+    report_fmd_counters (mb_names[i], enc_stat->fmd_mb[FMD_TESTED][mb_modes[i]],
+                         enc_stat->fmd_mb[FMD_BOUNDED][mb_modes[i]], enc_stat->fmd_mb[FMD_PRUNED][mb_modes[i]]);
+  for (i=0; i<5; i++)
+    report_fmd_counters (b8_names[i], enc_stat->fmd_b8[FMD_TESTED][b8_modes[i]],
+                         enc_stat->fmd_b8[FMD_BOUNDED][b8_modes[i]], enc_stat->fmd_b8[FMD_PRUNED][b8_modes[i]]);
+  report_fmd_counters ("4x4 intra pred", enc_stat->fmd_i4[FMD_TESTED], enc_stat->fmd_i4[FMD_BOUNDED], enc_stat->fmd_i4[FMD_PRUNED]);
+}
+
+
 void set_mbaff_parameters()
 {
   int  i, j, k, l;
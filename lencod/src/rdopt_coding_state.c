@@ -135,7 +135,13 @@ store_coding_state (CSptr cs)
 
   if (!input->rdopt)  return;
 
-  if (cs->symbol_mode==CABAC)
+  if (cs->symbol_mode==CABAC && img->currentSlice->partArr[0].ee_cabac.Eestimate)
+  {
+    //=== rate estimation: only the estimated bits change ===
+    for (i = 0; i <(img->currentPicture->idr_flag? 1:cs->no_part); i++)
+      cs->encenv[i].Eest_bits = img->currentSlice->partArr[i].ee_cabac.Eest_bits;
+  }
+  else if (cs->symbol_mode==CABAC)
   {
   //=== important variables of data partition array ===
 	//only one partition for IDR img
@@ -198,7 +204,13 @@ reset_coding_state (CSptr cs)
 
   if (!input->rdopt)  return;
 
-  if (cs->symbol_mode==CABAC) 
+  if (cs->symbol_mode==CABAC && img->currentSlice->partArr[0].ee_cabac.Eestimate)
+  {
+    //=== rate estimation: only the estimated bits change ===
+    for (i = 0; i <(img->currentPicture->idr_flag? 1:cs->no_part); i++)
+      img->currentSlice->partArr[i].ee_cabac.Eest_bits = cs->encenv[i].Eest_bits;
+  }
+  else if (cs->symbol_mode==CABAC) 
   {
   //=== important variables of data partition array ===
 	//only one partition for IDR img
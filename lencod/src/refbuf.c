@@ -58,7 +58,7 @@ void PutPel_11 (pel_t *Pic, int y, int x, pel_t val, int width)
  *    provided by the caller to change that (but it costs a memcpy()...
  ************************************************************************
  */
-static pel_t line[16];
+static THREAD_LOCAL pel_t line[16];
 
 pel_t *FastLine16Y_11 (pel_t *Pic, int y, int x, int height, int width)
 {
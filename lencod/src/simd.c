@@ -0,0 +1,145 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file simd.c
+ *
+ * \brief
+ *    Run-time detection of the SIMD instruction sets used by the
+ *    optimized kernels
+ *
+ * \note
+ *    The CPU is only queried once at start-up. All kernels are selected
+ *    through function pointers afterwards, so the same binary runs on
+ *    machines without SSE2/SSSE3/AVX2 support.
+ ************************************************************************
+ */
+
+#include "simd.h"
+
+#if defined(HAVE_X86_SIMD)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+int simd_level = SIMD_C;
+
+#if defined(HAVE_X86_SIMD)
+static void get_cpuid (int leaf, int subleaf, unsigned int reg[4])
+{
+#if defined(_MSC_VER)
+  __cpuidex ((int*)reg, leaf, subleaf);
+#else
+  __cpuid_count (leaf, subleaf, reg[0], reg[1], reg[2], reg[3]);
+#endif
+}
+
+static unsigned int get_xcr0 ()
+{
+#if defined(_MSC_VER)
+  return (unsigned int) _xgetbv (0);
+#else
+  unsigned int eax, edx;
+  __asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+  return eax;
+#endif
+}
+#endif
+
+/*!
+ ************************************************************************
+ * \brief
+ *    returns the highest SIMD level supported by CPU and OS
+ ************************************************************************
+ */
+int simd_detect ()
+{
+#if defined(HAVE_X86_SIMD)
+  unsigned int reg[4];
+  int level = SIMD_C;
+
+  get_cpuid (0, 0, reg);
+  if (reg[0] < 1)
+    return SIMD_C;
+  {
+    int max_leaf = reg[0];
+
+    get_cpuid (1, 0, reg);
+    if (reg[3] & (1<<26))                       // SSE2
+      level = SIMD_SSE2;
+    if (level == SIMD_SSE2 && (reg[2] & (1<<9))) // SSSE3
+      level = SIMD_SSSE3;
+
+    // AVX2 also needs the OS to save the ymm registers (OSXSAVE + XCR0)
+    if (level == SIMD_SSSE3 && max_leaf >= 7 && (reg[2] & (1<<27)) && (reg[2] & (1<<28)) &&
+        (get_xcr0 () & 6) == 6)
+    {
+      get_cpuid (7, 0, reg);
+      if (reg[1] & (1<<5))
+        level = SIMD_AVX2;
+    }
+  }
+  return level;
+#else
+  return SIMD_C;
+#endif
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    sets simd_level to the requested level, limited by the CPU
+ * \param requested_level
+ *    SIMD_AUTO or one of SIMD_C ... SIMD_AVX2
+ ************************************************************************
+ */
+void init_simd (int requested_level)
+{
+  int supported = simd_detect ();
+
+  if (requested_level == SIMD_AUTO || requested_level > supported)
+    simd_level = supported;
+  else
+    simd_level = requested_level;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    returns a printable name of a SIMD level
+ ************************************************************************
+ */
+const char *simd_name (int level)
+{
+  switch (level)
+  {
+  case SIMD_SSE2:
+    return "SSE2";
+  case SIMD_SSSE3:
+    return "SSSE3";
+  case SIMD_AVX2:
+    return "AVX2";
+  default:
+    return "C";
+  }
+}
@@ -55,6 +55,8 @@
 #include "cabac.h"
 #include "elements.h"
 #include "mbuffer.h"
+#include "context_ini.h"
+#include "me_distortion.h"
 
 // Local declarations
 
@@ -62,8 +64,50 @@ static Slice *malloc_slice();
 static void  free_slice(Slice *slice);
 static void  init_slice(int start_mb_addr);
 static void set_ref_pic_num();
-extern ColocatedParams *Co_located;
-extern StorablePicture **listX[6];
+static void set_partition_mapping();
+static int  encode_slice_macroblocks(int CurrentMbAddr);
+extern THREAD_LOCAL ColocatedParams *Co_located;
+extern THREAD_LOCAL StorablePicture **listX[6];
+
+THREAD_LOCAL int Bytes_After_Header;
+
+//! one slice coded by a slice thread
+typedef struct
+{
+  Slice *slice;               //!< set up by init_slice() in the main thread
+  int    slice_nr;
+  int    first_mb;
+  int    model_number;        //!< CABAC context model chosen by SetCtxModelNumber()
+
+  int    num_coded_mb;        //!< results, merged in slice order
+  int    last_mb;
+  int    intras;
+  int    me_time;
+  int    header_bits;
+  int    texture_bits;
+  int    bu_header_bits;
+  int    bu_texture_bits;
+  int    coded_mbs;
+  StatParameters stat;
+} SliceJob;
+
+static ThreadPool      *slice_pool = NULL;
+static ImageParameters *master_img = NULL;     //!< img of the main thread while the slice threads run
+
+//! picture level state of the main thread, thread local since the PAFF thread codes pictures as well
+static struct
+{
+  StorablePicture  *enc_picture;
+  StorablePicture **listX[6];
+  int               listXsize[6];
+  ColocatedParams  *Co_located;
+  byte            **imgY_org;
+  byte           ***imgUV_org;
+  int            ***direct_ref_idx;
+  int             **direct_pdir;
+  int              *MBAmap;
+} master_pic;
+static THREAD_LOCAL int slice_worker = 0;      //!< set on the slice threads
 
 /*!
  ************************************************************************
@@ -110,7 +154,10 @@ int start_slice()
 
   init_ref_pic_list_reordering();
 
-  RTPUpdateTimestamp (img->tr);   // this has no side effects, just leave it for all NALs
+  // for the slice threads this is done once per picture by encode_slices_parallel(),
+  // for a frame trial on the PAFF thread by the field trial of the same picture
+  if (!slice_worker && !paff_worker)
+    RTPUpdateTimestamp (img->tr);   // this has no side effects, just leave it for all NALs
 
   for (i=0; i<NumberOfPartitions; i++)
   {
@@ -131,7 +178,7 @@ int start_slice()
       writeVlcByteAlign(currStream);
       arienco_start_encoding(eep, currStream->streamBuffer, &(currStream->byte_pos)/*, &(currStream->last_startcode)*/,img->type);
       cabac_new_slice();
-    } else 
+    } else if (!slice_worker)
     {
       // Initialize CA-VLC
       CAVLC_init();
@@ -177,19 +224,19 @@ int terminate_slice()
       SODBtoRBSP(currStream);
       byte_pos_before_startcode_emu_prevention = currStream->byte_pos;
       currStream->byte_pos = RBSPtoEBSP(currStream->streamBuffer, 0 , currStream->byte_pos, 0);
-      *(stat->em_prev_bits) += (currStream->byte_pos - byte_pos_before_startcode_emu_prevention) * 8;
+      *(enc_stat->em_prev_bits) += (currStream->byte_pos - byte_pos_before_startcode_emu_prevention) * 8;
     }
     else     // CABAC
     {
       eep = &((currSlice->partArr[i]).ee_cabac);
       // terminate the arithmetic code
       arienco_done_encoding(eep);
-      currStream->bits_to_go = eep->Ebits_to_go;
+      currStream->bits_to_go = 8;      // the code ends byte aligned
       currStream->byte_buf = 0;
       bytes_written = currStream->byte_pos;
       byte_pos_before_startcode_emu_prevention= currStream->byte_pos;
       currStream->byte_pos = RBSPtoEBSP(currStream->streamBuffer, 0, currStream->byte_pos, eep->E);
-      *(stat->em_prev_bits) += (currStream->byte_pos - byte_pos_before_startcode_emu_prevention) * 8;
+      *(enc_stat->em_prev_bits) += (currStream->byte_pos - byte_pos_before_startcode_emu_prevention) * 8;
     }           // CABAC
   }           // partition loop
   if( input->symbol_mode == CABAC )
@@ -210,12 +257,7 @@ int terminate_slice()
  */
 int encode_one_slice (int SliceGroupId, Picture *pic)
 {
-  Boolean end_of_slice = FALSE;
-  Boolean recode_macroblock;
-  int len;
-  int NumberOfCodedMBs = 0;
   int CurrentMbAddr;
-  double FrameRDCost, FieldRDCost;
 
   img->cod_counter = 0;
 
@@ -228,13 +270,35 @@ int encode_one_slice (int SliceGroupId, Picture *pic)
 // printf ("\n\nEncode_one_slice: PictureID %d SliceGroupId %d  SliceID %d  FirstMB %d \n", img->tr, SliceGroupId, img->current_slice_nr, CurrentMbInScanOrder);
 
   init_slice (CurrentMbAddr);
-  Bytes_After_Header = img->currentSlice->partArr[0].bitstream->byte_pos;
 
   if (input->symbol_mode==CABAC)
   {
     SetCtxModelNumber ();
   }
 
+  return encode_slice_macroblocks (CurrentMbAddr);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Codes the macroblocks of the slice set up by init_slice(),
+ *    starting with CurrentMbAddr
+ * \par
+ *   returns the number of coded MBs in the SLice 
+ ************************************************************************
+ */
+static int encode_slice_macroblocks (int CurrentMbAddr)
+{
+  Boolean end_of_slice = FALSE;
+  Boolean recode_macroblock;
+  int len;
+  int NumberOfCodedMBs = 0;
+  double FrameRDCost, FieldRDCost;
+
+  Bytes_After_Header = img->currentSlice->partArr[0].bitstream->byte_pos;
+
 /*
   // Tian Dong: June 7, 2002 JVT-B042
   // When the pictures are put into different layers and subseq, not all the reference frames
@@ -268,8 +332,8 @@ int encode_one_slice (int SliceGroupId, Picture *pic)
     }
 */
   // Update statistics
-  stat->bit_slice += len;
-  stat->bit_use_header[img->type] += len;
+  enc_stat->bit_slice += len;
+  enc_stat->bit_use_header[img->type] += len;
 // printf ("\n\n");
 
   while (end_of_slice == FALSE) // loop over macroblocks
@@ -550,6 +614,25 @@ static void init_slice (int start_mb_addr)
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets the mapping of the syntax elements to the data partitions of
+ *    the current picture (per thread, slice threads set it per slice)
+ ************************************************************************
+ */
+static void set_partition_mapping()
+{
+  assignSE2partition[0] = assignSE2partition_NoDP;
+  //ZL
+  //for IDR img all the syntax element shoulde be mapped to one partition
+  if(!img->currentPicture->idr_flag&&input->partition_mode==1)
+    assignSE2partition[1] =  assignSE2partition_DP;
+  else
+    assignSE2partition[1] =  assignSE2partition_NoDP;
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -582,13 +665,7 @@ static Slice *malloc_slice()
 	if(img->currentPicture->idr_flag)
 		slice->max_part_nr = 1;
   
-  assignSE2partition[0] = assignSE2partition_NoDP;
-	//ZL 
-	//for IDR img all the syntax element shoulde be mapped to one partition        
-  if(!img->currentPicture->idr_flag&&input->partition_mode==1)
-    assignSE2partition[1] =  assignSE2partition_DP;
-	else
-    assignSE2partition[1] =  assignSE2partition_NoDP;    		 
+  set_partition_mapping ();
 
 
 
@@ -712,3 +789,296 @@ void set_ref_pic_num()
       }
 
 }
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up the coding state of a slice thread: private copies of
+ *    img, enc_stat and of all buffers written while coding a macroblock.
+ *    Runs on the slice thread, where img and enc_stat still point to the
+ *    structures of the main thread.
+ ************************************************************************
+ */
+static void slice_thread_init (int thread_id)
+{
+  ImageParameters *thread_img;
+  StatParameters  *thread_stat;
+
+  if ((thread_img = (ImageParameters *) malloc (sizeof (ImageParameters))) == NULL)
+    no_mem_exit ("slice_thread_init: thread_img");
+  if ((thread_stat = (StatParameters *) calloc (1, sizeof (StatParameters))) == NULL)
+    no_mem_exit ("slice_thread_init: thread_stat");
+
+  *thread_img = *img;
+  img      = thread_img;
+  enc_stat = thread_stat;
+
+  get_mem_mv (&(img->pred_mv));
+  get_mem_mv (&(img->all_mv));
+  get_mem_ACcoeff (&(img->cofAC));
+  get_mem_DCcoeff (&(img->cofDC));
+
+  init_rdopt ();
+  Init_Motion_Search_Thread ();
+  AllocNalPayloadBuffer ();
+
+  slice_worker = 1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Frees the coding state of a slice thread
+ ************************************************************************
+ */
+static void slice_thread_exit (int thread_id)
+{
+  FreeNalPayloadBuffer ();
+  Clear_Motion_Search_Thread ();
+  clear_rdopt ();
+
+  free_mem_mv (img->pred_mv);
+  free_mem_mv (img->all_mv);
+  free_mem_ACcoeff (img->cofAC);
+  free_mem_DCcoeff (img->cofDC);
+
+  free (img);
+  free (enc_stat);
+
+  CollectDistortionKernelStats ();
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Starts the slice threads (SliceThreads > 1)
+ ************************************************************************
+ */
+void init_slice_threads ()
+{
+  if (input->SliceThreads > 1)
+    slice_pool = create_thread_pool (input->SliceThreads, slice_thread_init, slice_thread_exit);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Stops the slice threads
+ ************************************************************************
+ */
+void free_slice_threads ()
+{
+  free_thread_pool (slice_pool);
+  slice_pool = NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Codes one slice on a slice thread
+ ************************************************************************
+ */
+static void encode_slice_job (void *arg)
+{
+  SliceJob *job = (SliceJob *) arg;
+  int****** pred_mv = img->pred_mv;
+  int****** all_mv  = img->all_mv;
+  int****   cofAC   = img->cofAC;
+  int***    cofDC   = img->cofDC;
+
+  // picture level state of the main thread, with the thread's own buffers
+  *img = *master_img;
+  img->pred_mv = pred_mv;
+  img->all_mv  = all_mv;
+  img->cofAC   = cofAC;
+  img->cofDC   = cofDC;
+
+  img->current_slice_nr = job->slice_nr;
+  img->current_mb_nr    = job->first_mb;
+  img->currentSlice     = job->slice;
+  img->model_number     = job->model_number;
+  img->cod_counter      = 0;
+
+  enc_picture    = master_pic.enc_picture;
+  memcpy (listX,     master_pic.listX,     sizeof (listX));
+  memcpy (listXsize, master_pic.listXsize, sizeof (listXsize));
+  Co_located     = master_pic.Co_located;
+  imgY_org       = master_pic.imgY_org;
+  imgUV_org      = master_pic.imgUV_org;
+  direct_ref_idx = master_pic.direct_ref_idx;
+  direct_pdir    = master_pic.direct_pdir;
+  MBAmap         = master_pic.MBAmap;
+  set_partition_mapping ();
+
+  memset (enc_stat, 0, sizeof (StatParameters));
+  enc_stat->em_prev_bits = &enc_stat->em_prev_bits_frm;
+  intras  = 0;
+  me_time = 0;
+
+  job->num_coded_mb    = encode_slice_macroblocks (job->first_mb);
+
+  job->last_mb         = img->current_mb_nr;
+  job->intras          = intras;
+  job->me_time         = me_time;
+  job->header_bits     = img->NumberofHeaderBits           - master_img->NumberofHeaderBits;
+  job->texture_bits    = img->NumberofTextureBits          - master_img->NumberofTextureBits;
+  job->bu_header_bits  = img->NumberofBasicUnitHeaderBits  - master_img->NumberofBasicUnitHeaderBits;
+  job->bu_texture_bits = img->NumberofBasicUnitTextureBits - master_img->NumberofBasicUnitTextureBits;
+  job->coded_mbs       = img->NumberofCodedMacroBlocks     - master_img->NumberofCodedMacroBlocks;
+  job->stat            = *enc_stat;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Adds the mode and bit counters of the statistics s of another
+ *    thread to enc_stat
+ ************************************************************************
+ */
+void add_thread_stats (StatParameters *s)
+{
+  int i, j;
+
+  for (i=0; i<NUM_PIC_TYPE; i++)
+  {
+    for (j=0; j<MAXMODE; j++)
+    {
+      enc_stat->mode_use    [i][j] += s->mode_use    [i][j];
+      enc_stat->bit_use_mode[i][j] += s->bit_use_mode[i][j];
+    }
+    enc_stat->bit_use_stuffingBits[i] += s->bit_use_stuffingBits[i];
+    enc_stat->bit_use_mb_type     [i] += s->bit_use_mb_type     [i];
+    enc_stat->bit_use_header      [i] += s->bit_use_header      [i];
+    enc_stat->tmp_bit_use_cbp     [i] += s->tmp_bit_use_cbp     [i];
+    enc_stat->bit_use_coeffY      [i] += s->bit_use_coeffY      [i];
+    enc_stat->bit_use_coeffC      [i] += s->bit_use_coeffC      [i];
+    enc_stat->bit_use_delta_quant [i] += s->bit_use_delta_quant [i];
+  }
+  for (i=0; i<3; i++)
+  {
+    for (j=0; j<MAXMODE; j++)
+      enc_stat->fmd_mb[i][j] += s->fmd_mb[i][j];
+    for (j=0; j<8; j++)
+      enc_stat->fmd_b8[i][j] += s->fmd_b8[i][j];
+    enc_stat->fmd_i4[i] += s->fmd_i4[i];
+  }
+  enc_stat->fmd_skip[0] += s->fmd_skip[0];
+  enc_stat->fmd_skip[1] += s->fmd_skip[1];
+  enc_stat->quant0 += s->quant0;
+  enc_stat->quant1 += s->quant1;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Adds the statistics of a slice coded by a slice thread
+ ************************************************************************
+ */
+static void add_slice_stats (SliceJob *job)
+{
+  add_thread_stats (&job->stat);
+  *(enc_stat->em_prev_bits) += job->stat.em_prev_bits_frm;
+
+  intras      += job->intras;
+  me_time     += job->me_time;
+  me_tot_time += job->me_time;
+
+  img->NumberofHeaderBits           += job->header_bits;
+  img->NumberofTextureBits          += job->texture_bits;
+  img->NumberofBasicUnitHeaderBits  += job->bu_header_bits;
+  img->NumberofBasicUnitTextureBits += job->bu_texture_bits;
+  img->NumberofCodedMacroBlocks     += job->coded_mbs;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Codes all slices of the current picture on the slice threads.
+ *
+ *    The slices (slice mode 1, one slice group) are set up in order in
+ *    the main thread, coded concurrently and their statistics merged in
+ *    slice order afterwards; the NAL units are written by
+ *    writeout_picture() in slice order as before. Each macroblock gets
+ *    its slice number before coding starts, so that the neighbour
+ *    availability checks see the same slice boundaries as in sequential
+ *    coding. The bitstream is identical to coding the slices one by one.
+ * \return
+ *    number of coded MBs, 0 if the picture has to be coded sequentially
+ ************************************************************************
+ */
+int encode_slices_parallel (Picture *pic)
+{
+  SliceJob *jobs;
+  int num_slices, n, mb, last;
+  int NumberOfCodedMBs = 0;
+
+  if (slice_pool == NULL || active_pps->num_slice_groups_minus1 > 0)
+    return 0;
+
+  num_slices = (img->total_number_mb + input->slice_argument - 1) / input->slice_argument;
+  if (num_slices < 2)
+    return 0;
+  if (input->symbol_mode == CABAC && !CtxModelsKnownBeforeCoding (num_slices))
+    return 0;
+
+  if ((jobs = (SliceJob *) calloc (num_slices, sizeof (SliceJob))) == NULL)
+    no_mem_exit ("encode_slices_parallel: jobs");
+
+  img->cod_counter = 0;
+
+  set_ref_pic_num();
+
+  if (img->type == B_SLICE)
+    compute_collocated(Co_located, listX);
+
+  RTPUpdateTimestamp (img->tr);
+  if (input->symbol_mode == UVLC)
+    CAVLC_init();
+
+  for (n=0; n<num_slices; n++)
+  {
+    jobs[n].slice_nr = img->current_slice_nr + n;
+    jobs[n].first_mb = n * input->slice_argument;
+
+    init_slice (jobs[n].first_mb);
+    jobs[n].slice = img->currentSlice;
+
+    if (input->symbol_mode == CABAC)
+    {
+      SetCtxModelNumber ();
+      jobs[n].model_number = img->model_number;
+    }
+
+    last = min (jobs[n].first_mb + input->slice_argument, img->total_number_mb);
+    for (mb=jobs[n].first_mb; mb<last; mb++)
+      img->mb_data[mb].slice_nr = jobs[n].slice_nr;
+  }
+
+  master_img = img;
+  master_pic.enc_picture    = enc_picture;
+  memcpy (master_pic.listX,     listX,     sizeof (listX));
+  memcpy (master_pic.listXsize, listXsize, sizeof (listXsize));
+  master_pic.Co_located     = Co_located;
+  master_pic.imgY_org       = imgY_org;
+  master_pic.imgUV_org      = imgUV_org;
+  master_pic.direct_ref_idx = direct_ref_idx;
+  master_pic.direct_pdir    = direct_pdir;
+  master_pic.MBAmap         = MBAmap;
+  run_thread_pool (slice_pool, encode_slice_job, jobs, sizeof (SliceJob), num_slices);
+  master_img = NULL;
+
+  for (n=0; n<num_slices; n++)
+  {
+    add_slice_stats (&jobs[n]);
+    NumberOfCodedMBs += jobs[n].num_coded_mb;
+
+    img->current_mb_nr = jobs[n].last_mb;
+    FmoSetLastMacroblockInSlice (img->current_mb_nr);
+    img->current_slice_nr++;
+  }
+  enc_stat->bit_slice = 0;
+
+  free (jobs);
+  return NumberOfCodedMBs;
+}
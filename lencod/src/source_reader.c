@@ -0,0 +1,691 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file source_reader.c
+ *
+ * \brief
+ *    Sequential reader of the YUV 4:2:0 source sequence
+ *
+ * \note
+ *    The frames of the source file are requested in coding order, i.e.
+ *    mostly increasing, but the B frames of a group are requested after
+ *    the following P frame. The file is accessed in one of three ways:
+ *
+ *    - seekable file: the requested frame is read at its position, a
+ *      seek is only done if it does not follow the previous frame.
+ *    - pipe (stdin with InputFile = "-", FIFO): the file is read strictly
+ *      sequentially into a ring of Sourceframes that is large enough to
+ *      hold a P frame and all B frames coded after it.
+ *    - memory map (InputMemoryMap = 1, regular files on POSIX systems):
+ *      the frame components point directly into the mapped file.
+ *
+ *    With InputReadAhead = N > 0 the file and pipe cases read through the
+ *    ring on a background thread, which keeps up to N frames beyond the
+ *    last requested one ready (including their field components). With a
+ *    memory map the next N frames are announced to the kernel instead.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_WIN32)
+  #include <io.h>
+  #include <fcntl.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+#endif
+
+#include "global.h"
+#include "memalloc.h"
+#include "minmax.h"
+#include "threadpool.h"
+#include "source_reader.h"
+
+#define SRC_FILE  0                    //!< seekable file
+#define SRC_PIPE  1                    //!< sequential input
+#define SRC_MMAP  2                    //!< memory mapped regular file
+
+#define SEEK_STEP (1<<30)              //!< largest relative fseek, keeps file positions beyond MAXINT reachable
+
+//! ring entry of the sequential reader
+typedef struct
+{
+  Sourceframe *sf;
+  int          frame;                  //!< frame number held by the entry, -1 if none
+} SourceSlot;
+
+static int          src_kind;
+static int          src_xs, src_ys;
+static int64        src_frame_bytes;
+static int64        src_first;          //!< file position of frame 0 (after header and StartFrame)
+static int64        src_filepos;        //!< current position of p_in, -1 if unknown (SRC_FILE, SRC_PIPE)
+static int          src_last;           //!< last frame the encoder can request (limits the read ahead)
+static int          src_next;           //!< next frame to be read into the ring
+static int          src_eof = 0;        //!< a read failed, no frames from src_next on
+static int          src_read_ahead;
+
+static byte        *src_map = NULL;     //!< mapped file (SRC_MMAP)
+static int64        src_map_bytes;
+
+static Sourceframe *src_direct = NULL;  //!< frame handed out without the ring
+static SourceSlot  *src_ring = NULL;
+static int          src_ring_size = 0;
+static int          src_max_request = -1;  //!< highest frame requested so far
+static int          src_pinned = -1;       //!< frame handed out from the ring, may not be overwritten
+
+static JMMutex     *src_lock = NULL;
+static JMCond      *src_cond = NULL;    //!< broadcast on every change of the ring or the requests
+static JMThread    *src_thread = NULL;
+static int          src_busy = 0;       //!< the reader thread is reading from p_in
+static int          src_stop = 0;
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Allocates Sourceframe structure
+ * \param xs
+ *    horizontal size of frame in pixels
+ * \param ys
+ *    vertical size of frame in pixels, must be divisible by 2
+ * \param frame_buffers
+ *    0 if the frame components are not allocated (they point into the
+ *    memory map)
+ * \return
+ *    pointer to initialized source frame structure
+ ************************************************************************
+ */
+static Sourceframe *AllocSourceframe (int xs, int ys, int frame_buffers)
+{
+  Sourceframe *sf = NULL;
+  const unsigned int bytes_y = xs*ys;
+  const unsigned int bytes_uv = (xs*ys)/4;
+
+  if ((sf = calloc (1, sizeof (Sourceframe))) == NULL) no_mem_exit ("AllocSourceframe: sf");
+  if (frame_buffers)
+  {
+    if ((sf->yf = calloc (1, bytes_y)) == NULL) no_mem_exit ("AllocSourceframe: sf->yf");
+    if ((sf->uf = calloc (1, bytes_uv)) == NULL) no_mem_exit ("AllocSourceframe: sf->uf");
+    if ((sf->vf = calloc (1, bytes_uv)) == NULL) no_mem_exit ("AllocSourceframe: sf->vf");
+  }
+  if ((sf->yt = calloc (1, bytes_y/2)) == NULL) no_mem_exit ("AllocSourceframe: sf->yt");
+  if ((sf->yb = calloc (1, bytes_y/2)) == NULL) no_mem_exit ("AllocSourceframe: sf->yb");
+  if ((sf->ut = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("AllocSourceframe: sf->ut");
+  if ((sf->ub = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("AllocSourceframe: sf->ub");
+  if ((sf->vt = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("AllocSourceframe: sf->vt");
+  if ((sf->vb = calloc (1, bytes_uv/2)) == NULL) no_mem_exit ("AllocSourceframe: sf->vb");
+  sf->x_size = xs;
+  sf->y_framesize = ys;
+  sf->y_fieldsize = ys/2;
+
+  return sf;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Frees Sourceframe structure
+ * \param sf
+ *    pointer to Sourceframe previoously allocated with AllocSourceframe()
+ * \param frame_buffers
+ *    as for AllocSourceframe()
+ ************************************************************************
+ */
+static void FreeSourceframe (Sourceframe *sf, int frame_buffers)
+{
+  if (sf!=NULL) 
+  {
+    if (frame_buffers)
+    {
+      free (sf->yf);
+      free (sf->uf);
+      free (sf->vf);
+    }
+    free (sf->yt);
+    free (sf->yb);
+    free (sf->ut);
+    free (sf->ub);
+    free (sf->vt);
+    free (sf->vb);
+    free (sf);
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Generate Field Component from Frame Components by copying
+ * \param src
+ *    source frame component
+ * \param top
+ *    destination top field component
+ * \param bot
+ *    destination bottom field component
+ * \param xs
+ *    horizontal size of frame in pixels
+ * \param ys
+ *    vertical size of frame in pixels, must be divisible by 2
+ ************************************************************************
+ */
+static void GenerateFieldComponent (char *src, char *top, char *bot, int xs, int ys)
+{
+  int fieldline;
+  assert (ys % 2 == 0);
+
+  for (fieldline = 0; fieldline < ys/2; fieldline++)
+  {
+    memcpy (&top[xs * fieldline], &src[xs * (fieldline * 2 + 0)], xs);
+    memcpy (&bot[xs * fieldline], &src[xs * (fieldline * 2 + 1)], xs);
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up the top and bottom field (sf->?t and sf->?b) of a
+ *    complete frame in sf->?f
+ ************************************************************************
+ */
+static void GenerateFields (Sourceframe *sf)
+{
+  GenerateFieldComponent (sf->yf, sf->yt, sf->yb, src_xs, src_ys);
+  GenerateFieldComponent (sf->uf, sf->ut, sf->ub, src_xs/2, src_ys/2);
+  GenerateFieldComponent (sf->vf, sf->vt, sf->vb, src_xs/2, src_ys/2);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads and discards bytes of a sequential input
+ * \return
+ *    1 on success, 0 at the end of the file
+ ************************************************************************
+ */
+static int SkipBytes (int64 bytes)
+{
+  char buf[4096];
+  int  n;
+
+  while (bytes > 0)
+  {
+    n = (int) (bytes < (int64) sizeof (buf) ? bytes : (int64) sizeof (buf));
+    if (fread (buf, 1, n, p_in) != (size_t) n)
+      return 0;
+    bytes -= n;
+  }
+  return 1;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Moves the position of p_in to the start of frame n.  Only seekable
+ *    files are repositioned, a pipe has to be there already.
+ * \return
+ *    1 on success, 0 if the seek failed
+ ************************************************************************
+ */
+static int SeekFrame (int n)
+{
+  int64 target = src_first + (int64) n * src_frame_bytes;
+  int64 delta;
+  long  step;
+
+  if (target == src_filepos)
+    return 1;
+  if (src_kind != SRC_FILE)
+    return 0;
+
+  if (src_filepos < 0)
+  {
+    clearerr (p_in);
+    if (fseek (p_in, 0, SEEK_SET) != 0)
+      return 0;
+    src_filepos = 0;
+  }
+  // relative steps, see the note of StW in the former ReadOneFrame() on positions beyond MAXINT
+  for (delta = target - src_filepos; delta != 0; delta -= step)
+  {
+    step = (long) (delta > SEEK_STEP ? SEEK_STEP : (delta < -SEEK_STEP ? -SEEK_STEP : delta));
+    if (fseek (p_in, step, SEEK_CUR) != 0)
+    {
+      src_filepos = -1;
+      return 0;
+    }
+  }
+  src_filepos = target;
+  return 1;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads frame n of the source file into sf and sets up its fields
+ * \return
+ *    1 on success, 0 at the end of the file
+ ************************************************************************
+ */
+static int ReadFrame (int n, Sourceframe *sf)
+{
+  const unsigned int bytes_y = src_xs*src_ys;
+  const unsigned int bytes_uv = (src_xs*src_ys)/4;
+
+  if (!SeekFrame (n))
+    return 0;
+
+  if (fread (sf->yf, 1, bytes_y, p_in) != bytes_y ||
+      fread (sf->uf, 1, bytes_uv, p_in) != bytes_uv ||
+      fread (sf->vf, 1, bytes_uv, p_in) != bytes_uv)
+  {
+    src_filepos = -1;
+    return 0;
+  }
+  src_filepos += src_frame_bytes;
+
+  GenerateFields (sf);
+  return 1;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Returns 1 if the next frame may be read into the ring now (called
+ *    with src_lock held).  Frames up to InputReadAhead beyond the last
+ *    request are read, but not beyond the last frame of the sequence,
+ *    and never into the entry of the frame that is being coded.
+ ************************************************************************
+ */
+static int RingSlotFree ()
+{
+  int limit = min (src_max_request + src_read_ahead, max (src_max_request, src_last));
+
+  if (src_next > limit)
+    return 0;
+  return src_pinned < 0 || src_ring[src_next % src_ring_size].frame != src_pinned;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Background reader: reads the frames following the last read one
+ *    into the ring as long as they are within the read ahead window
+ ************************************************************************
+ */
+static void SourceReaderThread (void *arg)
+{
+  SourceSlot *slot;
+  int n, ok;
+
+  lock_mutex (src_lock);
+  for (;;)
+  {
+    while (!src_stop && !src_eof && !RingSlotFree ())
+      wait_cond (src_cond, src_lock);
+    if (src_stop || src_eof)
+      break;
+
+    n = src_next;
+    slot = &src_ring[n % src_ring_size];
+    slot->frame = -1;
+    src_busy = 1;
+    unlock_mutex (src_lock);
+
+    ok = ReadFrame (n, slot->sf);
+
+    lock_mutex (src_lock);
+    src_busy = 0;
+    if (ok)
+    {
+      slot->frame = n;
+      src_next++;
+    }
+    else
+      src_eof = 1;
+    broadcast_cond (src_cond);
+  }
+  unlock_mutex (src_lock);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Opens the source sequence.  "-" reads from stdin.
+ ************************************************************************
+ */
+void OpenSourceFile (char *fn)
+{
+  if (strcmp (fn, "-") == 0)
+  {
+#if defined(_WIN32)
+    _setmode (_fileno (stdin), _O_BINARY);
+#endif
+    p_in = stdin;
+  }
+  else if ((p_in=fopen(fn,"rb"))==NULL)
+  {
+    snprintf(errortext, ET_SIZE, "Input file %s does not exist",fn);
+    error (errortext, 500);
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sets up the reader for frames of xs x ys luma samples: skips the
+ *    header and the StartFrame frames, maps the file or allocates the
+ *    ring and starts the read ahead thread
+ ************************************************************************
+ */
+void InitSourceReader (int xs, int ys)
+{
+  int i;
+
+  assert (xs % MB_BLOCK_SIZE == 0);
+  assert (ys % MB_BLOCK_SIZE == 0);
+  assert (p_in != NULL);
+
+  src_xs          = xs;
+  src_ys          = ys;
+  src_frame_bytes = (int64) xs * ys * 3 / 2;
+  src_first       = input->infile_header + (int64) input->start_frame * src_frame_bytes;
+  src_read_ahead  = input->InputReadAhead;
+  src_eof         = 0;
+  src_max_request = -1;
+  src_pinned      = -1;
+
+  // last frame CalculateFrameNumber() can return
+  src_last = (input->no_frames - 1) * (input->jumpd + 1);
+  if (input->NumFrameIn2ndIGOP)
+    src_last += 1 + (input->NumFrameIn2ndIGOP - 1) * (input->jumpd + 1);
+#ifdef _ADAPT_LAST_GROUP_
+  src_last = max (src_last, input->last_frame);
+#endif
+
+  src_kind = (p_in != stdin && fseek (p_in, 0, SEEK_END) == 0) ? SRC_FILE : SRC_PIPE;
+
+#if !defined(_WIN32)
+  if (src_kind == SRC_FILE && input->InputMemoryMap)
+  {
+    int64 size = (int64) lseek (fileno (p_in), 0, SEEK_END);
+    void *map;
+
+    if (size > 0 && (int64) (size_t) size == size)
+    {
+      map = mmap (NULL, (size_t) size, PROT_READ, MAP_SHARED, fileno (p_in), 0);
+      if (map != MAP_FAILED)
+      {
+        src_map       = (byte *) map;
+        src_map_bytes = size;
+        src_kind      = SRC_MMAP;
+        src_direct    = AllocSourceframe (xs, ys, 0);
+        return;
+      }
+    }
+    printf ("InitSourceReader: cannot map %s, reading it instead\n", input->infile);
+  }
+#endif
+
+  if (src_kind == SRC_FILE)
+  {
+    if (fseek (p_in, 0, SEEK_SET) != 0)
+      error ("InitSourceReader: cannot fseek to the start of p_in", -1);
+    src_filepos = 0;
+  }
+  else
+  {
+    // header and StartFrame frames
+    if (!SkipBytes (src_first))
+      src_eof = 1;
+    src_filepos = src_first;
+  }
+  src_next = 0;
+
+  if (src_kind == SRC_FILE && src_read_ahead == 0)
+  {
+    src_direct = AllocSourceframe (xs, ys, 1);
+    return;
+  }
+
+  // ring: the read ahead frames plus the B frames between two P frames
+  src_ring_size = src_read_ahead + input->jumpd + 2;
+  if ((src_ring = (SourceSlot *) calloc (src_ring_size, sizeof (SourceSlot))) == NULL)
+    no_mem_exit ("InitSourceReader: src_ring");
+  for (i=0; i<src_ring_size; i++)
+  {
+    src_ring[i].sf    = AllocSourceframe (xs, ys, 1);
+    src_ring[i].frame = -1;
+  }
+
+  if (src_read_ahead > 0)
+  {
+    src_lock   = create_mutex ();
+    src_cond   = create_cond ();
+    src_stop   = 0;
+    src_thread = create_thread (SourceReaderThread, NULL);
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Reports a frame that is not available and exits
+ ************************************************************************
+ */
+static void SourceFrameError (int FrameNoInFile)
+{
+  printf ("ReadOneFrame: cannot read %d bytes from input file, unexpected EOF?, exiting", src_xs*src_ys);
+  report_stats_on_error();
+  exit (-1);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Returns frame FrameNoInFile of the source sequence (counted from
+ *    StartFrame) with its field components.  The frame stays valid until
+ *    it is given back with ReleaseSourceFrame().
+ ************************************************************************
+ */
+Sourceframe *GetSourceFrame (int FrameNoInFile)
+{
+  const int n = FrameNoInFile;
+  SourceSlot *slot;
+
+  if (src_kind == SRC_MMAP)
+  {
+    const int bytes_y = src_xs*src_ys;
+    int64 pos = src_first + (int64) n * src_frame_bytes;
+
+    if (pos + src_frame_bytes > src_map_bytes)
+      SourceFrameError (n);
+
+    src_direct->yf = (char *) src_map + pos;
+    src_direct->uf = src_direct->yf + bytes_y;
+    src_direct->vf = src_direct->uf + bytes_y/4;
+    GenerateFields (src_direct);
+
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+    if (src_read_ahead > 0)
+    {
+      // announce the next frames, from the page following the current frame on
+      int64 page  = sysconf (_SC_PAGESIZE);
+      int64 start = (pos + src_frame_bytes) / page * page;
+      int64 end   = pos + (1 + (int64) src_read_ahead) * src_frame_bytes;
+
+      if (end > src_map_bytes)
+        end = src_map_bytes;
+      if (end > start)
+        madvise (src_map + start, (size_t) (end - start), MADV_WILLNEED);
+    }
+#endif
+    return src_direct;
+  }
+
+  if (src_ring == NULL)
+  {
+    if (!ReadFrame (n, src_direct))
+      SourceFrameError (n);
+    return src_direct;
+  }
+
+  if (src_thread)
+    lock_mutex (src_lock);
+  if (n > src_max_request)
+  {
+    src_max_request = n;
+    if (src_thread)
+      broadcast_cond (src_cond);
+  }
+
+  for (;;)
+  {
+    slot = &src_ring[n % src_ring_size];
+    if (slot->frame == n)
+    {
+      src_pinned = n;
+      if (src_thread)
+        unlock_mutex (src_lock);
+      return slot->sf;
+    }
+    if (n < src_next || src_eof)
+      break;                              // dropped from the ring, or behind the end of the file
+
+    if (src_thread)
+      wait_cond (src_cond, src_lock);
+    else
+    {
+      slot = &src_ring[src_next % src_ring_size];
+      slot->frame = -1;
+      if (ReadFrame (src_next, slot->sf))
+        slot->frame = src_next++;
+      else
+        src_eof = 1;
+    }
+  }
+
+  // a frame that already left the ring: a seekable file is read again at its position
+  if (src_kind == SRC_FILE && n < src_next)
+  {
+    if (src_thread)
+      while (src_busy)
+        wait_cond (src_cond, src_lock);
+    if (src_direct == NULL)
+      src_direct = AllocSourceframe (src_xs, src_ys, 1);
+    if (ReadFrame (n, src_direct))
+    {
+      if (src_thread)
+        unlock_mutex (src_lock);
+      return src_direct;
+    }
+  }
+
+  if (src_thread)
+    unlock_mutex (src_lock);
+  SourceFrameError (n);
+  return NULL;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Gives a frame returned by GetSourceFrame() back to the reader
+ ************************************************************************
+ */
+void ReleaseSourceFrame (Sourceframe *sf)
+{
+  if (src_thread)
+  {
+    lock_mutex (src_lock);
+    src_pinned = -1;
+    broadcast_cond (src_cond);
+    unlock_mutex (src_lock);
+  }
+  else
+    src_pinned = -1;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Stops the read ahead thread, frees the reader and closes the
+ *    source file
+ ************************************************************************
+ */
+void CloseSourceFile ()
+{
+  int i;
+
+  if (src_thread)
+  {
+    lock_mutex (src_lock);
+    src_stop = 1;
+    broadcast_cond (src_cond);
+    unlock_mutex (src_lock);
+    join_thread (src_thread);
+    free_cond (src_cond);
+    free_mutex (src_lock);
+    src_thread = NULL;
+    src_cond   = NULL;
+    src_lock   = NULL;
+  }
+
+  if (src_ring)
+  {
+    for (i=0; i<src_ring_size; i++)
+      FreeSourceframe (src_ring[i].sf, 1);
+    free (src_ring);
+    src_ring = NULL;
+  }
+
+#if !defined(_WIN32)
+  if (src_map)
+  {
+    munmap (src_map, (size_t) src_map_bytes);
+    src_map = NULL;
+    FreeSourceframe (src_direct, 0);
+    src_direct = NULL;
+  }
+#endif
+  FreeSourceframe (src_direct, 1);
+  src_direct = NULL;
+
+  if (p_in != NULL && p_in != stdin)
+    fclose (p_in);
+  p_in = NULL;
+}
@@ -0,0 +1,639 @@
+/**********************************************************************
+ * Software Copyright Licensing Disclaimer
+ *
+ * This software module was originally developed by contributors to the
+ * course of the development of ISO/IEC 14496-10 for reference purposes
+ * and its performance may not have been optimized.  This software
+ * module is an implementation of one or more tools as specified by
+ * ISO/IEC 14496-10.  ISO/IEC gives users free license to this software
+ * module or modifications thereof. Those intending to use this software
+ * module in products are advised that its use may infringe existing
+ * patents.  ISO/IEC have no liability for use of this software module
+ * or modifications thereof.  The original contributors retain full
+ * rights to modify and use the code for their own purposes, and to
+ * assign or donate the code to third-parties.
+ *
+ * This copyright notice must be included in all copies or derivative
+ * works.  Copyright (c) ISO/IEC 2004.
+ **********************************************************************/
+
+/*!
+ ************************************************************************
+ * \file upsample.c
+ *
+ * \brief
+ *    Quarter pel luma planes of the reference pictures, interpolated on demand
+ *
+ * \note
+ *    UnifiedOneForthPix() no longer interpolates the whole picture. The
+ *    quarter pel planes imgY_ups / imgY_ups_w keep their layout (4*IMG_PAD_SIZE
+ *    quarter pel samples of padding on every side), but they are allocated
+ *    on first use and filled in tiles of UPS_TILE_SIZE x UPS_TILE_SIZE
+ *    samples. Readers call FillOneForthPix() for the quarter pel window they
+ *    are going to access; only the tiles covering that window are
+ *    interpolated. The sample values are identical to the former full
+ *    picture interpolation.
+ *
+ *    A tile is computed separably on a small integer pel block whose
+ *    border samples were clamped once while loading it, so the 6-tap
+ *    filters themselves run without any per-sample clipping of coordinates.
+ *
+ *    With QPelCacheSize > 0 the planes of all pictures are kept below that
+ *    many MB: before a new plane is allocated, the planes of the pictures
+ *    that were least recently used (and not used by the current picture)
+ *    are released. They are interpolated again if they are needed later.
+ *
+ *    With HierarchicalME the integer pel plane is also decimated by 2 and
+ *    by 4 (imgY_sub), the coarse levels of the hierarchical motion search.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "memalloc.h"
+#include "simd.h"
+#include "threadpool.h"
+#include "upsample.h"
+
+#if defined(HAVE_X86_SIMD)
+  #include <emmintrin.h>
+#endif
+
+#define UPS_INT_SIZE  ((UPS_TILE_SIZE>>2)+1)  //!< integer pel rows / columns interpolated for one tile
+#define UPS_COLS      24                      //!< columns handled by the filter kernels (UPS_INT_SIZE rounded up to 8)
+#define UPS_SRC_COLS  (UPS_COLS+8)
+#define UPS_SRC_ROWS  (UPS_INT_SIZE+5)
+
+static StorablePicture *ups_cache = NULL;     //!< pictures holding quarter pel planes
+static int64    ups_cache_bytes;              //!< memory of all quarter pel planes
+static int64    ups_cache_limit;              //!< QPelCacheSize in bytes (0: unlimited)
+static int64    ups_peak_bytes;
+static int64    ups_tiles_total;              //!< tiles a full picture interpolation would have computed
+static int64    ups_tiles_filled;             //!< tiles actually interpolated
+static int64    ups_evictions;
+static int      ups_stamp;                    //!< number of the picture being coded
+static JMMutex *ups_lock = NULL;              //!< serializes the tile fills of the slice threads
+
+//! 6-tap filter of one row, dst[i] = filter (src[i] ... src[i+5]) for i < UPS_COLS
+static void (*ups_filter_hor) (short *src, short *dst);
+//! computes the full / half pel samples of one integer pel row from six source and horizontally filtered rows
+static void (*ups_filter_row) (short **src, short **hor, byte *even, byte *odd);
+
+
+static __inline byte clip_byte (int x)
+{
+  return (byte) (x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+static void filter_hor_c (short *src, short *dst)
+{
+  int i;
+
+  for (i = 0; i < UPS_COLS; i++)
+    dst[i] = (short) (src[i] + src[i+5] - 5 * (src[i+1] + src[i+4]) + 20 * (src[i+2] + src[i+3]));
+}
+
+static void filter_row_c (short **s, short **t, byte *even, byte *odd)
+{
+  int i, h, j;
+
+  for (i = 0; i < UPS_COLS; i++)
+  {
+    h = s[0][i+2] + s[5][i+2] - 5 * (s[1][i+2] + s[4][i+2]) + 20 * (s[2][i+2] + s[3][i+2]);
+    j = t[0][i]   + t[5][i]   - 5 * (t[1][i]   + t[4][i])   + 20 * (t[2][i]   + t[3][i]);
+
+    even[2*i  ] = (byte) s[2][i+2];                   // 1/1 pix
+    even[2*i+1] = clip_byte ((t[2][i] + 16) >> 5);    // 1/2 pix horizontal
+    odd [2*i  ] = clip_byte ((h + 16) >> 5);          // 1/2 pix vertical
+    odd [2*i+1] = clip_byte ((j + 512) >> 10);        // 1/2 pix center
+  }
+}
+
+#if defined(HAVE_X86_SIMD)
+#define LOADU(p) _mm_loadu_si128 ((__m128i *) (p))
+
+SIMD_TARGET("sse2")
+static void filter_hor_sse2 (short *src, short *dst)
+{
+  __m128i c5  = _mm_set1_epi16 (5);
+  __m128i c20 = _mm_set1_epi16 (20);
+  __m128i a, b, c;
+  int i;
+
+  // the filter output of 8 bit samples fits into 16 bits
+  for (i = 0; i < UPS_COLS; i += 8)
+  {
+    a = _mm_add_epi16 (LOADU (src+i),   LOADU (src+i+5));
+    b = _mm_add_epi16 (LOADU (src+i+1), LOADU (src+i+4));
+    c = _mm_add_epi16 (LOADU (src+i+2), LOADU (src+i+3));
+    _mm_storeu_si128 ((__m128i *) (dst+i), _mm_add_epi16 (_mm_sub_epi16 (a, _mm_mullo_epi16 (b, c5)), _mm_mullo_epi16 (c, c20)));
+  }
+}
+
+SIMD_TARGET("sse2")
+static void filter_row_sse2 (short **s, short **t, byte *even, byte *odd)
+{
+  __m128i c5    = _mm_set1_epi16 (5);
+  __m128i c20   = _mm_set1_epi16 (20);
+  __m128i c20m5 = _mm_set_epi16 (-5, 20, -5, 20, -5, 20, -5, 20);
+  __m128i r16   = _mm_set1_epi16 (16);
+  __m128i r512  = _mm_set1_epi32 (512);
+  __m128i a, b, c, f, h, lo, hi, j, v;
+  int i;
+
+  for (i = 0; i < UPS_COLS; i += 8)
+  {
+    // vertical filter of the integer samples (16 bit)
+    a = _mm_add_epi16 (LOADU (s[0]+i+2), LOADU (s[5]+i+2));
+    b = _mm_add_epi16 (LOADU (s[1]+i+2), LOADU (s[4]+i+2));
+    f = LOADU (s[2]+i+2);
+    c = _mm_add_epi16 (f, LOADU (s[3]+i+2));
+    h = _mm_add_epi16 (_mm_sub_epi16 (a, _mm_mullo_epi16 (b, c5)), _mm_mullo_epi16 (c, c20));
+    h = _mm_srai_epi16 (_mm_add_epi16 (h, r16), 5);
+
+    // vertical filter of the horizontally filtered samples (32 bit)
+    a  = _mm_add_epi16 (LOADU (t[0]+i), LOADU (t[5]+i));
+    b  = _mm_add_epi16 (LOADU (t[1]+i), LOADU (t[4]+i));
+    c  = _mm_add_epi16 (LOADU (t[2]+i), LOADU (t[3]+i));
+    lo = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (c, b), c20m5), _mm_srai_epi32 (_mm_unpacklo_epi16 (a, a), 16));
+    hi = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (c, b), c20m5), _mm_srai_epi32 (_mm_unpackhi_epi16 (a, a), 16));
+    lo = _mm_srai_epi32 (_mm_add_epi32 (lo, r512), 10);
+    hi = _mm_srai_epi32 (_mm_add_epi32 (hi, r512), 10);
+    j  = _mm_packs_epi32 (lo, hi);
+
+    b  = _mm_srai_epi16 (_mm_add_epi16 (LOADU (t[2]+i), r16), 5);
+
+    // saturate to [0,255] and interleave full / half pel samples
+    v = _mm_packus_epi16 (f, b);
+    _mm_storeu_si128 ((__m128i *) (even + 2*i), _mm_unpacklo_epi8 (v, _mm_srli_si128 (v, 8)));
+    v = _mm_packus_epi16 (h, j);
+    _mm_storeu_si128 ((__m128i *) (odd + 2*i), _mm_unpacklo_epi8 (v, _mm_srli_si128 (v, 8)));
+  }
+}
+#undef LOADU
+#endif
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    selects the filter kernels and creates the lock for the slice threads
+ *    and the PAFF thread
+ ************************************************************************
+ */
+void InitOneForthPixCache ()
+{
+  ups_filter_hor = filter_hor_c;
+  ups_filter_row = filter_row_c;
+#if defined(HAVE_X86_SIMD)
+  if (simd_level >= SIMD_SSE2)
+  {
+    ups_filter_hor = filter_hor_sse2;
+    ups_filter_row = filter_row_sse2;
+  }
+#endif
+
+  ups_cache_limit = (int64) input->QPelCacheSize << 20;
+  if (input->SliceThreads > 1 || (input->ConcurrentPAFF && input->PicInterlace == ADAPTIVE_CODING))
+    ups_lock = create_mutex ();
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    frees the lock (the planes are freed with their pictures)
+ ************************************************************************
+ */
+void FreeOneForthPixCache ()
+{
+  if (ups_lock)
+  {
+    free_mutex (ups_lock);
+    ups_lock = NULL;
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    prints the statistics of the quarter pel planes
+ ************************************************************************
+ */
+void ReportOneForthPixCache ()
+{
+  fprintf (stdout, " Quarter pel tiles interpolated    : %.1f%% (peak %d MB",
+           ups_tiles_total ? 100.0 * ups_tiles_filled / ups_tiles_total : 0.0, (int) ((ups_peak_bytes + (1<<20) - 1) >> 20));
+  if (ups_cache_limit)
+    fprintf (stdout, ", limit %d MB, %d planes released", input->QPelCacheSize, (int) ups_evictions);
+  fprintf (stdout, ")\n");
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    starts a new picture for the replacement of the cached planes
+ ************************************************************************
+ */
+void StartOneForthPixPicture ()
+{
+  if (ups_lock)
+    lock_mutex (ups_lock);
+  ups_stamp++;
+  if (ups_lock)
+    unlock_mutex (ups_lock);
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    frees the quarter pel planes of s and removes it from the cache
+ ************************************************************************
+ */
+static void release_planes (StorablePicture *s)
+{
+  StorablePicture **p;
+  int ph = (s->size_y + 2*IMG_PAD_SIZE) * 4;
+  int pw = (s->size_x + 2*IMG_PAD_SIZE) * 4;
+  int tiles = ((ph + UPS_TILE_SIZE - 1) >> UPS_TILE_SHIFT) * ((pw + UPS_TILE_SIZE - 1) >> UPS_TILE_SHIFT);
+
+  for (p = &ups_cache; *p; p = &(*p)->ups_next)
+  {
+    if (*p == s)
+    {
+      *p = s->ups_next;
+      break;
+    }
+  }
+  s->ups_next = NULL;
+
+  if (s->imgY_ups)
+  {
+    free_mem2D (s->imgY_ups);
+    s->imgY_ups = NULL;
+    ups_cache_bytes -= (int64) ph * pw;
+  }
+  if (s->imgY_ups_w)
+  {
+    free_mem2D (s->imgY_ups_w);
+    s->imgY_ups_w = NULL;
+    ups_cache_bytes -= (int64) ph * pw;
+  }
+  if (s->ups_tiles)
+    memset (s->ups_tiles, 0, tiles);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    allocates one quarter pel plane of s, releasing the least recently
+ *    used planes of other pictures first if the cache would exceed its limit
+ ************************************************************************
+ */
+static byte **alloc_plane (StorablePicture *s)
+{
+  StorablePicture *p, *lru;
+  byte **plane;
+  int ph = (s->size_y + 2*IMG_PAD_SIZE) * 4;
+  int pw = (s->size_x + 2*IMG_PAD_SIZE) * 4;
+
+  while (ups_cache_limit && ups_cache_bytes + (int64) ph * pw > ups_cache_limit)
+  {
+    // planes used by the current picture stay, other threads may be reading them
+    for (lru = NULL, p = ups_cache; p; p = p->ups_next)
+      if (p != s && p->ups_stamp < ups_stamp && (lru == NULL || p->ups_stamp < lru->ups_stamp))
+        lru = p;
+    if (lru == NULL)
+      break;
+    release_planes (lru);
+    ups_evictions++;
+  }
+
+  get_mem2D (&plane, ph, pw);
+  ups_cache_bytes += (int64) ph * pw;
+  ups_peak_bytes   = max (ups_peak_bytes, ups_cache_bytes);
+
+  if (s->imgY_ups == NULL && s->imgY_ups_w == NULL)
+  {
+    s->ups_next = ups_cache;
+    ups_cache   = s;
+  }
+  return plane;
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    interpolates the tile (ty,tx) of imgY_ups
+ ************************************************************************
+ */
+static void fill_tile (StorablePicture *s, int ty, int tx)
+{
+  short  src[UPS_SRC_ROWS][UPS_SRC_COLS];
+  short  hor[UPS_SRC_ROWS][UPS_COLS];
+  byte   g[2*UPS_INT_SIZE+1][2*UPS_COLS+2];   //!< full / half pel samples of the tile and its bottom/right neighbours
+  short *sp[6], *tp[6];
+  int    xs[UPS_SRC_COLS];
+  byte  *line, *out, *g0, *g1;
+  int    ph = (s->size_y + 2*IMG_PAD_SIZE) * 4;
+  int    pw = (s->size_x + 2*IMG_PAD_SIZE) * 4;
+  int    y0 = ty << UPS_TILE_SHIFT;
+  int    x0 = tx << UPS_TILE_SHIFT;
+  int    height = min (UPS_TILE_SIZE, ph - y0);
+  int    width  = min (UPS_TILE_SIZE, pw - x0);
+  int    nr = min (UPS_INT_SIZE, (ph - y0) >> 2);
+  int    nc = min (UPS_INT_SIZE, (pw - x0) >> 2);
+  int    i, k, n, c, yy;
+
+  // integer pel block (2 samples left / above, 3 right / below), clamped to the picture
+  for (i = 0; i < UPS_SRC_COLS; i++)
+    xs[i] = max (0, min (s->size_x - 1, (x0 >> 2) - IMG_PAD_SIZE - 2 + i));
+
+  for (k = 0; k < nr + 5; k++)
+  {
+    yy   = max (0, min (s->size_y - 1, (y0 >> 2) - IMG_PAD_SIZE - 2 + k));
+    line = s->imgY_11 + yy * s->size_x;
+    for (i = 0; i < UPS_SRC_COLS; i++)
+      src[k][i] = line[xs[i]];
+    ups_filter_hor (src[k], hor[k]);
+  }
+
+  // full and half pel samples; the last row / column is repeated where the
+  // plane ends, as the former interpolation did at its right / bottom border
+  for (k = 0; k < nr; k++)
+  {
+    for (n = 0; n < 6; n++)
+    {
+      sp[n] = src[k+n];
+      tp[n] = hor[k+n];
+    }
+    ups_filter_row (sp, tp, g[2*k], g[2*k+1]);
+    g[2*k  ][2*nc] = g[2*k  ][2*nc-1];
+    g[2*k+1][2*nc] = g[2*k+1][2*nc-1];
+  }
+  memcpy (g[2*nr], g[2*nr-1], 2*nc+1);
+
+  // quarter pel samples
+  for (k = 0; k < height; k++)
+  {
+    out = s->imgY_ups[y0 + k] + x0;
+    g0  = g[k >> 1];
+    g1  = g[(k + 1) >> 1];
+
+    if (!(k & 1))
+    {
+      for (i = 0; i < width; i += 2)
+      {
+        c = i >> 1;
+        out[i  ] = g0[c];
+        out[i+1] = (byte) ((g0[c] + g0[c+1] + 1) >> 1);             // '-'
+      }
+    }
+    else if (!(k & 2))
+    {
+      for (i = 0; i < width; i += 4)
+      {
+        c = i >> 1;
+        out[i  ] = (byte) ((g0[c  ] + g1[c  ] + 1) >> 1);           // '|'
+        out[i+1] = (byte) ((g0[c+1] + g1[c  ] + 1) >> 1);           // '/'
+        out[i+2] = (byte) ((g0[c+1] + g1[c+1] + 1) >> 1);           // '|'
+        out[i+3] = (byte) ((g0[c+1] + g1[c+2] + 1) >> 1);           // '\'
+      }
+    }
+    else
+    {
+      for (i = 0; i < width; i += 4)
+      {
+        c = i >> 1;
+        out[i  ] = (byte) ((g0[c  ] + g1[c  ] + 1) >> 1);           // '|'
+        out[i+1] = (byte) ((g0[c  ] + g1[c+1] + 1) >> 1);           // '\'
+        out[i+2] = (byte) ((g0[c+1] + g1[c+1] + 1) >> 1);           // '|'
+        out[i+3] = (byte) ((g0[c+2] + g1[c+1] + 1) >> 1);           // '/'
+      }
+    }
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    computes the tile (ty,tx) of imgY_ups_w from imgY_ups
+ ************************************************************************
+ */
+static void fill_tile_weighted (StorablePicture *s, int ty, int tx)
+{
+  byte lut[256];
+  byte *in, *out;
+  int  ph = (s->size_y + 2*IMG_PAD_SIZE) * 4;
+  int  pw = (s->size_x + 2*IMG_PAD_SIZE) * 4;
+  int  y0 = ty << UPS_TILE_SHIFT;
+  int  x0 = tx << UPS_TILE_SHIFT;
+  int  height = min (UPS_TILE_SIZE, ph - y0);
+  int  width  = min (UPS_TILE_SIZE, pw - x0);
+  int  i, k;
+
+  for (i = 0; i < 256; i++)
+    lut[i] = clip_byte (((i * s->ups_weight[0] + s->ups_weight[2]) >> s->ups_weight[3]) + s->ups_weight[1]);
+
+  for (k = 0; k < height; k++)
+  {
+    in  = s->imgY_ups  [y0 + k] + x0;
+    out = s->imgY_ups_w[y0 + k] + x0;
+    for (i = 0; i < width; i++)
+      out[i] = lut[in[i]];
+  }
+}
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    decimates the width x height plane src by 2 in both directions
+ *    (average of 2x2 samples) into dst
+ ************************************************************************
+ */
+static void decimate_plane (byte *src, int width, int height, byte *dst)
+{
+  int i, j;
+  byte *line0, *line1;
+
+  for (j = 0; j < (height>>1); j++)
+  {
+    line0 = src + (2*j) * width;
+    line1 = line0 + width;
+    for (i = 0; i < (width>>1); i++)
+      dst[i] = (line0[2*i] + line0[2*i+1] + line1[2*i] + line1[2*i+1] + 2) >> 2;
+    dst += (width>>1);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Prepares the picture s for quarter pel access: the integer pel copy
+ *    imgY_11 is made, the quarter pel planes are interpolated on demand by
+ *    FillOneForthPix(). With HierarchicalME the decimated planes imgY_sub
+ *    are made as well.
+ ************************************************************************
+ */
+void UnifiedOneForthPix (StorablePicture *s)
+{
+  int ph = (s->size_y + 2*IMG_PAD_SIZE) * 4;
+  int pw = (s->size_x + 2*IMG_PAD_SIZE) * 4;
+  int tiles = ((ph + UPS_TILE_SIZE - 1) >> UPS_TILE_SHIFT) * ((pw + UPS_TILE_SIZE - 1) >> UPS_TILE_SHIFT);
+  int j;
+
+  // don't upsample twice
+  if (s->imgY_11)
+    return;
+
+  s->imgY_11 = malloc ((s->size_x * s->size_y) * sizeof (byte));
+  if (NULL == s->imgY_11)
+    no_mem_exit("UnifiedOneForthPix: s->imgY_11");
+  if (input->WeightedPrediction || input->WeightedBiprediction)
+  {
+    s->imgY_11_w = malloc ((s->size_x * s->size_y) * sizeof (byte));
+    if (NULL == s->imgY_11_w)
+      no_mem_exit("UnifiedOneForthPix: s->imgY_11_w");
+  }
+  if ((s->ups_tiles = calloc (tiles, sizeof (byte))) == NULL)
+    no_mem_exit("UnifiedOneForthPix: s->ups_tiles");
+
+  // 1/1 pel representation (used for integer pel MV search and as source of the interpolation)
+  for (j = 0; j < s->size_y; j++)
+    memcpy (s->imgY_11 + j * s->size_x, s->imgY[j], s->size_x);
+
+  // 1/2 and 1/4 decimated representations (coarse levels of the hierarchical motion search)
+  if (input->HierarchicalME)
+  {
+    s->imgY_sub[0] = malloc ((s->size_x>>1) * (s->size_y>>1) * sizeof (byte));
+    s->imgY_sub[1] = malloc ((s->size_x>>2) * (s->size_y>>2) * sizeof (byte));
+    if (NULL == s->imgY_sub[0] || NULL == s->imgY_sub[1])
+      no_mem_exit("UnifiedOneForthPix: s->imgY_sub");
+    decimate_plane (s->imgY_11,     s->size_x,    s->size_y,    s->imgY_sub[0]);
+    decimate_plane (s->imgY_sub[0], s->size_x>>1, s->size_y>>1, s->imgY_sub[1]);
+  }
+
+  s->ups_weight[0] = 1;
+  s->ups_weight[1] = s->ups_weight[2] = s->ups_weight[3] = 0;
+  ups_tiles_total += tiles;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    frees the integer and quarter pel representations of s
+ ************************************************************************
+ */
+void FreeOneForthPix (StorablePicture *s)
+{
+  if (ups_lock)
+    lock_mutex (ups_lock);
+  release_planes (s);
+  if (ups_lock)
+    unlock_mutex (ups_lock);
+
+  if (s->ups_tiles)
+  {
+    free (s->ups_tiles);
+    s->ups_tiles = NULL;
+  }
+  if (s->imgY_11)
+  {
+    free (s->imgY_11);
+    s->imgY_11 = NULL;
+  }
+  if (s->imgY_11_w)
+  {
+    free (s->imgY_11_w);
+    s->imgY_11_w = NULL;
+  }
+  free (s->imgY_sub[0]);
+  free (s->imgY_sub[1]);
+  s->imgY_sub[0] = s->imgY_sub[1] = NULL;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    sets the weighted prediction parameters of imgY_ups_w,
+ *    imgY_ups_w = Clip (((imgY_ups * weight + round) >> log_denom) + offset).
+ *    Tiles computed with other parameters are recomputed when used.
+ ************************************************************************
+ */
+void SetOneForthPixWeights (StorablePicture *s, int weight, int offset, int round, int log_denom)
+{
+  int ph = (s->size_y + 2*IMG_PAD_SIZE) * 4;
+  int pw = (s->size_x + 2*IMG_PAD_SIZE) * 4;
+  int tiles = ((ph + UPS_TILE_SIZE - 1) >> UPS_TILE_SHIFT) * ((pw + UPS_TILE_SIZE - 1) >> UPS_TILE_SHIFT);
+  int i;
+
+  if (s->ups_weight[0] == weight && s->ups_weight[1] == offset && s->ups_weight[2] == round && s->ups_weight[3] == log_denom)
+    return;
+
+  s->ups_weight[0] = weight;
+  s->ups_weight[1] = offset;
+  s->ups_weight[2] = round;
+  s->ups_weight[3] = log_denom;
+  for (i = 0; i < tiles; i++)
+    s->ups_tiles[i] &= ~UPS_PLANE_W;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    makes sure that the samples of the quarter pel plane (UPS_PLANE or
+ *    UPS_PLANE_W) of s are available for all positions (y,x) with
+ *    y0 <= y <= y1 and x0 <= x <= x1. The coordinates are quarter pel
+ *    positions relative to the top left picture sample, as used by
+ *    UMVPelY_14(); positions outside the padded plane are mapped to its
+ *    border as UMVPelY_14() does.
+ ************************************************************************
+ */
+void FillOneForthPix (StorablePicture *s, int plane, int y0, int x0, int y1, int x1)
+{
+  int ph = (s->size_y + 2*IMG_PAD_SIZE) * 4;
+  int pw = (s->size_x + 2*IMG_PAD_SIZE) * 4;
+  int tiles_x = (pw + UPS_TILE_SIZE - 1) >> UPS_TILE_SHIFT;
+  int tx0, tx1, ty0, ty1, tx, ty;
+  byte *flags;
+
+  ty0 = max (0, min (ph - 1, y0 + 4*IMG_PAD_SIZE)) >> UPS_TILE_SHIFT;
+  ty1 = max (0, min (ph - 1, y1 + 4*IMG_PAD_SIZE)) >> UPS_TILE_SHIFT;
+  tx0 = max (0, min (pw - 1, x0 + 4*IMG_PAD_SIZE)) >> UPS_TILE_SHIFT;
+  tx1 = max (0, min (pw - 1, x1 + 4*IMG_PAD_SIZE)) >> UPS_TILE_SHIFT;
+
+  if (ups_lock)
+    lock_mutex (ups_lock);
+
+  s->ups_stamp = ups_stamp;
+  if (s->imgY_ups == NULL)
+    s->imgY_ups = alloc_plane (s);
+  if (plane == UPS_PLANE_W && s->imgY_ups_w == NULL)
+    s->imgY_ups_w = alloc_plane (s);
+
+  for (ty = ty0; ty <= ty1; ty++)
+  {
+    flags = s->ups_tiles + ty * tiles_x;
+    for (tx = tx0; tx <= tx1; tx++)
+    {
+      if (!(flags[tx] & UPS_PLANE))
+      {
+        fill_tile (s, ty, tx);
+        flags[tx] |= UPS_PLANE;
+        ups_tiles_filled++;
+      }
+      if (plane == UPS_PLANE_W && !(flags[tx] & UPS_PLANE_W))
+      {
+        fill_tile_weighted (s, ty, tx);
+        flags[tx] |= UPS_PLANE_W;
+      }
+    }
+  }
+
+  if (ups_lock)
+    unlock_mutex (ups_lock);
+}
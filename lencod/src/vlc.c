@@ -1147,7 +1147,7 @@ int writeSyntaxElement_Level_VLCN(SyntaxElement *se, int vlc, DataPartition *thi
 #if TRACE
 void trace2out(SyntaxElement *sym)
 {
-  static int bitcounter = 0;
+  static THREAD_LOCAL int bitcounter = 0;
   int i, chars;
 
   if (p_trace != NULL)
@@ -1200,7 +1200,7 @@ void writeVlcByteAlign(Bitstream* currStream)
   if (currStream->bits_to_go < 8)
   { // trailing bits to process
     currStream->byte_buf = (currStream->byte_buf <<currStream->bits_to_go) | (0xff >> (8 - currStream->bits_to_go));
-    stat->bit_use_stuffingBits[img->type]+=currStream->bits_to_go;
+    enc_stat->bit_use_stuffingBits[img->type]+=currStream->bits_to_go;
     currStream->streamBuffer[currStream->byte_pos++]=currStream->byte_buf;
     currStream->bits_to_go = 8;
   }
@@ -35,6 +35,7 @@
 #include <math.h>
 #include "global.h"
 #include "image.h"
+#include "upsample.h"
 
 
 #define Clip(min,max,val) (((val)<(min))?(min):(((val)>(max))?(max):(val)))
@@ -132,13 +133,7 @@ void estimate_weighting_factor_P_slice()
         {          
           ref_pic_w[i] = Clip (0, 255, (((int) ref_pic[i] * weight[clist][n][0] + wp_luma_round) >> luma_log_weight_denom) + offset[clist][n][0]);
         }
-        for (i = 0; i < 4*(img->height + 2*IMG_PAD_SIZE) ; i++)
-        {
-          for (j = 0; j< 4*(img->width + 2*IMG_PAD_SIZE); j++)
-          {
-            listX[LIST_0][n]->imgY_ups_w[i][j] =   Clip (0, 255, (((int) listX[LIST_0 ][n]->imgY_ups[i][j] * weight[clist][n][0] + wp_luma_round) >> luma_log_weight_denom) + offset[clist][n][0]);
-          }
-        }
+        SetOneForthPixWeights (listX[LIST_0][n], weight[clist][n][0], offset[clist][n][0], wp_luma_round, luma_log_weight_denom);
       }
     }
     
@@ -164,7 +159,7 @@ void estimate_weighting_factor_P_slice()
 */
 void estimate_weighting_factor_B_slice()
 {
-  int i, j, n, l;
+  int i, j, n;
   
   int x,z;
   double dc_org = 0.0;
@@ -289,14 +284,8 @@ void estimate_weighting_factor_B_slice()
           listX[1][j]->imgY_11_w[n] = listX[1][j]->imgY_11[n];
         }
         
-        for (n = 0; n < 4*(img->height + 2*IMG_PAD_SIZE) ; n++)
-        {
-          for (l = 0; l< 4*(img->width + 2*IMG_PAD_SIZE); l++)
-          {
-            listX[LIST_0][i]->imgY_ups_w[n][l] =   listX[LIST_0 ][i]->imgY_ups[n][l];
-            listX[LIST_1][j]->imgY_ups_w[n][l] =   listX[LIST_1 ][j]->imgY_ups[n][l];
-          }
-        }
+        SetOneForthPixWeights (listX[LIST_0][i], 1, 0, 0, 0);
+        SetOneForthPixWeights (listX[LIST_1][j], 1, 0, 0, 0);
       }
     }
   }
@@ -350,14 +339,7 @@ void estimate_weighting_factor_B_slice()
         {
           ref_pic_w[i] = Clip (0, 255, (((int) ref_pic[i] * wf_weight + wp_luma_round) >> luma_log_weight_denom) + wf_offset);
         }
-        for (i = 0; i < 4*(img->height + 2*IMG_PAD_SIZE) ; i++)
-        {
-          for (j = 0; j< 4*(img->width + 2*IMG_PAD_SIZE); j++)
-          {
-            listX[LIST_0][n]->imgY_ups_w[i][j] =   Clip (0, 255, (((int) listX[LIST_0][n]->imgY_ups[i][j] * wf_weight + wp_luma_round) >> (luma_log_weight_denom)) + wf_offset );      	
-          }
-          
-        }
+        SetOneForthPixWeights (listX[LIST_0][n], wf_weight, wf_offset, wp_luma_round, luma_log_weight_denom);
       }
     }
     